@@ -53,6 +53,8 @@ fifoq_create()
         return NULL;
     }
     fifoq_wipe(fifoq);
+    fifoq->consumers_waiting = 0;
+    fifoq->producers_waiting = 0;
     pthread_mutex_init(&fifoq->q_lock, NULL);
     pthread_cond_init(&fifoq->q_threshold, NULL);
     pthread_cond_init(&fifoq->q_nonfull, NULL);
@@ -69,10 +71,117 @@ fifoq_wipe(fifoq_type* q)
 {
     size_t i = 0;
     for (i=0; i < FIFOQ_MAX_COUNT; i++) {
-        q->blob[i] = NULL;
-        q->owner[i] = NULL;
+        q->cell[i].sequence = i;
+        q->cell[i].blob = NULL;
+        q->cell[i].owner = NULL;
+    }
+    q->head = 0;
+    q->tail = 0;
+}
+
+
+/**
+ * Claim a slot at the head of the ring and store the item in it.
+ * Returns 0 if the ring is full.
+ *
+ */
+static int
+fifoq_enqueue(fifoq_type* q, void* item, void* owner)
+{
+    struct fifoq_cell* cell;
+    size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    size_t seq;
+    long dif;
+    for (;;) {
+        cell = &q->cell[pos & (FIFOQ_MAX_COUNT - 1)];
+        seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        dif = (long) seq - (long) pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+            /* pos is updated by the failed compare-exchange */
+        } else if (dif < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+    cell->blob = item;
+    cell->owner = owner;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+/**
+ * Take the item from the slot at the tail of the ring.
+ * Returns NULL if the ring is empty.
+ *
+ */
+static void*
+fifoq_dequeue(fifoq_type* q, void** owner)
+{
+    struct fifoq_cell* cell;
+    size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    size_t seq;
+    long dif;
+    void* item;
+    for (;;) {
+        cell = &q->cell[pos & (FIFOQ_MAX_COUNT - 1)];
+        seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        dif = (long) seq - (long) (pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    item = cell->blob;
+    *owner = cell->owner;
+    __atomic_store_n(&cell->sequence, pos + FIFOQ_MAX_COUNT, __ATOMIC_RELEASE);
+    return item;
+}
+
+
+/**
+ * Wake up a consumer, if any is sleeping.  Must not be called with
+ * q_lock held.  The fence pairs with the one in fifoq_popwait(): either
+ * the consumer sees the pushed item or we see the consumer waiting.
+ *
+ */
+static void
+fifoq_wake_consumer(fifoq_type* q)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->consumers_waiting, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&q->q_lock);
+        pthread_cond_signal(&q->q_threshold);
+        pthread_mutex_unlock(&q->q_lock);
+    }
+}
+
+
+/**
+ * Wake up producers, if any are sleeping.  Must not be called with
+ * q_lock held.
+ *
+ */
+static void
+fifoq_wake_producers(fifoq_type* q)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->producers_waiting, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&q->q_lock);
+        pthread_cond_broadcast(&q->q_nonfull);
+        pthread_mutex_unlock(&q->q_lock);
     }
-    q->count = 0;
 }
 
 
@@ -84,88 +193,152 @@ void*
 fifoq_pop(fifoq_type* q, void** context)
 {
     void* pop = NULL;
-    size_t i = 0;
-    if (!q || q->count <= 0) {
+    if (!q) {
         return NULL;
     }
-    pop = q->blob[0];
-    *context = q->owner[0];
-    for (i = 0; i < q->count-1; i++) {
-        q->blob[i] = q->blob[i+1];
-        q->owner[i] = q->owner[i+1];
+    pop = fifoq_dequeue(q, context);
+    if (pop) {
+        fifoq_wake_producers(q);
     }
-    q->count -= 1;
-    if (q->count <= (size_t) FIFOQ_MAX_COUNT * 0.1) {
-        /**
-         * Notify waiting workers that they can start queuing again
-         * If no workers are waiting, this call has no effect.
-         */
-        pthread_cond_broadcast(&q->q_nonfull);
+    return pop;
+}
+
+
+/**
+ * Pop item from queue, wait until one is available.
+ *
+ */
+void*
+fifoq_popwait(fifoq_type* q, void** context, worker_type* worker)
+{
+    void* pop = NULL;
+    if (!q) {
+        return NULL;
+    }
+    pop = fifoq_pop(q, context);
+    if (pop) {
+        return pop;
+    }
+    pthread_mutex_lock(&q->q_lock);
+    __atomic_add_fetch(&q->consumers_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (!(pop = fifoq_dequeue(q, context)) && !worker->need_to_exit) {
+        ods_log_deeebug("[%s] nothing to do, wait", worker->name);
+        pthread_cond_wait(&q->q_threshold, &q->q_lock);
+    }
+    __atomic_sub_fetch(&q->consumers_waiting, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->q_lock);
+    if (pop) {
+        fifoq_wake_producers(q);
     }
     return pop;
 }
 
 
 /**
- * Push item to queue.
+ * Push item to queue, does not block.
  *
  */
 ods_status
-fifoq_push(fifoq_type* q, void* item, void* context, int* tries)
+fifoq_trypush(fifoq_type* q, void* item, void* context)
 {
     if (!q || !item) {
         return ODS_STATUS_ASSERT_ERR;
     }
-    if (q->count >= FIFOQ_MAX_COUNT) {
+    if (!fifoq_enqueue(q, item, context)) {
+        return ODS_STATUS_UNCHANGED;
+    }
+    fifoq_wake_consumer(q);
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Push item to queue.
+ *
+ */
+ods_status
+fifoq_push(fifoq_type* q, void* item, void* context, int* tries)
+{
+    ods_status status;
+    status = fifoq_trypush(q, item, context);
+    if (status == ODS_STATUS_UNCHANGED && tries) {
         /**
          * #262:
          * If drudgers remain on hold, do additional broadcast.
          * If no drudgers are waiting, this call has no effect.
          */
         if (*tries > FIFOQ_TRIES_COUNT) {
-            pthread_cond_broadcast(&q->q_threshold);
+            fifoq_notifyall(q);
             ods_log_debug("[%s] queue full, notify drudgers again", fifoq_str);
             /* reset tries */
             *tries = 0;
         }
-        return ODS_STATUS_UNCHANGED;
     }
-    q->blob[q->count] = item;
-    q->owner[q->count] = context;
-    q->count += 1;
-    if (q->count == 1) {
-        ods_log_deeebug("[%s] threshold %lu reached, notify drudgers",
-            fifoq_str, (unsigned long) q->count);
-        /* If no drudgers are waiting, this call has no effect. */
-        pthread_cond_broadcast(&q->q_threshold);
+    return status;
+}
+
+
+/**
+ * Push item to queue, wait until there is room.
+ *
+ */
+ods_status
+fifoq_pushwait(fifoq_type* q, void* item, void* context, worker_type* worker)
+{
+    ods_status status;
+    int queued = 0;
+    status = fifoq_trypush(q, item, context);
+    if (status != ODS_STATUS_UNCHANGED) {
+        return status;
+    }
+    pthread_mutex_lock(&q->q_lock);
+    __atomic_add_fetch(&q->producers_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (!(queued = fifoq_enqueue(q, item, context)) &&
+        !worker->need_to_exit) {
+        /**
+         * Apparently the queue is full. Lets take a small break to not
+         * hog CPU. Drudgers wake us up when they pop an item, the
+         * timeout is just a safety net.
+         */
+        ods_thread_wait(&q->q_nonfull, &q->q_lock, 5);
     }
+    __atomic_sub_fetch(&q->producers_waiting, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&q->q_lock);
+    if (!queued) {
+        return ODS_STATUS_UNCHANGED;
+    }
+    fifoq_wake_consumer(q);
     return ODS_STATUS_OK;
 }
 
 void
 fifoq_report(fifoq_type* q, worker_type* superior, ods_status subtaskstatus)
 {
-    pthread_mutex_lock(&q->q_lock);
     if (subtaskstatus != ODS_STATUS_OK) {
-        superior->tasksFailed += 1;
+        __atomic_add_fetch(&superior->tasksFailed, 1, __ATOMIC_RELAXED);
     }
-    superior->tasksOutstanding -= 1;
-    if (superior->tasksOutstanding == 0) {
+    if (__atomic_sub_fetch(&superior->tasksOutstanding, 1,
+        __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&q->q_lock);
         pthread_cond_signal(&superior->tasksBlocker);
+        pthread_mutex_unlock(&q->q_lock);
     }
-    pthread_mutex_unlock(&q->q_lock);
 }
 
 void
 fifoq_waitfor(fifoq_type* q, worker_type* worker, long nsubtasks, long* nsubtasksfailed)
 {
     pthread_mutex_lock(&q->q_lock);
-    worker->tasksOutstanding += nsubtasks;
-    while (worker->tasksOutstanding > 0 && !worker->need_to_exit) {
+    __atomic_add_fetch(&worker->tasksOutstanding, (int) nsubtasks,
+        __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&worker->tasksOutstanding, __ATOMIC_ACQUIRE) > 0
+        && !worker->need_to_exit) {
         pthread_cond_wait(&worker->tasksBlocker, &q->q_lock);
     }
-    *nsubtasksfailed = worker->tasksFailed;
-    worker->tasksFailed = 0;
+    *nsubtasksfailed = __atomic_exchange_n(&worker->tasksFailed, 0,
+        __ATOMIC_ACQ_REL);
     pthread_mutex_unlock(&q->q_lock);
 }
 
@@ -50,16 +50,36 @@ typedef struct fifoq_struct fifoq_type;
 #include "locks.h"
 #include "status.h"
 
-#define FIFOQ_MAX_COUNT 1000
+#define FIFOQ_MAX_COUNT 1024 /* must be a power of two */
 #define FIFOQ_TRIES_COUNT 10
+#define FIFOQ_CACHELINE 64
+
+/**
+ * FIFO Queue slot.
+ */
+struct fifoq_cell {
+    size_t sequence;
+    void* blob;
+    void* owner;
+};
 
 /**
  * FIFO Queue.
+ *
+ * Bounded multi-producer, multi-consumer ring.  Pushing and popping
+ * items is lock-free, q_lock and the condition variables are only used
+ * by threads that need to sleep until the queue is nonempty (consumers)
+ * or nonfull (producers).
  */
 struct fifoq_struct {
-    void* blob[FIFOQ_MAX_COUNT];
-    void* owner[FIFOQ_MAX_COUNT];
-    size_t count;
+    struct fifoq_cell cell[FIFOQ_MAX_COUNT];
+    char pad0[FIFOQ_CACHELINE];
+    size_t head; /* next position to push */
+    char pad1[FIFOQ_CACHELINE - sizeof(size_t)];
+    size_t tail; /* next position to pop */
+    char pad2[FIFOQ_CACHELINE - sizeof(size_t)];
+    int consumers_waiting;
+    int producers_waiting;
     pthread_mutex_t q_lock;
     pthread_cond_t q_threshold;
     pthread_cond_t q_nonfull;
@@ -67,7 +87,6 @@ struct fifoq_struct {
 
 /**
  * Create new FIFO queue.
- * \param[in] allocator memory allocator
  * \return fifoq_type* created queue
  *
  */
@@ -81,14 +100,24 @@ fifoq_type* fifoq_create(void);
 void fifoq_wipe(fifoq_type* q);
 
 /**
- * Pop item from queue.
+ * Pop item from queue, does not block.
  * \param[in] q queue
  * \param[out] worker worker that owns the item
- * \return void* popped item
+ * \return void* popped item, NULL if the queue is empty
  *
  */
 void* fifoq_pop(fifoq_type* q, void** worker);
 
+/**
+ * Pop item from queue, wait until one is available.
+ * \param[in] q queue
+ * \param[out] owner worker context that owns the item
+ * \param[in] worker calling worker
+ * \return void* popped item, NULL if the worker needs to exit
+ *
+ */
+void* fifoq_popwait(fifoq_type* q, void** owner, worker_type* worker);
+
 /**
  * Push item to queue.
  * \param[in] q queue
@@ -100,6 +129,29 @@ void* fifoq_pop(fifoq_type* q, void** worker);
  */
 ods_status fifoq_push(fifoq_type* q, void* item, void* worker, int* tries);
 
+/**
+ * Push item to queue, does not block.
+ * \param[in] q queue
+ * \param[in] item item
+ * \param[in] worker owner of item
+ * \return ods_status status, ODS_STATUS_UNCHANGED if the queue is full
+ *
+ */
+ods_status fifoq_trypush(fifoq_type* q, void* item, void* worker);
+
+/**
+ * Push item to queue, wait until there is room.
+ * \param[in] q queue
+ * \param[in] item item
+ * \param[in] owner owner of item
+ * \param[in] worker calling worker
+ * \return ods_status status, ODS_STATUS_UNCHANGED if the worker needs to
+ *         exit before the item could be queued
+ *
+ */
+ods_status fifoq_pushwait(fifoq_type* q, void* item, void* owner,
+    worker_type* worker);
+
 /**
  * Clean up queue.
  * \param[in] q queue to be cleaned up
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Measure the throughput of the sign queue.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "scheduler/fifoq.h"
+#include "scheduler/worker.h"
+
+#define FIFOQSPEED_THREADS_MAX 64
+
+extern char *optarg;
+char *progname = NULL;
+
+typedef struct {
+    fifoq_type* q;
+    worker_type worker;
+    unsigned int work;
+} consume_arg_t;
+
+typedef struct {
+    fifoq_type* q;
+    worker_type worker;
+    unsigned int items;
+} produce_arg_t;
+
+static void
+usage ()
+{
+    fprintf(stderr,
+        "usage: %s [-i items] [-p producers] [-t threads] [-w work]\n",
+        progname);
+}
+
+static void *
+consume (void *arg)
+{
+    consume_arg_t *consume_arg = arg;
+    worker_type *superior;
+    volatile unsigned int spin;
+    void *item;
+
+    while (!consume_arg->worker.need_to_exit) {
+        item = fifoq_popwait(consume_arg->q, (void**) &superior,
+            &consume_arg->worker);
+        if (item) {
+            /* pretend to sign */
+            for (spin = 0; spin < consume_arg->work; spin++);
+            fifoq_report(consume_arg->q, superior, ODS_STATUS_OK);
+        }
+    }
+    pthread_exit(NULL);
+    return NULL;
+}
+
+static void *
+produce (void *arg)
+{
+    produce_arg_t *produce_arg = arg;
+    unsigned int i;
+    long n = 0, failed = 0;
+
+    for (i=0; i<produce_arg->items; i++) {
+        if (fifoq_pushwait(produce_arg->q, produce_arg, &produce_arg->worker,
+            &produce_arg->worker) == ODS_STATUS_OK) {
+            n++;
+        }
+    }
+    fifoq_waitfor(produce_arg->q, &produce_arg->worker, n, &failed);
+    pthread_exit(NULL);
+    return NULL;
+}
+
+static double
+run (unsigned int threads, unsigned int producers, unsigned int items,
+    unsigned int work)
+{
+    fifoq_type* q;
+    consume_arg_t consume_arg_array[FIFOQSPEED_THREADS_MAX];
+    produce_arg_t produce_arg_array[FIFOQSPEED_THREADS_MAX];
+    pthread_t consume_thread_array[FIFOQSPEED_THREADS_MAX];
+    pthread_t produce_thread_array[FIFOQSPEED_THREADS_MAX];
+    static struct timeval start,end;
+    unsigned int n;
+    int result;
+
+    q = fifoq_create();
+    for (n=0; n<threads; n++) {
+        memset(&consume_arg_array[n], 0, sizeof(consume_arg_t));
+        consume_arg_array[n].q = q;
+        consume_arg_array[n].work = work;
+        consume_arg_array[n].worker.name = "consumer";
+        result = pthread_create(&consume_thread_array[n], NULL, consume,
+            (void *) &consume_arg_array[n]);
+        if (result) {
+            fprintf(stderr, "pthread_create() returned %d\n", result);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (n=0; n<producers; n++) {
+        memset(&produce_arg_array[n], 0, sizeof(produce_arg_t));
+        produce_arg_array[n].q = q;
+        produce_arg_array[n].items = items / producers;
+        produce_arg_array[n].worker.name = "producer";
+        pthread_cond_init(&produce_arg_array[n].worker.tasksBlocker, NULL);
+    }
+
+    gettimeofday(&start, NULL);
+    for (n=0; n<producers; n++) {
+        result = pthread_create(&produce_thread_array[n], NULL, produce,
+            (void *) &produce_arg_array[n]);
+        if (result) {
+            fprintf(stderr, "pthread_create() returned %d\n", result);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (n=0; n<producers; n++) {
+        pthread_join(produce_thread_array[n], NULL);
+    }
+    gettimeofday(&end, NULL);
+
+    /* Stop consumers */
+    for (n=0; n<threads; n++) {
+        consume_arg_array[n].worker.need_to_exit = 1;
+    }
+    fifoq_notifyall(q);
+    for (n=0; n<threads; n++) {
+        pthread_join(consume_thread_array[n], NULL);
+    }
+    for (n=0; n<producers; n++) {
+        pthread_cond_destroy(&produce_arg_array[n].worker.tasksBlocker);
+    }
+    fifoq_cleanup(q);
+
+    end.tv_sec -= start.tv_sec;
+    end.tv_usec-= start.tv_usec;
+    return (double)(end.tv_sec)+(double)(end.tv_usec)*.000001;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    unsigned int items = 1000000;
+    unsigned int producers = 1;
+    unsigned int threads = 0;
+    unsigned int work = 0;
+    unsigned int n;
+    double elapsed;
+    int ch;
+
+    progname = argv[0];
+
+    while ((ch = getopt(argc, argv, "i:p:t:w:")) != -1) {
+        switch (ch) {
+        case 'i':
+            items = atoi(optarg);
+            break;
+        case 'p':
+            producers = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'w':
+            work = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (producers < 1 || producers > FIFOQSPEED_THREADS_MAX ||
+        threads > FIFOQSPEED_THREADS_MAX) {
+        fprintf(stderr, "Use 1 to %d threads\n", FIFOQSPEED_THREADS_MAX);
+        exit(1);
+    }
+
+    /* Without -t, double the number of consumers from 1 up to the max */
+    for (n = (threads ? threads : 1); n <= (threads ? threads :
+        FIFOQSPEED_THREADS_MAX); n *= 2) {
+        elapsed = run(n, producers, items, work);
+        printf("%2u %s, %u %s, %u items, %.0f items/s\n",
+            n, (n > 1 ? "threads" : "thread"),
+            producers, (producers > 1 ? "producers" : "producer"),
+            items / producers * producers,
+            (items / producers * producers) / elapsed);
+    }
+    return 0;
+}
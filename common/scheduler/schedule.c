@@ -609,8 +609,8 @@ schedule_registertask(schedule_type* schedule, task_id taskclass, task_id taskty
     }
 }
 
-void
-schedule_scheduletask(schedule_type* schedule, task_id type, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when)
+static void
+schedule_registeredtask(schedule_type* schedule, task_id type, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when, int replace)
 {
     int i;
     task_type* task;
@@ -623,10 +623,22 @@ schedule_scheduletask(schedule_type* schedule, task_id type, const char* owner,
     if (handler) {
         task = task_create(strdup(owner), handler->class, type, handler->callback, userdata, NULL, when);
         task->lock = resource;
-        schedule_task(schedule, task, 0, 0);
+        schedule_task(schedule, task, replace, 0);
     }
 }
 
+void
+schedule_scheduletask(schedule_type* schedule, task_id type, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when)
+{
+    schedule_registeredtask(schedule, type, owner, userdata, resource, when, 0);
+}
+
+void
+schedule_rescheduletask(schedule_type* schedule, task_id type, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when)
+{
+    schedule_registeredtask(schedule, type, owner, userdata, resource, when, 1);
+}
+
 void
 schedule_unscheduletask(schedule_type* schedule, task_id type, const char* owner)
 {
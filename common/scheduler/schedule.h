@@ -122,6 +122,13 @@ void schedule_purge_owner(schedule_type* schedule, char const *class,
 ods_status schedule_task(schedule_type* schedule, task_type* task, int replace, int log);
 void schedule_scheduletask(schedule_type* schedule, task_id task, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when);
 
+/**
+ * Schedule task, or if the same task is already scheduled move it
+ * forward to when if that is earlier than its current due time.
+ *
+ */
+void schedule_rescheduletask(schedule_type* schedule, task_id task, const char* owner, void* userdata, pthread_mutex_t* resource, time_t when);
+
 /**
  * Unschedule task.
  * \return task_type* task, if it was scheduled
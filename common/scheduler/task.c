@@ -63,6 +63,7 @@ const char* TASK_SIGN           = "[sign]";
 const char* TASK_WRITE          = "[write]";
 const char* TASK_FORCESIGNCONF  = "[forcesignconf]";
 const char* TASK_FORCEREAD      = "[forceread]";
+const char* TASK_RECOVER        = "[recover]";
 
 task_type*
 task_create(const char *owner, char const *class, char const *type,
@@ -107,6 +107,7 @@ extern const char* TASK_SIGN;
 extern const char* TASK_WRITE;
 extern const char* TASK_FORCESIGNCONF;
 extern const char* TASK_FORCEREAD;
+extern const char* TASK_RECOVER;
 
 /*
  * owner: string is owned by task.
@@ -61,7 +61,7 @@ engine_config(const char* cfgfile,
 {
     engineconfig_type* ecfg;
     const char* rngfile = ODS_SE_RNGDIR "/conf.rng";
-    FILE* cfgfd = NULL;
+    xmlXPathContextPtr xpathCtx = NULL;
 
     if (!cfgfile || cfgfile[0] == 0) {
         ods_log_error("[%s] failed to read: no filename given", conf_str);
@@ -69,79 +69,71 @@ engine_config(const char* cfgfile,
     }
     ods_log_verbose("[%s] read cfgfile: %s", conf_str, cfgfile);
 
-    /* check syntax (slows down parsing configuration file) */
-    if (parse_file_check(cfgfile, rngfile) != ODS_STATUS_OK) {
+    /* parse the file once and check syntax */
+    if (parse_file_open(cfgfile, rngfile, &xpathCtx) != ODS_STATUS_OK) {
         ods_log_error("[%s] failed to read: unable to parse file %s",
             conf_str, cfgfile);
         return NULL;
     }
 
-    /* open cfgfile */
-    cfgfd = ods_fopen(cfgfile, NULL, "r");
-    if (cfgfd) {
-        ecfg = malloc(sizeof(engineconfig_type));
-        if (!ecfg) {
-            ods_log_error("[%s] failed to read: malloc failed", conf_str);
-            ods_fclose(cfgfd);
-            return NULL;
-        }
-        if (oldcfg) {
-            /* This is a reload */
-            ecfg->cfg_filename = strdup(oldcfg->cfg_filename);
-            ecfg->clisock_filename = strdup(oldcfg->clisock_filename);
-            ecfg->working_dir = strdup(oldcfg->working_dir);
-            ecfg->username = strdup_or_null(oldcfg->username);
-            ecfg->group = strdup_or_null(oldcfg->group);
-            ecfg->chroot = strdup_or_null(oldcfg->chroot);
-            ecfg->pid_filename = strdup(oldcfg->pid_filename);
-            ecfg->datastore = strdup(oldcfg->datastore);
-            ecfg->db_host = strdup_or_null(oldcfg->db_host);
-            ecfg->db_username = strdup_or_null(oldcfg->db_username);
-            ecfg->db_password = strdup_or_null(oldcfg->db_password);
-            ecfg->db_port = oldcfg->db_port;
-            ecfg->db_type = oldcfg->db_type;
-        } else {
-            ecfg->cfg_filename = strdup(cfgfile);
-            ecfg->clisock_filename = parse_conf_clisock_filename(cfgfile);
-            ecfg->working_dir = parse_conf_working_dir(cfgfile);
-            ecfg->username = parse_conf_username(cfgfile);
-            ecfg->group = parse_conf_group(cfgfile);
-            ecfg->chroot = parse_conf_chroot(cfgfile);
-            ecfg->pid_filename = parse_conf_pid_filename(cfgfile);
-            ecfg->datastore = parse_conf_datastore(cfgfile);
-            ecfg->db_host = parse_conf_db_host(cfgfile);
-            ecfg->db_username = parse_conf_db_username(cfgfile);
-            ecfg->db_password = parse_conf_db_password(cfgfile);
-            ecfg->db_port = parse_conf_db_port(cfgfile);
-            ecfg->db_type = parse_conf_db_type(cfgfile);
-        }
-        /* get values */
-        ecfg->policy_filename = parse_conf_policy_filename(cfgfile);
-        ecfg->zonelist_filename = parse_conf_zonelist_filename(cfgfile);
-        ecfg->zonefetch_filename = parse_conf_zonefetch_filename(cfgfile);
-        ecfg->log_filename = parse_conf_log_filename(cfgfile);
-        ecfg->delegation_signer_submit_command = 
-            parse_conf_delegation_signer_submit_command(cfgfile);
-        ecfg->delegation_signer_retract_command = 
-            parse_conf_delegation_signer_retract_command(cfgfile);
-        ecfg->use_syslog = parse_conf_use_syslog(cfgfile);
-        ecfg->num_worker_threads = parse_conf_worker_threads(cfgfile);
-        ecfg->manual_keygen = parse_conf_manual_keygen(cfgfile);
-        ecfg->repositories = parse_conf_repositories(cfgfile);
-        /* If any verbosity has been specified at cmd line we will use that */
-        ecfg->verbosity = cmdline_verbosity > 0 ?
-            cmdline_verbosity : parse_conf_verbosity(cfgfile);
-        ecfg->automatic_keygen_duration =
-            parse_conf_automatic_keygen_period(cfgfile);
-
-        /* done */
-        ods_fclose(cfgfd);
-        return ecfg;
+    ecfg = malloc(sizeof(engineconfig_type));
+    if (!ecfg) {
+        ods_log_error("[%s] failed to read: malloc failed", conf_str);
+        parse_file_close(xpathCtx);
+        return NULL;
+    }
+    if (oldcfg) {
+        /* This is a reload */
+        ecfg->cfg_filename = strdup(oldcfg->cfg_filename);
+        ecfg->clisock_filename = strdup(oldcfg->clisock_filename);
+        ecfg->working_dir = strdup(oldcfg->working_dir);
+        ecfg->username = strdup_or_null(oldcfg->username);
+        ecfg->group = strdup_or_null(oldcfg->group);
+        ecfg->chroot = strdup_or_null(oldcfg->chroot);
+        ecfg->pid_filename = strdup(oldcfg->pid_filename);
+        ecfg->datastore = strdup(oldcfg->datastore);
+        ecfg->db_host = strdup_or_null(oldcfg->db_host);
+        ecfg->db_username = strdup_or_null(oldcfg->db_username);
+        ecfg->db_password = strdup_or_null(oldcfg->db_password);
+        ecfg->db_port = oldcfg->db_port;
+        ecfg->db_type = oldcfg->db_type;
+    } else {
+        ecfg->cfg_filename = strdup(cfgfile);
+        ecfg->clisock_filename = parse_conf_clisock_filename(xpathCtx);
+        ecfg->working_dir = parse_conf_working_dir(xpathCtx);
+        ecfg->username = parse_conf_username(xpathCtx);
+        ecfg->group = parse_conf_group(xpathCtx);
+        ecfg->chroot = parse_conf_chroot(xpathCtx);
+        ecfg->pid_filename = parse_conf_pid_filename(xpathCtx);
+        ecfg->datastore = parse_conf_datastore(xpathCtx);
+        ecfg->db_host = parse_conf_db_host(xpathCtx);
+        ecfg->db_username = parse_conf_db_username(xpathCtx);
+        ecfg->db_password = parse_conf_db_password(xpathCtx);
+        ecfg->db_port = parse_conf_db_port(xpathCtx);
+        ecfg->db_type = parse_conf_db_type(xpathCtx);
     }
+    /* get values */
+    ecfg->policy_filename = parse_conf_policy_filename(xpathCtx);
+    ecfg->zonelist_filename = parse_conf_zonelist_filename(xpathCtx);
+    ecfg->zonefetch_filename = parse_conf_zonefetch_filename(xpathCtx);
+    ecfg->log_filename = parse_conf_log_filename(xpathCtx);
+    ecfg->delegation_signer_submit_command = 
+        parse_conf_delegation_signer_submit_command(xpathCtx);
+    ecfg->delegation_signer_retract_command = 
+        parse_conf_delegation_signer_retract_command(xpathCtx);
+    ecfg->use_syslog = parse_conf_use_syslog(xpathCtx);
+    ecfg->num_worker_threads = parse_conf_worker_threads(xpathCtx);
+    ecfg->manual_keygen = parse_conf_manual_keygen(xpathCtx);
+    ecfg->repositories = parse_conf_repositories(xpathCtx);
+    /* If any verbosity has been specified at cmd line we will use that */
+    ecfg->verbosity = cmdline_verbosity > 0 ?
+        cmdline_verbosity : parse_conf_verbosity(xpathCtx);
+    ecfg->automatic_keygen_duration =
+        parse_conf_automatic_keygen_period(xpathCtx);
 
-    ods_log_error("[%s] failed to read: unable to open file %s", conf_str,
-        cfgfile);
-    return NULL;
+    /* done */
+    parse_file_close(xpathCtx);
+    return ecfg;
 }
 
 
@@ -75,7 +75,8 @@ perform_update_repositorylist(int sockfd, engine_type* engine)
 {
 	const char* cfgfile = ODS_SE_CFGFILE;
 	int status = 1;
-	hsm_repository_t* new_reps;
+	hsm_repository_t* new_reps = NULL;
+	xmlXPathContextPtr xpathCtx = NULL;
 
 	if (validate_configfile(cfgfile)) {
 		ods_log_error_and_printf(sockfd, module_str,
@@ -89,7 +90,10 @@ perform_update_repositorylist(int sockfd, engine_type* engine)
 		/** we have got the lock, daemon thread is not going anywhere 
 		 * we can safely stop all workers */
 		engine_stop_workers(engine);
-		new_reps = parse_conf_repositories(cfgfile);
+		if (parse_file_open(cfgfile, NULL, &xpathCtx) == ODS_STATUS_OK) {
+			new_reps = parse_conf_repositories(xpathCtx);
+			parse_file_close(xpathCtx);
+		}
 		if (!new_reps) {
 			/* revert */
 			status = 0;
@@ -91,10 +91,18 @@ version(FILE* out)
 static void
 program_setup(const char* cfgfile, int cmdline_verbosity)
 {
-    const char* file;
+    const char* file = NULL;
+    int use_syslog = 0;
+    int verbosity = ODS_EN_VERBOSITY;
+    xmlXPathContextPtr xpathCtx = NULL;
     /* fully initialized log with parameters in conf file*/
-    file = parse_conf_log_filename(cfgfile);
-    ods_log_init("ods-enforcerd", parse_conf_use_syslog(cfgfile), file, cmdline_verbosity?cmdline_verbosity:parse_conf_verbosity(cfgfile));
+    if (parse_file_open(cfgfile, NULL, &xpathCtx) == ODS_STATUS_OK) {
+        file = parse_conf_log_filename(xpathCtx);
+        use_syslog = parse_conf_use_syslog(xpathCtx);
+        verbosity = parse_conf_verbosity(xpathCtx);
+        parse_file_close(xpathCtx);
+    }
+    ods_log_init("ods-enforcerd", use_syslog, file, cmdline_verbosity?cmdline_verbosity:verbosity);
     ods_log_verbose("[%s] starting enforcer", enforcerd_str);
 
     /* initialize */
@@ -112,6 +120,7 @@ program_teardown()
 {
     ods_log_close();
 
+    parse_file_cleanup();
     xmlCleanupParser();
     xmlCleanupGlobals();
     xmlCleanupThreads();
@@ -41,7 +41,6 @@
 #include "libhsm.h"
 #include "daemon/cfg.h"
 #include "libhsmdns.h"
-extern hsm_repository_t* parse_conf_repositories(const char* cfgfile);
 
 int verbosity;
 char* argv0;
@@ -372,7 +371,7 @@ main(int argc, char* argv[])
         abort(); /* TODO give some error, abort */
     }
 
-    status = hsm_open2(parse_conf_repositories(cfgfile), hsm_prompt_pin);
+    status = hsm_open2(cfg->repositories, hsm_prompt_pin);
     if (status != HSM_OK) {
         char* errorstr =  hsm_get_error(NULL);
         if (errorstr != NULL) {
@@ -38,6 +38,7 @@
 #include <libxml/xpath.h>
 #include <libxml/relaxng.h>
 #include <libxml/xmlreader.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/un.h>
@@ -46,96 +47,190 @@ static const char* parser_str = "parser";
 
 
 /**
- * Parse elements from the configuration file.
+ * Compiled RelaxNG schemas, kept for the lifetime of the process.
+ *
+ */
+typedef struct parse_schema_struct parse_schema_type;
+struct parse_schema_struct {
+    parse_schema_type* next;
+    char* rngfile;
+    xmlRelaxNGPtr schema;
+};
+static parse_schema_type* parse_schemas = NULL;
+static pthread_mutex_t parse_schemas_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Get the compiled RelaxNG schema.
+ *
+ */
+xmlRelaxNGPtr
+parse_file_schema(const char* rngfile)
+{
+    parse_schema_type* entry = NULL;
+    xmlRelaxNGParserCtxtPtr rngpctx = NULL;
+    xmlRelaxNGPtr schema = NULL;
+
+    if (!rngfile) {
+        return NULL;
+    }
+    pthread_mutex_lock(&parse_schemas_lock);
+    for (entry = parse_schemas; entry; entry = entry->next) {
+        if (strcmp(entry->rngfile, rngfile) == 0) {
+            schema = entry->schema;
+            break;
+        }
+    }
+    if (!schema) {
+        ods_log_debug("[%s] compile rngfile %s", parser_str, rngfile);
+        /* Create an XML RelaxNGs parser context for the relax-ng file. */
+        rngpctx = xmlRelaxNGNewParserCtxt(rngfile);
+        if (rngpctx == NULL) {
+            ods_log_error("[%s] unable to parse file: "
+               "xmlRelaxNGNewParserCtxt() failed", parser_str);
+        } else {
+            /* Parse a schema definition resource and
+             * build an internal XML schema structure.
+             */
+            schema = xmlRelaxNGParse(rngpctx);
+            xmlRelaxNGFreeParserCtxt(rngpctx);
+            if (schema == NULL) {
+                ods_log_error("[%s] unable to parse file: xmlRelaxNGParse() "
+                    "failed for rngfile %s", parser_str, rngfile);
+            } else {
+                CHECKALLOC(entry = (parse_schema_type*) malloc(
+                    sizeof(parse_schema_type)));
+                CHECKALLOC(entry->rngfile = strdup(rngfile));
+                entry->schema = schema;
+                entry->next = parse_schemas;
+                parse_schemas = entry;
+            }
+        }
+    }
+    pthread_mutex_unlock(&parse_schemas_lock);
+    return schema;
+}
+
+
+/**
+ * Clean up the compiled RelaxNG schemas.
+ *
+ */
+void
+parse_file_cleanup(void)
+{
+    parse_schema_type* entry = NULL;
+    pthread_mutex_lock(&parse_schemas_lock);
+    while (parse_schemas) {
+        entry = parse_schemas;
+        parse_schemas = entry->next;
+        xmlRelaxNGFree(entry->schema);
+        free(entry->rngfile);
+        free(entry);
+    }
+    pthread_mutex_unlock(&parse_schemas_lock);
+}
+
+
+/**
+ * Open a configuration file.
  *
  */
 ods_status
-parse_file_check(const char* cfgfile, const char* rngfile)
+parse_file_open(const char* cfgfile, const char* rngfile,
+    xmlXPathContextPtr* xpathCtx)
 {
     xmlDocPtr doc = NULL;
-    xmlDocPtr rngdoc = NULL;
-    xmlRelaxNGParserCtxtPtr rngpctx = NULL;
-    xmlRelaxNGValidCtxtPtr rngctx = NULL;
     xmlRelaxNGPtr schema = NULL;
-    int status;
+    xmlRelaxNGValidCtxtPtr rngctx = NULL;
+    int status = 0;
 
-    if (!cfgfile || !rngfile) {
-        ods_log_error("[%s] no cfgfile or rngfile", parser_str);
+    if (!cfgfile || !xpathCtx) {
         return ODS_STATUS_ASSERT_ERR;
     }
-    ods_log_assert(cfgfile);
-    ods_log_assert(rngfile);
-    ods_log_debug("[%s] check cfgfile %s with rngfile %s", parser_str,
-        cfgfile, rngfile);
-
+    *xpathCtx = NULL;
+    ods_log_debug("[%s] open cfgfile %s with rngfile %s", parser_str,
+        cfgfile, rngfile?rngfile:"-");
     /* Load XML document */
     doc = xmlParseFile(cfgfile);
     if (doc == NULL) {
-        ods_log_error("[%s] unable to read cfgfile %s", parser_str,
-            cfgfile);
+        ods_log_error("[%s] unable to parse file: failed to load cfgfile %s",
+            parser_str, cfgfile);
         return ODS_STATUS_XML_ERR;
     }
-    /* Load rng document */
-    rngdoc = xmlParseFile(rngfile);
-    if (rngdoc == NULL) {
-        ods_log_error("[%s] unable to read rngfile %s", parser_str,
-            rngfile);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_XML_ERR;
+    if (rngfile) {
+        schema = parse_file_schema(rngfile);
+        if (schema == NULL) {
+            xmlFreeDoc(doc);
+            return ODS_STATUS_PARSE_ERR;
+        }
+        /* Create an XML RelaxNGs validation context. */
+        rngctx = xmlRelaxNGNewValidCtxt(schema);
+        if (rngctx == NULL) {
+            ods_log_error("[%s] unable to parse file: "
+                "xmlRelaxNGNewValidCtxt() failed", parser_str);
+            xmlFreeDoc(doc);
+            return ODS_STATUS_RNG_ERR;
+        }
+        /* Validate a document tree in memory. */
+        status = xmlRelaxNGValidateDoc(rngctx, doc);
+        xmlRelaxNGFreeValidCtxt(rngctx);
+        if (status != 0) {
+            ods_log_error("[%s] unable to parse file: "
+                "xmlRelaxNGValidateDoc() failed for cfgfile %s", parser_str,
+                cfgfile);
+            xmlFreeDoc(doc);
+            return ODS_STATUS_RNG_ERR;
+        }
     }
-    /* Create an XML RelaxNGs parser context for the relax-ng document. */
-    rngpctx = xmlRelaxNGNewDocParserCtxt(rngdoc);
-    if (rngpctx == NULL) {
-        xmlFreeDoc(rngdoc);
+    /* Create xpath evaluation context */
+    *xpathCtx = xmlXPathNewContext(doc);
+    if (*xpathCtx == NULL) {
+        ods_log_error("[%s] unable to parse file %s: xmlXPathNewContext() "
+            "failed", parser_str, cfgfile);
         xmlFreeDoc(doc);
-        ods_log_error("[%s] unable to create XML RelaxNGs parser context",
-           parser_str);
         return ODS_STATUS_XML_ERR;
     }
-    /* Parse a schema definition resource and
-     * build an internal XML schema structure.
-     */
-    schema = xmlRelaxNGParse(rngpctx);
-    if (schema == NULL) {
-        ods_log_error("[%s] unable to parse a schema definition resource",
-            parser_str);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_PARSE_ERR;
-    }
-    /* Create an XML RelaxNGs validation context. */
-    rngctx = xmlRelaxNGNewValidCtxt(schema);
-    if (rngctx == NULL) {
-        ods_log_error("[%s] unable to create RelaxNGs validation context",
-            parser_str);
-        xmlRelaxNGFree(schema);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_RNG_ERR;
-    }
-    /* Validate a document tree in memory. */
-    status = xmlRelaxNGValidateDoc(rngctx,doc);
-    if (status != 0) {
-        ods_log_error("[%s] cfgfile validation failed %s", parser_str,
-            cfgfile);
-        xmlRelaxNGFreeValidCtxt(rngctx);
-        xmlRelaxNGFree(schema);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_RNG_ERR;
-    }
+    return ODS_STATUS_OK;
+}
 
-    xmlRelaxNGFreeValidCtxt(rngctx);
-    xmlRelaxNGFree(schema);
-    xmlRelaxNGFreeParserCtxt(rngpctx);
-    xmlFreeDoc(rngdoc);
+
+/**
+ * Close a configuration file.
+ *
+ */
+void
+parse_file_close(xmlXPathContextPtr xpathCtx)
+{
+    xmlDocPtr doc = NULL;
+    if (!xpathCtx) {
+        return;
+    }
+    doc = xpathCtx->doc;
+    xmlXPathFreeContext(xpathCtx);
     xmlFreeDoc(doc);
-    return ODS_STATUS_OK;
 }
 
+
+/**
+ * Check config file with rng file.
+ *
+ */
+ods_status
+parse_file_check(const char* cfgfile, const char* rngfile)
+{
+    xmlXPathContextPtr xpathCtx = NULL;
+    ods_status status = ODS_STATUS_OK;
+
+    if (!cfgfile || !rngfile) {
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    status = parse_file_open(cfgfile, rngfile, &xpathCtx);
+    parse_file_close(xpathCtx);
+    return status;
+}
+
+
 /* TODO: look how the enforcer reads this now */
 
 /**
@@ -143,30 +238,16 @@ parse_file_check(const char* cfgfile, const char* rngfile)
  *
  */
 const char*
-parse_conf_string(const char* cfgfile, const char* expr, int required)
+parse_conf_string(xmlXPathContextPtr xpathCtx, const char* expr,
+    int required)
 {
-    xmlDocPtr doc = NULL;
-    xmlXPathContextPtr xpathCtx = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
     xmlChar *xexpr = NULL;
     const char* string = NULL;
 
     ods_log_assert(expr);
-    ods_log_assert(cfgfile);
+    ods_log_assert(xpathCtx);
 
-    /* Load XML document */
-    doc = xmlParseFile(cfgfile);
-    if (doc == NULL) {
-        return NULL;
-    }
-    /* Create xpath evaluation context */
-    xpathCtx = xmlXPathNewContext(doc);
-    if (xpathCtx == NULL) {
-        ods_log_error("[%s] unable to create new XPath context for cfgile "
-            "%s expr %s", parser_str, cfgfile, (char*) expr);
-        xmlFreeDoc(doc);
-        return NULL;
-    }
     /* Get string */
     xexpr = (unsigned char*) expr;
     xpathObj = xmlXPathEvalExpression(xexpr, xpathCtx);
@@ -174,27 +255,17 @@ parse_conf_string(const char* cfgfile, const char* expr, int required)
         xpathObj->nodesetval->nodeNr <= 0) {
         if (required) {
             ods_log_error("[%s] unable to evaluate required element %s in "
-                "cfgfile %s", parser_str, (char*) xexpr, cfgfile);
+                "cfgfile %s", parser_str, (char*) xexpr,
+                (const char*) xpathCtx->doc->URL);
         }
-        xmlXPathFreeContext(xpathCtx);
         if (xpathObj) {
             xmlXPathFreeObject(xpathObj);
         }
-        xmlFreeDoc(doc);
         return NULL;
     }
-    if (xpathObj->nodesetval != NULL &&
-        xpathObj->nodesetval->nodeNr > 0) {
-        string = (const char*) xmlXPathCastToString(xpathObj);
-        xmlXPathFreeContext(xpathCtx);
-        xmlXPathFreeObject(xpathObj);
-        xmlFreeDoc(doc);
-        return string;
-    }
-    xmlXPathFreeContext(xpathCtx);
+    string = (const char*) xmlXPathCastToString(xpathObj);
     xmlXPathFreeObject(xpathObj);
-    xmlFreeDoc(doc);
-    return NULL;
+    return string;
 }
 
 /**
@@ -202,10 +273,8 @@ parse_conf_string(const char* cfgfile, const char* expr, int required)
  *
  */
 hsm_repository_t*
-parse_conf_repositories(const char* cfgfile)
+parse_conf_repositories(xmlXPathContextPtr xpathCtx)
 {
-    xmlDocPtr doc = NULL;
-    xmlXPathContextPtr xpathCtx = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
     xmlNode* curNode = NULL;
     xmlChar* xexpr = NULL;
@@ -220,27 +289,10 @@ parse_conf_repositories(const char* cfgfile)
     hsm_repository_t* rlist = NULL;
     hsm_repository_t* repo  = NULL;
 
-    /* Load XML document */
-    doc = xmlParseFile(cfgfile);
-    if (doc == NULL) {
-        ods_log_error("[%s] could not parse <RepositoryList>: "
-            "xmlParseFile() failed", parser_str);
-        return NULL;
-    }
-    /* Create xpath evaluation context */
-    xpathCtx = xmlXPathNewContext(doc);
-    if(xpathCtx == NULL) {
-        xmlFreeDoc(doc);
-        ods_log_error("[%s] could not parse <RepositoryList>: "
-            "xmlXPathNewContext() failed", parser_str);
-        return NULL;
-    }
     /* Evaluate xpath expression */
     xexpr = (xmlChar*) "//Configuration/RepositoryList/Repository";
     xpathObj = xmlXPathEvalExpression(xexpr, xpathCtx);
     if(xpathObj == NULL) {
-        xmlXPathFreeContext(xpathCtx);
-        xmlFreeDoc(doc);
         ods_log_error("[%s] could not parse <RepositoryList>: "
             "xmlXPathEvalExpression failed", parser_str);
         return NULL;
@@ -293,10 +345,6 @@ parse_conf_repositories(const char* cfgfile)
     }
 
     xmlXPathFreeObject(xpathObj);
-    xmlXPathFreeContext(xpathCtx);
-    if (doc) {
-        xmlFreeDoc(doc);
-    }
     return rlist;
 }
 
@@ -307,11 +355,11 @@ parse_conf_repositories(const char* cfgfile)
  */
  
 const char*
-parse_conf_policy_filename(const char* cfgfile)
+parse_conf_policy_filename(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-		cfgfile,
+		xpathCtx,
 		"//Configuration/Common/PolicyFile",
 		1);
     
@@ -323,11 +371,11 @@ parse_conf_policy_filename(const char* cfgfile)
 }
 
 const char*
-parse_conf_zonelist_filename(const char* cfgfile)
+parse_conf_zonelist_filename(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Common/ZoneListFile",
         1);
 
@@ -340,11 +388,11 @@ parse_conf_zonelist_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_zonefetch_filename(const char* cfgfile)
+parse_conf_zonefetch_filename(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Common/ZoneFetchFile",
         0);
 
@@ -357,14 +405,14 @@ parse_conf_zonefetch_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_log_filename(const char* cfgfile)
+parse_conf_log_filename(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Common/Logging/Syslog/Facility",
         0);
     if (!str) {
-        str = parse_conf_string(cfgfile,
+        str = parse_conf_string(xpathCtx,
             "//Configuration/Common/Logging/File/Filename",
             0);
     }
@@ -377,11 +425,11 @@ parse_conf_log_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_pid_filename(const char* cfgfile)
+parse_conf_pid_filename(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/PidFile",
         0);
 
@@ -396,11 +444,11 @@ parse_conf_pid_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_delegation_signer_submit_command(const char* cfgfile)
+parse_conf_delegation_signer_submit_command(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/DelegationSignerSubmitCommand",
         0);
 
@@ -412,11 +460,11 @@ parse_conf_delegation_signer_submit_command(const char* cfgfile)
 }
 
 const char*
-parse_conf_delegation_signer_retract_command(const char* cfgfile)
+parse_conf_delegation_signer_retract_command(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/DelegationSignerRetractCommand",
         0);
     
@@ -428,11 +476,11 @@ parse_conf_delegation_signer_retract_command(const char* cfgfile)
 }
 
 const char*
-parse_conf_clisock_filename(const char* cfgfile)
+parse_conf_clisock_filename(xmlXPathContextPtr xpathCtx)
 {
     char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/SocketFile",
         0);
 
@@ -451,11 +499,11 @@ parse_conf_clisock_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_working_dir(const char* cfgfile)
+parse_conf_working_dir(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/WorkingDirectory",
         0);
 
@@ -470,11 +518,11 @@ parse_conf_working_dir(const char* cfgfile)
 
 
 const char*
-parse_conf_username(const char* cfgfile)
+parse_conf_username(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/Privileges/User",
         0);
 
@@ -487,11 +535,11 @@ parse_conf_username(const char* cfgfile)
 
 
 const char*
-parse_conf_group(const char* cfgfile)
+parse_conf_group(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/Privileges/Group",
         0);
 
@@ -504,11 +552,11 @@ parse_conf_group(const char* cfgfile)
 
 
 const char*
-parse_conf_chroot(const char* cfgfile)
+parse_conf_chroot(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/Privileges/Directory",
         0);
 
@@ -520,16 +568,16 @@ parse_conf_chroot(const char* cfgfile)
 }
 
 const char*
-parse_conf_datastore(const char* cfgfile)
+parse_conf_datastore(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-		cfgfile,
+		xpathCtx,
 		"//Configuration/Enforcer/Datastore/MySQL/Database",
 		0);
 	if (!str) {
 		str = parse_conf_string(
-			cfgfile,
+			xpathCtx,
 			"//Configuration/Enforcer/Datastore/SQLite",
 			0);
 	}
@@ -545,11 +593,11 @@ parse_conf_datastore(const char* cfgfile)
 }
 
 const char*
-parse_conf_db_host(const char* cfgfile)
+parse_conf_db_host(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-		cfgfile,
+		xpathCtx,
 		"//Configuration/Enforcer/Datastore/MySQL/Host",
 		0);
     
@@ -561,11 +609,11 @@ parse_conf_db_host(const char* cfgfile)
 }
 
 const char*
-parse_conf_db_username(const char* cfgfile)
+parse_conf_db_username(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-		cfgfile,
+		xpathCtx,
 		"//Configuration/Enforcer/Datastore/MySQL/Username",
 		0);
     
@@ -577,11 +625,11 @@ parse_conf_db_username(const char* cfgfile)
 }
 
 const char*
-parse_conf_db_password(const char* cfgfile)
+parse_conf_db_password(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-		cfgfile,
+		xpathCtx,
 		"//Configuration/Enforcer/Datastore/MySQL/Password",
 		0);
     
@@ -597,9 +645,9 @@ parse_conf_db_password(const char* cfgfile)
  *
  */
 int
-parse_conf_use_syslog(const char* cfgfile)
+parse_conf_use_syslog(xmlXPathContextPtr xpathCtx)
 {
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Common/Logging/Syslog/Facility",
         0);
     if (str) {
@@ -610,10 +658,10 @@ parse_conf_use_syslog(const char* cfgfile)
 }
 
 int
-parse_conf_verbosity(const char* cfgfile)
+parse_conf_verbosity(xmlXPathContextPtr xpathCtx)
 {
 	int verbosity = ODS_EN_VERBOSITY;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Common/Logging/Verbosity",
         0);
     if (str) {
@@ -627,10 +675,10 @@ parse_conf_verbosity(const char* cfgfile)
 
 
 int
-parse_conf_worker_threads(const char* cfgfile)
+parse_conf_worker_threads(xmlXPathContextPtr xpathCtx)
 {
     int numwt = ODS_SE_WORKERTHREADS;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Enforcer/WorkerThreads",
         0);
     if (str) {
@@ -643,9 +691,9 @@ parse_conf_worker_threads(const char* cfgfile)
 }
 
 int
-parse_conf_manual_keygen(const char* cfgfile)
+parse_conf_manual_keygen(xmlXPathContextPtr xpathCtx)
 {
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Enforcer/ManualKeyGeneration",
         0);
     if (str) {
@@ -656,10 +704,10 @@ parse_conf_manual_keygen(const char* cfgfile)
 }
 
 int
-parse_conf_db_port(const char* cfgfile)
+parse_conf_db_port(xmlXPathContextPtr xpathCtx)
 {
     int port = 0; /* returning 0 (zero) means use the default port */
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
 		"//Configuration/Enforcer/Datastore/MySQL/Host/@Port",
 		0);
     if (str) {
@@ -671,11 +719,11 @@ parse_conf_db_port(const char* cfgfile)
     return port;
 }
 
-engineconfig_database_type_t parse_conf_db_type(const char *cfgfile) {
+engineconfig_database_type_t parse_conf_db_type(xmlXPathContextPtr xpathCtx) {
     const char* str = NULL;
 
     if ((str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/Datastore/MySQL/Host",
         0)))
     {
@@ -684,7 +732,7 @@ engineconfig_database_type_t parse_conf_db_type(const char *cfgfile) {
     }
 
     if ((str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/Datastore/SQLite",
         0)))
     {
@@ -696,10 +744,10 @@ engineconfig_database_type_t parse_conf_db_type(const char *cfgfile) {
 }
 
 time_t
-parse_conf_automatic_keygen_period(const char* cfgfile)
+parse_conf_automatic_keygen_period(xmlXPathContextPtr xpathCtx)
 {
     time_t period = 365 * 24 * 3600; /* default 1 normal year in seconds */
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
 		"//Configuration/Enforcer/AutomaticKeyGenerationPeriod",
 		0);
     if (str) {
@@ -37,6 +37,44 @@
 #include "status.h"
 #include "daemon/cfg.h"
 
+#include <libxml/relaxng.h>
+#include <libxml/xpath.h>
+
+/**
+ * Get the compiled rng file.  Every rng file is compiled only once
+ * and kept until parse_file_cleanup().
+ * \param[in] rngfile the rng file name
+ * \return xmlRelaxNGPtr compiled schema, NULL on error
+ *
+ */
+xmlRelaxNGPtr parse_file_schema(const char* rngfile);
+
+/**
+ * Clean up the compiled rng files.
+ *
+ */
+void parse_file_cleanup(void);
+
+/**
+ * Open a configuration file: parse it and check it with the rng file.
+ * The file is parsed once, the elements are then looked up in the
+ * returned XPath context.
+ * \param[in] cfgfile the configuration file name
+ * \param[in] rngfile the rng file name, NULL to skip the check
+ * \param[out] xpathCtx XPath context of the parsed file
+ * \return ods_status status
+ *
+ */
+ods_status parse_file_open(const char* cfgfile, const char* rngfile,
+    xmlXPathContextPtr* xpathCtx);
+
+/**
+ * Close a configuration file.
+ * \param[in] xpathCtx XPath context of the parsed file
+ *
+ */
+void parse_file_close(xmlXPathContextPtr xpathCtx);
+
 /**
  * Check config file with rng file.
  * \param[in] cfgfile the configuration file name
@@ -48,60 +86,59 @@ ods_status parse_file_check(const char* cfgfile, const char* rngfile);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile configuration file
+ * \param[in] xpathCtx XPath context of the configuration file
  * \param[in] expr xml expression
  * \param[in] required if the element is required
  * \return const char* string value
  *
  */
-const char* parse_conf_string(const char* cfgfile, const char* expr,
+const char* parse_conf_string(xmlXPathContextPtr xpathCtx, const char* expr,
     int required);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] allocator the allocator
- * \param[in] cfgfile the configuration file name
+ * \param[in] xpathCtx XPath context of the configuration file
  * \return const char* string
  *
  */
 
 /** Common */
-const char* parse_conf_policy_filename(const char* cfgfile);
-const char* parse_conf_zonelist_filename(const char* cfgfile);
-const char* parse_conf_zonefetch_filename(const char* cfgfile);
-const char* parse_conf_log_filename(const char* cfgfile);
+const char* parse_conf_policy_filename(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_zonelist_filename(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_zonefetch_filename(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_log_filename(xmlXPathContextPtr xpathCtx);
 
 /** Enforcer specific */
-const char* parse_conf_pid_filename(const char* cfgfile);
-const char* parse_conf_delegation_signer_submit_command(const char* cfgfile);
-const char* parse_conf_delegation_signer_retract_command(const char* cfgfile);
-const char* parse_conf_clisock_filename(const char* cfgfile);
-const char* parse_conf_working_dir(const char* cfgfile);
-const char* parse_conf_username(const char* cfgfile);
-const char* parse_conf_group(const char* cfgfile);
-const char* parse_conf_chroot(const char* cfgfile);
-const char* parse_conf_datastore(const char* cfgfile);
-const char* parse_conf_db_host(const char* cfgfile);
-const char* parse_conf_db_username(const char* cfgfile);
-const char* parse_conf_db_password(const char* cfgfile);
-engineconfig_database_type_t parse_conf_db_type(const char *cfgfile);
+const char* parse_conf_pid_filename(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_delegation_signer_submit_command(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_delegation_signer_retract_command(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_clisock_filename(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_working_dir(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_username(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_group(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_chroot(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_datastore(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_db_host(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_db_username(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_db_password(xmlXPathContextPtr xpathCtx);
+engineconfig_database_type_t parse_conf_db_type(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile the configuration file name
+ * \param[in] xpathCtx XPath context of the configuration file
  * \return int integer
  *
  */
 
 /** Common */
-int parse_conf_use_syslog(const char* cfgfile);
-int parse_conf_verbosity(const char* cfgfile);
+int parse_conf_use_syslog(xmlXPathContextPtr xpathCtx);
+int parse_conf_verbosity(xmlXPathContextPtr xpathCtx);
 
 /** Enforcer specific */
-int parse_conf_worker_threads(const char* cfgfile);
-int parse_conf_manual_keygen(const char* cfgfile);
-int parse_conf_db_port(const char *cfgfile);
-time_t parse_conf_automatic_keygen_period(const char* cfgfile);
-hsm_repository_t* parse_conf_repositories(const char* cfgfile);
+int parse_conf_worker_threads(xmlXPathContextPtr xpathCtx);
+int parse_conf_manual_keygen(xmlXPathContextPtr xpathCtx);
+int parse_conf_db_port(xmlXPathContextPtr xpathCtx);
+time_t parse_conf_automatic_keygen_period(xmlXPathContextPtr xpathCtx);
+hsm_repository_t* parse_conf_repositories(xmlXPathContextPtr xpathCtx);
 
 #endif /* PARSE_CONFPARSER_H */
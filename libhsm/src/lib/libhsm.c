@@ -681,6 +681,8 @@ hsm_ctx_new()
         memset(ctx->session, 0, HSM_MAX_SESSIONS);
         ctx->session_count = 0;
         ctx->error = 0;
+        ctx->sign_buf = NULL;
+        ctx->rrset_buf = NULL;
     }
     return ctx;
 }
@@ -695,6 +697,8 @@ hsm_ctx_free(hsm_ctx_t *ctx)
         for (i = 0; i < ctx->session_count; i++) {
             hsm_session_free(ctx->session[i]);
         }
+        if (ctx->sign_buf) ldns_buffer_free(ctx->sign_buf);
+        if (ctx->rrset_buf) ldns_buffer_free(ctx->rrset_buf);
         free(ctx);
     }
 }
@@ -1834,16 +1838,18 @@ hsm_get_key_rdata(hsm_ctx_t *ctx, hsm_session_t *session,
     }
 }
 
-/* this function allocates memory for the mechanism ID and enough room
- * to leave the upcoming digest data. It fills in the mechanism id
- * use with care. The returned data must be free'd by the caller.
+/* largest digest we compute (SHA-512) and largest PKCS#1 DigestInfo
+ * prefix (SHA-256/SHA-512) put in front of it */
+#define HSM_MAX_DIGEST_LENGTH 64
+#define HSM_MAX_PREFIX_LENGTH 19
+
+/* this function writes the mechanism ID in front of the room for the
+ * upcoming digest data, and returns the length of that prefix (0 if the
+ * mechanism does not need one, -1 for unsupported algorithms).
  * Only used by RSA PKCS. */
-static CK_BYTE *
-hsm_create_prefix(CK_ULONG digest_len,
-                  ldns_algorithm algorithm,
-                  CK_ULONG *data_size)
+static int
+hsm_create_prefix(ldns_algorithm algorithm, CK_BYTE *data)
 {
-    CK_BYTE *data;
     const CK_BYTE RSA_MD5_ID[] = { 0x30, 0x20, 0x30, 0x0C, 0x06, 0x08, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x02, 0x05, 0x05, 0x00, 0x04, 0x10 };
     const CK_BYTE RSA_SHA1_ID[] = { 0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2B, 0x0E, 0x03, 0x02, 0x1A, 0x05, 0x00, 0x04, 0x14 };
     const CK_BYTE RSA_SHA256_ID[] = { 0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20 };
@@ -1851,26 +1857,18 @@ hsm_create_prefix(CK_ULONG digest_len,
 
     switch(algorithm) {
         case LDNS_SIGN_RSAMD5:
-            *data_size = sizeof(RSA_MD5_ID) + digest_len;
-            data = malloc(*data_size);
             memcpy(data, RSA_MD5_ID, sizeof(RSA_MD5_ID));
-            break;
+            return sizeof(RSA_MD5_ID);
         case LDNS_SIGN_RSASHA1:
         case LDNS_SIGN_RSASHA1_NSEC3:
-            *data_size = sizeof(RSA_SHA1_ID) + digest_len;
-            data = malloc(*data_size);
             memcpy(data, RSA_SHA1_ID, sizeof(RSA_SHA1_ID));
-            break;
+            return sizeof(RSA_SHA1_ID);
 	case LDNS_SIGN_RSASHA256:
-            *data_size = sizeof(RSA_SHA256_ID) + digest_len;
-            data = malloc(*data_size);
             memcpy(data, RSA_SHA256_ID, sizeof(RSA_SHA256_ID));
-            break;
+            return sizeof(RSA_SHA256_ID);
 	case LDNS_SIGN_RSASHA512:
-            *data_size = sizeof(RSA_SHA512_ID) + digest_len;
-            data = malloc(*data_size);
             memcpy(data, RSA_SHA512_ID, sizeof(RSA_SHA512_ID));
-            break;
+            return sizeof(RSA_SHA512_ID);
         case LDNS_SIGN_DSA:
         case LDNS_SIGN_DSA_NSEC3:
         case LDNS_SIGN_ECC_GOST:
@@ -1879,35 +1877,30 @@ hsm_create_prefix(CK_ULONG digest_len,
         case LDNS_SIGN_ECDSAP256SHA256:
         case LDNS_SIGN_ECDSAP384SHA384:
 #endif
-            *data_size = digest_len;
-            data = malloc(*data_size);
-            break;
+            return 0;
         default:
-            return NULL;
+            return -1;
     }
-    return data;
 }
 
-static CK_BYTE *
+static int
 hsm_digest_through_hsm(hsm_ctx_t *ctx,
                        hsm_session_t *session,
                        CK_MECHANISM_TYPE mechanism_type,
+                       CK_BYTE *digest,
                        CK_ULONG digest_len,
                        ldns_buffer *sign_buf)
 {
     CK_MECHANISM digest_mechanism;
-    CK_BYTE *digest;
     CK_RV rv;
 
     digest_mechanism.pParameter = NULL;
     digest_mechanism.ulParameterLen = 0;
     digest_mechanism.mechanism = mechanism_type;
-    digest = malloc(digest_len);
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_DigestInit(session->session,
                                                  &digest_mechanism);
     if (hsm_pkcs11_check_error(ctx, rv, "HSM digest init")) {
-        free(digest);
-        return NULL;
+        return -1;
     }
 
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_Digest(session->session,
@@ -1916,14 +1909,17 @@ hsm_digest_through_hsm(hsm_ctx_t *ctx,
                                         digest,
                                         &digest_len);
     if (hsm_pkcs11_check_error(ctx, rv, "HSM digest")) {
-        free(digest);
-        return NULL;
+        return -1;
     }
-    return digest;
+    return 0;
 }
 
+/* sign the data in sign_buf with the key, using a session that was
+ * already looked up for it. The digest and the data passed to the HSM
+ * live on the stack, so nothing is allocated but the resulting rdf. */
 static ldns_rdf *
 hsm_sign_buffer(hsm_ctx_t *ctx,
+                hsm_session_t *session,
                 ldns_buffer *sign_buf,
                 const libhsm_key_t *key,
                 ldns_algorithm algorithm)
@@ -1933,17 +1929,19 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
     CK_BYTE signature[HSM_MAX_SIGNATURE_LENGTH];
     CK_MECHANISM sign_mechanism;
 
-    ldns_rdf *sig_rdf;
-    CK_BYTE *digest = NULL;
+    CK_BYTE data[HSM_MAX_PREFIX_LENGTH + HSM_MAX_DIGEST_LENGTH];
+    CK_BYTE *digest;
     CK_ULONG digest_len;
+    int prefix_len;
 
-    CK_BYTE *data = NULL;
-    CK_ULONG data_len = 0;
-
-    hsm_session_t *session;
-
-    session = hsm_find_key_session(ctx, key);
-    if (!session) return NULL;
+    /* CKM_RSA_PKCS does the padding, but cannot know the identifier
+     * prefix, so we need to add that ourselves.
+     * The other algorithms will just get the digest. */
+    prefix_len = hsm_create_prefix(algorithm, data);
+    if (prefix_len < 0) {
+        return NULL;
+    }
+    digest = data + prefix_len;
 
     /* some HSMs don't really handle CKM_SHA1_RSA_PKCS well, so
      * we'll do the hashing manually */
@@ -1951,19 +1949,19 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
     switch (algorithm) {
         case LDNS_SIGN_RSAMD5:
             digest_len = 16;
-            digest = hsm_digest_through_hsm(ctx, session,
-                                            CKM_MD5, digest_len,
-                                            sign_buf);
+            if (hsm_digest_through_hsm(ctx, session, CKM_MD5, digest,
+                                       digest_len, sign_buf)) {
+                return NULL;
+            }
             break;
         case LDNS_SIGN_RSASHA1:
         case LDNS_SIGN_RSASHA1_NSEC3:
         case LDNS_SIGN_DSA:
         case LDNS_SIGN_DSA_NSEC3:
             digest_len = LDNS_SHA1_DIGEST_LENGTH;
-            digest = malloc(digest_len);
-            digest = ldns_sha1(ldns_buffer_begin(sign_buf),
-                               ldns_buffer_position(sign_buf),
-                               digest);
+            ldns_sha1(ldns_buffer_begin(sign_buf),
+                      ldns_buffer_position(sign_buf),
+                      digest);
             break;
 
         case LDNS_SIGN_RSASHA256:
@@ -1972,33 +1970,31 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
         case LDNS_SIGN_ECDSAP256SHA256:
 #endif
             digest_len = LDNS_SHA256_DIGEST_LENGTH;
-            digest = malloc(digest_len);
-            digest = ldns_sha256(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha256(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
 /* TODO: We can remove the directive if we require LDNS >= 1.6.13 */
 #if !defined LDNS_BUILD_CONFIG_USE_ECDSA || LDNS_BUILD_CONFIG_USE_ECDSA
         case LDNS_SIGN_ECDSAP384SHA384:
             digest_len = LDNS_SHA384_DIGEST_LENGTH;
-            digest = malloc(digest_len);
-            digest = ldns_sha384(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha384(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
 #endif
         case LDNS_SIGN_RSASHA512:
             digest_len = LDNS_SHA512_DIGEST_LENGTH;
-            digest = malloc(digest_len);
-            digest = ldns_sha512(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha512(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
         case LDNS_SIGN_ECC_GOST:
             digest_len = 32;
-            digest = hsm_digest_through_hsm(ctx, session,
-                                            CKM_GOSTR3411, digest_len,
-                                            sign_buf);
+            if (hsm_digest_through_hsm(ctx, session, CKM_GOSTR3411, digest,
+                                       digest_len, sign_buf)) {
+                return NULL;
+            }
             break;
         default:
             /* log error? or should we not even get here for
@@ -2006,16 +2002,6 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
             return NULL;
     }
 
-    if (!digest) {
-        return NULL;
-    }
-
-    /* CKM_RSA_PKCS does the padding, but cannot know the identifier
-     * prefix, so we need to add that ourselves.
-     * The other algorithms will just get the digest buffer returned. */
-    data = hsm_create_prefix(digest_len, algorithm, &data_len);
-    memcpy(data + data_len - digest_len, digest, digest_len);
-
     sign_mechanism.pParameter = NULL;
     sign_mechanism.ulParameterLen = 0;
     switch(algorithm) {
@@ -2043,8 +2029,6 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
         default:
             /* log error? or should we not even get here for
              * unsupported algorithms? */
-            free(data);
-            free(digest);
             return NULL;
     }
 
@@ -2053,29 +2037,20 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
                                       &sign_mechanism,
                                       key->private_key);
     if (hsm_pkcs11_check_error(ctx, rv, "sign init")) {
-        free(data);
-        free(digest);
         return NULL;
     }
 
-    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_Sign(session->session, data, data_len,
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_Sign(session->session,
+                                      data, prefix_len + digest_len,
                                       signature,
                                       &signatureLen);
     if (hsm_pkcs11_check_error(ctx, rv, "sign final")) {
-        free(data);
-        free(digest);
         return NULL;
     }
 
-    sig_rdf = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64,
-                                    signatureLen,
-                                    signature);
-
-    free(data);
-    free(digest);
-
-    return sig_rdf;
-
+    return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64,
+                                 signatureLen,
+                                 signature);
 }
 
 static int
@@ -2087,7 +2062,7 @@ hsm_dname_is_wildcard(const ldns_rdf* dname)
 }
 
 static ldns_rr *
-hsm_create_empty_rrsig(const ldns_rr_list *rrset,
+hsm_create_empty_rrsig(const ldns_rr *rr,
                        const hsm_sign_params_t *sign_params)
 {
     ldns_rr *rrsig;
@@ -2097,25 +2072,22 @@ hsm_create_empty_rrsig(const ldns_rr_list *rrset,
     uint8_t label_count;
 
     label_count = ldns_dname_label_count(
-                       ldns_rr_owner(ldns_rr_list_rr(rrset, 0)));
+                       ldns_rr_owner(rr));
     /* RFC 4035 section 2.2: dnssec label length and wildcards */
-    if (hsm_dname_is_wildcard(ldns_rr_owner(ldns_rr_list_rr(rrset, 0)))) {
+    if (hsm_dname_is_wildcard(ldns_rr_owner(rr))) {
         label_count--;
     }
 
     rrsig = ldns_rr_new_frm_type(LDNS_RR_TYPE_RRSIG);
 
     /* set the type on the new signature */
-    orig_ttl = ldns_rr_ttl(ldns_rr_list_rr(rrset, 0));
-    orig_class = ldns_rr_get_class(ldns_rr_list_rr(rrset, 0));
+    orig_ttl = ldns_rr_ttl(rr);
+    orig_class = ldns_rr_get_class(rr);
 
     ldns_rr_set_class(rrsig, orig_class);
     ldns_rr_set_ttl(rrsig, orig_ttl);
     ldns_rr_set_owner(rrsig,
-              ldns_rdf_clone(
-                   ldns_rr_owner(
-                    ldns_rr_list_rr(rrset,
-                            0))));
+              ldns_rdf_clone(ldns_rr_owner(rr)));
 
     /* fill in what we know of the signature */
 
@@ -2128,7 +2100,7 @@ hsm_create_empty_rrsig(const ldns_rr_list *rrset,
     (void)ldns_rr_rrsig_set_signame(
                rrsig,
                ldns_rdf_clone(sign_params->owner));
-    /* label count - get it from the first rr in the rr_list */
+    /* label count - get it from the rr */
     (void)ldns_rr_rrsig_set_labels(
             rrsig,
             ldns_native2rdf_int8(LDNS_RDF_TYPE_INT8,
@@ -2175,8 +2147,7 @@ hsm_create_empty_rrsig(const ldns_rr_list *rrset,
             rrsig,
             ldns_native2rdf_int16(
                 LDNS_RDF_TYPE_TYPE,
-                ldns_rr_get_type(ldns_rr_list_rr(rrset,
-                                                 0))));
+                ldns_rr_get_type(rr)));
 
     return rrsig;
 }
@@ -2933,52 +2904,76 @@ libhsm_key_info_free(libhsm_key_info_t *key_info)
     }
 }
 
-ldns_rr*
-hsm_sign_rrset(hsm_ctx_t *ctx,
-               const ldns_rr_list* rrset,
-               const libhsm_key_t *key,
-               const hsm_sign_params_t *sign_params)
+/* get a cleared scratch buffer of the context, allocating it on first use */
+static ldns_buffer *
+hsm_ctx_scratch(ldns_buffer **buf)
+{
+    if (!*buf) {
+        *buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+    } else {
+        ldns_buffer_clear(*buf);
+    }
+    return *buf;
+}
+
+/* put the canonical wire format of the rrset in the rrset scratch buffer,
+ * without changing the rrset itself */
+static ldns_buffer *
+hsm_rrset2wire(hsm_ctx_t *ctx, const ldns_rr_list *rrset)
+{
+    ldns_buffer *rrset_buf;
+    size_t i;
+
+    rrset_buf = hsm_ctx_scratch(&ctx->rrset_buf);
+    if (!rrset_buf) return NULL;
+
+    for(i = 0; i < ldns_rr_list_rr_count(rrset); i++) {
+        if (ldns_rr2buffer_wire_canonical(rrset_buf,
+                ldns_rr_list_rr(rrset, i), LDNS_SECTION_ANSWER)
+            != LDNS_STATUS_OK) {
+            return NULL;
+        }
+    }
+    return rrset_buf;
+}
+
+/* create the signature over an rrset that is already in canonical
+ * wire format, taking owner, class and ttl from one of its RRs */
+static ldns_rr *
+hsm_sign_wire_session(hsm_ctx_t *ctx,
+                      hsm_session_t *session,
+                      const ldns_rr *rr,
+                      const uint8_t *wire,
+                      size_t wire_len,
+                      const libhsm_key_t *key,
+                      const hsm_sign_params_t *sign_params)
 {
     ldns_rr *signature;
     ldns_buffer *sign_buf;
     ldns_rdf *b64_rdf;
-    size_t i;
-
-    if (!key) return NULL;
-    if (!sign_params) return NULL;
 
-    signature = hsm_create_empty_rrsig((ldns_rr_list *)rrset,
-                                       sign_params);
+    signature = hsm_create_empty_rrsig(rr, sign_params);
 
     /* right now, we have: a key, a semi-sig and an rrset. For
      * which we can create the sig and base64 encode that and
      * add that to the signature */
-    sign_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
-
-    if (ldns_rrsig2buffer_wire(sign_buf, signature)
-        != LDNS_STATUS_OK) {
-        ldns_buffer_free(sign_buf);
+    sign_buf = hsm_ctx_scratch(&ctx->sign_buf);
+    if (!sign_buf ||
+        ldns_rrsig2buffer_wire(sign_buf, signature) != LDNS_STATUS_OK) {
         /* ERROR */
         ldns_rr_free(signature);
         return NULL;
     }
 
-    /* make it canonical */
-    for(i = 0; i < ldns_rr_list_rr_count(rrset); i++) {
-        ldns_rr2canonical(ldns_rr_list_rr(rrset, i));
-    }
-
     /* add the rrset in sign_buf */
-    if (ldns_rr_list2buffer_wire(sign_buf, rrset)
-        != LDNS_STATUS_OK) {
-        ldns_buffer_free(sign_buf);
+    if (!ldns_buffer_reserve(sign_buf, wire_len)) {
         ldns_rr_free(signature);
         return NULL;
     }
+    ldns_buffer_write(sign_buf, wire, wire_len);
 
-    b64_rdf = hsm_sign_buffer(ctx, sign_buf, key, sign_params->algorithm);
-
-    ldns_buffer_free(sign_buf);
+    b64_rdf = hsm_sign_buffer(ctx, session, sign_buf, key,
+                              sign_params->algorithm);
     if (!b64_rdf) {
         /* signing went wrong */
         ldns_rr_free(signature);
@@ -2990,6 +2985,113 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
     return signature;
 }
 
+ldns_rr*
+hsm_sign_rrset(hsm_ctx_t *ctx,
+               const ldns_rr_list* rrset,
+               const libhsm_key_t *key,
+               const hsm_sign_params_t *sign_params)
+{
+    hsm_session_t *session;
+    ldns_buffer *rrset_buf;
+
+    if (!key) return NULL;
+    if (!sign_params) return NULL;
+
+    session = hsm_find_key_session(ctx, key);
+    if (!session) return NULL;
+
+    rrset_buf = hsm_rrset2wire(ctx, rrset);
+    if (!rrset_buf) return NULL;
+
+    return hsm_sign_wire_session(ctx, session, ldns_rr_list_rr(rrset, 0),
+                                 ldns_buffer_begin(rrset_buf),
+                                 ldns_buffer_position(rrset_buf),
+                                 key, sign_params);
+}
+
+ldns_rr*
+hsm_sign_wire(hsm_ctx_t *ctx,
+              const ldns_rr *rr,
+              const uint8_t *wire,
+              size_t wire_len,
+              const libhsm_key_t *key,
+              const hsm_sign_params_t *sign_params)
+{
+    hsm_session_t *session;
+
+    if (!rr || !wire) return NULL;
+    if (!key) return NULL;
+    if (!sign_params) return NULL;
+
+    session = hsm_find_key_session(ctx, key);
+    if (!session) return NULL;
+
+    return hsm_sign_wire_session(ctx, session, rr, wire, wire_len, key,
+                                 sign_params);
+}
+
+int
+hsm_sign_rrset_batch(hsm_ctx_t *ctx,
+                     const hsm_sign_request_t *requests,
+                     size_t count,
+                     ldns_rr **signatures)
+{
+    hsm_session_t *session = NULL;
+    const libhsm_key_t *session_key = NULL;
+    const ldns_rr_list *rrset = NULL;
+    ldns_buffer *rrset_buf = NULL;
+    int result = HSM_OK;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        signatures[i] = NULL;
+    }
+    for (i = 0; i < count; i++) {
+        if ((!requests[i].rrset && (!requests[i].rr || !requests[i].wire)) ||
+            !requests[i].key || !requests[i].params) {
+            result = HSM_ERROR;
+            continue;
+        }
+        /* look the session up only when the key lives in another module */
+        if (!session || !requests[i].key->modulename ||
+            strcmp(session_key->modulename, requests[i].key->modulename)) {
+            session = hsm_find_key_session(ctx, requests[i].key);
+            session_key = requests[i].key;
+        }
+        if (!session) {
+            result = HSM_ERROR;
+            continue;
+        }
+        if (requests[i].wire) {
+            /* already serialized by the caller */
+            signatures[i] = hsm_sign_wire_session(ctx, session,
+                                requests[i].rr, requests[i].wire,
+                                requests[i].wire_len, requests[i].key,
+                                requests[i].params);
+        } else {
+            /* serialize each rrset once, no matter how many keys sign it */
+            if (requests[i].rrset != rrset || !rrset_buf) {
+                rrset = requests[i].rrset;
+                rrset_buf = hsm_rrset2wire(ctx, rrset);
+                if (!rrset_buf) {
+                    rrset = NULL;
+                    result = HSM_ERROR;
+                    continue;
+                }
+            }
+            signatures[i] = hsm_sign_wire_session(ctx, session,
+                                ldns_rr_list_rr(rrset, 0),
+                                ldns_buffer_begin(rrset_buf),
+                                ldns_buffer_position(rrset_buf),
+                                requests[i].key, requests[i].params);
+        }
+        if (!signatures[i]) {
+            result = HSM_ERROR;
+        }
+    }
+    return result;
+}
+
 int
 hsm_keytag(const char* loc, int alg, int ksk, uint16_t* keytag)
 {
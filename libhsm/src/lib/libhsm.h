@@ -142,6 +142,10 @@ typedef struct {
     
     ldns_rbtree_t* keycache;
     pthread_mutex_t *keycache_lock;
+
+    /*!< scratch buffers reused by every signing operation on this context */
+    ldns_buffer *sign_buf;
+    ldns_buffer *rrset_buf;
 } hsm_ctx_t;
 
 
@@ -81,6 +81,65 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
                const hsm_sign_params_t *sign_params);
 
 
+/*! Sign RRset in wire format using key
+
+Signs an RRset that the caller has already serialized: the RRs in
+canonical form and canonical order (RFC 4034, section 6), as they
+appear in the signed data. The owner, class and TTL of the signature
+are taken from rr, which should be one of the RRs of the RRset.
+The returned ldns_rr structure can be freed with ldns_rr_free()
+
+\param context HSM context
+\param rr RR of the RRset
+\param wire canonical wire format of the RRset
+\param wire_len length of wire
+\param key Key pair used to sign
+\param sign_params the signing parameters (flags, algorithm, etc)
+\return ldns_rr* RRSIG for the RRset
+*/
+ldns_rr*
+hsm_sign_wire(hsm_ctx_t *ctx,
+              const ldns_rr *rr,
+              const uint8_t *wire,
+              size_t wire_len,
+              const libhsm_key_t *key,
+              const hsm_sign_params_t *sign_params);
+
+
+/*! A single signature to create with hsm_sign_rrset_batch() */
+typedef struct {
+    const ldns_rr_list *rrset;        /*!< RRset to sign, if wire is NULL */
+    const ldns_rr *rr;                /*!< RR of the RRset when signing wire */
+    const uint8_t *wire;              /*!< canonical wire format of the RRset */
+    size_t wire_len;                  /*!< length of wire */
+    const libhsm_key_t *key;          /*!< key pair used to sign */
+    const hsm_sign_params_t *params;  /*!< signer parameters for this key */
+} hsm_sign_request_t;
+
+
+/*! Sign a batch of RRsets
+
+Creates one signature per request, reusing the scratch buffers of the
+context. The key session is only looked up when the key changes, and
+consecutive requests for the same RRset serialize it only once, so
+order the requests by RRset and key. Requests that carry the wire
+format of the RRset are signed without serializing it. The returned ldns_rr structures
+can be freed with ldns_rr_free(); entries that could not be signed are
+set to NULL.
+
+\param context HSM context
+\param requests RRsets, keys and parameters to sign with
+\param count number of requests
+\param signatures array of count entries receiving the signatures
+\return HSM_OK if all signatures were made, HSM_ERROR otherwise
+*/
+int
+hsm_sign_rrset_batch(hsm_ctx_t *ctx,
+                     const hsm_sign_request_t *requests,
+                     size_t count,
+                     ldns_rr **signatures);
+
+
 /*! Get DNSKEY RR
 
 The returned ldns_rr structure can be freed with ldns_rr_free()
@@ -33,6 +33,7 @@
 #include "adapter/adapi.h"
 #include "adapter/adapter.h"
 #include "adapter/addns.h"
+#include "adapter/adreader.h"
 #include "adapter/adutil.h"
 #include "parser/addnsparser.h"
 #include "parser/confparser.h"
@@ -41,16 +42,19 @@
 #include "log.h"
 #include "status.h"
 #include "util.h"
+#include "signer/ixfrjournal.h"
 #include "signer/zone.h"
+#include "wire/axfr.h"
 #include "wire/notify.h"
 #include "wire/xfrd.h"
 
+#include <errno.h>
 #include <ldns/ldns.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static const char* adapter_str = "adapter";
-static ods_status addns_read_pkt(FILE* fd, zone_type* zone);
 static ods_status addns_read_file(FILE* fd, zone_type* zone);
 
 
@@ -130,57 +134,271 @@ addns_read_line:
 }
 
 
+/**
+ * Reader of the zone transfers spooled by xfrd. Older spool files have
+ * the transfers in text format, between ;;BEGINPACKET and ;;ENDPACKET.
+ * The text reader only lives for the duration of a text transfer.
+ *
+ */
+typedef struct addns_spool_struct addns_spool_type;
+struct addns_spool_struct {
+    FILE* fd;
+    unsigned wire : 1;
+    uint8_t marker; /* BEGIN or END that stopped reading, 0 otherwise */
+    unsigned l; /* line or RR number */
+    /* text format */
+    adreader_type* reader;
+    /* wire format */
+    uint8_t* msg;
+    size_t msgsize;
+    size_t msglen;
+    size_t pos;
+    uint16_t ancount;
+};
+
+
+/**
+ * Text of the current RR, for logging.
+ *
+ */
+static const char*
+addns_spool_text(addns_spool_type* spool)
+{
+    return spool->reader ? adreader_text(spool->reader) : "";
+}
+
+
+/**
+ * Position in the spool file.
+ *
+ */
+static long
+addns_spool_tell(addns_spool_type* spool)
+{
+    return spool->reader ? adreader_tell(spool->reader) : ftell(spool->fd);
+}
+
+
+/**
+ * Read spool record header.
+ *
+ */
+static int
+addns_spool_record(addns_spool_type* spool, uint8_t* type, uint16_t* len)
+{
+    uint8_t hdr[XFRD_SPOOL_RECORD_LEN];
+    if (fread(hdr, 1, sizeof(hdr), spool->fd) != sizeof(hdr)) {
+        return 0;
+    }
+    *type = hdr[0];
+    *len = ldns_read_uint16(hdr + 1);
+    return 1;
+}
+
+
+/**
+ * Read the start of the next zone transfer.
+ *
+ */
+static ods_status
+addns_spool_begin(addns_spool_type* spool, zone_type* zone)
+{
+    int c = 0;
+    uint8_t type = 0;
+    uint16_t rlen = 0;
+    ldns_rr* rr = NULL;
+    ldns_status status = LDNS_STATUS_OK;
+    const char* marker = NULL;
+
+    spool->marker = 0;
+    if (spool->reader) {
+        /* the text reader reads ahead, go back to where it stopped */
+        if (fseek(spool->fd, adreader_tell(spool->reader), SEEK_SET) != 0) {
+            ods_log_error("[%s] unable to seek in xfrd file zone %s: %s",
+                adapter_str, zone->name, strerror(errno));
+            return ODS_STATUS_FSEEK_ERR;
+        }
+        adreader_cleanup(spool->reader);
+        spool->reader = NULL;
+    }
+    /* detect the format of every transfer: xfrd appends wire format
+       transfers to a text spool left by an older signer */
+    do {
+        c = fgetc(spool->fd);
+    } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+    if (c == EOF) {
+        return ODS_STATUS_EOF;
+    }
+    (void) ungetc(c, spool->fd);
+    spool->wire = (c != ';');
+    if (!spool->wire) {
+        spool->reader = adreader_create(spool->fd, NULL, 0, ADREADER_MARKERS);
+    }
+    if (spool->wire) {
+        if (!addns_spool_record(spool, &type, &rlen)) {
+            return ODS_STATUS_EOF;
+        }
+        if (type != XFRD_SPOOL_BEGIN || rlen != 0) {
+            ods_log_error("[%s] bogus xfrd file zone %s, missing begin "
+                "record (was %u)", adapter_str, zone->name, (unsigned) type);
+            return ODS_STATUS_ERR;
+        }
+        return ODS_STATUS_OK;
+    }
+    rr = adreader_read_rr(spool->reader, &status);
+    spool->l = adreader_line(spool->reader);
+    marker = adreader_marker(spool->reader);
+    if (!rr && !marker && status == LDNS_STATUS_OK) {
+        /* EOF */
+        return ODS_STATUS_EOF;
+    }
+    ldns_rr_free(rr);
+    if (!marker || ods_strcmp(";;BEGINPACKET", marker) != 0) {
+        ods_log_error("[%s] bogus xfrd file zone %s, missing ;;BEGINPACKET (was %s)",
+            adapter_str, zone->name, adreader_text(spool->reader));
+        return ODS_STATUS_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Read the next RR of the zone transfer. Returns NULL at the end of the
+ * transfer, or on error.
+ *
+ */
+static ldns_rr*
+addns_spool_rr(addns_spool_type* spool, ldns_status* status)
+{
+    ldns_rr* rr = NULL;
+    uint8_t type = 0;
+    uint16_t len = 0, qdcount = 0;
+    const char* marker = NULL;
+
+    *status = LDNS_STATUS_OK;
+    spool->marker = 0;
+    if (!spool->wire) {
+        while (1) {
+            rr = adreader_read_rr(spool->reader, status);
+            spool->l = adreader_line(spool->reader);
+            marker = adreader_marker(spool->reader);
+            if (rr || !marker) {
+                return rr;
+            }
+            if (ods_strcmp(";;ENDPACKET", marker) == 0) {
+                spool->marker = XFRD_SPOOL_END;
+                return NULL;
+            } else if (ods_strcmp(";;BEGINPACKET", marker) == 0) {
+                spool->marker = XFRD_SPOOL_BEGIN;
+                return NULL;
+            }
+            /* some other comment */
+        }
+    }
+    while (!spool->ancount) {
+        if (!addns_spool_record(spool, &type, &len)) {
+            /* EOF, or record not completely written */
+            return NULL;
+        }
+        if (type == XFRD_SPOOL_BEGIN || type == XFRD_SPOOL_END) {
+            spool->marker = type;
+            return NULL;
+        }
+        if (len > spool->msgsize) {
+            CHECKALLOC(spool->msg = (uint8_t*) realloc(spool->msg, len));
+            spool->msgsize = len;
+        }
+        if (fread(spool->msg, 1, len, spool->fd) != len) {
+            return NULL;
+        }
+        if (type != XFRD_SPOOL_MSG) {
+            continue;
+        }
+        if (len < LDNS_HEADER_SIZE) {
+            *status = LDNS_STATUS_PACKET_OVERFLOW;
+            return NULL;
+        }
+        spool->msglen = len;
+        spool->pos = LDNS_HEADER_SIZE;
+        qdcount = ldns_read_uint16(spool->msg + 4);
+        spool->ancount = ldns_read_uint16(spool->msg + 6);
+        while (qdcount--) {
+            *status = ldns_wire2rr(&rr, spool->msg, spool->msglen,
+                &spool->pos, LDNS_SECTION_QUESTION);
+            if (*status != LDNS_STATUS_OK) {
+                spool->ancount = 0;
+                return NULL;
+            }
+            ldns_rr_free(rr);
+            rr = NULL;
+        }
+    }
+    *status = ldns_wire2rr(&rr, spool->msg, spool->msglen, &spool->pos,
+        LDNS_SECTION_ANSWER);
+    spool->ancount--;
+    spool->l++;
+    if (*status != LDNS_STATUS_OK) {
+        spool->ancount = 0;
+        if (rr) {
+            ldns_rr_free(rr);
+        }
+        return NULL;
+    }
+    return rr;
+}
+
+
+/**
+ * Forget the text format $ORIGIN and previous owner name.
+ *
+ */
+static void
+addns_spool_clear(addns_spool_type* spool)
+{
+    if (spool->reader) {
+        adreader_reset(spool->reader, NULL, 0);
+    }
+}
+
+
 /**
  * Read pkt from file.
  *
  */
 static ods_status
-addns_read_pkt(FILE* fd, zone_type* zone)
+addns_read_pkt(addns_spool_type* spool, zone_type* zone)
 {
     ldns_rr* rr = NULL;
     long startpos = 0;
     long fpos = 0;
-    int len = 0;
     uint32_t new_serial = 0;
     uint32_t old_serial = 0;
     uint32_t tmp_serial = 0;
-    ldns_rdf* prev = NULL;
-    ldns_rdf* orig = NULL;
     ldns_rdf* dname = NULL;
-    uint32_t ttl = 0;
     size_t rr_count = 0;
     ods_status result = ODS_STATUS_OK;
     ldns_status status = LDNS_STATUS_OK;
-    char line[SE_ADFILE_MAXLINE];
     unsigned is_axfr = 0;
     unsigned del_mode = 0;
     unsigned soa_seen = 0;
     unsigned line_update_interval = 100000;
     unsigned line_update = line_update_interval;
-    unsigned l = 0;
     char* xfrd;
     char* fin;
     char* fout;
 
-    ods_log_assert(fd);
+    ods_log_assert(spool);
     ods_log_assert(zone);
     ods_log_assert(zone->name);
 
 
-    fpos = ftell(fd);
-    len = adutil_readline_frm_file(fd, line, &l, 1);
-    if (len < 0) {
-        /* -1 EOF */
-        return ODS_STATUS_EOF;
-    }
-    adutil_rtrim_line(line, &len);
-    if (ods_strcmp(";;BEGINPACKET", line) != 0) {
-        ods_log_error("[%s] bogus xfrd file zone %s, missing ;;BEGINPACKET (was %s)",
-            adapter_str, zone->name, line);
-        return ODS_STATUS_ERR;
+    fpos = addns_spool_tell(spool);
+    result = addns_spool_begin(spool, zone);
+    if (result != ODS_STATUS_OK) {
+        return result;
     }
     startpos = fpos;
-    fpos = ftell(fd);
+    fpos = addns_spool_tell(spool);
 
 begin_pkt:
     rr_count = 0;
@@ -194,30 +412,27 @@ begin_pkt:
             adapter_str);
         return ODS_STATUS_ERR;
     }
-    orig = ldns_rdf_clone(dname);
-    if (!orig) {
-        ods_log_error("[%s] error setting default value for $ORIGIN",
-            adapter_str);
-        return ODS_STATUS_ERR;
-    }
     /* $TTL <default ttl> */
-    ttl = adapi_get_ttl(zone);
+    if (spool->reader) {
+        adreader_reset(spool->reader, dname, adapi_get_ttl(zone));
+    }
 
     /* read RRs */
-    while ((rr = addns_read_rr(fd, line, &orig, &prev, &ttl, &status, &l))
-        != NULL) {
+    while ((rr = addns_spool_rr(spool, &status)) != NULL) {
         /* update file position */
-        fpos = ftell(fd);
+        fpos = addns_spool_tell(spool);
         /* check status */
         if (status != LDNS_STATUS_OK) {
             ods_log_error("[%s] error reading RR at line %i (%s): %s",
-                adapter_str, l, ldns_get_errorstr_by_id(status), line);
+                adapter_str, spool->l, ldns_get_errorstr_by_id(status),
+                addns_spool_text(spool));
             result = ODS_STATUS_ERR;
             break;
         }
         /* debug update */
-        if (l > line_update) {
-            ods_log_debug("[%s] ...at line %i: %s", adapter_str, l, line);
+        if (spool->l > line_update) {
+            ods_log_debug("[%s] ...at line %i: %s", adapter_str, spool->l,
+                addns_spool_text(spool));
             line_update += line_update_interval;
         }
         /* first RR: check if SOA and correct zone & serialno */
@@ -346,41 +561,36 @@ begin_pkt:
         /* [add to/remove from] the zone */
         if (!is_axfr && del_mode) {
             ods_log_deeebug("[%s] delete RR #%lu at line %i: %s",
-                adapter_str, (unsigned long)rr_count, l, line);
+                adapter_str, (unsigned long)rr_count, spool->l, addns_spool_text(spool));
             result = adapi_del_rr(zone, rr, 0);
             ldns_rr_free(rr);
             rr = NULL;
         } else {
             ods_log_deeebug("[%s] add RR #%lu at line %i: %s",
-                adapter_str, (unsigned long)rr_count, l, line);
+                adapter_str, (unsigned long)rr_count, spool->l, addns_spool_text(spool));
             result = adapi_add_rr(zone, rr, 0);
         }
         if (result == ODS_STATUS_UNCHANGED) {
             ods_log_debug("[%s] skipping RR at line %i (%s): %s",
-                adapter_str, l, del_mode?"not found":"duplicate", line);
+                adapter_str, spool->l, del_mode?"not found":"duplicate",
+                addns_spool_text(spool));
             ldns_rr_free(rr);
             rr = NULL;
             result = ODS_STATUS_OK;
             continue;
         } else if (result != ODS_STATUS_OK) {
             ods_log_error("[%s] error %s RR at line %i: %s",
-                adapter_str, del_mode?"deleting":"adding", l, line);
+                adapter_str, del_mode?"deleting":"adding", spool->l,
+                addns_spool_text(spool));
             ldns_rr_free(rr);
             rr = NULL;
             break;
         }
     }
     /* and done */
-    if (orig) {
-        ldns_rdf_deep_free(orig);
-        orig = NULL;
-    }
-    if (prev) {
-        ldns_rdf_deep_free(prev);
-        prev = NULL;
-    }
+    addns_spool_clear(spool);
     /* check again */
-    if (ods_strcmp(";;ENDPACKET", line) == 0) {
+    if (spool->marker == XFRD_SPOOL_END) {
         ods_log_verbose("[%s] xfr zone %s on disk complete, commit to db",
             adapter_str, zone->name);
             startpos = 0;
@@ -388,7 +598,7 @@ begin_pkt:
         ods_log_warning("[%s] xfr zone %s on disk incomplete, rollback",
             adapter_str, zone->name);
         namedb_rollback(zone->db, 1);
-        if (ods_strcmp(";;BEGINPACKET", line) == 0) {
+        if (spool->marker == XFRD_SPOOL_BEGIN) {
             result = ODS_STATUS_OK;
             startpos = fpos;
             goto begin_pkt;
@@ -399,7 +609,8 @@ begin_pkt:
     /* otherwise EOF */
     if (result == ODS_STATUS_OK && status != LDNS_STATUS_OK) {
         ods_log_error("[%s] error reading RR at line %i (%s): %s",
-            adapter_str, l, ldns_get_errorstr_by_id(status), line);
+            adapter_str, spool->l, ldns_get_errorstr_by_id(status),
+            addns_spool_text(spool));
         result = ODS_STATUS_ERR;
     }
     /* check the number of SOAs seen */
@@ -477,9 +688,12 @@ static ods_status
 addns_read_file(FILE* fd, zone_type* zone)
 {
     ods_status status = ODS_STATUS_OK;
+    addns_spool_type* spool = NULL;
 
+    CHECKALLOC(spool = (addns_spool_type*) calloc(1, sizeof(addns_spool_type)));
+    spool->fd = fd;
     while (status == ODS_STATUS_OK) {
-        status = addns_read_pkt(fd, zone);
+        status = addns_read_pkt(spool, zone);
         if (status == ODS_STATUS_OK) {
             pthread_mutex_lock(&zone->xfrd->serial_lock);
             zone->xfrd->serial_xfr = adapi_get_serial(zone);
@@ -487,6 +701,9 @@ addns_read_file(FILE* fd, zone_type* zone)
             pthread_mutex_unlock(&zone->xfrd->serial_lock);
         }
     }
+    adreader_cleanup(spool->reader);
+    free(spool->msg);
+    free(spool);
     if (status == ODS_STATUS_EOF) {
         status = ODS_STATUS_OK;
     }
@@ -672,7 +889,7 @@ dnsout_send_notify(void* zone)
         z->name, z->db->intserial);
     rrset = zone_lookup_rrset(z, z->apex, LDNS_RR_TYPE_SOA);
     ods_log_assert(rrset);
-    soa = ldns_rr_clone(rrset->rrs[0].rr);
+    soa = rrset_rr2ldns(rrset, &rrset->rrs[0]);
     notify_enable(z->notify, soa);
 }
 
@@ -772,9 +989,14 @@ addns_write(void* zone)
     char* axfrfile = NULL;
     char* itmpfile = NULL;
     char* ixfrfile = NULL;
+    char* wtmpfile = NULL;
+    char* wirefile = NULL;
+    char* journalfile = NULL;
     zone_type* z = (zone_type*) zone;
     int ret = 0;
     ods_status status = ODS_STATUS_OK;
+    ods_status wirestatus = ODS_STATUS_OK;
+    ods_status journalstatus = ODS_STATUS_OK;
     ods_log_assert(z);
     ods_log_assert(z->name);
     ods_log_assert(z->adoutbound);
@@ -831,11 +1053,37 @@ addns_write(void* zone)
         }
     }
 
+    /* wire format snapshot, so that zone transfers need not parse */
+    wtmpfile = ods_build_path(z->name, ".axfr.wire.tmp", 0, 1);
+    wirefile = ods_build_path(z->name, ".axfr.wire", 0, 1);
+    if (!wtmpfile || !wirefile) {
+        free((void*) atmpfile);
+        free((void*) itmpfile);
+        free((void*) wtmpfile);
+        free((void*) wirefile);
+        return ODS_STATUS_MALLOC_ERR;
+    }
+    fd = ods_fopen(wtmpfile, NULL, "w");
+    if (fd) {
+        wirestatus = axfr_write_wire(fd, z);
+        ods_fclose(fd);
+    } else {
+        wirestatus = ODS_STATUS_FOPEN_ERR;
+    }
+    if (wirestatus != ODS_STATUS_OK) {
+        ods_log_warning("[%s] unable to write zone %s axfr snapshot (%s), "
+            "transfers use the axfr file", adapter_str, z->name,
+            ods_status2str(wirestatus));
+        (void) unlink(wtmpfile);
+    }
+
     /* lock and move */
     axfrfile = ods_build_path(z->name, ".axfr", 0, 1);
     if (!axfrfile) {
         free((void*) atmpfile);
         free((void*) itmpfile);
+        free((void*) wtmpfile);
+        free((void*) wirefile);
         return ODS_STATUS_MALLOC_ERR;
     }
 
@@ -848,12 +1096,32 @@ addns_write(void* zone)
         free((void*) atmpfile);
         free((void*) axfrfile);
         free((void*) itmpfile);
+        free((void*) wtmpfile);
+        free((void*) wirefile);
         return ODS_STATUS_RENAME_ERR;
     }
     free((void*) axfrfile);
     free((void*) atmpfile);
     axfrfile = NULL;
     atmpfile = NULL;
+    /* never leave a snapshot of an older zone behind */
+    if (wirestatus == ODS_STATUS_OK) {
+        ret = rename(wtmpfile, wirefile);
+    }
+    if (wirestatus != ODS_STATUS_OK || ret != 0) {
+        if (wirestatus == ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to rename file %s to %s: %s",
+                adapter_str, wtmpfile, wirefile, strerror(errno));
+        }
+        if (unlink(wirefile) != 0 && errno != ENOENT) {
+            ods_log_error("[%s] unable to remove stale axfr snapshot %s: %s",
+                adapter_str, wirefile, strerror(errno));
+        }
+    }
+    free((void*) wtmpfile);
+    free((void*) wirefile);
+    wtmpfile = NULL;
+    wirefile = NULL;
 
     if (z->db->is_initialized  && z->ixfr->part[0] &&
             z->ixfr->part[0]->soamin && z->ixfr->part[0]->soaplus)
@@ -877,6 +1145,30 @@ addns_write(void* zone)
         }
         free((void*) ixfrfile);
     }
+
+    /* the history that IXFR requests are answered from */
+    if (z->db->is_initialized && z->ixfr->part[0] &&
+            z->ixfr->part[0]->soamin && z->ixfr->part[0]->soaplus) {
+        journalfile = ods_build_path(z->name, ".ixfr.journal", 0, 1);
+        if (!journalfile) {
+            journalstatus = ODS_STATUS_MALLOC_ERR;
+        } else {
+            pthread_mutex_lock(&z->ixfr->ixfr_lock);
+            journalstatus = ixfrjournal_append(journalfile,
+                z->ixfr->part[0]);
+            pthread_mutex_unlock(&z->ixfr->ixfr_lock);
+        }
+        if (journalstatus != ODS_STATUS_OK) {
+            ods_log_warning("[%s] unable to update ixfr journal for zone %s "
+                "(%s), ixfr requests fall back to axfr", adapter_str,
+                z->name, ods_status2str(journalstatus));
+            /* never answer from a history that ends at an older zone */
+            if (journalfile) {
+                (void) unlink(journalfile);
+            }
+        }
+        free((void*) journalfile);
+    }
     free((void*) itmpfile);
     pthread_mutex_unlock(&z->xfr_lock);
 
@@ -33,160 +33,72 @@
 #include "adapter/adapi.h"
 #include "adapter/adapter.h"
 #include "adapter/adfile.h"
-#include "adapter/adutil.h"
+#include "adapter/adreader.h"
 #include "duration.h"
 #include "file.h"
 #include "log.h"
 #include "status.h"
 #include "util.h"
+#include "signer/parallel.h"
 #include "signer/zone.h"
 
 #include <ldns/ldns.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 static const char* adapter_str = "adapter";
-static ods_status adfile_read_file(FILE* fd, zone_type* zone);
 
+/* bytes of zone file per parse job */
+#define ADFILE_CHUNK_MIN (4 * 1024 * 1024)
 
 /**
- * Read the next RR from zone file.
+ * Record read by a parse job.
  *
  */
-static ldns_rr*
-adfile_read_rr(FILE* fd, zone_type* zone, char* line, ldns_rdf** orig,
-    ldns_rdf** prev, uint32_t* ttl, ldns_status* status, unsigned int* l)
-{
-    ldns_rr* rr = NULL;
-    ldns_rdf* tmp = NULL;
-    FILE* fd_include = NULL;
-    int len = 0;
-    ods_status s = ODS_STATUS_OK;
-    uint32_t new_ttl = 0;
-    const char *endptr;  /* unused */
-    int offset = 0;
+struct adfile_entry {
+    ldns_rr* rr;
+    unsigned int line;
+};
 
-adfile_read_line:
-    if (ttl) {
-        new_ttl = *ttl;
-    }
-    len = adutil_readline_frm_file(fd, line, l, 0);
-    adutil_rtrim_line(line, &len);
-    if (len >= 0) {
-        switch (line[0]) {
-            /* directive */
-            case '$':
-                if (strncmp(line, "$ORIGIN", 7) == 0 && isspace((int)line[7])) {
-                    /* copy from ldns */
-                    if (*orig) {
-                        ldns_rdf_deep_free(*orig);
-                        *orig = NULL;
-                    }
-                    offset = 8;
-                    while (isspace((int)line[offset])) {
-                        offset++;
-                    }
-                    tmp = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME,
-                        line + offset);
-                    if (!tmp) {
-                        /* could not parse what next to $ORIGIN */
-                        *status = LDNS_STATUS_SYNTAX_DNAME_ERR;
-                        return NULL;
-                    }
-                    *orig = tmp;
-                    /* end copy from ldns */
-                    goto adfile_read_line; /* perhaps next line is rr */
-                    break;
-                } else if (strncmp(line, "$TTL", 4) == 0 &&
-                    isspace((int)line[4])) {
-                    /* override default ttl */
-                    offset = 5;
-                    while (isspace((int)line[offset])) {
-                        offset++;
-                    }
-                    if (ttl) {
-                        *ttl = ldns_str2period(line + offset, &endptr);
-                        new_ttl = *ttl;
-                    }
-                    goto adfile_read_line; /* perhaps next line is rr */
-                    break;
-                } else if (strncmp(line, "$INCLUDE", 8) == 0 &&
-                    isspace((int)line[8])) {
-                    /* dive into this file */
-                    offset = 9;
-                    while (isspace((int)line[offset])) {
-                        offset++;
-                    }
-                    fd_include = ods_fopen(line + offset, NULL, "r");
-                    if (fd_include) {
-                        s = adfile_read_file(fd_include, zone);
-                        ods_fclose(fd_include);
-                    } else {
-                        ods_log_error("[%s] unable to open include file %s",
-                            adapter_str, (line+offset));
-                        *status = LDNS_STATUS_SYNTAX_ERR;
-                        return NULL;
-                    }
-                    if (s != ODS_STATUS_OK) {
-                        *status = LDNS_STATUS_SYNTAX_ERR;
-                        ods_log_error("[%s] error in include file %s",
-                            adapter_str, (line+offset));
-                        return NULL;
-                    }
-                    /* restore current ttl */
-                    if (ttl) {
-                        *ttl = new_ttl;
-                    }
-                    goto adfile_read_line; /* perhaps next line is rr */
-                    break;
-                }
-                goto adfile_read_rr; /* this can be an owner name */
-                break;
-            /* comments, empty lines */
-            case ';':
-            case '\n':
-                goto adfile_read_line; /* perhaps next line is rr */
-                break;
-            /* let's hope its a RR */
-            default:
-adfile_read_rr:
-                if (adutil_whitespace_line(line, len)) {
-                    goto adfile_read_line; /* perhaps next line is rr */
-                    break;
-                }
-                *status = ldns_rr_new_frm_str(&rr, line, new_ttl, *orig, prev);
-                if (*status == LDNS_STATUS_OK) {
-                    return rr;
-                } else if (*status == LDNS_STATUS_SYNTAX_EMPTY) {
-                    if (rr) {
-                        ldns_rr_free(rr);
-                        rr = NULL;
-                    }
-                    *status = LDNS_STATUS_OK;
-                    goto adfile_read_line; /* perhaps next line is rr */
-                    break;
-                } else {
-                    ods_log_error("[%s] error parsing RR at line %i (%s): %s",
-                        adapter_str, l&&*l?*l:0,
-                        ldns_get_errorstr_by_id(*status), line);
-                    while (len >= 0) {
-                        len = adutil_readline_frm_file(fd, line, l, 0);
-                    }
-                    if (rr) {
-                        ldns_rr_free(rr);
-                        rr = NULL;
-                    }
-                    return NULL;
-                }
-                break;
-        }
+/**
+ * Parse job, reads one chunk of the zone file in a sorted run.
+ *
+ */
+struct adfile_job {
+    const char* filename;
+    adreader_chunk_type* chunk;
+    struct adfile_entry* entries;
+    size_t count;
+    size_t size;
+    size_t next; /* next entry to merge */
+    size_t rr_count;
+    size_t fallback_count;
+    ods_status result;
+    ldns_status status;
+    unsigned int line; /* line of the error */
+    char* text; /* text of the record in error */
+};
+
+
+/**
+ * Input zone ok, examine it and set the inbound serial.
+ *
+ */
+static ods_status
+adfile_read_done(zone_type* zone, uint32_t new_serial)
+{
+    ods_status result = namedb_examine(zone->db);
+    if (result != ODS_STATUS_OK) {
+        ods_log_error("[%s] unable to read file: zonefile contains errors",
+            adapter_str);
+        return result;
     }
-    /* -1, EOF */
-    *status = LDNS_STATUS_OK;
-    return NULL;
+    adapi_set_serial(zone, new_serial);
+    return ODS_STATUS_OK;
 }
 
-
 /**
  * Read zone file.
  *
@@ -195,17 +107,16 @@ static ods_status
 adfile_read_file(FILE* fd, zone_type* zone)
 {
     ods_status result = ODS_STATUS_OK;
+    adreader_type* reader = NULL;
     ldns_rr* rr = NULL;
-    ldns_rdf* prev = NULL;
-    ldns_rdf* orig = NULL;
     ldns_rdf* dname = NULL;
-    uint32_t ttl = 0;
     uint32_t new_serial = 0;
     ldns_status status = LDNS_STATUS_OK;
-    char line[SE_ADFILE_MAXLINE];
     unsigned int line_update_interval = 100000;
     unsigned int line_update = line_update_interval;
     unsigned int l = 0;
+    size_t rr_count = 0;
+    size_t fallback_count = 0;
 
     ods_log_assert(fd);
     ods_log_assert(zone);
@@ -217,27 +128,15 @@ adfile_read_file(FILE* fd, zone_type* zone)
             adapter_str);
         return ODS_STATUS_ERR;
     }
-    orig = ldns_rdf_clone(dname);
-    if (!orig) {
-        ods_log_error("[%s] error setting default value for $ORIGIN",
-            adapter_str);
-        return ODS_STATUS_ERR;
-    }
     /* $TTL <default ttl> */
-    ttl = adapi_get_ttl(zone);
+    reader = adreader_create(fd, dname, adapi_get_ttl(zone), 0);
     /* read RRs */
-    while ((rr = adfile_read_rr(fd, zone, line, &orig, &prev, &ttl,
-        &status, &l)) != NULL) {
-        /* check status */
-        if (status != LDNS_STATUS_OK) {
-            ods_log_error("[%s] error reading RR at line %i (%s): %s",
-                adapter_str, l, ldns_get_errorstr_by_id(status), line);
-            result = ODS_STATUS_ERR;
-            break;
-        }
+    while ((rr = adreader_read_rr(reader, &status)) != NULL) {
+        l = adreader_line(reader);
         /* debug update */
         if (l > line_update) {
-            ods_log_debug("[%s] ...at line %i: %s", adapter_str, l, line);
+            ods_log_debug("[%s] ...at line %i: %s", adapter_str, l,
+                adreader_text(reader));
             line_update += line_update_interval;
         }
         /* SOA? */
@@ -249,42 +148,263 @@ adfile_read_file(FILE* fd, zone_type* zone)
         result = adapi_add_rr(zone, rr, 0);
         if (result == ODS_STATUS_UNCHANGED) {
             ods_log_debug("[%s] skipping RR at line %i (duplicate): %s",
-                adapter_str, l, line);
+                adapter_str, l, adreader_text(reader));
             ldns_rr_free(rr);
             rr = NULL;
             result = ODS_STATUS_OK;
             continue;
         } else if (result != ODS_STATUS_OK) {
             ods_log_error("[%s] error adding RR at line %i: %s",
-                adapter_str, l, line);
+                adapter_str, l, adreader_text(reader));
             ldns_rr_free(rr);
             rr = NULL;
             break;
         }
     }
     /* and done */
-    if (orig) {
-        ldns_rdf_deep_free(orig);
-        orig = NULL;
-    }
-    if (prev) {
-        ldns_rdf_deep_free(prev);
-        prev = NULL;
-    }
     if (result == ODS_STATUS_OK && status != LDNS_STATUS_OK) {
         ods_log_error("[%s] error reading RR at line %i (%s): %s",
-            adapter_str, l, ldns_get_errorstr_by_id(status), line);
+            adapter_str, adreader_line(reader),
+            ldns_get_errorstr_by_id(status), adreader_text(reader));
         result = ODS_STATUS_ERR;
     }
+    adreader_stats(reader, &rr_count, &fallback_count);
+    ods_log_debug("[%s] read %lu RRs, %lu parsed by ldns", adapter_str,
+        (unsigned long) rr_count, (unsigned long) fallback_count);
+    adreader_cleanup(reader);
     /* input zone ok, set inbound serial and apply differences */
     if (result == ODS_STATUS_OK) {
-        result = namedb_examine(zone->db);
+        result = adfile_read_done(zone, new_serial);
+    }
+    return result;
+}
+
+
+/**
+ * Compare records by owner name, and by line for the same owner name.
+ *
+ */
+static int
+adfile_entry_compare(const void* a, const void* b)
+{
+    const struct adfile_entry* x = (const struct adfile_entry*) a;
+    const struct adfile_entry* y = (const struct adfile_entry*) b;
+    int c = ldns_dname_compare(ldns_rr_owner(x->rr), ldns_rr_owner(y->rr));
+    if (c != 0) {
+        return c;
+    }
+    return x->line < y->line ? -1 : (x->line > y->line ? 1 : 0);
+}
+
+
+/**
+ * Parse one chunk of the zone file.
+ *
+ */
+static void
+adfile_parse_run(void* arg)
+{
+    struct adfile_job* job = (struct adfile_job*) arg;
+    adreader_type* reader = NULL;
+    ldns_rr* rr = NULL;
+    FILE* fd = NULL;
+
+    job->result = ODS_STATUS_OK;
+    job->status = LDNS_STATUS_OK;
+    fd = ods_fopen(job->filename, NULL, "r");
+    if (!fd) {
+        job->result = ODS_STATUS_FOPEN_ERR;
+        return;
+    }
+    if (fseek(fd, job->chunk->start, SEEK_SET) != 0) {
+        ods_fclose(fd);
+        job->result = ODS_STATUS_FREAD_ERR;
+        return;
+    }
+    reader = adreader_create(fd, job->chunk->orig, job->chunk->ttl, 0);
+    adreader_set_chunk(reader, job->chunk);
+    while ((rr = adreader_read_rr(reader, &job->status)) != NULL) {
+        if (job->count == job->size) {
+            job->size = job->size ? job->size * 2 : 1024;
+            CHECKALLOC(job->entries = (struct adfile_entry*) realloc(
+                job->entries, job->size * sizeof(struct adfile_entry)));
+        }
+        job->entries[job->count].rr = rr;
+        job->entries[job->count].line = adreader_line(reader);
+        job->count++;
+    }
+    if (job->status != LDNS_STATUS_OK) {
+        job->result = ODS_STATUS_ERR;
+        job->line = adreader_line(reader);
+        job->text = strdup(adreader_text(reader));
+    } else {
+        qsort(job->entries, job->count, sizeof(struct adfile_entry),
+            adfile_entry_compare);
+    }
+    adreader_stats(reader, &job->rr_count, &job->fallback_count);
+    adreader_cleanup(reader);
+    ods_fclose(fd);
+}
+
+
+/**
+ * Is the next record of one job before that of another.
+ *
+ */
+static int
+adfile_merge_less(struct adfile_job* jobs, size_t a, size_t b)
+{
+    int c = adfile_entry_compare(&jobs[a].entries[jobs[a].next],
+        &jobs[b].entries[jobs[b].next]);
+    return c < 0 || (c == 0 && a < b);
+}
+
+
+/**
+ * Restore the heap of jobs with records left to merge, from position i.
+ *
+ */
+static void
+adfile_merge_sift(struct adfile_job* jobs, size_t* heap, size_t count,
+    size_t i)
+{
+    size_t child, tmp;
+    while ((child = 2 * i + 1) < count) {
+        if (child + 1 < count &&
+            adfile_merge_less(jobs, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!adfile_merge_less(jobs, heap[child], heap[i])) {
+            break;
+        }
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+
+/**
+ * Read zone file in chunks, parsed by the worker reading the zone and
+ * the drudgers that pick them up from the signing queue. The sorted
+ * runs of the chunks are merged into the zone in one ordered pass.
+ *
+ */
+static ods_status
+adfile_read_parallel(FILE* fd, zone_type* zone, const char* filename,
+    size_t njobs)
+{
+    ods_status result = ODS_STATUS_OK;
+    adreader_chunk_type* chunks = NULL;
+    struct adfile_job* jobs = NULL;
+    struct adfile_entry* entry = NULL;
+    size_t* heap = NULL;
+    size_t nchunks = njobs;
+    size_t nheap = 0;
+    size_t rr_count = 0;
+    size_t fallback_count = 0;
+    size_t i, j;
+    ldns_rdf* dname = NULL;
+    uint32_t new_serial = 0;
+
+    dname = adapi_get_origin(zone);
+    if (!dname) {
+        ods_log_error("[%s] error getting default value for $ORIGIN",
+            adapter_str);
+        return ODS_STATUS_ERR;
+    }
+    chunks = adreader_split(fd, dname, adapi_get_ttl(zone), &nchunks);
+    if (!chunks || nchunks < 2) {
+        /* no safe boundaries, or $INCLUDE: read it in one go */
+        adreader_chunks_cleanup(chunks, nchunks);
+        rewind(fd);
+        return adfile_read_file(fd, zone);
+    }
+    CHECKALLOC(jobs = (struct adfile_job*) calloc(nchunks,
+        sizeof(struct adfile_job)));
+    for (i = 0; i < nchunks; i++) {
+        jobs[i].filename = filename;
+        jobs[i].chunk = &chunks[i];
+    }
+    parallel_run(adfile_parse_run, jobs, sizeof(struct adfile_job), nchunks);
+    for (i = 0; i < nchunks; i++) {
+        rr_count += jobs[i].rr_count;
+        fallback_count += jobs[i].fallback_count;
+        if (result == ODS_STATUS_OK && jobs[i].result != ODS_STATUS_OK) {
+            /* report the first error in the file */
+            if (jobs[i].status != LDNS_STATUS_OK) {
+                ods_log_error("[%s] error reading RR at line %i (%s): %s",
+                    adapter_str, jobs[i].line,
+                    ldns_get_errorstr_by_id(jobs[i].status),
+                    jobs[i].text ? jobs[i].text : "");
+                result = ODS_STATUS_ERR;
+            } else {
+                ods_log_error("[%s] unable to read file %s: %s", adapter_str,
+                    filename, ods_status2str(jobs[i].result));
+                result = jobs[i].result;
+            }
+        }
+    }
+    ods_log_debug("[%s] read %lu RRs in %lu chunks, %lu parsed by ldns",
+        adapter_str, (unsigned long) rr_count, (unsigned long) nchunks,
+        (unsigned long) fallback_count);
+    /* merge the runs */
+    CHECKALLOC(heap = (size_t*) malloc(nchunks * sizeof(size_t)));
+    if (result == ODS_STATUS_OK) {
+        for (i = 0; i < nchunks; i++) {
+            if (jobs[i].count) {
+                heap[nheap++] = i;
+            }
+        }
+        for (i = nheap; i > 0; i--) {
+            adfile_merge_sift(jobs, heap, nheap, i - 1);
+        }
+    }
+    while (nheap) {
+        j = heap[0];
+        entry = &jobs[j].entries[jobs[j].next];
+        /* SOA? */
+        if (ldns_rr_get_type(entry->rr) == LDNS_RR_TYPE_SOA) {
+            new_serial = ldns_rdf2native_int32(
+                ldns_rr_rdf(entry->rr, SE_SOA_RDATA_SERIAL));
+        }
+        /* add to the database */
+        result = adapi_add_rr(zone, entry->rr, 0);
+        if (result == ODS_STATUS_UNCHANGED) {
+            ods_log_debug("[%s] skipping RR at line %i (duplicate)",
+                adapter_str, entry->line);
+            ldns_rr_free(entry->rr);
+            result = ODS_STATUS_OK;
+        } else if (result != ODS_STATUS_OK) {
+            ods_log_error("[%s] error adding RR at line %i", adapter_str,
+                entry->line);
+            ldns_rr_free(entry->rr);
+        }
+        entry->rr = NULL;
+        jobs[j].next++;
         if (result != ODS_STATUS_OK) {
-            ods_log_error("[%s] unable to read file: zonefile contains errors",
-                adapter_str);
-            return result;
+            break;
+        }
+        if (jobs[j].next == jobs[j].count) {
+            heap[0] = heap[--nheap];
+        }
+        adfile_merge_sift(jobs, heap, nheap, 0);
+    }
+    /* clean up what was not merged */
+    for (i = 0; i < nchunks; i++) {
+        for (j = jobs[i].next; j < jobs[i].count; j++) {
+            ldns_rr_free(jobs[i].entries[j].rr);
         }
-        adapi_set_serial(zone, new_serial);
+        free(jobs[i].entries);
+        free(jobs[i].text);
+    }
+    free(heap);
+    free(jobs);
+    adreader_chunks_cleanup(chunks, nchunks);
+    /* input zone ok, set inbound serial and apply differences */
+    if (result == ODS_STATUS_OK) {
+        result = adfile_read_done(zone, new_serial);
     }
     return result;
 }
@@ -300,6 +420,8 @@ adfile_read(void* zone)
     FILE* fd = NULL;
     zone_type* adzone = (zone_type*) zone;
     ods_status status = ODS_STATUS_OK;
+    struct stat st;
+    size_t njobs = 1;
     if (!adzone || !adzone->adinbound || !adzone->adinbound->configstr) {
         ods_log_error("[%s] unable to read file: no input adapter",
             adapter_str);
@@ -309,7 +431,15 @@ adfile_read(void* zone)
     if (!fd) {
         return ODS_STATUS_FOPEN_ERR;
     }
-    status = adfile_read_file(fd, adzone);
+    if (fstat(fileno(fd), &st) == 0 && st.st_size > 0) {
+        njobs = parallel_jobs((size_t) st.st_size, ADFILE_CHUNK_MIN);
+    }
+    if (njobs > 1) {
+        status = adfile_read_parallel(fd, adzone,
+            adzone->adinbound->configstr, njobs);
+    } else {
+        status = adfile_read_file(fd, adzone);
+    }
     ods_fclose(fd);
     if (status == ODS_STATUS_OK) {
         adapi_trans_full(zone, 0);
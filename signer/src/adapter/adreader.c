@@ -0,0 +1,1144 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Zone file reader.
+ *
+ */
+
+#include "config.h"
+#include "adapter/adreader.h"
+#include "file.h"
+#include "log.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char* adreader_str = "adapter";
+
+/**
+ * File being read, with the state of the including file.
+ *
+ */
+typedef struct adreader_file_struct adreader_file_type;
+struct adreader_file_struct {
+    adreader_file_type* parent;
+    FILE* fd;
+    char* buf;
+    size_t len;
+    size_t pos;
+    long offset; /* position in the file of buf[0] */
+    long limit; /* end of the chunk being read, -1 for none */
+    unsigned int line; /* newlines seen */
+    ldns_rdf* orig;
+    ldns_rdf* prev;
+    uint32_t ttl;
+};
+
+/**
+ * Token of a record, as part of the record text.
+ *
+ */
+typedef struct adreader_token_struct adreader_token_type;
+struct adreader_token_struct {
+    size_t pos;
+    size_t len;
+    unsigned quoted : 1;
+};
+
+struct adreader_struct {
+    adreader_file_type* file;
+    size_t depth;
+    int flags;
+    ldns_rdf* orig;
+    ldns_rdf* prev;
+    uint32_t ttl;
+    /* last record */
+    unsigned int line;
+    char* text;
+    size_t text_len;
+    size_t text_size;
+    adreader_token_type* tokens;
+    size_t token_count;
+    size_t token_size;
+    char* scratch;
+    size_t scratch_size;
+    unsigned owner_omitted : 1;
+    unsigned escaped : 1;
+    unsigned marker : 1;
+    /* statistics */
+    size_t rr_count;
+    size_t fallback_count;
+};
+
+
+/**
+ * Create file being read.
+ *
+ */
+static adreader_file_type*
+adreader_file_create(FILE* fd)
+{
+    adreader_file_type* file = NULL;
+    CHECKALLOC(file = (adreader_file_type*) calloc(1,
+        sizeof(adreader_file_type)));
+    CHECKALLOC(file->buf = (char*) malloc(ADREADER_BUFSIZE));
+    file->fd = fd;
+    file->offset = ftell(fd);
+    file->limit = -1;
+    return file;
+}
+
+
+/**
+ * Create zone file reader.
+ *
+ */
+adreader_type*
+adreader_create(FILE* fd, ldns_rdf* orig, uint32_t ttl, int flags)
+{
+    adreader_type* reader = NULL;
+    ods_log_assert(fd);
+    CHECKALLOC(reader = (adreader_type*) calloc(1, sizeof(adreader_type)));
+    reader->file = adreader_file_create(fd);
+    reader->flags = flags;
+    reader->text_size = 256;
+    CHECKALLOC(reader->text = (char*) malloc(reader->text_size));
+    reader->text[0] = '\0';
+    reader->token_size = 16;
+    CHECKALLOC(reader->tokens = (adreader_token_type*) malloc(
+        reader->token_size * sizeof(adreader_token_type)));
+    reader->scratch_size = 256;
+    CHECKALLOC(reader->scratch = (char*) malloc(reader->scratch_size));
+    adreader_reset(reader, orig, ttl);
+    return reader;
+}
+
+
+/**
+ * Limit the reader to a chunk of the file.
+ *
+ */
+void
+adreader_set_chunk(adreader_type* reader, adreader_chunk_type* chunk)
+{
+    ods_log_assert(reader);
+    ods_log_assert(chunk);
+    reader->file->limit = chunk->end;
+    reader->file->line = chunk->line;
+}
+
+
+/**
+ * Reset $ORIGIN and $TTL, and forget the previous owner name.
+ *
+ */
+void
+adreader_reset(adreader_type* reader, ldns_rdf* orig, uint32_t ttl)
+{
+    ods_log_assert(reader);
+    ldns_rdf_deep_free(reader->orig);
+    ldns_rdf_deep_free(reader->prev);
+    reader->orig = orig ? ldns_rdf_clone(orig) : NULL;
+    reader->prev = NULL;
+    reader->ttl = ttl;
+}
+
+
+/**
+ * Refill the buffer, return the next character.
+ *
+ */
+static int
+adreader_fill(adreader_file_type* file)
+{
+    size_t size = ADREADER_BUFSIZE;
+    file->offset += (long) file->len;
+    file->pos = 0;
+    if (file->limit >= 0 && file->offset + (long) size > file->limit) {
+        size = file->offset < file->limit ?
+            (size_t) (file->limit - file->offset) : 0;
+    }
+    file->len = size ? fread(file->buf, 1, size, file->fd) : 0;
+    if (file->len == 0) {
+        return EOF;
+    }
+    return (unsigned char) file->buf[file->pos++];
+}
+
+#define adreader_getc(f) ((f)->pos < (f)->len ? \
+    (int) (unsigned char) (f)->buf[(f)->pos++] : adreader_fill(f))
+
+
+/**
+ * Look at the next character, without reading it.
+ *
+ */
+static int
+adreader_peek(adreader_file_type* file)
+{
+    int c = adreader_getc(file);
+    if (c != EOF) {
+        file->pos--;
+    }
+    return c;
+}
+
+
+/**
+ * Append character to the record text.
+ *
+ */
+static void
+adreader_append(adreader_type* reader, int c)
+{
+    if (reader->text_len + 2 > reader->text_size) {
+        reader->text_size *= 2;
+        CHECKALLOC(reader->text = (char*) realloc(reader->text,
+            reader->text_size));
+    }
+    reader->text[reader->text_len++] = (char) c;
+}
+
+
+/**
+ * Start a new token in the record text.
+ *
+ */
+static void
+adreader_token_start(adreader_type* reader, int quoted)
+{
+    if (reader->token_count == reader->token_size) {
+        reader->token_size *= 2;
+        CHECKALLOC(reader->tokens = (adreader_token_type*) realloc(
+            reader->tokens, reader->token_size * sizeof(adreader_token_type)));
+    }
+    if (reader->token_count) {
+        adreader_append(reader, ' ');
+    } else {
+        reader->line = reader->file->line + 1;
+        if (reader->owner_omitted) {
+            /* ldns takes the previous owner for a leading blank */
+            adreader_append(reader, ' ');
+        }
+    }
+    reader->tokens[reader->token_count].pos = reader->text_len;
+    reader->tokens[reader->token_count].len = 0;
+    reader->tokens[reader->token_count].quoted = quoted;
+    reader->token_count++;
+}
+
+
+/**
+ * End the token in the record text.
+ *
+ */
+static void
+adreader_token_end(adreader_type* reader, int* in_token)
+{
+    adreader_token_type* token = NULL;
+    if (*in_token) {
+        token = &reader->tokens[reader->token_count - 1];
+        token->len = reader->text_len - token->pos;
+        *in_token = 0;
+    }
+}
+
+
+/**
+ * Scan the next record: its tokens, up to the end of the line that is
+ * not inside parentheses. Comments are skipped.
+ * Returns 1 if a record or marker was read, 0 at end of file, -1 on
+ * error.
+ *
+ */
+static int
+adreader_scan(adreader_type* reader)
+{
+    adreader_file_type* file = reader->file;
+    int c = 0;
+    int depth = 0;
+    int in_token = 0;
+    int in_quote = 0;
+    int bol = 1;
+
+    reader->text_len = 0;
+    reader->token_count = 0;
+    reader->owner_omitted = 0;
+    reader->escaped = 0;
+    reader->marker = 0;
+    reader->text[0] = '\0';
+    while (1) {
+        c = adreader_getc(file);
+        if (c == EOF) {
+            adreader_token_end(reader, &in_token);
+            reader->text[reader->text_len] = '\0';
+            if (in_quote || depth) {
+                ods_log_error("[%s] read line: %s mismatch discovered at "
+                    "line %u, missing '%c'", adreader_str,
+                    in_quote ? "quote" : "bracket", reader->line,
+                    in_quote ? '"' : ')');
+                return -1;
+            }
+            return reader->token_count ? 1 : 0;
+        }
+        if (in_quote) {
+            adreader_append(reader, c);
+            if (c == '\\') {
+                c = adreader_getc(file);
+                if (c == EOF) {
+                    continue;
+                }
+                adreader_append(reader, c);
+                reader->escaped = 1;
+            } else if (c == '"') {
+                in_quote = 0;
+                in_token = 1;
+                adreader_token_end(reader, &in_token);
+            }
+            if (c == '\n') {
+                file->line++;
+            }
+            continue;
+        }
+        switch (c) {
+            case '\n':
+                file->line++;
+                adreader_token_end(reader, &in_token);
+                if (depth == 0 && reader->token_count) {
+                    reader->text[reader->text_len] = '\0';
+                    return 1;
+                }
+                if (reader->token_count == 0) {
+                    reader->owner_omitted = 0;
+                }
+                bol = 1;
+                break;
+            case ' ':
+            case '\t':
+            case '\r':
+                if (bol && depth == 0 && reader->token_count == 0) {
+                    reader->owner_omitted = 1;
+                }
+                adreader_token_end(reader, &in_token);
+                bol = 0;
+                break;
+            case ';':
+                adreader_token_end(reader, &in_token);
+                if (bol && depth == 0 && reader->token_count == 0 &&
+                    (reader->flags & ADREADER_MARKERS) &&
+                    adreader_peek(file) == ';') {
+                    /* marker line */
+                    reader->line = file->line + 1;
+                    adreader_append(reader, c);
+                    while ((c = adreader_getc(file)) != EOF && c != '\n') {
+                        adreader_append(reader, c);
+                    }
+                    if (c == '\n') {
+                        file->line++;
+                    }
+                    while (reader->text_len > 0 &&
+                        isspace((unsigned char)
+                        reader->text[reader->text_len - 1])) {
+                        reader->text_len--;
+                    }
+                    reader->text[reader->text_len] = '\0';
+                    reader->marker = 1;
+                    return 1;
+                }
+                /* comment, up to the end of the line */
+                while ((c = adreader_getc(file)) != EOF && c != '\n') {
+                    /* skip */
+                }
+                if (c == '\n') {
+                    /* end of line is handled above */
+                    file->pos--;
+                }
+                break;
+            case '(':
+                adreader_token_end(reader, &in_token);
+                depth++;
+                bol = 0;
+                break;
+            case ')':
+                adreader_token_end(reader, &in_token);
+                if (depth == 0) {
+                    ods_log_error("[%s] read line: bracket mismatch "
+                        "discovered at line %u, missing '('", adreader_str,
+                        file->line + 1);
+                    reader->text[reader->text_len] = '\0';
+                    return -1;
+                }
+                depth--;
+                break;
+            case '"':
+                adreader_token_end(reader, &in_token);
+                adreader_token_start(reader, 1);
+                adreader_append(reader, c);
+                in_quote = 1;
+                bol = 0;
+                break;
+            case '\\':
+                if (!in_token) {
+                    adreader_token_start(reader, 0);
+                    in_token = 1;
+                }
+                adreader_append(reader, c);
+                c = adreader_getc(file);
+                if (c != EOF) {
+                    adreader_append(reader, c);
+                    if (c == '\n') {
+                        file->line++;
+                    }
+                }
+                reader->escaped = 1;
+                bol = 0;
+                break;
+            default:
+                if (!in_token) {
+                    adreader_token_start(reader, 0);
+                    in_token = 1;
+                }
+                adreader_append(reader, c);
+                bol = 0;
+                break;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Get a token as string, without quotes.
+ *
+ */
+static const char*
+adreader_token(adreader_type* reader, size_t i)
+{
+    adreader_token_type* token = &reader->tokens[i];
+    const char* str = reader->text + token->pos;
+    size_t len = token->len;
+    if (token->quoted) {
+        str++;
+        len = len > 1 ? len - 2 : 0;
+    }
+    if (len + 1 > reader->scratch_size) {
+        while (len + 1 > reader->scratch_size) {
+            reader->scratch_size *= 2;
+        }
+        CHECKALLOC(reader->scratch = (char*) realloc(reader->scratch,
+            reader->scratch_size));
+    }
+    memcpy(reader->scratch, str, len);
+    reader->scratch[len] = '\0';
+    return reader->scratch;
+}
+
+
+/**
+ * Get the tokens from i onwards as one string, without the blanks
+ * between them.
+ *
+ */
+static const char*
+adreader_token_join(adreader_type* reader, size_t i)
+{
+    size_t len = 0, j = 0;
+    for (j = i; j < reader->token_count; j++) {
+        len += reader->tokens[j].len;
+    }
+    if (len + 1 > reader->scratch_size) {
+        while (len + 1 > reader->scratch_size) {
+            reader->scratch_size *= 2;
+        }
+        CHECKALLOC(reader->scratch = (char*) realloc(reader->scratch,
+            reader->scratch_size));
+    }
+    len = 0;
+    for (j = i; j < reader->token_count; j++) {
+        memcpy(reader->scratch + len, reader->text + reader->tokens[j].pos,
+            reader->tokens[j].len);
+        len += reader->tokens[j].len;
+    }
+    reader->scratch[len] = '\0';
+    return reader->scratch;
+}
+
+
+/**
+ * Convert a domain name without escapes to wire format. Relative
+ * names are made absolute with $ORIGIN. Returns NULL if the name is
+ * not valid.
+ *
+ */
+static ldns_rdf*
+adreader_dname(adreader_type* reader, size_t i)
+{
+    uint8_t wire[LDNS_MAX_DOMAINLEN + 1];
+    adreader_token_type* token = &reader->tokens[i];
+    const char* str = reader->text + token->pos;
+    size_t len = token->len;
+    size_t start = 0, w = 0, n = 0, j = 0;
+
+    if (token->quoted || len == 0) {
+        return NULL;
+    }
+    if (len == 1 && str[0] == '@') {
+        return reader->orig ? ldns_rdf_clone(reader->orig) : NULL;
+    }
+    if (len == 1 && str[0] == '.') {
+        wire[0] = 0;
+        return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_DNAME, 1, wire);
+    }
+    for (j = 0; j <= len; j++) {
+        if (j < len && str[j] != '.') {
+            continue;
+        }
+        if (j == len && start == len) {
+            /* absolute */
+            break;
+        }
+        n = j - start;
+        if (n == 0 || n > LDNS_MAX_LABELLEN ||
+            w + n + 1 > LDNS_MAX_DOMAINLEN) {
+            return NULL;
+        }
+        wire[w++] = (uint8_t) n;
+        memcpy(wire + w, str + start, n);
+        w += n;
+        start = j + 1;
+    }
+    if (str[len - 1] == '.') {
+        if (w + 1 > LDNS_MAX_DOMAINLEN) {
+            return NULL;
+        }
+        wire[w++] = 0;
+    } else {
+        /* relative */
+        if (!reader->orig ||
+            w + ldns_rdf_size(reader->orig) > LDNS_MAX_DOMAINLEN) {
+            return NULL;
+        }
+        memcpy(wire + w, ldns_rdf_data(reader->orig),
+            ldns_rdf_size(reader->orig));
+        w += ldns_rdf_size(reader->orig);
+    }
+    return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_DNAME, w, wire);
+}
+
+
+/**
+ * Convert any domain name, with ldns if it has escapes.
+ *
+ */
+static ldns_rdf*
+adreader_name(adreader_type* reader, size_t i)
+{
+    ldns_rdf* dname = NULL;
+    ldns_rdf* tmp = NULL;
+    const char* str = NULL;
+    dname = adreader_dname(reader, i);
+    if (dname) {
+        return dname;
+    }
+    str = adreader_token(reader, i);
+    dname = ldns_dname_new_frm_str(str);
+    if (dname && !ldns_dname_str_absolute(str) && reader->orig) {
+        tmp = dname;
+        dname = ldns_dname_cat_clone(tmp, reader->orig);
+        ldns_rdf_deep_free(tmp);
+    }
+    return dname;
+}
+
+
+/**
+ * Build RR directly from the tokens. Returns NULL if the record should
+ * be left to ldns.
+ *
+ */
+static ldns_rr*
+adreader_build(adreader_type* reader)
+{
+    const ldns_rr_descriptor* desc = NULL;
+    ldns_rr* rr = NULL;
+    ldns_rdf* owner = NULL;
+    ldns_rdf* rdf = NULL;
+    ldns_rr_class klass = LDNS_RR_CLASS_IN;
+    ldns_rr_class c = 0;
+    ldns_rr_type type = 0;
+    ldns_rdf_type ftype = LDNS_RDF_TYPE_NONE;
+    uint32_t ttl = reader->ttl ? reader->ttl : LDNS_DEFAULT_TTL;
+    const char* str = NULL;
+    const char* endptr = NULL;
+    size_t i = 0, f = 0, n = 0, max = 0;
+
+    if (reader->escaped) {
+        return NULL;
+    }
+    /* owner */
+    if (reader->owner_omitted) {
+        if (!reader->prev) {
+            return NULL;
+        }
+        owner = ldns_rdf_clone(reader->prev);
+    } else {
+        owner = adreader_dname(reader, 0);
+        i = 1;
+    }
+    if (!owner) {
+        return NULL;
+    }
+    /* ttl and class, in any order */
+    for (n = 0; n < 2 && i < reader->token_count; n++) {
+        str = adreader_token(reader, i);
+        if (isdigit((unsigned char) str[0])) {
+            ttl = ldns_str2period(str, &endptr);
+            if (*endptr != '\0') {
+                goto build_failed;
+            }
+        } else if ((c = ldns_get_rr_class_by_name(str)) != 0) {
+            klass = c;
+        } else {
+            break;
+        }
+        i++;
+    }
+    /* type */
+    if (i >= reader->token_count) {
+        goto build_failed;
+    }
+    type = ldns_get_rr_type_by_name(adreader_token(reader, i));
+    desc = ldns_rr_descript(type);
+    if (!type || !desc) {
+        goto build_failed;
+    }
+    i++;
+    rr = ldns_rr_new();
+    if (!rr) {
+        goto build_failed;
+    }
+    ldns_rr_set_owner(rr, owner);
+    owner = NULL;
+    ldns_rr_set_ttl(rr, ttl);
+    ldns_rr_set_class(rr, klass);
+    ldns_rr_set_type(rr, type);
+    /* rdata, one token per field */
+    max = ldns_rr_descriptor_maximum(desc);
+    for (f = 0; i < reader->token_count; f++, i++) {
+        if (f >= max) {
+            goto build_failed;
+        }
+        ftype = ldns_rr_descriptor_field_type(desc, f);
+        if (reader->tokens[i].quoted && ftype != LDNS_RDF_TYPE_STR) {
+            goto build_failed;
+        }
+        switch (ftype) {
+            case LDNS_RDF_TYPE_DNAME:
+                rdf = adreader_dname(reader, i);
+                break;
+            case LDNS_RDF_TYPE_B64:
+            case LDNS_RDF_TYPE_HEX:
+                if (f + 1 == max) {
+                    /* last field, may be split in blanks */
+                    rdf = ldns_rdf_new_frm_str(ftype,
+                        adreader_token_join(reader, i));
+                    i = reader->token_count - 1;
+                } else {
+                    rdf = ldns_rdf_new_frm_str(ftype,
+                        adreader_token(reader, i));
+                }
+                break;
+            case LDNS_RDF_TYPE_A:
+            case LDNS_RDF_TYPE_AAAA:
+            case LDNS_RDF_TYPE_INT8:
+            case LDNS_RDF_TYPE_INT16:
+            case LDNS_RDF_TYPE_INT32:
+            case LDNS_RDF_TYPE_PERIOD:
+            case LDNS_RDF_TYPE_TIME:
+            case LDNS_RDF_TYPE_TYPE:
+            case LDNS_RDF_TYPE_ALG:
+            case LDNS_RDF_TYPE_STR:
+            case LDNS_RDF_TYPE_NSEC3_SALT:
+                rdf = ldns_rdf_new_frm_str(ftype, adreader_token(reader, i));
+                break;
+            default:
+                rdf = NULL;
+                break;
+        }
+        if (!rdf) {
+            goto build_failed;
+        }
+        ldns_rr_push_rdf(rr, rdf);
+    }
+    if (f < ldns_rr_descriptor_minimum(desc)) {
+        goto build_failed;
+    }
+    ldns_rdf_deep_free(reader->prev);
+    reader->prev = ldns_rdf_clone(ldns_rr_owner(rr));
+    return rr;
+
+build_failed:
+    ldns_rdf_deep_free(owner);
+    ldns_rr_free(rr);
+    return NULL;
+}
+
+
+/**
+ * Parse the record.
+ *
+ */
+static ldns_rr*
+adreader_parse(adreader_type* reader, ldns_status* status)
+{
+    ldns_rr* rr = adreader_build(reader);
+    if (rr) {
+        *status = LDNS_STATUS_OK;
+        return rr;
+    }
+    /* leave it to ldns */
+    reader->fallback_count++;
+    *status = ldns_rr_new_frm_str(&rr, reader->text, reader->ttl,
+        reader->orig, &reader->prev);
+    if (*status != LDNS_STATUS_OK && rr) {
+        ldns_rr_free(rr);
+        rr = NULL;
+    }
+    return rr;
+}
+
+
+/**
+ * Enter $INCLUDE file.
+ *
+ */
+static int
+adreader_include(adreader_type* reader, ldns_rdf* orig)
+{
+    adreader_file_type* file = NULL;
+    FILE* fd = NULL;
+    const char* filename = adreader_token(reader, 1);
+
+    if (reader->depth >= ADREADER_MAXINCLUDE) {
+        ods_log_error("[%s] unable to include file %s: too many nested "
+            "includes", adreader_str, filename);
+        return 0;
+    }
+    fd = ods_fopen(filename, NULL, "r");
+    if (!fd) {
+        ods_log_error("[%s] unable to open include file %s", adreader_str,
+            filename);
+        return 0;
+    }
+    file = adreader_file_create(fd);
+    file->parent = reader->file;
+    file->orig = reader->orig;
+    file->prev = reader->prev;
+    file->ttl = reader->ttl;
+    reader->file = file;
+    reader->depth++;
+    reader->orig = orig ? orig :
+        (file->orig ? ldns_rdf_clone(file->orig) : NULL);
+    reader->prev = NULL;
+    return 1;
+}
+
+
+/**
+ * Leave $INCLUDE file, restore the state of the including file.
+ *
+ */
+static void
+adreader_include_end(adreader_type* reader)
+{
+    adreader_file_type* file = reader->file;
+    ods_log_assert(file->parent);
+    ods_fclose(file->fd);
+    ldns_rdf_deep_free(reader->orig);
+    ldns_rdf_deep_free(reader->prev);
+    reader->orig = file->orig;
+    reader->prev = file->prev;
+    reader->ttl = file->ttl;
+    reader->file = file->parent;
+    reader->depth--;
+    free(file->buf);
+    free(file);
+}
+
+
+/**
+ * Handle directive. Returns 1 if handled, 0 if the record is not a
+ * directive, -1 on error.
+ *
+ */
+static int
+adreader_directive(adreader_type* reader, ldns_status* status)
+{
+    const char* str = reader->text + reader->tokens[0].pos;
+    size_t len = reader->tokens[0].len;
+    const char* endptr = NULL;
+    ldns_rdf* dname = NULL;
+
+    if (len == 7 && strncmp(str, "$ORIGIN", 7) == 0) {
+        if (reader->token_count < 2 ||
+            !(dname = adreader_name(reader, 1))) {
+            /* could not parse what next to $ORIGIN */
+            *status = LDNS_STATUS_SYNTAX_DNAME_ERR;
+            return -1;
+        }
+        ldns_rdf_deep_free(reader->orig);
+        reader->orig = dname;
+        return 1;
+    } else if (len == 4 && strncmp(str, "$TTL", 4) == 0) {
+        if (reader->token_count < 2) {
+            *status = LDNS_STATUS_SYNTAX_TTL_ERR;
+            return -1;
+        }
+        reader->ttl = ldns_str2period(adreader_token(reader, 1), &endptr);
+        return 1;
+    } else if (len == 8 && strncmp(str, "$INCLUDE", 8) == 0) {
+        if (reader->token_count < 2) {
+            *status = LDNS_STATUS_SYNTAX_ERR;
+            return -1;
+        }
+        if (reader->token_count > 2 && !(dname = adreader_name(reader, 2))) {
+            *status = LDNS_STATUS_SYNTAX_DNAME_ERR;
+            return -1;
+        }
+        if (!adreader_include(reader, dname)) {
+            ldns_rdf_deep_free(dname);
+            *status = LDNS_STATUS_SYNTAX_ERR;
+            return -1;
+        }
+        return 1;
+    }
+    /* this can be an owner name */
+    return 0;
+}
+
+
+/**
+ * Read the next RR.
+ *
+ */
+ldns_rr*
+adreader_read_rr(adreader_type* reader, ldns_status* status)
+{
+    ldns_rr* rr = NULL;
+    int ret = 0;
+
+    ods_log_assert(reader);
+    ods_log_assert(status);
+    while (1) {
+        ret = adreader_scan(reader);
+        if (ret < 0) {
+            *status = LDNS_STATUS_SYNTAX_ERR;
+            return NULL;
+        }
+        if (ret == 0) {
+            if (!reader->file->parent) {
+                /* EOF */
+                *status = LDNS_STATUS_OK;
+                return NULL;
+            }
+            adreader_include_end(reader);
+            continue;
+        }
+        if (reader->marker) {
+            *status = LDNS_STATUS_OK;
+            return NULL;
+        }
+        if (!reader->owner_omitted &&
+            reader->text[reader->tokens[0].pos] == '$') {
+            ret = adreader_directive(reader, status);
+            if (ret < 0) {
+                ods_log_error("[%s] error parsing directive at line %u "
+                    "(%s): %s", adreader_str, reader->line,
+                    ldns_get_errorstr_by_id(*status), reader->text);
+                return NULL;
+            } else if (ret > 0) {
+                continue;
+            }
+        }
+        rr = adreader_parse(reader, status);
+        if (*status == LDNS_STATUS_SYNTAX_EMPTY) {
+            *status = LDNS_STATUS_OK;
+            continue;
+        }
+        if (!rr) {
+            ods_log_error("[%s] error parsing RR at line %u (%s): %s",
+                adreader_str, reader->line, ldns_get_errorstr_by_id(*status),
+                reader->text);
+            return NULL;
+        }
+        reader->rr_count++;
+        return rr;
+    }
+    return NULL;
+}
+
+
+/**
+ * Start a new chunk.
+ *
+ */
+static void
+adreader_chunk_start(adreader_type* reader, adreader_chunk_type* chunk,
+    long start)
+{
+    chunk->start = start;
+    chunk->end = -1;
+    chunk->line = reader->file->line;
+    chunk->orig = reader->orig ? ldns_rdf_clone(reader->orig) : NULL;
+    chunk->ttl = reader->ttl;
+}
+
+
+/**
+ * Split a zone file in chunks that can be read in parallel.
+ *
+ */
+adreader_chunk_type*
+adreader_split(FILE* fd, ldns_rdf* orig, uint32_t ttl, size_t* count)
+{
+    adreader_type* reader = NULL;
+    adreader_file_type* file = NULL;
+    adreader_chunk_type* chunks = NULL;
+    ldns_status status = LDNS_STATUS_OK;
+    struct stat st;
+    long start = 0, size = 0, target = 0, pos = 0;
+    size_t n = 0;
+    int c = 0;
+    int depth = 0;
+    int in_quote = 0;
+    int bol = 1;
+
+    ods_log_assert(fd);
+    ods_log_assert(count);
+    if (*count < 2 || fstat(fileno(fd), &st) != 0) {
+        return NULL;
+    }
+    reader = adreader_create(fd, orig, ttl, 0);
+    file = reader->file;
+    start = file->offset;
+    size = (long) st.st_size - start;
+    CHECKALLOC(chunks = (adreader_chunk_type*) calloc(*count,
+        sizeof(adreader_chunk_type)));
+    adreader_chunk_start(reader, &chunks[n++], start);
+    target = start + size / (long) *count;
+    while ((c = adreader_getc(file)) != EOF) {
+        if (bol && depth == 0) {
+            pos = file->offset + (long) file->pos - 1;
+            if (c == '$') {
+                /* directive, or an owner name */
+                file->pos--;
+                if (adreader_scan(reader) < 0) {
+                    goto split_failed;
+                }
+                if (reader->token_count && reader->tokens[0].len == 8 &&
+                    strncmp(reader->text + reader->tokens[0].pos,
+                    "$INCLUDE", 8) == 0) {
+                    goto split_failed;
+                }
+                if (reader->token_count &&
+                    adreader_directive(reader, &status) < 0) {
+                    goto split_failed;
+                }
+                continue;
+            }
+            if (pos >= target && n < *count && !isspace(c) && c != ';' &&
+                c != '(' && c != ')' && c != '"') {
+                /* a record with an owner name: safe boundary */
+                chunks[n - 1].end = pos;
+                adreader_chunk_start(reader, &chunks[n++], pos);
+                target = start + (long) ((size / (long) *count) * n);
+            }
+        }
+        bol = 0;
+        switch (c) {
+            case '\n':
+                file->line++;
+                bol = !in_quote;
+                break;
+            case '\\':
+                c = adreader_getc(file);
+                if (c == '\n') {
+                    file->line++;
+                }
+                break;
+            case '"':
+                in_quote = !in_quote;
+                break;
+            case ';':
+                if (in_quote) {
+                    break;
+                }
+                while ((c = adreader_getc(file)) != EOF && c != '\n') {
+                    /* skip */
+                }
+                if (c == '\n') {
+                    file->pos--;
+                }
+                break;
+            case '(':
+                if (!in_quote) {
+                    depth++;
+                }
+                break;
+            case ')':
+                if (!in_quote && depth > 0) {
+                    depth--;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    adreader_cleanup(reader);
+    *count = n;
+    return chunks;
+
+split_failed:
+    adreader_cleanup(reader);
+    adreader_chunks_cleanup(chunks, n);
+    return NULL;
+}
+
+
+/**
+ * Clean up chunks.
+ *
+ */
+void
+adreader_chunks_cleanup(adreader_chunk_type* chunks, size_t count)
+{
+    size_t i;
+    if (!chunks) {
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        ldns_rdf_deep_free(chunks[i].orig);
+    }
+    free(chunks);
+}
+
+
+/**
+ * Get the marker line that stopped the last read.
+ *
+ */
+const char*
+adreader_marker(adreader_type* reader)
+{
+    if (!reader || !reader->marker) {
+        return NULL;
+    }
+    return reader->text;
+}
+
+
+/**
+ * Get the text of the last record read.
+ *
+ */
+const char*
+adreader_text(adreader_type* reader)
+{
+    if (!reader) {
+        return "";
+    }
+    return reader->text;
+}
+
+
+/**
+ * Get the line number the last record read started at.
+ *
+ */
+unsigned int
+adreader_line(adreader_type* reader)
+{
+    if (!reader) {
+        return 0;
+    }
+    return reader->line;
+}
+
+
+/**
+ * Get the position in the file of the reader.
+ *
+ */
+long
+adreader_tell(adreader_type* reader)
+{
+    ods_log_assert(reader);
+    return reader->file->offset + (long) reader->file->pos;
+}
+
+
+/**
+ * Get the number of RRs read.
+ *
+ */
+void
+adreader_stats(adreader_type* reader, size_t* count, size_t* fallback)
+{
+    ods_log_assert(reader);
+    if (count) {
+        *count = reader->rr_count;
+    }
+    if (fallback) {
+        *fallback = reader->fallback_count;
+    }
+}
+
+
+/**
+ * Clean up zone file reader.
+ *
+ */
+void
+adreader_cleanup(adreader_type* reader)
+{
+    if (!reader) {
+        return;
+    }
+    while (reader->file->parent) {
+        adreader_include_end(reader);
+    }
+    ldns_rdf_deep_free(reader->orig);
+    ldns_rdf_deep_free(reader->prev);
+    free(reader->file->buf);
+    free(reader->file);
+    free(reader->text);
+    free(reader->tokens);
+    free(reader->scratch);
+    free(reader);
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Zone file reader.
+ *
+ */
+
+#ifndef ADAPTER_ADREADER_H
+#define ADAPTER_ADREADER_H
+
+#include "config.h"
+
+#include <stdio.h>
+#include <ldns/ldns.h>
+
+#define ADREADER_BUFSIZE 65536 /* bytes read from the file at a time */
+#define ADREADER_MAXINCLUDE 16 /* nesting depth of $INCLUDE files */
+
+/* Stop at comment lines that start with ;; and report them as marker. */
+#define ADREADER_MARKERS 0x01
+
+typedef struct adreader_struct adreader_type;
+
+/**
+ * Part of a zone file that can be read on its own. It starts with a
+ * record that has an owner name, at a line outside of parentheses.
+ *
+ */
+typedef struct adreader_chunk_struct adreader_chunk_type;
+struct adreader_chunk_struct {
+    long start;
+    long end; /* -1 for the end of the file */
+    unsigned int line; /* lines before the chunk */
+    ldns_rdf* orig; /* $ORIGIN at the start of the chunk */
+    uint32_t ttl; /* $TTL at the start of the chunk */
+};
+
+/**
+ * Create zone file reader. The file is read in blocks and tokenized
+ * by the reader. RRs of the common types are built directly from the
+ * tokens, others are parsed by ldns.
+ * \param[in] fd open zone file, not closed by the reader
+ * \param[in] orig initial $ORIGIN, copied by the reader (may be NULL)
+ * \param[in] ttl initial $TTL
+ * \param[in] flags ADREADER_* flags
+ * \return adreader_type* zone file reader
+ *
+ */
+adreader_type* adreader_create(FILE* fd, ldns_rdf* orig, uint32_t ttl,
+    int flags);
+
+/**
+ * Limit the reader to a chunk of the file. The file must be positioned
+ * at the start of the chunk when the reader is created.
+ * \param[in] reader zone file reader
+ * \param[in] chunk chunk of the file
+ *
+ */
+void adreader_set_chunk(adreader_type* reader, adreader_chunk_type* chunk);
+
+/**
+ * Split a zone file in chunks that can be read in parallel. The file
+ * is scanned once, for record boundaries and directives, without
+ * parsing the records.
+ * \param[in] fd open zone file, positioned at the start
+ * \param[in] orig initial $ORIGIN (may be NULL)
+ * \param[in] ttl initial $TTL
+ * \param[in,out] count in: chunks wanted, out: chunks found
+ * \return adreader_chunk_type* chunks, NULL if the file can not be
+ *                              split, for example if it uses $INCLUDE
+ *
+ */
+adreader_chunk_type* adreader_split(FILE* fd, ldns_rdf* orig, uint32_t ttl,
+    size_t* count);
+
+/**
+ * Clean up chunks.
+ * \param[in] chunks chunks
+ * \param[in] count number of chunks
+ *
+ */
+void adreader_chunks_cleanup(adreader_chunk_type* chunks, size_t count);
+
+/**
+ * Reset $ORIGIN and $TTL, and forget the previous owner name.
+ * \param[in] reader zone file reader
+ * \param[in] orig $ORIGIN, copied by the reader (may be NULL)
+ * \param[in] ttl $TTL
+ *
+ */
+void adreader_reset(adreader_type* reader, ldns_rdf* orig, uint32_t ttl);
+
+/**
+ * Read the next RR. Directives are handled by the reader.
+ * \param[in] reader zone file reader
+ * \param[out] status LDNS_STATUS_OK, or the parse error
+ * \return ldns_rr* RR, NULL at end of file, at a marker or on error
+ *
+ */
+ldns_rr* adreader_read_rr(adreader_type* reader, ldns_status* status);
+
+/**
+ * Get the marker line that stopped the last read.
+ * \param[in] reader zone file reader
+ * \return const char* marker line, NULL if the read was not stopped
+ *                     by a marker
+ *
+ */
+const char* adreader_marker(adreader_type* reader);
+
+/**
+ * Get the text of the last record read, for logging.
+ * \param[in] reader zone file reader
+ * \return const char* text of the record
+ *
+ */
+const char* adreader_text(adreader_type* reader);
+
+/**
+ * Get the line number the last record read started at.
+ * \param[in] reader zone file reader
+ * \return unsigned int line number
+ *
+ */
+unsigned int adreader_line(adreader_type* reader);
+
+/**
+ * Get the position in the file of the reader, like ftell(). Only
+ * meaningful outside of $INCLUDE files.
+ * \param[in] reader zone file reader
+ * \return long position in the file
+ *
+ */
+long adreader_tell(adreader_type* reader);
+
+/**
+ * Get the number of RRs read, and the number of those that were
+ * parsed by ldns.
+ * \param[in] reader zone file reader
+ * \param[out] count RRs read
+ * \param[out] fallback RRs parsed by ldns
+ *
+ */
+void adreader_stats(adreader_type* reader, size_t* count, size_t* fallback);
+
+/**
+ * Clean up zone file reader. Files opened for $INCLUDE are closed.
+ * \param[in] reader zone file reader
+ *
+ */
+void adreader_cleanup(adreader_type* reader);
+
+#endif /* ADAPTER_ADREADER_H */
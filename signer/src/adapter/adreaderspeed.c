@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Measure the throughput of the zone file reader.
+ *
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <ldns/ldns.h>
+
+#include "adapter/adreader.h"
+#include "adapter/adutil.h"
+
+extern char *optarg;
+extern int optind;
+char *progname = NULL;
+
+static void
+usage ()
+{
+    fprintf(stderr, "usage: %s [-o origin] [-r rounds] zonefile\n",
+        progname);
+}
+
+/* The line reader the file adapter used before, for comparison */
+static size_t
+read_lines (FILE* fd, ldns_rdf* origin)
+{
+    static char line[SE_ADFILE_MAXLINE];
+    ldns_rdf* orig = ldns_rdf_clone(origin);
+    ldns_rdf* prev = NULL;
+    ldns_rr* rr = NULL;
+    ldns_status status;
+    const char* endptr;
+    unsigned int l = 0;
+    uint32_t ttl = 0;
+    size_t count = 0;
+    int len;
+
+    while ((len = adutil_readline_frm_file(fd, line, &l, 0)) >= 0) {
+        adutil_rtrim_line(line, &len);
+        if (len <= 0 || line[0] == ';' || line[0] == '\n' ||
+            adutil_whitespace_line(line, len)) {
+            continue;
+        }
+        if (strncmp(line, "$ORIGIN", 7) == 0) {
+            ldns_rdf_deep_free(orig);
+            orig = ldns_dname_new_frm_str(line + 8);
+            continue;
+        } else if (strncmp(line, "$TTL", 4) == 0) {
+            ttl = ldns_str2period(line + 5, &endptr);
+            continue;
+        }
+        status = ldns_rr_new_frm_str(&rr, line, ttl, orig, &prev);
+        if (status != LDNS_STATUS_OK) {
+            fprintf(stderr, "line %u: %s: %s\n", l,
+                ldns_get_errorstr_by_id(status), line);
+            exit(1);
+        }
+        ldns_rr_free(rr);
+        count++;
+    }
+    ldns_rdf_deep_free(orig);
+    ldns_rdf_deep_free(prev);
+    return count;
+}
+
+static size_t
+read_tokens (FILE* fd, ldns_rdf* origin, size_t* fallback)
+{
+    adreader_type* reader = adreader_create(fd, origin, 0, 0);
+    ldns_rr* rr = NULL;
+    ldns_status status;
+    size_t count = 0;
+
+    while ((rr = adreader_read_rr(reader, &status)) != NULL) {
+        ldns_rr_free(rr);
+    }
+    if (status != LDNS_STATUS_OK) {
+        fprintf(stderr, "line %u: %s: %s\n", adreader_line(reader),
+            ldns_get_errorstr_by_id(status), adreader_text(reader));
+        exit(1);
+    }
+    adreader_stats(reader, &count, fallback);
+    adreader_cleanup(reader);
+    return count;
+}
+
+static double
+run (const char* zonefile, ldns_rdf* origin, int tokens, size_t* count,
+    size_t* fallback)
+{
+    static struct timeval start,end;
+    FILE* fd;
+
+    fd = fopen(zonefile, "r");
+    if (!fd) {
+        fprintf(stderr, "unable to open %s\n", zonefile);
+        exit(1);
+    }
+    gettimeofday(&start, NULL);
+    if (tokens) {
+        *count = read_tokens(fd, origin, fallback);
+    } else {
+        *count = read_lines(fd, origin);
+    }
+    gettimeofday(&end, NULL);
+    fclose(fd);
+
+    end.tv_sec -= start.tv_sec;
+    end.tv_usec-= start.tv_usec;
+    return (double)(end.tv_sec)+(double)(end.tv_usec)*.000001;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+    const char* originstr = ".";
+    ldns_rdf* origin = NULL;
+    unsigned int rounds = 1;
+    unsigned int n;
+    size_t count = 0, fallback = 0;
+    double elapsed;
+    struct stat st;
+    int ch, tokens;
+
+    progname = argv[0];
+
+    while ((ch = getopt(argc, argv, "o:r:")) != -1) {
+        switch (ch) {
+        case 'o':
+            originstr = optarg;
+            break;
+        case 'r':
+            rounds = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || rounds < 1) {
+        usage();
+        exit(1);
+    }
+    origin = ldns_dname_new_frm_str(originstr);
+    if (!origin) {
+        fprintf(stderr, "bad origin %s\n", originstr);
+        exit(1);
+    }
+    if (stat(argv[optind], &st) != 0) {
+        fprintf(stderr, "unable to stat %s\n", argv[optind]);
+        exit(1);
+    }
+
+    for (n = 0; n < rounds; n++) {
+        for (tokens = 0; tokens <= 1; tokens++) {
+            elapsed = run(argv[optind], origin, tokens, &count, &fallback);
+            printf("%-8s %lu RRs in %.2fs, %.0f RRs/s, %.1f MB/s",
+                (tokens ? "adreader" : "readline"), (unsigned long) count,
+                elapsed, count / elapsed, st.st_size / elapsed / 1048576);
+            if (tokens) {
+                printf(", %lu parsed by ldns", (unsigned long) fallback);
+            }
+            printf("\n");
+        }
+    }
+    ldns_rdf_deep_free(origin);
+    return 0;
+}
@@ -52,53 +52,49 @@ engine_config(const char* cfgfile, int cmdline_verbosity)
 {
     engineconfig_type* ecfg;
     const char* rngfile = ODS_SE_RNGDIR "/conf.rng";
-    FILE* cfgfd = NULL;
+    xmlXPathContextPtr xpathCtx = NULL;
 
     if (!cfgfile) {
         return NULL;
     }
-    /* check syntax (slows down parsing configuration file) */
-    if (parse_file_check(cfgfile, rngfile) != ODS_STATUS_OK) {
+    /* parse the file once and check syntax */
+    if (parse_file_open(cfgfile, rngfile, &xpathCtx) != ODS_STATUS_OK) {
         ods_log_error("[%s] unable to create config: parse error in %s",
             conf_str, cfgfile);
         return NULL;
     }
-    /* open cfgfile */
-    cfgfd = ods_fopen(cfgfile, NULL, "r");
-    if (cfgfd) {
-        ods_log_verbose("[%s] read cfgfile: %s", conf_str, cfgfile);
-        /* create config */
-        CHECKALLOC(ecfg = (engineconfig_type*) malloc(sizeof(engineconfig_type)));
-        /* get values */
-        ecfg->cfg_filename = strdup(cfgfile);
-        ecfg->zonelist_filename = parse_conf_zonelist_filename(cfgfile);
-        ecfg->log_filename = parse_conf_log_filename(cfgfile);
-        ecfg->pid_filename = parse_conf_pid_filename(cfgfile);
-        ecfg->notify_command = parse_conf_notify_command(cfgfile);
-        ecfg->clisock_filename = parse_conf_clisock_filename(cfgfile);
-        ecfg->working_dir = parse_conf_working_dir(cfgfile);
-        ecfg->username = parse_conf_username(cfgfile);
-        ecfg->group = parse_conf_group(cfgfile);
-        ecfg->chroot = parse_conf_chroot(cfgfile);
-        ecfg->use_syslog = parse_conf_use_syslog(cfgfile);
-        ecfg->num_worker_threads = parse_conf_worker_threads(cfgfile);
-        ecfg->num_signer_threads = parse_conf_signer_threads(cfgfile);
-        /* If any verbosity has been specified at cmd line we will use that */
-        if (cmdline_verbosity > 0) {
-        	ecfg->verbosity = cmdline_verbosity;
-        }
-        else {
-        	ecfg->verbosity = parse_conf_verbosity(cfgfile);
-        }
-        ecfg->interfaces = parse_conf_listener(cfgfile);
-        ecfg->repositories = parse_conf_repositories(cfgfile);
-        /* done */
-        ods_fclose(cfgfd);
-        return ecfg;
+    ods_log_verbose("[%s] read cfgfile: %s", conf_str, cfgfile);
+    /* create config */
+    CHECKALLOC(ecfg = (engineconfig_type*) malloc(sizeof(engineconfig_type)));
+    /* get values */
+    ecfg->cfg_filename = strdup(cfgfile);
+    ecfg->zonelist_filename = parse_conf_zonelist_filename(xpathCtx);
+    ecfg->log_filename = parse_conf_log_filename(xpathCtx);
+    ecfg->pid_filename = parse_conf_pid_filename(xpathCtx);
+    ecfg->notify_command = parse_conf_notify_command(xpathCtx);
+    ecfg->clisock_filename = parse_conf_clisock_filename(xpathCtx);
+    ecfg->working_dir = parse_conf_working_dir(xpathCtx);
+    ecfg->username = parse_conf_username(xpathCtx);
+    ecfg->group = parse_conf_group(xpathCtx);
+    ecfg->chroot = parse_conf_chroot(xpathCtx);
+    ecfg->use_syslog = parse_conf_use_syslog(xpathCtx);
+    ecfg->num_worker_threads = parse_conf_worker_threads(xpathCtx);
+    ecfg->num_signer_threads = parse_conf_signer_threads(xpathCtx);
+    ecfg->signer_batch_size = parse_conf_signer_batch_size(xpathCtx);
+    ecfg->ixfr_history = parse_conf_ixfr_history(xpathCtx);
+    ecfg->num_listener_threads = parse_conf_listener_threads(xpathCtx);
+    /* If any verbosity has been specified at cmd line we will use that */
+    if (cmdline_verbosity > 0) {
+    	ecfg->verbosity = cmdline_verbosity;
+    }
+    else {
+    	ecfg->verbosity = parse_conf_verbosity(xpathCtx);
     }
-    ods_log_error("[%s] unable to create config: failed to open file %s",
-        conf_str, cfgfile);
-    return NULL;
+    ecfg->interfaces = parse_conf_listener(xpathCtx);
+    ecfg->repositories = parse_conf_repositories(xpathCtx);
+    /* done */
+    parse_file_close(xpathCtx);
+    return ecfg;
 }
 
 
@@ -196,6 +192,8 @@ engine_config_print(FILE* out, engineconfig_type* config)
         if (config->interfaces) {
              size_t i = 0;
              fprintf(out, "\t\t<Listener>\n");
+             fprintf(out, "\t\t\t<Threads>%i</Threads>\n",
+                 config->num_listener_threads);
 
              for (i=0; i < config->interfaces->count; i++) {
                  fprintf(out, "\t\t\t<Interface>");
@@ -219,6 +217,10 @@ engine_config_print(FILE* out, engineconfig_type* config)
             config->num_worker_threads);
         fprintf(out, "\t\t<SignerThreads>%i</SignerThreads>\n",
             config->num_signer_threads);
+        fprintf(out, "\t\t<SignerBatchSize>%i</SignerBatchSize>\n",
+            config->signer_batch_size);
+        fprintf(out, "\t\t<IxfrHistory>%i</IxfrHistory>\n",
+            config->ixfr_history);
         if (config->notify_command) {
             fprintf(out, "\t\t<NotifyCommand>%s</NotifyCommand>\n",
                 config->notify_command);
@@ -58,6 +58,9 @@ struct engineconfig_struct {
     int use_syslog;
     int num_worker_threads;
     int num_signer_threads;
+    int signer_batch_size;
+    int ixfr_history;
+    int num_listener_threads;
     int verbosity;
 };
 
@@ -48,9 +48,10 @@ static void dnshandler_handle_xfr(netio_type* netio,
  *
  */
 dnshandler_type*
-dnshandler_create(listener_type* interfaces)
+dnshandler_create(listener_type* interfaces, int threads)
 {
     dnshandler_type* dnsh = NULL;
+    size_t i = 0, j = 0;
     if (!interfaces || interfaces->count <= 0) {
         return NULL;
     }
@@ -63,30 +64,33 @@ dnshandler_create(listener_type* interfaces)
     dnsh->need_to_exit = 0;
     dnsh->engine = NULL;
     dnsh->interfaces = interfaces;
-    dnsh->socklist = NULL;
-    dnsh->netio = NULL;
-    dnsh->query = NULL;
+    dnsh->thread_id = 0;
+    dnsh->thread_count = threads > 0 ? (size_t) threads : 1;
     /* setup */
-    CHECKALLOC(dnsh->socklist = (socklist_type*) malloc(sizeof(socklist_type)));
-    if (!dnsh->socklist) {
-        ods_log_error("[%s] unable to create socklist: "
-            "allocator_alloc() failed", dnsh_str);
-        dnshandler_cleanup(dnsh);
-        return NULL;
-    }
-    dnsh->netio = netio_create();
-    if (!dnsh->netio) {
-        ods_log_error("[%s] unable to create dnshandler: "
-            "netio_create() failed", dnsh_str);
-        dnshandler_cleanup(dnsh);
-        return NULL;
-    }
-    dnsh->query = query_create();
-    if (!dnsh->query) {
-        ods_log_error("[%s] unable to create dnshandler: "
-            "query_create() failed", dnsh_str);
-        dnshandler_cleanup(dnsh);
-        return NULL;
+    CHECKALLOC(dnsh->threads = (dnsthread_type*) calloc(dnsh->thread_count,
+        sizeof(dnsthread_type)));
+    for (i=0; i < dnsh->thread_count; i++) {
+        dnsthread_type* thread = &dnsh->threads[i];
+        thread->dnshandler = dnsh;
+        CHECKALLOC(thread->socklist = (socklist_type*) malloc(sizeof(socklist_type)));
+        for (j=0; j < MAX_INTERFACES; j++) {
+            thread->socklist->udp[j].s = -1;
+            thread->socklist->tcp[j].s = -1;
+        }
+        thread->netio = netio_create();
+        if (!thread->netio) {
+            ods_log_error("[%s] unable to create dnshandler: "
+                "netio_create() failed", dnsh_str);
+            dnshandler_cleanup(dnsh);
+            return NULL;
+        }
+        thread->query = query_create();
+        if (!thread->query) {
+            ods_log_error("[%s] unable to create dnshandler: "
+                "query_create() failed", dnsh_str);
+            dnshandler_cleanup(dnsh);
+            return NULL;
+        }
     }
     dnsh->xfrhandler.fd = -1;
     dnsh->xfrhandler.user_data = (void*) dnsh;
@@ -97,6 +101,29 @@ dnshandler_create(listener_type* interfaces)
 }
 
 
+/**
+ * Close the sockets in the socket list.
+ *
+ */
+static void
+dnshandler_close(dnshandler_type* dnshandler, socklist_type* socklist)
+{
+    size_t i = 0;
+    for (i = 0; i < dnshandler->interfaces->count; i++) {
+        if (socklist->udp[i].s != -1) {
+            close(socklist->udp[i].s);
+            freeaddrinfo((void*)socklist->udp[i].addr);
+            socklist->udp[i].s = -1;
+        }
+        if (socklist->tcp[i].s != -1) {
+            close(socklist->tcp[i].s);
+            freeaddrinfo((void*)socklist->tcp[i].addr);
+            socklist->tcp[i].s = -1;
+        }
+    }
+}
+
+
 /**
  * Start dns handler listener.
  *
@@ -105,33 +132,54 @@ ods_status
 dnshandler_listen(dnshandler_type* dnshandler)
 {
     ods_status status = ODS_STATUS_OK;
+    size_t i = 0;
+    int reuseport = 0;
     ods_log_assert(dnshandler);
-    status = sock_listen(dnshandler->socklist, dnshandler->interfaces);
+#ifdef SO_REUSEPORT
+    reuseport = dnshandler->thread_count > 1;
+#endif
+    status = sock_listen(dnshandler->threads[0].socklist,
+        dnshandler->interfaces, reuseport);
     if (status != ODS_STATUS_OK) {
         ods_log_error("[%s] unable to start: sock_listen() "
             "failed (%s)", dnsh_str, ods_status2str(status));
         dnshandler->thread_id = 0;
+        return status;
+    }
+    for (i=1; i < dnshandler->thread_count; i++) {
+        dnsthread_type* thread = &dnshandler->threads[i];
+        if (reuseport) {
+            status = sock_listen(thread->socklist, dnshandler->interfaces,
+                reuseport);
+            if (status == ODS_STATUS_OK) {
+                continue;
+            }
+            ods_log_warning("[%s] unable to listen with SO_REUSEPORT (%s), "
+                "threads will share sockets", dnsh_str,
+                ods_status2str(status));
+            dnshandler_close(dnshandler, thread->socklist);
+            reuseport = 0;
+        }
+        /* all threads wait on the same sockets */
+        free(thread->socklist);
+        thread->socklist = dnshandler->threads[0].socklist;
     }
-    return status;
+    return ODS_STATUS_OK;
 }
 
 
 /**
- * Start dns handler.
+ * Run dns handler thread.
  *
  */
-void
-dnshandler_start(dnshandler_type* dnshandler)
+static void
+dnshandler_run(dnsthread_type* thread)
 {
     size_t i = 0;
-    engine_type* engine = NULL;
+    dnshandler_type* dnshandler = thread->dnshandler;
+    engine_type* engine = dnshandler->engine;
     netio_handler_type* tcp_accept_handlers = NULL;
 
-    ods_log_assert(dnshandler);
-    ods_log_assert(dnshandler->engine);
-    ods_log_debug("[%s] start", dnsh_str);
-
-    engine = dnshandler->engine;
     /* udp */
     for (i=0; i < dnshandler->interfaces->count; i++) {
         struct udp_data* data = NULL;
@@ -144,9 +192,9 @@ dnshandler_start(dnshandler_type* dnshandler)
             engine->need_to_exit = 1;
             break;
         }
-        data->query = dnshandler->query;
-        data->engine = dnshandler->engine;
-        data->socket = &dnshandler->socklist->udp[i];
+        data->query = thread->query;
+        data->engine = engine;
+        data->socket = &thread->socklist->udp[i];
         CHECKALLOC(handler = (netio_handler_type*) malloc(sizeof(netio_handler_type)));
         if (!handler) {
             ods_log_error("[%s] unable to start: allocator_alloc() "
@@ -156,14 +204,14 @@ dnshandler_start(dnshandler_type* dnshandler)
             engine->need_to_exit = 1;
             break;
         }
-        handler->fd = dnshandler->socklist->udp[i].s;
+        handler->fd = thread->socklist->udp[i].s;
         handler->timeout = NULL;
         handler->user_data = data;
         handler->event_types = NETIO_EVENT_READ;
         handler->event_handler = sock_handle_udp;
         ods_log_debug("[%s] add udp network handler fd %u", dnsh_str,
             (unsigned) handler->fd);
-        netio_add_handler(dnshandler->netio, handler);
+        netio_add_handler(thread->netio, handler);
     }
     /* tcp */
     CHECKALLOC(tcp_accept_handlers = (netio_handler_type*) malloc(dnshandler->interfaces->count * sizeof(netio_handler_type)));
@@ -178,24 +226,24 @@ dnshandler_start(dnshandler_type* dnshandler)
             engine->need_to_exit = 1;
             return;
         }
-        data->engine = dnshandler->engine;
-        data->socket = &dnshandler->socklist->udp[i];
+        data->engine = engine;
+        data->socket = &thread->socklist->udp[i];
         data->tcp_accept_handler_count = dnshandler->interfaces->count;
         data->tcp_accept_handlers = tcp_accept_handlers;
         handler = &tcp_accept_handlers[i];
-        handler->fd = dnshandler->socklist->tcp[i].s;
+        handler->fd = thread->socklist->tcp[i].s;
         handler->timeout = NULL;
         handler->user_data = data;
         handler->event_types = NETIO_EVENT_READ;
         handler->event_handler = sock_handle_tcp_accept;
         ods_log_debug("[%s] add tcp network handler fd %u", dnsh_str,
             (unsigned) handler->fd);
-        netio_add_handler(dnshandler->netio, handler);
+        netio_add_handler(thread->netio, handler);
     }
     /* service */
     while (dnshandler->need_to_exit == 0) {
         ods_log_deeebug("[%s] netio dispatch", dnsh_str);
-        if (netio_dispatch(dnshandler->netio, NULL, NULL) == -1) {
+        if (netio_dispatch(thread->netio, NULL, NULL) == -1) {
             if (errno != EINTR) {
                 ods_log_error("[%s] unable to dispatch netio: %s", dnsh_str,
                     strerror(errno));
@@ -203,19 +251,39 @@ dnshandler_start(dnshandler_type* dnshandler)
             }
         }
     }
+    free(tcp_accept_handlers);
+}
+
+
+/**
+ * Start dns handler.
+ *
+ */
+void
+dnshandler_start(dnshandler_type* dnshandler)
+{
+    size_t i = 0;
+
+    ods_log_assert(dnshandler);
+    ods_log_assert(dnshandler->engine);
+    ods_log_debug("[%s] start %u threads", dnsh_str,
+        (unsigned) dnshandler->thread_count);
+
+    for (i=1; i < dnshandler->thread_count; i++) {
+        janitor_thread_create(&dnshandler->threads[i].thread_id,
+            handlerthreadclass, (janitor_runfn_t) dnshandler_run,
+            &dnshandler->threads[i]);
+    }
+    dnshandler_run(&dnshandler->threads[0]);
     /* shutdown */
     ods_log_debug("[%s] shutdown", dnsh_str);
-    free(tcp_accept_handlers);
- /*   for (i=0; i < dnshandler->interfaces->count; i++) {
-        if (dnshandler->socklist->udp[i].s != -1) {
-            close(dnshandler->socklist->udp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->udp[i].addr);
-        }
-        if (dnshandler->socklist->tcp[i].s != -1) {
-            close(dnshandler->socklist->tcp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->tcp[i].addr);
+    for (i=1; i < dnshandler->thread_count; i++) {
+        if (dnshandler->threads[i].thread_id) {
+            janitor_thread_signal(dnshandler->threads[i].thread_id);
+            janitor_thread_join(dnshandler->threads[i].thread_id);
+            dnshandler->threads[i].thread_id = 0;
         }
-    }*/
+    }
 }
 
 
@@ -226,8 +294,14 @@ dnshandler_start(dnshandler_type* dnshandler)
 void
 dnshandler_signal(dnshandler_type* dnshandler)
 {
+    size_t i = 0;
     if (dnshandler && dnshandler->thread_id) {
         janitor_thread_signal(dnshandler->thread_id);
+        for (i=1; i < dnshandler->thread_count; i++) {
+            if (dnshandler->threads[i].thread_id) {
+                janitor_thread_signal(dnshandler->threads[i].thread_id);
+            }
+        }
     }
 }
 
@@ -289,20 +363,20 @@ dnshandler_cleanup(dnshandler_type* dnshandler)
     if (!dnshandler) {
         return;
     }
-    netio_cleanup(dnshandler->netio);
-    query_cleanup(dnshandler->query);
-
-
-    for (i = 0; i < dnshandler->interfaces->count; i++) {
-        if (dnshandler->socklist->udp[i].s != -1) {
-            close(dnshandler->socklist->udp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->udp[i].addr);
+    for (i = 0; i < dnshandler->thread_count; i++) {
+        dnsthread_type* thread = &dnshandler->threads[i];
+        if (thread->netio) {
+            netio_cleanup(thread->netio);
+        }
+        query_cleanup(thread->query);
+        if (i > 0 && thread->socklist == dnshandler->threads[0].socklist) {
+            continue;
+        }
+        if (thread->socklist) {
+            dnshandler_close(dnshandler, thread->socklist);
+            free(thread->socklist);
         }
-        if (dnshandler->socklist->tcp[i].s != -1) {
-            close(dnshandler->socklist->tcp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->tcp[i].addr);
-        }  
     }
-    free(dnshandler->socklist);
+    free(dnshandler->threads);
     free(dnshandler);
 }
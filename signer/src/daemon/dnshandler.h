@@ -36,6 +36,7 @@
 #include <stdint.h>
 
 typedef struct dnshandler_struct dnshandler_type;
+typedef struct dnsthread_struct dnsthread_type;
 
 #include "status.h"
 #include "locks.h"
@@ -48,25 +49,38 @@ typedef struct dnshandler_struct dnshandler_type;
 #define ODS_SE_NOTIFY_CMD "NOTIFY"
 #define ODS_SE_MAX_HANDLERS 5
 
+/**
+ * DNS handler thread. Every thread has its own sockets, bound with
+ * SO_REUSEPORT so the kernel spreads the queries over the threads,
+ * its own event loop and its own query.
+ *
+ */
+struct dnsthread_struct {
+    janitor_thread_t thread_id;
+    dnshandler_type* dnshandler;
+    socklist_type* socklist; /* may be shared with the first thread */
+    netio_type* netio;
+    query_type* query;
+};
+
 struct dnshandler_struct {
     janitor_thread_t thread_id;
     engine_type* engine;
     listener_type* interfaces;
-    socklist_type* socklist;
-    netio_type* netio;
-    query_type* query;
+    dnsthread_type* threads;
+    size_t thread_count;
     netio_handler_type xfrhandler;
     unsigned need_to_exit;
 };
 
 /**
  * Create dns handler.
- * \param[in] allocator memory allocator
  * \param[in] interfaces list of interfaces
+ * \param[in] threads number of threads
  * \return dnshandler_type* created dns handler
  *
  */
-dnshandler_type* dnshandler_create(listener_type* interfaces);
+dnshandler_type* dnshandler_create(listener_type* interfaces, int threads);
 
 /**
  * Start dns handler listener.
@@ -77,7 +91,7 @@ dnshandler_type* dnshandler_create(listener_type* interfaces);
 ods_status dnshandler_listen(dnshandler_type* dnshandler);
 
 /**
- * Start dns handler.
+ * Start dns handler. Runs the first thread and starts the others.
  * \param[in] dnshandler_type* dns handler
  *
  */
@@ -41,6 +41,8 @@
 #include "privdrop.h"
 #include "status.h"
 #include "util.h"
+#include "signer/ixfrjournal.h"
+#include "signer/parallel.h"
 #include "signer/zonelist.h"
 #include "wire/tsig.h"
 #include "libhsm.h"
@@ -85,6 +87,8 @@ engine_create(void)
     engine->daemonize = 0;
     engine->need_to_exit = 0;
     engine->need_to_reload = 0;
+    engine->recover_total = 0;
+    engine->recover_done = 0;
     pthread_mutex_init(&engine->signal_lock, NULL);
     pthread_cond_init(&engine->signal_cond, NULL);
     engine->zonelist = zonelist_create();
@@ -99,6 +103,7 @@ engine_create(void)
     schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_FORCEREAD, do_forcereadzone);
     schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_SIGN, do_signzone);
     schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_WRITE, do_writezone);
+    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_RECOVER, do_recoverzone);
     if (!engine->taskq) {
         engine_cleanup(engine);
         return NULL;
@@ -245,11 +250,14 @@ engine_start_workers(engine_type* engine)
     ods_log_assert(engine);
     ods_log_assert(engine->config);
     ods_log_debug("[%s] start workers", engine_str);
+    parallel_setup(engine->taskq->signq, engine->config->num_signer_threads);
+    ixfrjournal_set_depth(engine->config->ixfr_history);
     for (i=0; i < engine->config->num_worker_threads; i++,threadCount++) {
         CHECKALLOC(context = malloc(sizeof(struct worker_context)));
         context->engine = engine;
         context->worker = engine->workers[threadCount];
         context->signq = engine->taskq->signq;
+        context->batches = NULL;
         engine->workers[threadCount]->need_to_exit = 0;
         engine->workers[threadCount]->context = context;
         janitor_thread_create(&engine->workers[threadCount]->thread_id, workerthreadclass, (janitor_runfn_t)worker_start, engine->workers[threadCount]);
@@ -279,6 +287,7 @@ engine_stop_threads(engine_type* engine)
         ods_log_debug("[%s] join worker %d", engine_str, i+1);
         janitor_thread_join(engine->workers[i]->thread_id);
     }
+    worker_contexts_cleanup(engine);
 }
 
 
@@ -350,7 +359,8 @@ engine_setup(void)
     if (!engine->cmdhandler) {
         return ODS_STATUS_CMDHANDLER_ERR;
     }
-    engine->dnshandler = dnshandler_create(engine->config->interfaces);
+    engine->dnshandler = dnshandler_create(engine->config->interfaces,
+        engine->config->num_listener_threads);
     engine->xfrhandler = xfrhandler_create();
     if (!engine->xfrhandler) {
         return ODS_STATUS_XFRHANDLER_ERR;
@@ -610,6 +620,29 @@ dnsconfig_zone(engine_type* engine, zone_type* zone)
 }
 
 
+/**
+ * Remove zone.
+ *
+ */
+void
+engine_remove_zone(engine_type* engine, zone_type* zone)
+{
+    pthread_mutex_lock(&zone->zone_lock);
+    zonelist_del_zone(engine->zonelist, zone);
+    schedule_unscheduletask(engine->taskq, schedule_WHATEVER, zone->name);
+    pthread_mutex_unlock(&zone->zone_lock);
+    if (zone->xfrd) {
+        netio_remove_handler(engine->xfrhandler->netio,
+            &zone->xfrd->handler);
+    }
+    if (zone->notify) {
+        netio_remove_handler(engine->xfrhandler->netio,
+            &zone->notify->handler);
+    }
+    zone_cleanup(zone);
+}
+
+
 /**
  * Update zones.
  *
@@ -628,22 +661,27 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
     }
 
     ods_log_debug("[%s] commit zone list changes", engine_str);
-    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    pthread_rwlock_wrlock(&engine->zonelist->zl_lock);
     node = ldns_rbtree_first(engine->zonelist->zones);
     while (node && node != LDNS_RBTREE_NULL) {
         zone = (zone_type*) node->data;
 
-        if (zone->zl_status == ZONE_ZL_REMOVED) {
+        if (zone->zl_status == ZONE_ZL_REMOVED && zone->recovering) {
+            /* the recover task removes the zone once it is done */
+            ods_log_debug("[%s] zone %s is being recovered, removing it "
+                "later", engine_str, zone->name);
             node = ldns_rbtree_next(node);
-            pthread_mutex_lock(&zone->zone_lock);
-            zonelist_del_zone(engine->zonelist, zone);
-            schedule_unscheduletask(engine->taskq, schedule_WHATEVER, zone->name);
-            pthread_mutex_unlock(&zone->zone_lock);
-            netio_remove_handler(engine->xfrhandler->netio,
-                &zone->xfrd->handler);
-            zone_cleanup(zone);
+            continue;
+        } else if (zone->zl_status == ZONE_ZL_REMOVED) {
+            node = ldns_rbtree_next(node);
+            engine_remove_zone(engine, zone);
             zone = NULL;
             continue;
+        } else if (zone->zl_status == ZONE_ZL_OK &&
+            zl_changed == ODS_STATUS_OK) {
+            /* the zone list changed, but not for this zone */
+            node = ldns_rbtree_next(node);
+            continue;
         } else if (zone->zl_status == ZONE_ZL_ADDED) {
             pthread_mutex_lock(&zone->zone_lock);
             /* set notify nameserver command */
@@ -668,7 +706,12 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
         /* for dns adapters */
         warnings += dnsconfig_zone(engine, zone);
 
-        if (zone->zl_status == ZONE_ZL_ADDED) {
+        if (zone->recovering) {
+            /* the recover task takes care of the zone */
+            wake_up = 1;
+            node = ldns_rbtree_next(node);
+            continue;
+        } else if (zone->zl_status == ZONE_ZL_ADDED) {
             schedule_scheduletask(engine->taskq, TASK_SIGNCONF, zone->name, zone, &zone->zone_lock, 0);
         } else if (zl_changed == ODS_STATUS_OK) {
             schedule_scheduletask(engine->taskq, TASK_FORCESIGNCONF, zone->name, zone, &zone->zone_lock, 0);
@@ -682,7 +725,7 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
         }
         node = ldns_rbtree_next(node);
     }
-    pthread_mutex_unlock(&engine->zonelist->zl_lock);
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
     if (engine->dnshandler) {
         ods_log_debug("[%s] forward notify for all zones", engine_str);
         dnshandler_fwd_notify(engine->dnshandler,
@@ -701,14 +744,16 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
 /**
  * Try to recover from the backup files.
  *
+ * Every zone is recovered by a task of its own, so the worker threads
+ * recover zones side by side.  A zone is only served and updated once
+ * its recovery is done.
+ *
  */
 static ods_status
 engine_recover(engine_type* engine)
 {
     ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     zone_type* zone = NULL;
-    ods_status status = ODS_STATUS_OK;
-    ods_status result = ODS_STATUS_UNCHANGED;
 
     if (!engine || !engine->zonelist || !engine->zonelist->zones) {
         ods_log_error("[%s] cannot recover zones: no engine or zonelist",
@@ -719,45 +764,26 @@ engine_recover(engine_type* engine)
     ods_log_assert(engine->zonelist);
     ods_log_assert(engine->zonelist->zones);
 
-    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    pthread_rwlock_wrlock(&engine->zonelist->zl_lock);
     /* [LOCK] zonelist */
+    engine->recover_total = 0;
+    engine->recover_done = 0;
     node = ldns_rbtree_first(engine->zonelist->zones);
     while (node && node != LDNS_RBTREE_NULL) {
         zone = (zone_type*) node->data;
 
         ods_log_assert(zone->zl_status == ZONE_ZL_ADDED);
-        pthread_mutex_lock(&zone->zone_lock);
-        status = zone_recover2(engine, zone);
-        if (status == ODS_STATUS_OK) {
-            ods_log_assert(zone->db);
-            ods_log_assert(zone->signconf);
-            /* notify nameserver */
-            if (engine->config->notify_command && !zone->notify_ns) {
-                set_notify_ns(zone, engine->config->notify_command);
-            }
-            if (status != ODS_STATUS_OK) {
-                ods_log_crit("[%s] unable to schedule task for zone %s: %s",
-                    engine_str, zone->name, ods_status2str(status));
-                result = ODS_STATUS_OK; /* will trigger update zones */
-            } else {
-                ods_log_debug("[%s] recovered zone %s", engine_str,
-                    zone->name);
-                /* recovery done */
-                zone->zl_status = ZONE_ZL_OK;
-            }
-        } else {
-            if (status != ODS_STATUS_UNCHANGED) {
-                ods_log_warning("[%s] unable to recover zone %s from backup,"
-                " performing full sign", engine_str, zone->name);
-            }
-            result = ODS_STATUS_OK; /* will trigger update zones */
-        }
-        pthread_mutex_unlock(&zone->zone_lock);
+        zone->recovering = 1;
+        schedule_scheduletask(engine->taskq, TASK_RECOVER, zone->name, zone,
+            NULL, schedule_IMMEDIATELY);
+        engine->recover_total++;
         node = ldns_rbtree_next(node);
     }
     /* [UNLOCK] zonelist */
-    pthread_mutex_unlock(&engine->zonelist->zl_lock);
-    return result;
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
+    ods_log_info("[%s] recovering %u zones from backup", engine_str,
+        (unsigned) engine->recover_total);
+    return ODS_STATUS_UNCHANGED;
 }
 
 
@@ -804,13 +830,13 @@ engine_start(const char* cfgfile, int cmdline_verbosity, int daemonize, int info
     /* run */
     while (engine->need_to_exit == 0) {
         /* update zone list */
-        pthread_mutex_lock(&engine->zonelist->zl_lock);
+        pthread_rwlock_wrlock(&engine->zonelist->zl_lock);
         zl_changed = zonelist_update(engine->zonelist,
             engine->config->zonelist_filename);
         engine->zonelist->just_removed = 0;
         engine->zonelist->just_added = 0;
         engine->zonelist->just_updated = 0;
-        pthread_mutex_unlock(&engine->zonelist->zl_lock);
+        pthread_rwlock_unlock(&engine->zonelist->zl_lock);
         /* start/reload */
         if (engine->need_to_reload) {
             ods_log_info("[%s] signer reloading", engine_str);
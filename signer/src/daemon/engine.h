@@ -70,6 +70,10 @@ struct engine_struct {
     dnshandler_type* dnshandler;
     xfrhandler_type* xfrhandler;
     edns_data_type edns;
+
+    /* zones recovered from backup at startup, under the zonelist lock */
+    size_t recover_total;
+    size_t recover_done;
 };
 
 /**
@@ -92,10 +96,21 @@ int engine_start(const char* cfgfile, int cmdline_verbosity,
  */
 void engine_wakeup_workers(engine_type* engine);
 
+/**
+ * Remove a zone that is no longer in the zone list, with its tasks and
+ * handlers.  The caller holds the zone list write lock.
+ * \param[in] engine engine
+ * \param[in] zone zone, freed
+ *
+ */
+void engine_remove_zone(engine_type* engine, zone_type* zone);
+
 /**
  * Update zones.
  * \param[in] engine engine
- * \param[in] zl_changed whether the zonelist has changed or not
+ * \param[in] zl_changed whether the zonelist has changed or not; if
+ *            it has, only the zones that were added, updated or removed
+ *            are dealt with
  *
  */
 void engine_update_zones(engine_type* engine, ods_status zl_changed);
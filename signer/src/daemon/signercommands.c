@@ -61,6 +61,10 @@ cmdhandler_handle_cmd_help(int sockfd, cmdhandler_ctx_type* context, const char
                                     "zone.\n"
         "                            All signatures will be regenerated "
                                     "on the next re-sign.\n"
+        "export <zone>               Write the backup of this zone in "
+                                    "text format.\n"
+        "                            Signing of the zone waits until "
+                                    "it is written.\n"
         "queue                       Show the current task queue.\n"
         "flush                       Execute all scheduled tasks "
                                     "immediately.\n"
@@ -69,12 +73,16 @@ cmdhandler_handle_cmd_help(int sockfd, cmdhandler_ctx_type* context, const char
 
     (void) snprintf(buf, ODS_SE_MAXLINE,
         "update <zone>               Update this zone signer "
-                                    "configurations.\n"
+                                    "configurations, adding or\n"
+        "                            removing it if its zone list entry "
+                                    "changed.\n"
         "update [--all]              Update zone list and all signer "
                                     "configurations.\n"
         "retransfer <zone>           Retransfer the zone from the master.\n"
         "start                       Start the engine.\n"
-        "running                     Check if the engine is running.\n"
+        "running                     Check if the engine is running, and "
+                                    "how far zone\n"
+        "                            recovery at startup is.\n"
         "reload                      Reload the engine.\n"
         "stop                        Stop the engine.\n"
         "verbosity <nr>              Set verbosity.\n"
@@ -103,7 +111,7 @@ cmdhandler_handle_cmd_zones(int sockfd, cmdhandler_ctx_type* context, const char
         return 0;
     }
     /* how many zones */
-    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
     (void)snprintf(buf, ODS_SE_MAXLINE, "There are %i zones configured\n",
         (int) engine->zonelist->zones->count);
     client_printf(sockfd, buf);
@@ -118,7 +126,7 @@ cmdhandler_handle_cmd_zones(int sockfd, cmdhandler_ctx_type* context, const char
         client_printf(sockfd, buf);
         node = ldns_rbtree_next(node);
     }
-    pthread_mutex_unlock(&engine->zonelist->zl_lock);
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
     return 0;
 }
 
@@ -133,12 +141,14 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_ctx_type* context, const cha
     engine_type* engine;
     char buf[ODS_SE_MAXLINE];
     ods_status status = ODS_STATUS_OK;
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     zone_type* zone = NULL;
     ods_status zl_changed = ODS_STATUS_OK;
+    time_t zl_mtime = 0;
     engine = getglobalcontext(context);
     ods_log_assert(engine->taskq);
     if (cmdargument(cmd, "--all", NULL)) {
-        pthread_mutex_lock(&engine->zonelist->zl_lock);
+        pthread_rwlock_wrlock(&engine->zonelist->zl_lock);
         zl_changed = zonelist_update(engine->zonelist,
             engine->config->zonelist_filename);
         if (zl_changed == ODS_STATUS_UNCHANGED) {
@@ -153,7 +163,7 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_ctx_type* context, const cha
                 engine->zonelist->just_updated);
             client_printf(sockfd, buf);
         } else {
-            pthread_mutex_unlock(&engine->zonelist->zl_lock);
+            pthread_rwlock_unlock(&engine->zonelist->zl_lock);
             (void)snprintf(buf, ODS_SE_MAXLINE, "Zone list has errors.\n");
             client_printf(sockfd, buf);
         }
@@ -162,16 +172,58 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_ctx_type* context, const cha
             engine->zonelist->just_removed = 0;
             engine->zonelist->just_added = 0;
             engine->zonelist->just_updated = 0;
-            pthread_mutex_unlock(&engine->zonelist->zl_lock);
-            /**
-              * Always update the signconf for zones, even if zonelist has
-              * not changed: ODS_STATUS_OK.
-              */
+            if (zl_changed == ODS_STATUS_UNCHANGED) {
+                /**
+                  * Always update the signconf for zones, even if zonelist
+                  * has not changed: mark them all as updated.
+                  */
+                node = ldns_rbtree_first(engine->zonelist->zones);
+                while (node && node != LDNS_RBTREE_NULL) {
+                    zone = (zone_type*) node->data;
+                    if (zone->zl_status == ZONE_ZL_OK) {
+                        zone->zl_status = ZONE_ZL_UPDATED;
+                    }
+                    node = ldns_rbtree_next(node);
+                }
+            }
+            pthread_rwlock_unlock(&engine->zonelist->zl_lock);
             engine_update_zones(engine, ODS_STATUS_OK);
         }
     } else {
+        /* pick up changes to the zone list entry of this zone only, the
+         * file is read if its entry was not read since the file changed */
+        zl_mtime = ods_file_lastmodified(engine->config->zonelist_filename);
+        pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
+        zone = zonelist_lookup_zone_by_name(engine->zonelist, cmdargument(cmd, NULL, ""),
+            LDNS_RR_CLASS_IN);
+        zl_changed = (!zone || (zl_mtime > engine->zonelist->last_modified &&
+            zl_mtime > zone->zl_modified)) ? ODS_STATUS_OK :
+            ODS_STATUS_UNCHANGED;
+        pthread_rwlock_unlock(&engine->zonelist->zl_lock);
+        if (zl_changed == ODS_STATUS_OK) {
+            pthread_rwlock_wrlock(&engine->zonelist->zl_lock);
+            zl_changed = zonelist_update_zone(engine->zonelist,
+                engine->config->zonelist_filename, cmdargument(cmd, NULL, ""));
+            if (zl_changed == ODS_STATUS_OK && (engine->zonelist->just_removed ||
+                engine->zonelist->just_added || engine->zonelist->just_updated)) {
+                (void)snprintf(buf, ODS_SE_MAXLINE, "Zone list updated: %i "
+                "removed, %i added, %i updated.\n",
+                    engine->zonelist->just_removed,
+                    engine->zonelist->just_added,
+                    engine->zonelist->just_updated);
+                client_printf(sockfd, buf);
+                engine->zonelist->just_removed = 0;
+                engine->zonelist->just_added = 0;
+                engine->zonelist->just_updated = 0;
+                pthread_rwlock_unlock(&engine->zonelist->zl_lock);
+                engine_update_zones(engine, ODS_STATUS_OK);
+                return 0;
+            }
+            pthread_rwlock_unlock(&engine->zonelist->zl_lock);
+        }
+
         /* look up zone */
-        pthread_mutex_lock(&engine->zonelist->zl_lock);
+        pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
         zone = zonelist_lookup_zone_by_name(engine->zonelist, cmdargument(cmd, NULL, ""),
             LDNS_RR_CLASS_IN);
         /* If this zone is just added, don't update (it might not have a
@@ -179,14 +231,12 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_ctx_type* context, const cha
         if (zone && zone->zl_status == ZONE_ZL_ADDED) {
             zone = NULL;
         }
-        pthread_mutex_unlock(&engine->zonelist->zl_lock);
+        pthread_rwlock_unlock(&engine->zonelist->zl_lock);
 
         if (!zone) {
             (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Zone %s not found.\n",
                 cmdargument(cmd, NULL, ""));
             client_printf(sockfd, buf);
-            /* update all */
-            cmdhandler_handle_cmd_update(sockfd, context, "update --all");
             return 1;
         }
 
@@ -226,7 +276,7 @@ cmdhandler_handle_cmd_retransfer(int sockfd, cmdhandler_ctx_type* context, const
     engine = getglobalcontext(context);
     ods_log_assert(engine->taskq);
     /* look up zone */
-    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
     zone = zonelist_lookup_zone_by_name(engine->zonelist, cmdargument(cmd, NULL, ""),
         LDNS_RR_CLASS_IN);
     /* If this zone is just added, don't retransfer (it might not have a
@@ -234,7 +284,7 @@ cmdhandler_handle_cmd_retransfer(int sockfd, cmdhandler_ctx_type* context, const
     if (zone && zone->zl_status == ZONE_ZL_ADDED) {
         zone = NULL;
     }
-    pthread_mutex_unlock(&engine->zonelist->zl_lock);
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
 
     if (!zone) {
         (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Zone %s not found.\n",
@@ -299,13 +349,13 @@ cmdhandler_handle_cmd_sign(int sockfd, cmdhandler_ctx_type* context, const char
     engine = getglobalcontext(context);
     ods_log_assert(engine->taskq);
     if (cmdargument(cmd, "--all", NULL)) {
-        pthread_mutex_lock(&engine->zonelist->zl_lock);
+        pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
         ldns_rbnode_t* node;
         for (node = ldns_rbtree_first(engine->zonelist->zones); node != LDNS_RBTREE_NULL && node != NULL; node = ldns_rbtree_next(node)) {
             zone = node->data;
             forceread(engine, zone, 0, 0, sockfd);
         }
-        pthread_mutex_unlock(&engine->zonelist->zl_lock);
+        pthread_rwlock_unlock(&engine->zonelist->zl_lock);
         engine_wakeup_workers(engine);
         client_printf(sockfd, "All zones scheduled for immediate re-sign.\n");
     } else {
@@ -338,7 +388,7 @@ cmdhandler_handle_cmd_sign(int sockfd, cmdhandler_ctx_type* context, const char
             force_serial = 1;
             *delim1 = '\0';
         }
-        pthread_mutex_lock(&engine->zonelist->zl_lock);
+        pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
         zone = zonelist_lookup_zone_by_name(engine->zonelist, cmdargument(cmd, NULL, ""),
             LDNS_RR_CLASS_IN);
         /* If this zone is just added, don't update (it might not have a task
@@ -347,7 +397,7 @@ cmdhandler_handle_cmd_sign(int sockfd, cmdhandler_ctx_type* context, const char
         if (zone && zone->zl_status == ZONE_ZL_ADDED) {
             zone = NULL;
         }
-        pthread_mutex_unlock(&engine->zonelist->zl_lock);
+        pthread_rwlock_unlock(&engine->zonelist->zl_lock);
 
         if (!zone) {
             (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Zone %s not found.\n",
@@ -397,11 +447,13 @@ cmdhandler_handle_cmd_clear(int sockfd, cmdhandler_ctx_type* context, const char
     unlink_backup_file(cmdargument(cmd, NULL, ""), ".inbound");
     unlink_backup_file(cmdargument(cmd, NULL, ""), ".backup");
     unlink_backup_file(cmdargument(cmd, NULL, ""), ".axfr");
+    unlink_backup_file(cmdargument(cmd, NULL, ""), ".axfr.wire");
     unlink_backup_file(cmdargument(cmd, NULL, ""), ".ixfr");
-    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    unlink_backup_file(cmdargument(cmd, NULL, ""), ".ixfr.journal");
+    pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
     zone = zonelist_lookup_zone_by_name(engine->zonelist, cmdargument(cmd, NULL, ""),
         LDNS_RR_CLASS_IN);
-    pthread_mutex_unlock(&engine->zonelist->zl_lock);
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
     if (zone) {
         pthread_mutex_lock(&zone->zone_lock);
         inbserial = zone->db->inbserial;
@@ -453,6 +505,45 @@ cmdhandler_handle_cmd_clear(int sockfd, cmdhandler_ctx_type* context, const char
 }
 
 
+/**
+ * Handle the 'export' command.
+ * The zone is locked while it is written, which holds up signing it.
+ *
+ */
+static int
+cmdhandler_handle_cmd_export(int sockfd, cmdhandler_ctx_type* context, const char *cmd)
+{
+    ods_status status = ODS_STATUS_OK;
+    engine_type* engine;
+    zone_type* zone = NULL;
+    engine = getglobalcontext(context);
+    pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, cmdargument(cmd, NULL, ""),
+        LDNS_RR_CLASS_IN);
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
+    if (!zone) {
+        client_printf(sockfd, "Error: Zone %s not found.\n",
+            cmdargument(cmd, NULL, ""));
+        return 1;
+    }
+    pthread_mutex_lock(&zone->zone_lock);
+    status = zone_export2(zone);
+    pthread_mutex_unlock(&zone->zone_lock);
+    if (status != ODS_STATUS_OK) {
+        client_printf(sockfd, "Error: Unable to export zone %s: %s.\n",
+            cmdargument(cmd, NULL, ""), ods_status2str(status));
+        ods_log_error("[%s] unable to export zone %s: %s", cmdh_str,
+            cmdargument(cmd, NULL, ""), ods_status2str(status));
+        return 1;
+    }
+    client_printf(sockfd, "Zone %s exported to %s.backup2.text.\n",
+        cmdargument(cmd, NULL, ""), cmdargument(cmd, NULL, ""));
+    ods_log_verbose("[%s] zone %s exported", cmdh_str,
+        cmdargument(cmd, NULL, ""));
+    return 0;
+}
+
+
 /**
  * Handle the 'queue' command.
  *
@@ -585,9 +676,22 @@ cmdhandler_handle_cmd_start(int sockfd, cmdhandler_ctx_type* context, const char
 static int
 cmdhandler_handle_cmd_running(int sockfd, cmdhandler_ctx_type* context, const char *cmd)
 {
+    engine_type* engine;
     char buf[ODS_SE_MAXLINE];
+    size_t done, total;
+    engine = getglobalcontext(context);
     (void)snprintf(buf, ODS_SE_MAXLINE, "Engine running.\n");
     client_printf(sockfd, buf);
+    /* zones still being recovered from backup */
+    pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
+    done = engine->recover_done;
+    total = engine->recover_total;
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
+    if (done < total) {
+        (void)snprintf(buf, ODS_SE_MAXLINE, "Recovering zones from backup: "
+            "%u of %u done.\n", (unsigned) done, (unsigned) total);
+        client_printf(sockfd, buf);
+    }
     return 0;
 }
 
@@ -640,6 +744,7 @@ struct cmd_func_block helpCmdDef = { "help", NULL, NULL, NULL, &cmdhandler_handl
 struct cmd_func_block zonesCmdDef = { "zones", NULL, NULL, NULL, &cmdhandler_handle_cmd_zones };
 struct cmd_func_block signCmdDef = { "sign", NULL, NULL, NULL, &cmdhandler_handle_cmd_sign };
 struct cmd_func_block clearCmdDef = { "clear", NULL, NULL, NULL, &cmdhandler_handle_cmd_clear };
+struct cmd_func_block exportCmdDef = { "export", NULL, NULL, NULL, &cmdhandler_handle_cmd_export };
 struct cmd_func_block queueCmdDef = { "queue", NULL, NULL, NULL, &cmdhandler_handle_cmd_queue };
 struct cmd_func_block flushCmdDef = { "flush", NULL, NULL, NULL, &cmdhandler_handle_cmd_flush };
 struct cmd_func_block updateCmdDef = { "update", NULL, NULL, NULL, &cmdhandler_handle_cmd_update };
@@ -655,6 +760,7 @@ struct cmd_func_block* signcommands[] = {
     &zonesCmdDef,
     &signCmdDef,
     &clearCmdDef,
+    &exportCmdDef,
     &queueCmdDef,
     &flushCmdDef,
     &updateCmdDef,
@@ -36,44 +36,91 @@
 #include "util.h"
 #include "log.h"
 #include "status.h"
+#include "signer/parallel.h"
 #include "signer/tools.h"
 #include "signer/zone.h"
 #include "util.h"
 #include "signertasks.h"
 
 /**
- * Queue RRset for signing.
+ * Batch of RRsets that is queued, signed and reported as one work item.
+ * The drudger that signs it collects the IXFR changes in the batch, and
+ * the batch is kept until the changes of all batches are merged.
+ *
+ */
+struct worker_batch {
+    struct worker_batch* next;
+    size_t count;
+    size_t capacity;
+    rrset_type** rrsets;
+    ixfr_delta_type delta;
+};
+
+
+/**
+ * Queue batch of RRsets for signing.
  *
  */
 static void
-worker_queue_rrset(struct worker_context* context, fifoq_type* q, rrset_type* rrset, long* nsubtasks)
+worker_queue_batch(struct worker_context* context, fifoq_type* q, struct worker_batch* batch, long* nsubtasks)
 {
-    ods_status status = ODS_STATUS_UNCHANGED;
-    int tries = 0;
+    ods_status status;
     ods_log_assert(q);
-    ods_log_assert(rrset);
+    ods_log_assert(batch);
+
+    /* waits while the queue is full */
+    status = fifoq_pushwait(q, (void*) batch, context, context->worker);
+    if (status != ODS_STATUS_OK) {
+        /* worker needs to exit */
+        free(batch->rrsets);
+        free(batch);
+        return;
+    }
+    batch->next = context->batches;
+    context->batches = batch;
+    *nsubtasks += 1;
+}
+
 
-    pthread_mutex_lock(&q->q_lock);
-    status = fifoq_push(q, (void*) rrset, context, &tries);
-    while (status == ODS_STATUS_UNCHANGED) {
-        tries++;
-        if (context->worker->need_to_exit) {
-            pthread_mutex_unlock(&q->q_lock);
-            return;
+/**
+ * Queue RRset for signing.  The RRset is added to the pending batch,
+ * which is queued once it is full.
+ *
+ */
+static void
+worker_queue_rrset(struct worker_context* context, fifoq_type* q, struct worker_batch** batch, rrset_type* rrset, long* nsubtasks)
+{
+    ods_log_assert(context);
+    ods_log_assert(batch);
+    ods_log_assert(rrset);
+    if (!*batch) {
+        CHECKALLOC(*batch = (struct worker_batch*) calloc(1, sizeof(struct worker_batch)));
+        (*batch)->count = 0;
+        (*batch)->capacity = context->engine->config->signer_batch_size;
+        if ((*batch)->capacity < 1) {
+            (*batch)->capacity = 1;
         }
-        /**
-         * Apparently the queue is full. Lets take a small break to not hog CPU.
-         * The worker will release the signq lock while sleeping and will
-         * automatically grab the lock when the queue is nonfull.
-         * Queue is nonfull at 10% of the queue size.
-         */
-        ods_thread_wait(&q->q_nonfull, &q->q_lock, 5);
-        status = fifoq_push(q, (void*) rrset, context, &tries);
+        CHECKALLOC((*batch)->rrsets = (rrset_type**) malloc((*batch)->capacity * sizeof(rrset_type*)));
     }
-    pthread_mutex_unlock(&q->q_lock);
+    (*batch)->rrsets[(*batch)->count++] = rrset;
+    if ((*batch)->count == (*batch)->capacity) {
+        worker_queue_batch(context, q, *batch, nsubtasks);
+        *batch = NULL;
+    }
+}
 
-    ods_log_assert(status == ODS_STATUS_OK);
-    *nsubtasks += 1;
+
+/**
+ * Queue the pending batch, even if it is not full.
+ *
+ */
+static void
+worker_queue_flush(struct worker_context* context, fifoq_type* q, struct worker_batch** batch, long* nsubtasks)
+{
+    if (*batch) {
+        worker_queue_batch(context, q, *batch, nsubtasks);
+        *batch = NULL;
+    }
 }
 
 
@@ -82,7 +129,7 @@ worker_queue_rrset(struct worker_context* context, fifoq_type* q, rrset_type* rr
  *
  */
 static void
-worker_queue_domain(struct worker_context* context, fifoq_type* q, domain_type* domain, long* nsubtasks)
+worker_queue_domain(struct worker_context* context, fifoq_type* q, struct worker_batch** batch, domain_type* domain, long* nsubtasks)
 {
     rrset_type* rrset = NULL;
     denial_type* denial = NULL;
@@ -91,12 +138,12 @@ worker_queue_domain(struct worker_context* context, fifoq_type* q, domain_type*
     ods_log_assert(domain);
     rrset = domain->rrsets;
     while (rrset) {
-        worker_queue_rrset(context, q, rrset, nsubtasks);
+        worker_queue_rrset(context, q, batch, rrset, nsubtasks);
         rrset = rrset->next;
     }
     denial = (denial_type*) domain->denial;
     if (denial && denial->rrset) {
-        worker_queue_rrset(context, q, denial->rrset, nsubtasks);
+        worker_queue_rrset(context, q, batch, denial->rrset, nsubtasks);
     }
 }
 
@@ -110,6 +157,7 @@ worker_queue_zone(struct worker_context* context, fifoq_type* q, zone_type* zone
 {
     ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     domain_type* domain = NULL;
+    struct worker_batch* batch = NULL;
     ods_log_assert(context);
     ods_log_assert(q);
     ods_log_assert(zone);
@@ -121,12 +169,148 @@ worker_queue_zone(struct worker_context* context, fifoq_type* q, zone_type* zone
     }
     while (node && node != LDNS_RBTREE_NULL) {
         domain = (domain_type*) node->data;
-        worker_queue_domain(context, q, domain, nsubtasks);
+        worker_queue_domain(context, q, &batch, domain, nsubtasks);
+        node = ldns_rbtree_next(node);
+    }
+    worker_queue_flush(context, q, &batch, nsubtasks);
+}
+
+
+/**
+ * Queue the RRsets from the resign index that are due for signing.
+ *
+ */
+static rrset_type**
+worker_queue_resign(struct worker_context* context, fifoq_type* q, zone_type* zone, uint32_t until, long* nresign, long* nsubtasks)
+{
+    rrset_type** rrsets = NULL;
+    rrset_type* rrset = NULL;
+    struct worker_batch* batch = NULL;
+    long capacity = 0;
+    ods_log_assert(context);
+    ods_log_assert(q);
+    ods_log_assert(zone);
+    ods_log_assert(zone->db);
+    *nresign = 0;
+    while ((rrset = resign_pop(zone->db->resign, until))) {
+        if (*nresign == capacity) {
+            capacity = (capacity ? capacity * 2 : 1024);
+            CHECKALLOC(rrsets = (rrset_type**) realloc(rrsets,
+                capacity * sizeof(rrset_type*)));
+        }
+        rrsets[(*nresign)++] = rrset;
+        worker_queue_rrset(context, q, &batch, rrset, nsubtasks);
+    }
+    worker_queue_flush(context, q, &batch, nsubtasks);
+    return rrsets;
+}
+
+
+/**
+ * Add all RRsets of the zone to the resign index.
+ *
+ */
+static void
+worker_index_zone(zone_type* zone)
+{
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    domain_type* domain = NULL;
+    denial_type* denial = NULL;
+    rrset_type* rrset = NULL;
+    ods_log_assert(zone);
+    if (!zone->db || !zone->db->domains) {
+        return;
+    }
+    if (zone->db->domains->root != LDNS_RBTREE_NULL) {
+        node = ldns_rbtree_first(zone->db->domains);
+    }
+    while (node && node != LDNS_RBTREE_NULL) {
+        domain = (domain_type*) node->data;
+        for (rrset = domain->rrsets; rrset; rrset = rrset->next) {
+            resign_update(zone->db->resign, rrset);
+        }
+        denial = (denial_type*) domain->denial;
+        if (denial && denial->rrset) {
+            resign_update(zone->db->resign, denial->rrset);
+        }
         node = ldns_rbtree_next(node);
     }
 }
 
 
+/**
+ * Merge the IXFR changes of the signed batches into the journal, and
+ * free the batches.
+ *
+ */
+static void
+worker_merge_batches(struct worker_context* context, zone_type* zone)
+{
+    struct worker_batch* batch = NULL;
+    ixfr_delta_type** deltas = NULL;
+    size_t count = 0;
+    size_t i = 0;
+
+    for (batch = context->batches; batch; batch = batch->next) {
+        count++;
+    }
+    if (count) {
+        CHECKALLOC(deltas = (ixfr_delta_type**) malloc(count *
+            sizeof(ixfr_delta_type*)));
+        for (batch = context->batches; batch; batch = batch->next) {
+            deltas[i++] = &batch->delta;
+        }
+        ixfr_delta_merge(zone->ixfr, deltas, count);
+        free(deltas);
+    }
+    while (context->batches) {
+        batch = context->batches;
+        context->batches = batch->next;
+        ixfr_delta_clear(&batch->delta);
+        free(batch);
+    }
+}
+
+
+/**
+ * Clean up the worker contexts once the workers and drudgers stopped:
+ * empty the signing queue and free the batches of interrupted sign
+ * tasks, with their IXFR changes.
+ *
+ */
+void
+worker_contexts_cleanup(engine_type* engine)
+{
+    struct worker_context* context = NULL;
+    struct worker_batch* batch = NULL;
+    void* item = NULL;
+    void* owner = NULL;
+    int i;
+
+    /* batches are freed below, with the context that queued them */
+    while ((item = fifoq_pop(engine->taskq->signq, &owner))) {
+        if (parallel_owns(owner)) {
+            parallel_drudge(item);
+        }
+    }
+    for (i = 0; i < engine->config->num_worker_threads; i++) {
+        context = (struct worker_context*) engine->workers[i]->context;
+        if (!context) {
+            continue;
+        }
+        while (context->batches) {
+            batch = context->batches;
+            context->batches = batch->next;
+            ixfr_delta_clear(&batch->delta);
+            free(batch->rrsets);
+            free(batch);
+        }
+        free(context);
+        engine->workers[i]->context = NULL;
+    }
+}
+
+
 /**
  * Make sure that no appointed jobs have failed.
  *
@@ -137,8 +321,8 @@ worker_check_jobs(worker_type* worker, task_type* task, int ntasks, long ntasksf
     ods_log_assert(worker);
     ods_log_assert(task);
     if (ntasksfailed) {
-        ods_log_error("[%s] sign zone %s failed: %ld RRsets failed",
-            worker->name, task->owner, ntasksfailed);
+        ods_log_error("[%s] sign zone %s failed: %ld batches of RRsets "
+            "failed", worker->name, task->owner, ntasksfailed);
         return ODS_STATUS_ERR;
     } else if (worker->need_to_exit) {
         ods_log_error("[%s] sign zone %s failed: worker needs to exit",
@@ -151,7 +335,7 @@ worker_check_jobs(worker_type* worker, task_type* task, int ntasks, long ntasksf
 void
 drudge(worker_type* worker)
 {
-    rrset_type* rrset;
+    struct worker_batch* batch;
     ods_status status;
     struct worker_context* superior;
     hsm_ctx_t* ctx = NULL;
@@ -160,24 +344,16 @@ drudge(worker_type* worker)
 
     while (worker->need_to_exit == 0) {
         ods_log_deeebug("[%s] report for duty", worker->name);
-        pthread_mutex_lock(&signq->q_lock);
         superior = NULL;
-        rrset = (rrset_type*) fifoq_pop(signq, (void**)&superior);
-        if (!rrset) {
-            ods_log_deeebug("[%s] nothing to do, wait", worker->name);
-            /**
-             * Apparently the queue is empty. Wait until new work is queued.
-             * The drudger will release the signq lock while sleeping and
-             * will automatically grab the lock when the threshold is reached.
-             * Threshold is at 1 and MAX (after a number of tries).
-             */
-            pthread_cond_wait(&signq->q_threshold, &signq->q_lock);
-            if(worker->need_to_exit == 0)
-                rrset = (rrset_type*) fifoq_pop(signq, (void**)&superior);
+        /* waits until work is queued or the drudger needs to exit */
+        batch = (struct worker_batch*) fifoq_popwait(signq, (void**)&superior, worker);
+        if (batch && parallel_owns(superior)) {
+            /* help out with a bulk operation of one of the workers */
+            parallel_drudge(batch);
+            continue;
         }
-        pthread_mutex_unlock(&signq->q_lock);
         /* do some work */
-        if (rrset) {
+        if (batch) {
             ods_log_assert(superior);
             if (!ctx) {
                 ods_log_debug("[%s] create hsm context", worker->name);
@@ -193,8 +369,12 @@ drudge(worker_type* worker)
                 ods_log_error("signer instructed to reload due to hsm reset while signing");
                 status = ODS_STATUS_HSM_ERR;
             } else {
-                status = rrset_sign(ctx, rrset, superior->clock_in);
+                status = rrset_sign_batch(ctx, batch->rrsets, batch->count,
+                    superior->clock_in, &batch->delta);
             }
+            /* the batch itself is freed by the superior */
+            free(batch->rrsets);
+            batch->rrsets = NULL;
             fifoq_report(signq, superior->worker, status);
         }
         /* done work */
@@ -276,6 +456,10 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     time_t end = 0;
     long nsubtasks = 0;
     long nsubtasksfailed = 0;
+    long nresign = 0;
+    long i;
+    rrset_type** resign = NULL;
+    time_t refresh = 0;
     context->clock_in = time_now();
     status = zone_update_serial(zone);
     if (status != ODS_STATUS_OK) {
@@ -311,12 +495,34 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     /* prepare keys */
     status = zone_prepare_keys(zone);
     if (status == ODS_STATUS_OK) {
+        if (zone->signconf->sig_refresh_interval) {
+            refresh = duration2time(zone->signconf->sig_refresh_interval);
+        }
+        if (!refresh || refresh != zone->db->resign->refresh) {
+            /* refresh disabled (every signature is replaced) or changed */
+            resign_reset(zone->db->resign);
+        }
         /* queue menial, hard signing work */
-        worker_queue_zone(context, worker->taskq->signq, zone, &nsubtasks);
+        if (zone->db->resign->sign_all) {
+            zone->db->resign->refresh = (uint32_t) refresh;
+            worker_queue_zone(context, worker->taskq->signq, zone, &nsubtasks);
+        } else {
+            resign = worker_queue_resign(context, worker->taskq->signq, zone,
+                (uint32_t) context->clock_in, &nresign, &nsubtasks);
+            ods_log_debug("[%s] zone %s has %ld RRsets due for signing",
+                worker->name, task->owner, nresign);
+        }
         ods_log_deeebug("[%s] wait until drudgers are finished "
                 "signing zone %s", worker->name, task->owner);
         /* sleep until work is done */
         fifoq_waitfor(context->signq, worker, nsubtasks, &nsubtasksfailed);
+        if (worker->need_to_exit) {
+            /* drudgers may still hold batches, they are freed by
+             * worker_contexts_cleanup() once the drudgers stopped */
+        } else {
+            /* merge the IXFR changes of all drudgers in one go */
+            worker_merge_batches(context, zone);
+        }
     }
     /* stop timer */
     end = time(NULL);
@@ -324,6 +530,18 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     if (status == ODS_STATUS_OK) {
         status = worker_check_jobs(worker, task, nsubtasks, nsubtasksfailed);
     }
+    /* maintain resign index */
+    if (status != ODS_STATUS_OK) {
+        resign_reset(zone->db->resign);
+    } else if (zone->db->resign->sign_all) {
+        zone->db->resign->sign_all = 0;
+        worker_index_zone(zone);
+    } else {
+        for (i=0; i < nresign; i++) {
+            resign_update(zone->db->resign, resign[i]);
+        }
+    }
+    free(resign);
     if (status == ODS_STATUS_OK && zone->stats) {
         pthread_mutex_lock(&zone->stats->stats_lock);
         zone->stats->sig_time = (end - start);
@@ -431,6 +649,7 @@ do_writezone(task_type* task, const char* zonename, void* zonearg, void *context
     zone_type* zone = zonearg;
     ods_status status;
     time_t resign;
+    uint32_t due;
     context->clock_in = time_now(); /* TODO this means something different */
     /* perform write to output adapter task */
     status = tools_output(zone, engine);
@@ -451,6 +670,14 @@ do_writezone(task_type* task, const char* zonename, void* zonearg, void *context
                 "zone %s", worker->name, task->owner);
         resign = context->clock_in + 3600;
     }
+    /* nothing due before the resign interval ends, sleep until it is */
+    due = resign_next(zone->db->resign);
+    if (due && (time_t) due > resign) {
+        ods_log_debug("[%s] zone %s has no signatures due before %lu, "
+                "resign at %lu", worker->name, task->owner,
+                (unsigned long) resign, (unsigned long) due);
+        resign = (time_t) due;
+    }
     /* backup the last successful run */
     status = zone_backup2(zone, resign);
     if (status != ODS_STATUS_OK) {
@@ -459,6 +686,45 @@ do_writezone(task_type* task, const char* zonename, void* zonearg, void *context
         /* just a warning */
         status = ODS_STATUS_OK;
     }
-    schedule_scheduletask(engine->taskq, TASK_SIGN, zone->name, zone, &zone->zone_lock, resign);
+    schedule_rescheduletask(engine->taskq, TASK_SIGN, zone->name, zone, &zone->zone_lock, resign);
+    return schedule_SUCCESS;
+}
+
+time_t
+do_recoverzone(task_type* task, const char* zonename, void* zonearg, void *contextarg)
+{
+    struct worker_context* context = contextarg;
+    engine_type* engine = context->engine;
+    worker_type* worker = context->worker;
+    zone_type* zone = zonearg;
+    ods_status status;
+    /* perform 'recover from backup' task */
+    pthread_mutex_lock(&zone->zone_lock);
+    status = zone_recover2(engine, zone);
+    if (status == ODS_STATUS_OK) {
+        ods_log_debug("[%s] recovered zone %s", worker->name, task->owner);
+    } else {
+        if (status != ODS_STATUS_UNCHANGED) {
+            ods_log_warning("[%s] unable to recover zone %s from backup, "
+                "performing full sign", worker->name, task->owner);
+        }
+        schedule_scheduletask(engine->taskq, TASK_SIGNCONF, zone->name, zone, &zone->zone_lock, schedule_IMMEDIATELY);
+    }
+    pthread_mutex_unlock(&zone->zone_lock);
+    /* from now on the zone is served and updated like any other */
+    pthread_rwlock_wrlock(&engine->zonelist->zl_lock);
+    zone->recovering = 0;
+    if (++engine->recover_done == engine->recover_total) {
+        ods_log_info("[%s] recovered %u zones", worker->name,
+            (unsigned) engine->recover_total);
+    }
+    if (zone->zl_status == ZONE_ZL_REMOVED) {
+        /* removed from the zone list while it was recovered */
+        ods_log_debug("[%s] remove zone %s", worker->name, task->owner);
+        engine_remove_zone(engine, zone);
+    } else if (zone->zl_status == ZONE_ZL_ADDED) {
+        zone->zl_status = ZONE_ZL_OK;
+    }
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
     return schedule_SUCCESS;
 }
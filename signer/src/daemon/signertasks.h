@@ -35,14 +35,18 @@
 #include "status.h"
 #include "locks.h"
 
+struct worker_batch;
+
 struct worker_context {
     engine_type* engine;
     worker_type* worker;
     fifoq_type* signq;
     time_t clock_in;
+    struct worker_batch* batches; /* queued while signing a zone */
 };
 
 void drudge(worker_type* worker);
+void worker_contexts_cleanup(engine_type* engine);
 void task_schedule_easy(const char* zonename, task_id class, task_id type, time_t(*fn)(task_type*,const char*,void*,void*), void*, time_t time);
 
 time_t do_readsignconf(task_type* task, const char* zonename, void* zonearg, void *contextarg);
@@ -51,5 +55,6 @@ time_t do_signzone(task_type* task, const char* zonename, void* zonearg, void *c
 time_t do_readzone(task_type* task, const char* zonename, void* zonearg, void *contextarg);
 time_t do_forcereadzone(task_type* task, const char* zonename, void* zonearg, void *contextarg);
 time_t do_writezone(task_type* task, const char* zonename, void* zonearg, void *contextarg);
+time_t do_recoverzone(task_type* task, const char* zonename, void* zonearg, void *contextarg);
 
 #endif /* SIGNERTASKS_H */
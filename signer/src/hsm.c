@@ -47,7 +47,7 @@ lhsm_clear_key_cache(key_type* key)
         return;
     }
     if (key->dnskey) {
-        /* DNSKEY still exists in zone */
+        ldns_rr_free(key->dnskey);
         key->dnskey = NULL;
     }
     if (key->params) {
@@ -172,3 +172,71 @@ lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     }
     return result;
 }
+
+
+/**
+ * Get a batch of RRSIGs from the HSMs in one go.
+ *
+ */
+ods_status
+lhsm_sign_batch(hsm_ctx_t* ctx, lhsm_sign_type* sigs, size_t count)
+{
+    char* error = NULL;
+    hsm_sign_request_t* requests;
+    hsm_sign_params_t* params;
+    ldns_rr** rrsigs;
+    size_t i;
+    int result;
+
+    if (!count) {
+        return ODS_STATUS_OK;
+    }
+    CHECKALLOC(requests = (hsm_sign_request_t*) malloc(count * sizeof(hsm_sign_request_t)));
+    CHECKALLOC(params = (hsm_sign_params_t*) malloc(count * sizeof(hsm_sign_params_t)));
+    CHECKALLOC(rrsigs = (ldns_rr**) malloc(count * sizeof(ldns_rr*)));
+    for (i=0; i < count; i++) {
+        ods_log_assert(sigs[i].rr);
+        ods_log_assert(sigs[i].wire);
+        ods_log_assert(sigs[i].key_id);
+        ods_log_assert(sigs[i].key_id->dnskey);
+        ods_log_assert(sigs[i].key_id->params);
+        /* the owner is only read while signing, no need to copy it */
+        params[i].owner = sigs[i].key_id->params->owner;
+        params[i].algorithm = sigs[i].key_id->algorithm;
+        params[i].flags = sigs[i].key_id->flags;
+        params[i].inception = sigs[i].inception;
+        params[i].expiration = sigs[i].expiration;
+        params[i].keytag = sigs[i].key_id->params->keytag;
+        requests[i].rrset = NULL;
+        requests[i].rr = sigs[i].rr;
+        requests[i].wire = sigs[i].wire;
+        requests[i].wire_len = sigs[i].wire_len;
+        requests[i].key = keylookup(ctx, sigs[i].key_id->locator);
+        requests[i].params = &params[i];
+        ods_log_deeebug("[%s] sign RRset[%i] with key %s tag %u", hsm_str,
+            ldns_rr_get_type(sigs[i].rr),
+            sigs[i].key_id->locator?sigs[i].key_id->locator:"(null)",
+            params[i].keytag);
+    }
+    result = hsm_sign_rrset_batch(ctx, requests, count, rrsigs);
+    for (i=0; i < count; i++) {
+        if (result != HSM_OK) {
+            ldns_rr_free(rrsigs[i]);
+            rrsigs[i] = NULL;
+        }
+        sigs[i].rrsig = rrsigs[i];
+    }
+    free(rrsigs);
+    free(params);
+    free(requests);
+    if (result != HSM_OK) {
+        error = hsm_get_error(ctx);
+        if (error) {
+            ods_log_error("[%s] %s", hsm_str, error);
+            free((void*)error);
+        }
+        ods_log_crit("[%s] error signing rrset with libhsm", hsm_str);
+        return ODS_STATUS_HSM_ERR;
+    }
+    return ODS_STATUS_OK;
+}
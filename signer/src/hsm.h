@@ -53,6 +53,17 @@
  */
 ods_status lhsm_get_key(hsm_ctx_t* ctx, ldns_rdf* owner, key_type* key_id, int skip_hsm_access);
 
+typedef struct lhsm_sign_struct lhsm_sign_type;
+struct lhsm_sign_struct {
+    ldns_rr* rr;
+    const uint8_t* wire;
+    size_t wire_len;
+    key_type* key_id;
+    time_t inception;
+    time_t expiration;
+    ldns_rr* rrsig;
+};
+
 /**
  * Get RRSIG from one of the HSMs, given a RRset and a key.
  * \param[in] ctx HSM context
@@ -67,4 +78,16 @@ ods_status lhsm_get_key(hsm_ctx_t* ctx, ldns_rdf* owner, key_type* key_id, int s
 ldns_rr* lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     ldns_rdf* owner, time_t inception, time_t expiration);
 
+/**
+ * Get a batch of RRSIGs from the HSMs in one go.
+ * The RRsets are given in canonical wire format, with one of their RRs.
+ * On failure no signatures are returned.
+ * \param[in] ctx HSM context
+ * \param[in,out] sigs RRsets and keys to sign with, receives the RRSIGs
+ * \param[in] count number of signatures
+ * \return ods_status status
+ *
+ */
+ods_status lhsm_sign_batch(hsm_ctx_t* ctx, lhsm_sign_type* sigs, size_t count);
+
 #endif /* SHARED_HSM_H */
@@ -87,9 +87,17 @@ static void
 program_setup(const char* cfgfile, int cmdline_verbosity)
 {
     const char* file = NULL;
+    int use_syslog = 0;
+    int verbosity = ODS_SE_VERBOSITY;
+    xmlXPathContextPtr xpathCtx = NULL;
     /* open log */
-    file = parse_conf_log_filename(cfgfile);
-    ods_log_init("ods-signerd", parse_conf_use_syslog(cfgfile), file, cmdline_verbosity?cmdline_verbosity:parse_conf_verbosity(cfgfile));
+    if (parse_file_open(cfgfile, NULL, &xpathCtx) == ODS_STATUS_OK) {
+        file = parse_conf_log_filename(xpathCtx);
+        use_syslog = parse_conf_use_syslog(xpathCtx);
+        verbosity = parse_conf_verbosity(xpathCtx);
+        parse_file_close(xpathCtx);
+    }
+    ods_log_init("ods-signerd", use_syslog, file, cmdline_verbosity?cmdline_verbosity:verbosity);
 
     ods_log_verbose("[engine] starting signer");
 
@@ -105,6 +113,7 @@ program_setup(const char* cfgfile, int cmdline_verbosity)
 static void
 program_teardown()
 {
+    parse_file_cleanup();
     xmlCleanupParser();
     xmlCleanupGlobals();
     xmlCleanupThreads();
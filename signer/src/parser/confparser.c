@@ -40,6 +40,7 @@
 #include <libxml/xpath.h>
 #include <libxml/relaxng.h>
 #include <libxml/xmlreader.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/un.h>
@@ -48,24 +49,110 @@ static const char* parser_str = "parser";
 
 
 /**
- * Parse elements from the configuration file.
+ * Compiled RelaxNG schemas, kept for the lifetime of the process.
+ *
+ */
+typedef struct parse_schema_struct parse_schema_type;
+struct parse_schema_struct {
+    parse_schema_type* next;
+    char* rngfile;
+    xmlRelaxNGPtr schema;
+};
+static parse_schema_type* parse_schemas = NULL;
+static pthread_mutex_t parse_schemas_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Get the compiled RelaxNG schema.
+ *
+ */
+xmlRelaxNGPtr
+parse_file_schema(const char* rngfile)
+{
+    parse_schema_type* entry = NULL;
+    xmlRelaxNGParserCtxtPtr rngpctx = NULL;
+    xmlRelaxNGPtr schema = NULL;
+
+    if (!rngfile) {
+        return NULL;
+    }
+    pthread_mutex_lock(&parse_schemas_lock);
+    for (entry = parse_schemas; entry; entry = entry->next) {
+        if (strcmp(entry->rngfile, rngfile) == 0) {
+            schema = entry->schema;
+            break;
+        }
+    }
+    if (!schema) {
+        ods_log_debug("[%s] compile rngfile %s", parser_str, rngfile);
+        /* Create an XML RelaxNGs parser context for the relax-ng file. */
+        rngpctx = xmlRelaxNGNewParserCtxt(rngfile);
+        if (rngpctx == NULL) {
+            ods_log_error("[%s] unable to parse file: "
+               "xmlRelaxNGNewParserCtxt() failed", parser_str);
+        } else {
+            /* Parse a schema definition resource and
+             * build an internal XML schema structure.
+             */
+            schema = xmlRelaxNGParse(rngpctx);
+            xmlRelaxNGFreeParserCtxt(rngpctx);
+            if (schema == NULL) {
+                ods_log_error("[%s] unable to parse file: xmlRelaxNGParse() "
+                    "failed for rngfile %s", parser_str, rngfile);
+            } else {
+                CHECKALLOC(entry = (parse_schema_type*) malloc(
+                    sizeof(parse_schema_type)));
+                CHECKALLOC(entry->rngfile = strdup(rngfile));
+                entry->schema = schema;
+                entry->next = parse_schemas;
+                parse_schemas = entry;
+            }
+        }
+    }
+    pthread_mutex_unlock(&parse_schemas_lock);
+    return schema;
+}
+
+
+/**
+ * Clean up the compiled RelaxNG schemas.
+ *
+ */
+void
+parse_file_cleanup(void)
+{
+    parse_schema_type* entry = NULL;
+    pthread_mutex_lock(&parse_schemas_lock);
+    while (parse_schemas) {
+        entry = parse_schemas;
+        parse_schemas = entry->next;
+        xmlRelaxNGFree(entry->schema);
+        free(entry->rngfile);
+        free(entry);
+    }
+    pthread_mutex_unlock(&parse_schemas_lock);
+}
+
+
+/**
+ * Open a configuration file.
  *
  */
 ods_status
-parse_file_check(const char* cfgfile, const char* rngfile)
+parse_file_open(const char* cfgfile, const char* rngfile,
+    xmlXPathContextPtr* xpathCtx)
 {
     xmlDocPtr doc = NULL;
-    xmlDocPtr rngdoc = NULL;
-    xmlRelaxNGParserCtxtPtr rngpctx = NULL;
-    xmlRelaxNGValidCtxtPtr rngctx = NULL;
     xmlRelaxNGPtr schema = NULL;
+    xmlRelaxNGValidCtxtPtr rngctx = NULL;
     int status = 0;
 
-    if (!cfgfile || !rngfile) {
+    if (!cfgfile || !xpathCtx) {
         return ODS_STATUS_ASSERT_ERR;
     }
-    ods_log_debug("[%s] check cfgfile %s with rngfile %s", parser_str,
-        cfgfile, rngfile);
+    *xpathCtx = NULL;
+    ods_log_debug("[%s] open cfgfile %s with rngfile %s", parser_str,
+        cfgfile, rngfile?rngfile:"-");
     /* Load XML document */
     doc = xmlParseFile(cfgfile);
     if (doc == NULL) {
@@ -73,66 +160,79 @@ parse_file_check(const char* cfgfile, const char* rngfile)
             parser_str, cfgfile);
         return ODS_STATUS_XML_ERR;
     }
-    /* Load rng document */
-    rngdoc = xmlParseFile(rngfile);
-    if (rngdoc == NULL) {
-        ods_log_error("[%s] unable to parse file: failed to load rngfile %s",
-            parser_str, rngfile);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_XML_ERR;
+    if (rngfile) {
+        schema = parse_file_schema(rngfile);
+        if (schema == NULL) {
+            xmlFreeDoc(doc);
+            return ODS_STATUS_PARSE_ERR;
+        }
+        /* Create an XML RelaxNGs validation context. */
+        rngctx = xmlRelaxNGNewValidCtxt(schema);
+        if (rngctx == NULL) {
+            ods_log_error("[%s] unable to parse file: "
+                "xmlRelaxNGNewValidCtxt() failed", parser_str);
+            xmlFreeDoc(doc);
+            return ODS_STATUS_RNG_ERR;
+        }
+        /* Validate a document tree in memory. */
+        status = xmlRelaxNGValidateDoc(rngctx, doc);
+        xmlRelaxNGFreeValidCtxt(rngctx);
+        if (status != 0) {
+            ods_log_error("[%s] unable to parse file: "
+                "xmlRelaxNGValidateDoc() failed for cfgfile %s", parser_str,
+                cfgfile);
+            xmlFreeDoc(doc);
+            return ODS_STATUS_RNG_ERR;
+        }
     }
-    /* Create an XML RelaxNGs parser context for the relax-ng document. */
-    rngpctx = xmlRelaxNGNewDocParserCtxt(rngdoc);
-    if (rngpctx == NULL) {
-        ods_log_error("[%s] unable to parse file: "
-           "xmlRelaxNGNewDocParserCtxt() failed", parser_str);
-        xmlFreeDoc(rngdoc);
+    /* Create xpath evaluation context */
+    *xpathCtx = xmlXPathNewContext(doc);
+    if (*xpathCtx == NULL) {
+        ods_log_error("[%s] unable to parse file %s: xmlXPathNewContext() "
+            "failed", parser_str, cfgfile);
         xmlFreeDoc(doc);
         return ODS_STATUS_XML_ERR;
     }
-    /* Parse a schema definition resource and
-     * build an internal XML schema structure.
-     */
-    schema = xmlRelaxNGParse(rngpctx);
-    if (schema == NULL) {
-        ods_log_error("[%s] unable to parse file: xmlRelaxNGParse() failed",
-            parser_str);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_PARSE_ERR;
-    }
-    /* Create an XML RelaxNGs validation context. */
-    rngctx = xmlRelaxNGNewValidCtxt(schema);
-    if (rngctx == NULL) {
-        ods_log_error("[%s] unable to parse file: xmlRelaxNGNewValidCtxt() "
-            "failed", parser_str);
-        xmlRelaxNGFree(schema);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_RNG_ERR;
-    }
-    /* Validate a document tree in memory. */
-    status = xmlRelaxNGValidateDoc(rngctx,doc);
-    if (status != 0) {
-        ods_log_error("[%s] unable to parse file: xmlRelaxNGValidateDoc() "
-            "failed", parser_str);
-        xmlRelaxNGFreeValidCtxt(rngctx);
-        xmlRelaxNGFree(schema);
-        xmlRelaxNGFreeParserCtxt(rngpctx);
-        xmlFreeDoc(rngdoc);
-        xmlFreeDoc(doc);
-        return ODS_STATUS_RNG_ERR;
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Close a configuration file.
+ *
+ */
+void
+parse_file_close(xmlXPathContextPtr xpathCtx)
+{
+    xmlDocPtr doc = NULL;
+    if (!xpathCtx) {
+        return;
     }
-    xmlRelaxNGFreeValidCtxt(rngctx);
-    xmlRelaxNGFree(schema);
-    xmlRelaxNGFreeParserCtxt(rngpctx);
-    xmlFreeDoc(rngdoc);
+    doc = xpathCtx->doc;
+    xmlXPathFreeContext(xpathCtx);
     xmlFreeDoc(doc);
-    return ODS_STATUS_OK;
 }
 
+
+/**
+ * Check config file with rng file.
+ *
+ */
+ods_status
+parse_file_check(const char* cfgfile, const char* rngfile)
+{
+    xmlXPathContextPtr xpathCtx = NULL;
+    ods_status status = ODS_STATUS_OK;
+
+    if (!cfgfile || !rngfile) {
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    status = parse_file_open(cfgfile, rngfile, &xpathCtx);
+    parse_file_close(xpathCtx);
+    return status;
+}
+
+
 /* TODO: look how the enforcer reads this now */
 
 /**
@@ -140,10 +240,8 @@ parse_file_check(const char* cfgfile, const char* rngfile)
  *
  */
 hsm_repository_t*
-parse_conf_repositories(const char* cfgfile)
+parse_conf_repositories(xmlXPathContextPtr xpathCtx)
 {
-    xmlDocPtr doc = NULL;
-    xmlXPathContextPtr xpathCtx = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
     xmlNode* curNode = NULL;
     xmlChar* xexpr = NULL;
@@ -158,27 +256,10 @@ parse_conf_repositories(const char* cfgfile)
     hsm_repository_t* rlist = NULL;
     hsm_repository_t* repo  = NULL;
 
-    /* Load XML document */
-    doc = xmlParseFile(cfgfile);
-    if (doc == NULL) {
-        ods_log_error("[%s] could not parse <RepositoryList>: "
-            "xmlParseFile() failed", parser_str);
-        return NULL;
-    }
-    /* Create xpath evaluation context */
-    xpathCtx = xmlXPathNewContext(doc);
-    if(xpathCtx == NULL) {
-        xmlFreeDoc(doc);
-        ods_log_error("[%s] could not parse <RepositoryList>: "
-            "xmlXPathNewContext() failed", parser_str);
-        return NULL;
-    }
     /* Evaluate xpath expression */
     xexpr = (xmlChar*) "//Configuration/RepositoryList/Repository";
     xpathObj = xmlXPathEvalExpression(xexpr, xpathCtx);
     if(xpathObj == NULL) {
-        xmlXPathFreeContext(xpathCtx);
-        xmlFreeDoc(doc);
         ods_log_error("[%s] could not parse <RepositoryList>: "
             "xmlXPathEvalExpression failed", parser_str);
         return NULL;
@@ -232,10 +313,6 @@ parse_conf_repositories(const char* cfgfile)
     }
 
     xmlXPathFreeObject(xpathObj);
-    xmlXPathFreeContext(xpathCtx);
-    if (doc) {
-        xmlFreeDoc(doc);
-    }
     return rlist;
 }
 
@@ -245,42 +322,23 @@ parse_conf_repositories(const char* cfgfile)
  *
  */
 listener_type*
-parse_conf_listener(const char* cfgfile)
+parse_conf_listener(xmlXPathContextPtr xpathCtx)
 {
     listener_type* listener = NULL;
     interface_type* interface = NULL;
     int i = 0;
     char* address = NULL;
     const char* port = NULL;
-    xmlDocPtr doc = NULL;
-    xmlXPathContextPtr xpathCtx = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
     xmlNode* curNode = NULL;
     xmlChar* xexpr = NULL;
 
-    ods_log_assert(cfgfile);
+    ods_log_assert(xpathCtx);
 
-    /* Load XML document */
-    doc = xmlParseFile(cfgfile);
-    if (doc == NULL) {
-        ods_log_error("[%s] could not parse <Listener>: "
-            "xmlParseFile() failed", parser_str);
-        return NULL;
-    }
-    /* Create xpath evaluation context */
-    xpathCtx = xmlXPathNewContext(doc);
-    if(xpathCtx == NULL) {
-        xmlFreeDoc(doc);
-        ods_log_error("[%s] could not parse <Listener>: "
-            "xmlXPathNewContext() failed", parser_str);
-        return NULL;
-    }
     /* Evaluate xpath expression */
     xexpr = (xmlChar*) "//Configuration/Signer/Listener/Interface";
     xpathObj = xmlXPathEvalExpression(xexpr, xpathCtx);
     if(xpathObj == NULL) {
-        xmlXPathFreeContext(xpathCtx);
-        xmlFreeDoc(doc);
         ods_log_error("[%s] could not parse <Listener>: "
             "xmlXPathEvalExpression failed", parser_str);
         return NULL;
@@ -335,10 +393,6 @@ parse_conf_listener(const char* cfgfile)
         }
     }
     xmlXPathFreeObject(xpathObj);
-    xmlXPathFreeContext(xpathCtx);
-    if (doc) {
-        xmlFreeDoc(doc);
-    }
     return listener;
 }
 
@@ -348,32 +402,16 @@ parse_conf_listener(const char* cfgfile)
  *
  */
 const char*
-parse_conf_string(const char* cfgfile, const char* expr, int required)
+parse_conf_string(xmlXPathContextPtr xpathCtx, const char* expr,
+    int required)
 {
-    xmlDocPtr doc = NULL;
-    xmlXPathContextPtr xpathCtx = NULL;
     xmlXPathObjectPtr xpathObj = NULL;
     xmlChar *xexpr = NULL;
     const char* string = NULL;
 
     ods_log_assert(expr);
-    ods_log_assert(cfgfile);
+    ods_log_assert(xpathCtx);
 
-    /* Load XML document */
-    doc = xmlParseFile(cfgfile);
-    if (doc == NULL) {
-        ods_log_error("[%s] unable to parse file %s: xmlParseFile() failed",
-            parser_str, cfgfile);
-        return NULL;
-    }
-    /* Create xpath evaluation context */
-    xpathCtx = xmlXPathNewContext(doc);
-    if (xpathCtx == NULL) {
-        ods_log_error("[%s] unable to parse file %s: xmlXPathNewContext() "
-            "failed", parser_str, cfgfile);
-        xmlFreeDoc(doc);
-        return NULL;
-    }
     /* Get string */
     xexpr = (unsigned char*) expr;
     xpathObj = xmlXPathEvalExpression(xexpr, xpathCtx);
@@ -381,44 +419,33 @@ parse_conf_string(const char* cfgfile, const char* expr, int required)
         xpathObj->nodesetval->nodeNr <= 0) {
         if (required) {
             ods_log_error("[%s] unable to evaluate expression %s in cfgile %s",
-                parser_str, (char*) xexpr, cfgfile);
+                parser_str, (char*) xexpr,
+                (const char*) xpathCtx->doc->URL);
         }
-        xmlXPathFreeContext(xpathCtx);
         if (xpathObj) {
             xmlXPathFreeObject(xpathObj);
         }
-        xmlFreeDoc(doc);
         return NULL;
     }
-    if (xpathObj->nodesetval != NULL &&
-        xpathObj->nodesetval->nodeNr > 0) {
-        string = (const char*) xmlXPathCastToString(xpathObj);
-        xmlXPathFreeContext(xpathCtx);
-        xmlXPathFreeObject(xpathObj);
-        xmlFreeDoc(doc);
-        return string;
-    }
-    xmlXPathFreeContext(xpathCtx);
+    string = (const char*) xmlXPathCastToString(xpathObj);
     xmlXPathFreeObject(xpathObj);
-    xmlFreeDoc(doc);
-    return NULL;
+    return string;
 }
 
 /*
- *  TODO all parse routines parse the complete file. Yuk!
  *  TODO make a parse_conf_bool for testing existence of empty elements
  *      instead of abusing parse_conf_string
  * */
 
 const char*
-parse_conf_zonelist_filename(const char* cfgfile)
+parse_conf_zonelist_filename(xmlXPathContextPtr xpathCtx)
 {
     int lwd = 0;
     int lzl = 0;
     int found = 0;
     char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Enforcer/WorkingDirectory",
         0);
 
@@ -450,14 +477,14 @@ parse_conf_zonelist_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_log_filename(const char* cfgfile)
+parse_conf_log_filename(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Common/Logging/Syslog/Facility",
         0);
     if (!str) {
-        str = parse_conf_string(cfgfile,
+        str = parse_conf_string(xpathCtx,
             "//Configuration/Common/Logging/File/Filename",
             0);
     }
@@ -470,11 +497,11 @@ parse_conf_log_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_pid_filename(const char* cfgfile)
+parse_conf_pid_filename(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Signer/PidFile",
         0);
 
@@ -489,11 +516,11 @@ parse_conf_pid_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_notify_command(const char* cfgfile)
+parse_conf_notify_command(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Signer/NotifyCommand",
         0);
 
@@ -506,11 +533,11 @@ parse_conf_notify_command(const char* cfgfile)
 
 
 const char*
-parse_conf_clisock_filename(const char* cfgfile)
+parse_conf_clisock_filename(xmlXPathContextPtr xpathCtx)
 {
     char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Signer/SocketFile",
         0);
 
@@ -529,11 +556,11 @@ parse_conf_clisock_filename(const char* cfgfile)
 
 
 const char*
-parse_conf_working_dir(const char* cfgfile)
+parse_conf_working_dir(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Signer/WorkingDirectory",
         0);
 
@@ -549,11 +576,11 @@ parse_conf_working_dir(const char* cfgfile)
 
 
 const char*
-parse_conf_username(const char* cfgfile)
+parse_conf_username(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Signer/Privileges/User",
         0);
 
@@ -566,11 +593,11 @@ parse_conf_username(const char* cfgfile)
 
 
 const char*
-parse_conf_group(const char* cfgfile)
+parse_conf_group(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Signer/Privileges/Group",
         0);
 
@@ -583,11 +610,11 @@ parse_conf_group(const char* cfgfile)
 
 
 const char*
-parse_conf_chroot(const char* cfgfile)
+parse_conf_chroot(xmlXPathContextPtr xpathCtx)
 {
     const char* dup = NULL;
     const char* str = parse_conf_string(
-        cfgfile,
+        xpathCtx,
         "//Configuration/Signer/Privileges/Directory",
         0);
 
@@ -604,9 +631,9 @@ parse_conf_chroot(const char* cfgfile)
  *
  */
 int
-parse_conf_use_syslog(const char* cfgfile)
+parse_conf_use_syslog(xmlXPathContextPtr xpathCtx)
 {
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Common/Logging/Syslog/Facility",
         0);
     if (str) {
@@ -617,10 +644,10 @@ parse_conf_use_syslog(const char* cfgfile)
 }
 
 int
-parse_conf_verbosity(const char* cfgfile)
+parse_conf_verbosity(xmlXPathContextPtr xpathCtx)
 {
 	int verbosity = ODS_SE_VERBOSITY;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Common/Logging/Verbosity",
         0);
     if (str) {
@@ -634,10 +661,10 @@ parse_conf_verbosity(const char* cfgfile)
 
 
 int
-parse_conf_worker_threads(const char* cfgfile)
+parse_conf_worker_threads(xmlXPathContextPtr xpathCtx)
 {
     int numwt = ODS_SE_WORKERTHREADS;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Signer/WorkerThreads",
         0);
     if (str) {
@@ -651,10 +678,10 @@ parse_conf_worker_threads(const char* cfgfile)
 
 
 int
-parse_conf_signer_threads(const char* cfgfile)
+parse_conf_signer_threads(xmlXPathContextPtr xpathCtx)
 {
     int numwt = ODS_SE_WORKERTHREADS;
-    const char* str = parse_conf_string(cfgfile,
+    const char* str = parse_conf_string(xpathCtx,
         "//Configuration/Signer/SignerThreads",
         0);
     if (str) {
@@ -665,5 +692,56 @@ parse_conf_signer_threads(const char* cfgfile)
         return numwt;
     }
     /* no SignerThreads value configured, look at WorkerThreads */
-    return parse_conf_worker_threads(cfgfile);
+    return parse_conf_worker_threads(xpathCtx);
+}
+
+
+int
+parse_conf_signer_batch_size(xmlXPathContextPtr xpathCtx)
+{
+    int batchsize = ODS_SE_SIGNERBATCHSIZE;
+    const char* str = parse_conf_string(xpathCtx,
+        "//Configuration/Signer/SignerBatchSize",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            batchsize = atoi(str);
+        }
+        free((void*)str);
+    }
+    return batchsize;
+}
+
+
+int
+parse_conf_ixfr_history(xmlXPathContextPtr xpathCtx)
+{
+    int history = ODS_SE_IXFRHISTORY;
+    const char* str = parse_conf_string(xpathCtx,
+        "//Configuration/Signer/IxfrHistory",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            history = atoi(str);
+        }
+        free((void*)str);
+    }
+    return history;
+}
+
+
+int
+parse_conf_listener_threads(xmlXPathContextPtr xpathCtx)
+{
+    int numlt = ODS_SE_LISTENERTHREADS;
+    const char* str = parse_conf_string(xpathCtx,
+        "//Configuration/Signer/Listener/Threads",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numlt = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numlt;
 }
@@ -37,8 +37,46 @@
 #include "hsm.h"
 #include "status.h"
 
+#include <libxml/relaxng.h>
+#include <libxml/xpath.h>
+
 #define ADMAX 6 /* Maximum number of adapters that can be initialized */
 
+/**
+ * Get the compiled rng file.  Every rng file is compiled only once
+ * and kept until parse_file_cleanup().
+ * \param[in] rngfile the rng file name
+ * \return xmlRelaxNGPtr compiled schema, NULL on error
+ *
+ */
+xmlRelaxNGPtr parse_file_schema(const char* rngfile);
+
+/**
+ * Clean up the compiled rng files.
+ *
+ */
+void parse_file_cleanup(void);
+
+/**
+ * Open a configuration file: parse it and check it with the rng file.
+ * The file is parsed once, the elements are then looked up in the
+ * returned XPath context.
+ * \param[in] cfgfile the configuration file name
+ * \param[in] rngfile the rng file name, NULL to skip the check
+ * \param[out] xpathCtx XPath context of the parsed file
+ * \return ods_status status
+ *
+ */
+ods_status parse_file_open(const char* cfgfile, const char* rngfile,
+    xmlXPathContextPtr* xpathCtx);
+
+/**
+ * Close a configuration file.
+ * \param[in] xpathCtx XPath context of the parsed file
+ *
+ */
+void parse_file_close(xmlXPathContextPtr xpathCtx);
+
 /**
  * Check config file with rng file.
  * \param[in] cfgfile the configuration file name
@@ -50,66 +88,67 @@ ods_status parse_file_check(const char* cfgfile, const char* rngfile);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile configuration file
+ * \param[in] xpathCtx XPath context of the configuration file
  * \param[in] expr xml expression
  * \param[in] required if the element is required
  * \return const char* string value
  *
  */
-const char* parse_conf_string(const char* cfgfile, const char* expr,
+const char* parse_conf_string(xmlXPathContextPtr xpathCtx, const char* expr,
     int required);
 
 /**
  * Parse the repository list.
- * \param[in] cfgfile the configuration file name
+ * \param[in] xpathCtx XPath context of the configuration file
  * \return hsm_repository_t* repositories
  *
  */
-hsm_repository_t* parse_conf_repositories(const char* cfgfile);
+hsm_repository_t* parse_conf_repositories(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse the listener interfaces.
- * \param[in] allocator the allocator
- * \param[in] cfgfile the configuration file name
+ * \param[in] xpathCtx XPath context of the configuration file
  * \return listener_type* listener interfaces
  *
  */
-listener_type* parse_conf_listener(const char* cfgfile);
+listener_type* parse_conf_listener(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] allocator the allocator
- * \param[in] cfgfile the configuration file name
+ * \param[in] xpathCtx XPath context of the configuration file
  * \return const char* string
  *
  */
 
 /** Common */
-const char* parse_conf_zonelist_filename(const char* cfgfile);
-const char* parse_conf_log_filename(const char* cfgfile);
+const char* parse_conf_zonelist_filename(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_log_filename(xmlXPathContextPtr xpathCtx);
 
 /** Signer specific */
-const char* parse_conf_pid_filename(const char* cfgfile);
-const char* parse_conf_notify_command(const char* cfgfile);
-const char* parse_conf_clisock_filename(const char* cfgfile);
-const char* parse_conf_working_dir(const char* cfgfile);
-const char* parse_conf_username(const char* cfgfile);
-const char* parse_conf_group(const char* cfgfile);
-const char* parse_conf_chroot(const char* cfgfile);
+const char* parse_conf_pid_filename(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_notify_command(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_clisock_filename(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_working_dir(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_username(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_group(xmlXPathContextPtr xpathCtx);
+const char* parse_conf_chroot(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile the configuration file name
+ * \param[in] xpathCtx XPath context of the configuration file
  * \return int integer
  *
  */
 
 /** Common */
-int parse_conf_use_syslog(const char* cfgfile);
-int parse_conf_verbosity(const char* cfgfile);
+int parse_conf_use_syslog(xmlXPathContextPtr xpathCtx);
+int parse_conf_verbosity(xmlXPathContextPtr xpathCtx);
 
 /** Signer specific */
-int parse_conf_worker_threads(const char* cfgfile);
-int parse_conf_signer_threads(const char* cfgfile);
+int parse_conf_worker_threads(xmlXPathContextPtr xpathCtx);
+int parse_conf_signer_threads(xmlXPathContextPtr xpathCtx);
+int parse_conf_signer_batch_size(xmlXPathContextPtr xpathCtx);
+int parse_conf_ixfr_history(xmlXPathContextPtr xpathCtx);
+int parse_conf_listener_threads(xmlXPathContextPtr xpathCtx);
 
 #endif /* PARSE_CONFPARSER_H */
@@ -43,71 +43,71 @@
 /**
  * Parse keys from the signer configuration file.
  * \param[in] sc signer configuration reference
- * \param[in] cfgfile the configuration file name.
+ * \param[in] xpathCtx XPath context of the signer configuration file
  * \return keylist_type* key list
  *
  */
-keylist_type* parse_sc_keys(void* sc, const char* cfgfile);
+keylist_type* parse_sc_keys(void* sc, xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile the configuration file name.
+ * \param[in] xpathCtx XPath context of the signer configuration file
  * \return duration_type* duration
  *
  */
-duration_type* parse_sc_sig_resign_interval(const char* cfgfile);
-duration_type* parse_sc_sig_refresh_interval(const char* cfgfile);
-duration_type* parse_sc_sig_validity_default(const char* cfgfile);
-duration_type* parse_sc_sig_validity_denial(const char* cfgfile);
-duration_type* parse_sc_sig_validity_keyset(const char* cfgfile);
-duration_type* parse_sc_sig_jitter(const char* cfgfile);
-duration_type* parse_sc_sig_inception_offset(const char* cfgfile);
-duration_type* parse_sc_dnskey_ttl(const char* cfgfile);
-const char** parse_sc_dnskey_sigrrs(const char* cfgfile);
-duration_type* parse_sc_nsec3param_ttl(const char* cfgfile);
-duration_type* parse_sc_soa_ttl(const char* cfgfile);
-duration_type* parse_sc_soa_min(const char* cfgfile);
-duration_type* parse_sc_max_zone_ttl(const char* cfgfile);
+duration_type* parse_sc_sig_resign_interval(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_sig_refresh_interval(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_sig_validity_default(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_sig_validity_denial(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_sig_validity_keyset(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_sig_jitter(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_sig_inception_offset(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_dnskey_ttl(xmlXPathContextPtr xpathCtx);
+const char** parse_sc_dnskey_sigrrs(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_nsec3param_ttl(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_soa_ttl(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_soa_min(xmlXPathContextPtr xpathCtx);
+duration_type* parse_sc_max_zone_ttl(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile the configuration file name.
+ * \param[in] xpathCtx XPath context of the signer configuration file
  * \return ldns_rr_type rr type
  *
  */
-ldns_rr_type parse_sc_nsec_type(const char* cfgfile);
+ldns_rr_type parse_sc_nsec_type(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile the configuration file name.
+ * \param[in] xpathCtx XPath context of the signer configuration file
  * \return uint32_t integer
  *
  */
-uint32_t parse_sc_nsec3_algorithm(const char* cfgfile);
-uint32_t parse_sc_nsec3_iterations(const char* cfgfile);
+uint32_t parse_sc_nsec3_algorithm(xmlXPathContextPtr xpathCtx);
+uint32_t parse_sc_nsec3_iterations(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile the configuration file name.
+ * \param[in] xpathCtx XPath context of the signer configuration file
  * \return int integer
  *
  */
-int parse_sc_nsec3_optout(const char* cfgfile);
+int parse_sc_nsec3_optout(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile the configuration file name.
+ * \param[in] xpathCtx XPath context of the signer configuration file
  * \return boolean
  */
-int parse_sc_passthrough(const char* cfgfile);
+int parse_sc_passthrough(xmlXPathContextPtr xpathCtx);
 
 /**
  * Parse elements from the configuration file.
- * \param[in] cfgfile the configuration file name.
+ * \param[in] xpathCtx XPath context of the signer configuration file
  * \return const char* string
  *
  */
-const char* parse_sc_soa_serial(const char* cfgfile);
-const char* parse_sc_nsec3_salt(const char* cfgfile);
+const char* parse_sc_soa_serial(xmlXPathContextPtr xpathCtx);
+const char* parse_sc_nsec3_salt(xmlXPathContextPtr xpathCtx);
 
 #endif /* PARSER_SIGNCONFPARSER_H */
@@ -30,6 +30,7 @@
  */
 
 #include "adapter/adapter.h"
+#include "parser/confparser.h"
 #include "parser/zonelistparser.h"
 #include "file.h"
 #include "log.h"
@@ -37,36 +38,65 @@
 #include "signer/zonelist.h"
 #include "signer/zone.h"
 
-#include <libxml/xpath.h>
 #include <libxml/xmlreader.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 static const char* parser_str = "parser";
 
 
 /**
- * Parse expr inside XPath Context.
+ * Update the hash of a zonelist entry (32-bit FNV-1a).  The terminating
+ * zero is included, so that adjacent fields do not run together.
  *
  */
-static const char*
-parse_zonelist_element(xmlXPathContextPtr xpathCtx, xmlChar* expr)
+static uint32_t
+zlp_hash(uint32_t sum, const char* str)
 {
-    xmlXPathObjectPtr xpathObj = NULL;
-    const char* str = NULL;
+    const unsigned char* p = (const unsigned char*) (str?str:"");
+    do {
+        sum ^= *p;
+        sum *= 16777619U;
+    } while (*p++);
+    return sum;
+}
 
-    ods_log_assert(xpathCtx);
-    ods_log_assert(expr);
 
-    xpathObj = xmlXPathEvalExpression(expr, xpathCtx);
-    if (xpathObj == NULL) {
-        ods_log_error("[%s] unable to evaluate xpath expression %s",
-            parser_str, expr);
-        return NULL;
+/**
+ * Compute the hash of a zonelist entry.
+ *
+ */
+static uint32_t
+zlp_hash_zone(zone_type* zone)
+{
+    uint32_t sum = 2166136261U;
+    sum = zlp_hash(sum, zone->policy_name);
+    sum = zlp_hash(sum, zone->signconf_filename);
+    sum = zlp_hash(sum, zone->adinbound->type == ADAPTER_DNS?"DNS":"File");
+    sum = zlp_hash(sum, zone->adinbound->configstr);
+    sum = zlp_hash(sum, zone->adoutbound->type == ADAPTER_DNS?"DNS":"File");
+    sum = zlp_hash(sum, zone->adoutbound->configstr);
+    return sum;
+}
+
+
+/**
+ * Compare zone names, ignoring case and a trailing dot.
+ *
+ */
+static int
+zlp_name_match(const char* a, const char* b)
+{
+    size_t alen = strlen(a);
+    size_t blen = strlen(b);
+    if (alen > 1 && a[alen-1] == '.') {
+        alen--;
+    }
+    if (blen > 1 && b[blen-1] == '.') {
+        blen--;
     }
-    str = (const char*) xmlXPathCastToString(xpathObj);
-    xmlXPathFreeObject(xpathObj);
-    return str;
+    return alen == blen && strncasecmp(a, b, alen) == 0;
 }
 
 
@@ -96,93 +126,100 @@ zlp_adapter(xmlNode* curNode, adapter_mode type, unsigned inbound)
  *
  */
 static adapter_type*
-parse_zonelist_adapter(xmlXPathContextPtr xpathCtx, xmlChar* expr,
-    int inbound)
+parse_zonelist_adapter(xmlNode* node, int inbound)
 {
-    xmlXPathObjectPtr xpathObj = NULL;
     xmlNode* curNode = NULL;
     xmlChar* type = NULL;
     adapter_type* adapter = NULL;
-    int i = 0;
 
-    if (!xpathCtx || !expr) {
-        return NULL;
-    }
-    xpathObj = xmlXPathEvalExpression(expr, xpathCtx);
-    if (xpathObj == NULL) {
-        ods_log_error("[%s] unable to parse adapter: xmlPathEvalExpression() "
-            "failed (expr %s)", parser_str, expr);
-        return NULL;
-    }
-    if (xpathObj->nodesetval) {
-        for (i=0; i < xpathObj->nodesetval->nodeNr; i++) {
-            curNode = xpathObj->nodesetval->nodeTab[i]->xmlChildrenNode;
-            while (curNode) {
-                if (xmlStrEqual(curNode->name, (const xmlChar*)"File")) {
-                    adapter = zlp_adapter(curNode, ADAPTER_FILE, inbound);
-                } else if (xmlStrEqual(curNode->name,
-                    (const xmlChar*)"Adapter")) {
-                    type = xmlGetProp(curNode, (const xmlChar*)"type");
-                    if (xmlStrEqual(type, (const xmlChar*)"File")) {
-                        adapter = zlp_adapter(curNode, ADAPTER_FILE, inbound);
-                    } else if (xmlStrEqual(type, (const xmlChar*)"DNS")) {
-                        adapter = zlp_adapter(curNode, ADAPTER_DNS, inbound);
-                    } else {
-                        ods_log_error("[%s] unable to parse %s adapter: "
-                            "unknown type", parser_str, (const char*) type);
-                    }
-                    free((void*)type);
-                    type = NULL;
-                }
-                if (adapter) {
-		    xmlXPathFreeObject(xpathObj);
-		    return adapter;
-                }
-                curNode = curNode->next;
+    for (curNode = node->children; curNode; curNode = curNode->next) {
+        if (curNode->type != XML_ELEMENT_NODE) {
+            continue;
+        }
+        if (xmlStrEqual(curNode->name, (const xmlChar*)"File")) {
+            adapter = zlp_adapter(curNode, ADAPTER_FILE, inbound);
+        } else if (xmlStrEqual(curNode->name, (const xmlChar*)"Adapter")) {
+            type = xmlGetProp(curNode, (const xmlChar*)"type");
+            if (xmlStrEqual(type, (const xmlChar*)"File")) {
+                adapter = zlp_adapter(curNode, ADAPTER_FILE, inbound);
+            } else if (xmlStrEqual(type, (const xmlChar*)"DNS")) {
+                adapter = zlp_adapter(curNode, ADAPTER_DNS, inbound);
+            } else {
+                ods_log_error("[%s] unable to parse %s adapter: "
+                    "unknown type", parser_str, (const char*) type);
             }
+            free((void*)type);
+            type = NULL;
+        }
+        if (adapter) {
+            return adapter;
         }
     }
-    xmlXPathFreeObject(xpathObj);
     return NULL;
 }
 
 
 /**
- * Parse the adapters.
+ * Parse the contents of a zone element.
  *
  */
 static void
-parse_zonelist_adapters(xmlXPathContextPtr xpathCtx, zone_type* zone)
+parse_zonelist_zone(xmlNode* node, zone_type* zone)
 {
-    xmlChar* i_expr = (xmlChar*) "//Zone/Adapters/Input";
-    xmlChar* o_expr = (xmlChar*) "//Zone/Adapters/Output";
+    xmlNode* curNode = NULL;
+    xmlNode* adNode = NULL;
 
-    if (!xpathCtx || !zone) {
-        return;
+    for (curNode = node->children; curNode; curNode = curNode->next) {
+        if (curNode->type != XML_ELEMENT_NODE) {
+            continue;
+        }
+        if (xmlStrEqual(curNode->name, (const xmlChar*)"Policy")) {
+            if (!zone->policy_name) {
+                zone->policy_name = (const char*) xmlNodeGetContent(curNode);
+            }
+        } else if (xmlStrEqual(curNode->name,
+            (const xmlChar*)"SignerConfiguration")) {
+            if (!zone->signconf_filename) {
+                zone->signconf_filename =
+                    (const char*) xmlNodeGetContent(curNode);
+            }
+        } else if (xmlStrEqual(curNode->name, (const xmlChar*)"Adapters")) {
+            for (adNode = curNode->children; adNode; adNode = adNode->next) {
+                if (adNode->type != XML_ELEMENT_NODE) {
+                    continue;
+                }
+                if (xmlStrEqual(adNode->name, (const xmlChar*)"Input") &&
+                    !zone->adinbound) {
+                    zone->adinbound = parse_zonelist_adapter(adNode, 1);
+                } else if (xmlStrEqual(adNode->name,
+                    (const xmlChar*)"Output") && !zone->adoutbound) {
+                    zone->adoutbound = parse_zonelist_adapter(adNode, 0);
+                }
+            }
+        }
     }
-    zone->adinbound  = parse_zonelist_adapter(xpathCtx, i_expr, 1);
-    zone->adoutbound = parse_zonelist_adapter(xpathCtx, o_expr, 0);
 }
 
 
 /**
  * Parse the zonelist file.
  *
+ * The file is read as a stream: only the Zone element at hand is
+ * expanded into a tree, and it is validated along the way.
+ *
  */
 ods_status
-parse_zonelist_zones(void* zlist, const char* zlfile)
+parse_zonelist_zones(void* zlist, const char* zlfile, const char* rngfile,
+    const char* zonename)
 {
-    char* tag_name = NULL;
     char* zone_name = NULL;
     zone_type* new_zone = NULL;
+    xmlNode* node = NULL;
     int ret = 0;
     int error = 0;
     xmlTextReaderPtr reader = NULL;
-    xmlDocPtr doc = NULL;
-    xmlXPathContextPtr xpathCtx = NULL;
+    xmlRelaxNGPtr schema = NULL;
     xmlChar* name_expr = (unsigned char*) "name";
-    xmlChar* policy_expr = (unsigned char*) "//Zone/Policy";
-    xmlChar* signconf_expr = (unsigned char*) "//Zone/SignerConfiguration";
 
     if (!zlist || !zlfile) {
         ods_log_error("[%s] unable to parse zonelist: no storage or no filename",
@@ -195,87 +232,88 @@ parse_zonelist_zones(void* zlist, const char* zlfile)
             parser_str, zlfile);
         return ODS_STATUS_XML_ERR;
     }
+    if (rngfile && ((schema = parse_file_schema(rngfile)) == NULL ||
+        xmlTextReaderRelaxNGSetSchema(reader, schema) != 0)) {
+        ods_log_error("[%s] unable to parse zonelist: failed to load rngfile "
+            "%s", parser_str, rngfile);
+        xmlFreeTextReader(reader);
+        return ODS_STATUS_RNG_ERR;
+    }
     ret = xmlTextReaderRead(reader);
-    while (ret == XML_READER_TYPE_ELEMENT) {
-        tag_name = (char*) xmlTextReaderLocalName(reader);
-        if (ods_strcmp(tag_name, "Zone") == 0 &&
-            ods_strcmp(tag_name, "ZoneList") != 0 &&
-            xmlTextReaderNodeType(reader) == XML_READER_TYPE_ELEMENT) {
-            /* Found a zone */
-            zone_name = (char*) xmlTextReaderGetAttribute(reader,
-                name_expr);
-            if (!zone_name || strlen(zone_name) <= 0) {
-                ods_log_alert("[%s] unable to extract zone name from "
-                    "zonelist %s, skipping...", parser_str, zlfile);
-                if (zone_name) {
-                    free((void*) zone_name);
-                }
-                free((void*) tag_name);
-                ret = xmlTextReaderRead(reader);
-                continue;
-            }
-            /* Expand this node to get the rest of the info */
-            xmlTextReaderExpand(reader);
-            doc = xmlTextReaderCurrentDoc(reader);
-            if (doc) {
-                xpathCtx = xmlXPathNewContext(doc);
-            }
-            if (doc == NULL || xpathCtx == NULL) {
-                ods_log_alert("[%s] unable to read zone %s, skipping...",
-                   parser_str, zone_name);
-                ret = xmlTextReaderRead(reader);
-                free((void*) zone_name);
-                free((void*) tag_name);
-                continue;
-            }
-            /* That worked, now read out the contents... */
-            new_zone = zone_create(zone_name, LDNS_RR_CLASS_IN);
-            if (new_zone) {
-                new_zone->policy_name = parse_zonelist_element(xpathCtx,
-                    policy_expr);
-                new_zone->signconf_filename = parse_zonelist_element(xpathCtx,
-                    signconf_expr);
-                parse_zonelist_adapters(xpathCtx, new_zone);
-                if (!new_zone->policy_name || !new_zone->signconf_filename ||
-                    !new_zone->adinbound || !new_zone->adoutbound) {
-                    zone_cleanup(new_zone);
-                    new_zone = NULL;
-                    ods_log_crit("[%s] unable to create zone %s", parser_str,
-                        zone_name);
-                    error = 1;
-                } else if (zonelist_add_zone((zonelist_type*) zlist, new_zone)
+    while (ret == 1) {
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT ||
+            !xmlStrEqual(xmlTextReaderConstLocalName(reader),
+            (const xmlChar*) "Zone")) {
+            ret = xmlTextReaderRead(reader);
+            continue;
+        }
+        /* Found a zone */
+        zone_name = (char*) xmlTextReaderGetAttribute(reader, name_expr);
+        if (!zone_name || strlen(zone_name) <= 0) {
+            ods_log_alert("[%s] unable to extract zone name from "
+                "zonelist %s, skipping...", parser_str, zlfile);
+            free((void*) zone_name);
+            ret = xmlTextReaderNext(reader);
+            continue;
+        }
+        if (zonename && !zlp_name_match(zone_name, zonename)) {
+            /* not the zone we are looking for */
+            free((void*) zone_name);
+            ret = xmlTextReaderNext(reader);
+            continue;
+        }
+        /* Expand this node to get the rest of the info */
+        node = xmlTextReaderExpand(reader);
+        if (!node) {
+            ods_log_alert("[%s] unable to read zone %s, skipping...",
+               parser_str, zone_name);
+            free((void*) zone_name);
+            ret = xmlTextReaderNext(reader);
+            continue;
+        }
+        /* That worked, now read out the contents... */
+        new_zone = zone_create(zone_name, LDNS_RR_CLASS_IN);
+        if (new_zone) {
+            parse_zonelist_zone(node, new_zone);
+            if (!new_zone->policy_name || !new_zone->signconf_filename ||
+                !new_zone->adinbound || !new_zone->adoutbound) {
+                zone_cleanup(new_zone);
+                new_zone = NULL;
+                ods_log_crit("[%s] unable to create zone %s", parser_str,
+                    zone_name);
+                error = 1;
+            } else {
+                new_zone->zl_hash = zlp_hash_zone(new_zone);
+                if (zonelist_add_zone((zonelist_type*) zlist, new_zone)
                     == NULL) {
                     ods_log_crit("[%s] unable to add zone %s", parser_str,
                         zone_name);
-                    zone_cleanup(new_zone);
                     new_zone = NULL;
                     error = 1;
                 }
-            } else {
-                ods_log_crit("[%s] unable to create zone %s", parser_str,
-                    zone_name);
-                error = 1;
-            }
-            xmlXPathFreeContext(xpathCtx);
-            xpathCtx = NULL;
-            free((void*) zone_name);
-            if (error) {
-                free((void*) tag_name);
-                tag_name = NULL;
-                ret = 1;
-                break;
             }
-            ods_log_debug("[%s] zone %s added", parser_str, new_zone->name);
+        } else {
+            ods_log_crit("[%s] unable to create zone %s", parser_str,
+                zone_name);
+            error = 1;
         }
-        free((void*) tag_name);
-        ret = xmlTextReaderRead(reader);
+        free((void*) zone_name);
+        if (error) {
+            ret = -1;
+            break;
+        }
+        ods_log_debug("[%s] zone %s added", parser_str, new_zone->name);
+        ret = xmlTextReaderNext(reader);
     }
     /* no more zones */
     ods_log_debug("[%s] no more zones", parser_str);
-    xmlFreeTextReader(reader);
-    if (doc) {
-        xmlFreeDoc(doc);
+    if (ret == 0 && rngfile && xmlTextReaderIsValid(reader) != 1) {
+        ods_log_error("[%s] unable to parse zonelist: %s does not validate "
+            "against %s", parser_str, zlfile, rngfile);
+        xmlFreeTextReader(reader);
+        return ODS_STATUS_RNG_ERR;
     }
+    xmlFreeTextReader(reader);
     if (ret != 0) {
         ods_log_error("[%s] unable to parse zonelist: parse error in %s",
             parser_str, zlfile);
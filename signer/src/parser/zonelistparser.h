@@ -35,16 +35,18 @@
 #include "adapter/adapter.h"
 #include "status.h"
 
-#include <libxml/xpath.h>
 #include <libxml/xmlreader.h>
 
 /**
  * Parse the zonelist file.
  * \param[in] zlist zone list storage
  * \param[in] zlfile zonelist file name
+ * \param[in] rngfile RelaxNG schema to validate against, NULL for none
+ * \param[in] zonename only read the entry of this zone, NULL for all
  * \return ods_status status
  *
  */
-ods_status parse_zonelist_zones(void* zlist, const char* zlfile);
+ods_status parse_zonelist_zones(void* zlist, const char* zlfile,
+    const char* rngfile, const char* zonename);
 
 #endif /* PARSER_ZONELISTPARSER_H */
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Zone lifetime memory arena for the name database.
+ *
+ */
+
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "signer/arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* allocations are rounded up to this */
+#define ARENA_ALIGN 16
+/* larger allocations are passed on to malloc */
+#define ARENA_SMALL_MAX 512
+#define ARENA_CLASSES (ARENA_SMALL_MAX / ARENA_ALIGN)
+#define ARENA_BLOCK_SIZE (256 * 1024)
+
+/**
+ * Block of memory, small allocations are carved from the end of it.
+ *
+ */
+typedef struct arena_block_struct arena_block_type;
+struct arena_block_struct {
+    arena_block_type* next;
+};
+
+/**
+ * Memory given back, kept for reuse by the next allocation of its size.
+ *
+ */
+typedef struct arena_chunk_struct arena_chunk_type;
+struct arena_chunk_struct {
+    arena_chunk_type* next;
+};
+
+/**
+ * Allocation too large to be carved from a block, kept in a list so
+ * that it goes with the arena.
+ *
+ */
+typedef struct arena_large_struct arena_large_type;
+struct arena_large_struct {
+    arena_large_type* next;
+    arena_large_type* prev;
+};
+
+struct arena_struct {
+    arena_block_type* blocks;
+    arena_large_type* large;
+    char* pos;
+    size_t left;
+    arena_chunk_type* recycle[ARENA_CLASSES];
+};
+
+
+/**
+ * Create arena.
+ *
+ */
+arena_type*
+arena_create(void)
+{
+    arena_type* arena = NULL;
+    CHECKALLOC(arena = (arena_type*) calloc(1, sizeof(arena_type)));
+    return arena;
+}
+
+
+/**
+ * Round size up to the alignment.
+ *
+ */
+static size_t
+arena_round(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+}
+
+
+/**
+ * Allocate memory from the arena.
+ *
+ */
+void*
+arena_alloc(arena_type* arena, size_t size)
+{
+    arena_block_type* block = NULL;
+    arena_chunk_type* chunk = NULL;
+    arena_large_type* large = NULL;
+    size_t header = arena_round(sizeof(arena_block_type));
+    size_t idx;
+    void* ptr = NULL;
+
+    ods_log_assert(arena);
+    size = arena_round(size ? size : 1);
+    if (size > ARENA_SMALL_MAX) {
+        header = arena_round(sizeof(arena_large_type));
+        CHECKALLOC(large = (arena_large_type*) calloc(1, header + size));
+        large->next = arena->large;
+        if (arena->large) {
+            arena->large->prev = large;
+        }
+        arena->large = large;
+        return (char*) large + header;
+    }
+    idx = size / ARENA_ALIGN - 1;
+    chunk = arena->recycle[idx];
+    if (chunk) {
+        arena->recycle[idx] = chunk->next;
+        memset(chunk, 0, size);
+        return chunk;
+    }
+    if (arena->left < size) {
+        CHECKALLOC(block = (arena_block_type*) malloc(ARENA_BLOCK_SIZE));
+        block->next = arena->blocks;
+        arena->blocks = block;
+        arena->pos = (char*) block + header;
+        arena->left = ARENA_BLOCK_SIZE - header;
+    }
+    ptr = arena->pos;
+    arena->pos += size;
+    arena->left -= size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+
+/**
+ * Give memory back to the arena.
+ *
+ */
+void
+arena_free(arena_type* arena, void* ptr, size_t size)
+{
+    arena_chunk_type* chunk = (arena_chunk_type*) ptr;
+    arena_large_type* large = NULL;
+    size_t idx;
+
+    if (!arena || !ptr) {
+        return;
+    }
+    size = arena_round(size ? size : 1);
+    if (size > ARENA_SMALL_MAX) {
+        large = (arena_large_type*) ((char*) ptr -
+            arena_round(sizeof(arena_large_type)));
+        if (large->prev) {
+            large->prev->next = large->next;
+        } else {
+            arena->large = large->next;
+        }
+        if (large->next) {
+            large->next->prev = large->prev;
+        }
+        free(large);
+        return;
+    }
+    idx = size / ARENA_ALIGN - 1;
+    chunk->next = arena->recycle[idx];
+    arena->recycle[idx] = chunk;
+}
+
+
+/**
+ * Size of an allocation that holds a structure and a domain name.
+ *
+ */
+size_t
+arena_dname_size(size_t size, const ldns_rdf* dname)
+{
+    return arena_round(size) + sizeof(ldns_rdf) + ldns_rdf_size(dname);
+}
+
+
+/**
+ * Copy a domain name into memory after a structure.
+ *
+ */
+ldns_rdf*
+arena_dname_copy(void* mem, size_t size, const ldns_rdf* dname)
+{
+    ldns_rdf* rdf = (ldns_rdf*) ((char*) mem + arena_round(size));
+    uint8_t* data = (uint8_t*) (rdf + 1);
+    memcpy(data, ldns_rdf_data(dname), ldns_rdf_size(dname));
+    ldns_rdf_set_size(rdf, ldns_rdf_size(dname));
+    ldns_rdf_set_type(rdf, LDNS_RDF_TYPE_DNAME);
+    ldns_rdf_set_data(rdf, data);
+    return rdf;
+}
+
+
+/**
+ * Clean up arena.
+ *
+ */
+void
+arena_cleanup(arena_type* arena)
+{
+    arena_block_type* block = NULL;
+    arena_large_type* large = NULL;
+    if (!arena) {
+        return;
+    }
+    while (arena->blocks) {
+        block = arena->blocks;
+        arena->blocks = block->next;
+        free(block);
+    }
+    while (arena->large) {
+        large = arena->large;
+        arena->large = large->next;
+        free(large);
+    }
+    free(arena);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Zone lifetime memory arena for the name database.
+ *
+ */
+
+#ifndef SIGNER_ARENA_H
+#define SIGNER_ARENA_H
+
+#include "config.h"
+#include <ldns/ldns.h>
+#include <stddef.h>
+
+typedef struct arena_struct arena_type;
+
+/**
+ * Create arena.
+ * \return arena_type* arena
+ *
+ */
+arena_type* arena_create(void);
+
+/**
+ * Allocate memory from the arena. Small allocations are carved from
+ * large blocks, and reuse memory that was given back with the same size.
+ * Larger ones are allocated on their own, but still go with the arena.
+ * \param[in] arena arena
+ * \param[in] size number of bytes
+ * \return void* zeroed memory
+ *
+ */
+void* arena_alloc(arena_type* arena, size_t size);
+
+/**
+ * Give memory back to the arena.
+ * \param[in] arena arena
+ * \param[in] ptr memory from arena_alloc()
+ * \param[in] size number of bytes, as given to arena_alloc()
+ *
+ */
+void arena_free(arena_type* arena, void* ptr, size_t size);
+
+/**
+ * Size of an allocation that holds a structure followed by a copy of
+ * a domain name.
+ * \param[in] size size of the structure
+ * \param[in] dname domain name
+ * \return size_t number of bytes
+ *
+ */
+size_t arena_dname_size(size_t size, const ldns_rdf* dname);
+
+/**
+ * Copy a domain name, in wire format, into memory after a structure.
+ * The copy must not be freed with ldns_rdf_deep_free().
+ * \param[in] mem allocation of arena_dname_size() bytes
+ * \param[in] size size of the structure
+ * \param[in] dname domain name
+ * \return ldns_rdf* copy of the domain name
+ *
+ */
+ldns_rdf* arena_dname_copy(void* mem, size_t size, const ldns_rdf* dname);
+
+/**
+ * Clean up arena, and all memory allocated from it.
+ * \param[in] arena arena
+ *
+ */
+void arena_cleanup(arena_type* arena);
+
+#endif /* SIGNER_ARENA_H */
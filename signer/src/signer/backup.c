@@ -40,7 +40,13 @@
 #include "signer/backup.h"
 #include "signer/zone.h"
 
+#include <ctype.h>
+#include <errno.h>
 #include <ldns/ldns.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static const char* backup_str = "backup";
 
@@ -490,6 +496,940 @@ backup_namedb_done:
 }
 
 
+#define BACKUP_SECTION_MAX 8
+#define BACKUP_INDEX_ENTRY_LEN 28
+#define BACKUP_TRAILER_LEN (16 + BACKUP_BINARY_MAGIC_LEN)
+
+struct backup_section_struct {
+    uint32_t type;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t checksum;
+};
+
+struct backup_writer_struct {
+    FILE* fd;
+    ldns_buffer* buf;
+    uint64_t offset;
+    struct backup_section_struct sections[BACKUP_SECTION_MAX];
+    size_t nsections;
+    unsigned error : 1;
+};
+
+
+/**
+ * Update checksum (32-bit FNV-1a).
+ *
+ */
+static uint32_t
+backup_checksum(uint32_t sum, const uint8_t* data, size_t len)
+{
+    size_t i;
+    for (i = 0; i < len; i++) {
+        sum ^= data[i];
+        sum *= 16777619U;
+    }
+    return sum;
+}
+#define BACKUP_CHECKSUM_INIT 2166136261U
+
+
+/**
+ * Write 64bit unsigned integer to buffer.
+ *
+ */
+static void
+backup_buffer_write_u64(ldns_buffer* buf, uint64_t v)
+{
+    ldns_buffer_write_u32(buf, (uint32_t) (v >> 32));
+    ldns_buffer_write_u32(buf, (uint32_t) v);
+}
+
+
+/**
+ * Read 64bit unsigned integer from memory.
+ *
+ */
+static uint64_t
+backup_read_u64(const uint8_t* data)
+{
+    return ((uint64_t) ldns_read_uint32(data) << 32) |
+        (uint64_t) ldns_read_uint32(data + 4);
+}
+
+
+/**
+ * Write the contents of the writer buffer to file, as part of the
+ * current section if there is one.
+ *
+ */
+static void
+backup_writer_flush(backup_writer_type* writer)
+{
+    struct backup_section_struct* section = NULL;
+    size_t len = ldns_buffer_position(writer->buf);
+    if (len && fwrite(ldns_buffer_begin(writer->buf), 1, len, writer->fd)
+        != len) {
+        writer->error = 1;
+    }
+    if (writer->nsections) {
+        section = &writer->sections[writer->nsections - 1];
+        section->checksum = backup_checksum(section->checksum,
+            ldns_buffer_begin(writer->buf), len);
+        section->length += len;
+    }
+    writer->offset += len;
+    ldns_buffer_clear(writer->buf);
+}
+
+
+/**
+ * Create a writer for the binary part of a backup file.
+ *
+ */
+backup_writer_type*
+backup_writer_create(FILE* fd)
+{
+    backup_writer_type* writer = NULL;
+    ods_log_assert(fd);
+    CHECKALLOC(writer = (backup_writer_type*) malloc(sizeof(backup_writer_type)));
+    CHECKALLOC(writer->buf = ldns_buffer_new(LDNS_MAX_PACKETLEN));
+    writer->fd = fd;
+    writer->offset = 0;
+    writer->nsections = 0;
+    writer->error = 0;
+    ldns_buffer_write(writer->buf, BACKUP_BINARY_MAGIC,
+        BACKUP_BINARY_MAGIC_LEN);
+    backup_writer_flush(writer);
+    return writer;
+}
+
+
+/**
+ * Start a new section.
+ *
+ */
+void
+backup_writer_section(backup_writer_type* writer, uint32_t type)
+{
+    struct backup_section_struct* section = NULL;
+    if (!writer || writer->error) {
+        return;
+    }
+    if (writer->nsections >= BACKUP_SECTION_MAX) {
+        ods_log_error("[%s] unable to write section: too many sections",
+            backup_str);
+        writer->error = 1;
+        return;
+    }
+    section = &writer->sections[writer->nsections++];
+    section->type = type;
+    section->count = 0;
+    section->offset = writer->offset;
+    section->length = 0;
+    section->checksum = BACKUP_CHECKSUM_INIT;
+}
+
+
+/**
+ * Put RR in wire format, preceded by its length, in the writer buffer.
+ *
+ */
+static int
+backup_writer_put_rr(backup_writer_type* writer, ldns_rr* rr)
+{
+    size_t len;
+    ldns_buffer_clear(writer->buf);
+    ldns_buffer_write_u16(writer->buf, 0);
+    if (ldns_rr2buffer_wire(writer->buf, rr, LDNS_SECTION_ANSWER)
+        != LDNS_STATUS_OK) {
+        log_rr(rr, "unable to backup RR", LOG_ERR);
+        writer->error = 1;
+        return 0;
+    }
+    len = ldns_buffer_position(writer->buf) - 2;
+    ldns_buffer_write_u16_at(writer->buf, 0, (uint16_t) len);
+    return 1;
+}
+
+
+/**
+ * Write RR to the current section.
+ *
+ */
+void
+backup_writer_rr(backup_writer_type* writer, ldns_rr* rr)
+{
+    if (!writer || !rr || writer->error || !writer->nsections) {
+        return;
+    }
+    if (backup_writer_put_rr(writer, rr)) {
+        writer->sections[writer->nsections - 1].count++;
+        backup_writer_flush(writer);
+    }
+}
+
+
+/**
+ * Write RRSIG with its key information to the current section.
+ *
+ */
+void
+backup_writer_rrsig(backup_writer_type* writer, ldns_rr* rr,
+    const char* locator, uint32_t flags)
+{
+    size_t len = (locator ? strlen(locator) : 0);
+    if (!writer || !rr || writer->error || !writer->nsections) {
+        return;
+    }
+    if (!backup_writer_put_rr(writer, rr)) {
+        return;
+    }
+    if (len > 0xffff || !ldns_buffer_reserve(writer->buf, 6 + len)) {
+        log_rr(rr, "unable to backup RRSIG", LOG_ERR);
+        writer->error = 1;
+        return;
+    }
+    ldns_buffer_write_u32(writer->buf, flags);
+    ldns_buffer_write_u16(writer->buf, (uint16_t) len);
+    ldns_buffer_write(writer->buf, locator, len);
+    writer->sections[writer->nsections - 1].count++;
+    backup_writer_flush(writer);
+}
+
+
+/**
+ * Write raw record to the current section.
+ *
+ */
+void
+backup_writer_data(backup_writer_type* writer, const uint8_t* data,
+    size_t len)
+{
+    if (!writer || !data || writer->error || !writer->nsections) {
+        return;
+    }
+    ldns_buffer_clear(writer->buf);
+    if (!ldns_buffer_reserve(writer->buf, len)) {
+        writer->error = 1;
+        return;
+    }
+    ldns_buffer_write(writer->buf, data, len);
+    writer->sections[writer->nsections - 1].count++;
+    backup_writer_flush(writer);
+}
+
+
+/**
+ * Finish the binary part.
+ *
+ */
+ods_status
+backup_writer_finish(backup_writer_type* writer)
+{
+    ods_status status = ODS_STATUS_OK;
+    uint64_t index = 0;
+    size_t i;
+    if (!writer) {
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    if (!writer->error) {
+        index = writer->offset;
+        for (i = 0; i < writer->nsections; i++) {
+            ldns_buffer_write_u32(writer->buf, writer->sections[i].type);
+            ldns_buffer_write_u32(writer->buf, writer->sections[i].count);
+            backup_buffer_write_u64(writer->buf, writer->sections[i].offset);
+            backup_buffer_write_u64(writer->buf, writer->sections[i].length);
+            ldns_buffer_write_u32(writer->buf, writer->sections[i].checksum);
+        }
+        ldns_buffer_write_u32(writer->buf, BACKUP_BINARY_VERSION);
+        ldns_buffer_write_u32(writer->buf, (uint32_t) writer->nsections);
+        backup_buffer_write_u64(writer->buf, index);
+        ldns_buffer_write(writer->buf, BACKUP_BINARY_MAGIC,
+            BACKUP_BINARY_MAGIC_LEN);
+        i = ldns_buffer_position(writer->buf);
+        if (fwrite(ldns_buffer_begin(writer->buf), 1, i, writer->fd) != i) {
+            writer->error = 1;
+        }
+    }
+    if (writer->error) {
+        status = ODS_STATUS_FWRITE_ERR;
+    }
+    ldns_buffer_free(writer->buf);
+    free(writer);
+    return status;
+}
+
+
+/**
+ * Find section in the index of the binary part.
+ *
+ */
+static const uint8_t*
+backup_binary_section(const uint8_t* data, uint64_t size, uint32_t type,
+    uint64_t* len, uint32_t* count)
+{
+    const uint8_t* trailer = data + size - BACKUP_TRAILER_LEN;
+    const uint8_t* entry = NULL;
+    uint64_t index = backup_read_u64(trailer + 8);
+    uint32_t nsections = ldns_read_uint32(trailer + 4);
+    uint64_t offset;
+    uint32_t i;
+
+    for (i = 0; i < nsections; i++) {
+        entry = data + index + i * BACKUP_INDEX_ENTRY_LEN;
+        if (ldns_read_uint32(entry) != type) {
+            continue;
+        }
+        offset = backup_read_u64(entry + 8);
+        *len = backup_read_u64(entry + 16);
+        *count = ldns_read_uint32(entry + 4);
+        if (offset < BACKUP_BINARY_MAGIC_LEN || offset > index ||
+            *len > index - offset) {
+            ods_log_error("[%s] section %u out of bounds", backup_str,
+                (unsigned) type);
+            return NULL;
+        }
+        if (backup_checksum(BACKUP_CHECKSUM_INIT, data + offset, *len) !=
+            ldns_read_uint32(entry + 24)) {
+            ods_log_error("[%s] section %u checksum mismatch", backup_str,
+                (unsigned) type);
+            return NULL;
+        }
+        return data + offset;
+    }
+    ods_log_error("[%s] section %u missing", backup_str, (unsigned) type);
+    return NULL;
+}
+
+
+/**
+ * Check the framing of the binary part.
+ *
+ */
+static int
+backup_binary_check(const uint8_t* data, uint64_t size)
+{
+    const uint8_t* trailer = NULL;
+    uint64_t index;
+    uint32_t nsections;
+    if (size < BACKUP_BINARY_MAGIC_LEN + BACKUP_TRAILER_LEN ||
+        memcmp(data, BACKUP_BINARY_MAGIC, BACKUP_BINARY_MAGIC_LEN) != 0) {
+        ods_log_error("[%s] binary part missing", backup_str);
+        return 0;
+    }
+    trailer = data + size - BACKUP_TRAILER_LEN;
+    if (memcmp(trailer + 16, BACKUP_BINARY_MAGIC, BACKUP_BINARY_MAGIC_LEN)
+        != 0) {
+        ods_log_error("[%s] binary part truncated", backup_str);
+        return 0;
+    }
+    if (ldns_read_uint32(trailer) != BACKUP_BINARY_VERSION) {
+        ods_log_error("[%s] binary part version %u not supported",
+            backup_str, (unsigned) ldns_read_uint32(trailer));
+        return 0;
+    }
+    nsections = ldns_read_uint32(trailer + 4);
+    index = backup_read_u64(trailer + 8);
+    if (nsections > BACKUP_SECTION_MAX || index > size ||
+        index + (uint64_t) nsections * BACKUP_INDEX_ENTRY_LEN !=
+        size - BACKUP_TRAILER_LEN) {
+        ods_log_error("[%s] binary part index corrupted", backup_str);
+        return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * Decode the next record of a section.
+ *
+ */
+static ldns_rr*
+backup_binary_rr(const uint8_t* data, uint64_t len, uint64_t* pos)
+{
+    ldns_rr* rr = NULL;
+    size_t rrpos = 0;
+    uint16_t rrlen;
+    if (len - *pos < 2) {
+        return NULL;
+    }
+    rrlen = ldns_read_uint16(data + *pos);
+    *pos += 2;
+    if (len - *pos < rrlen ||
+        ldns_wire2rr(&rr, data + *pos, rrlen, &rrpos, LDNS_SECTION_ANSWER)
+        != LDNS_STATUS_OK || rrpos != rrlen) {
+        ldns_rr_free(rr);
+        return NULL;
+    }
+    *pos += rrlen;
+    return rr;
+}
+
+
+/**
+ * Restore the RRs, NSEC(3)s and RRSIGs from the binary part.
+ *
+ */
+static ods_status
+backup_binary_namedb(zone_type* z, const uint8_t* data, uint64_t size)
+{
+    const uint8_t* section = NULL;
+    denial_type* denial = NULL;
+    rrset_type* rrset = NULL;
+    ldns_rr* rr = NULL;
+    ldns_rr_type type_covered;
+    ods_status result = ODS_STATUS_OK;
+    uint64_t len = 0, pos;
+    uint32_t count = 0, i, flags;
+    uint16_t loclen;
+    char* locator = NULL;
+
+    if (!backup_binary_check(data, size)) {
+        return ODS_STATUS_ERR;
+    }
+    /* NSEC3 hashes */
+    section = backup_binary_section(data, size, BACKUP_SECTION_NSEC3HASHES,
+        &len, &count);
+    if (!section || !nsec3hash_recover(z->db->hashes, section, len, count,
+        z->apex)) {
+        return ODS_STATUS_ERR;
+    }
+    /* RRs */
+    ods_log_debug("[%s] read RRs %s", backup_str, z->name);
+    section = backup_binary_section(data, size, BACKUP_SECTION_RRS, &len,
+        &count);
+    if (!section) {
+        return ODS_STATUS_ERR;
+    }
+    for (i = 0, pos = 0; i < count; i++) {
+        if (!(rr = backup_binary_rr(section, len, &pos))) {
+            ods_log_error("[%s] error reading RR #%u", backup_str, i + 1);
+            return ODS_STATUS_ERR;
+        }
+        result = adapi_add_rr(z, rr, 1);
+        if (result == ODS_STATUS_UNCHANGED) {
+            ldns_rr_free(rr);
+            result = ODS_STATUS_OK;
+        } else if (result != ODS_STATUS_OK) {
+            log_rr(rr, "error adding RR", LOG_ERR);
+            ldns_rr_free(rr);
+            return result;
+        }
+    }
+    namedb_diff(z->db, 0, 0);
+    /* NSEC(3)s */
+    ods_log_debug("[%s] read NSEC(3)s %s", backup_str, z->name);
+    section = backup_binary_section(data, size, BACKUP_SECTION_DENIALS, &len,
+        &count);
+    if (!section) {
+        return ODS_STATUS_ERR;
+    }
+    for (i = 0, pos = 0; i < count; i++) {
+        if (!(rr = backup_binary_rr(section, len, &pos))) {
+            ods_log_error("[%s] error reading NSEC(3) #%u", backup_str, i + 1);
+            return ODS_STATUS_ERR;
+        }
+        denial = NULL;
+        if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_NSEC ||
+            ldns_rr_get_type(rr) == LDNS_RR_TYPE_NSEC3) {
+            denial = namedb_lookup_denial(z->db, ldns_rr_owner(rr));
+        }
+        if (!denial) {
+            log_rr(rr, "error adding NSEC(3)", LOG_ERR);
+            ldns_rr_free(rr);
+            return ODS_STATUS_ERR;
+        }
+        denial_add_rr(denial, rr);
+    }
+    /* RRSIGs */
+    ods_log_debug("[%s] read RRSIGs %s", backup_str, z->name);
+    section = backup_binary_section(data, size, BACKUP_SECTION_RRSIGS, &len,
+        &count);
+    if (!section) {
+        return ODS_STATUS_ERR;
+    }
+    for (i = 0, pos = 0; i < count; i++) {
+        if (!(rr = backup_binary_rr(section, len, &pos)) ||
+            ldns_rr_get_type(rr) != LDNS_RR_TYPE_RRSIG || len - pos < 6) {
+            ods_log_error("[%s] error reading RRSIG #%u", backup_str, i + 1);
+            ldns_rr_free(rr);
+            return ODS_STATUS_ERR;
+        }
+        flags = ldns_read_uint32(section + pos);
+        loclen = ldns_read_uint16(section + pos + 4);
+        pos += 6;
+        if (len - pos < loclen) {
+            ods_log_error("[%s] error reading RRSIG #%u", backup_str, i + 1);
+            ldns_rr_free(rr);
+            return ODS_STATUS_ERR;
+        }
+        locator = NULL;
+        if (loclen) {
+            CHECKALLOC(locator = strndup((const char*) section + pos, loclen));
+        }
+        pos += loclen;
+        type_covered = ldns_rdf2rr_type(ldns_rr_rrsig_typecovered(rr));
+        if (type_covered == LDNS_RR_TYPE_NSEC ||
+            type_covered == LDNS_RR_TYPE_NSEC3) {
+            denial = namedb_lookup_denial(z->db, ldns_rr_owner(rr));
+            rrset = (denial ? denial->rrset : NULL);
+        } else {
+            rrset = zone_lookup_rrset(z, ldns_rr_owner(rr), type_covered);
+        }
+        if (!rrset) {
+            log_rr(rr, "error restoring RRSIG", LOG_ERR);
+            ldns_rr_free(rr);
+            free(locator);
+            return ODS_STATUS_ERR;
+        }
+        rrset_add_rrsig(rrset, rr, locator, flags);
+        rrset->needs_signing = 0;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Binary part of a backup file, mapped into memory or read.
+ *
+ */
+struct backup_map_struct {
+    uint8_t* map;
+    size_t maplen;
+    uint8_t* data;
+    uint64_t size;
+};
+
+
+/**
+ * Map file into memory from offset start on.
+ *
+ */
+static ods_status
+backup_map(FILE* in, long start, struct backup_map_struct* m)
+{
+    struct stat st;
+    m->map = NULL;
+    m->data = NULL;
+    m->maplen = 0;
+    m->size = 0;
+    if (start < 0 || fstat(fileno(in), &st) != 0 || st.st_size < start) {
+        ods_log_error("[%s] unable to locate binary part: %s", backup_str,
+            strerror(errno));
+        return ODS_STATUS_FSEEK_ERR;
+    }
+    m->size = (uint64_t) (st.st_size - start);
+    if (!m->size) {
+        return ODS_STATUS_OK;
+    }
+    m->maplen = (size_t) st.st_size;
+    m->map = mmap(NULL, m->maplen, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+    if (m->map != MAP_FAILED) {
+        (void) madvise(m->map, m->maplen, MADV_SEQUENTIAL);
+        m->data = m->map + start;
+        return ODS_STATUS_OK;
+    }
+    /* fall back to reading it */
+    m->map = NULL;
+    CHECKALLOC(m->data = (uint8_t*) malloc((size_t) m->size));
+    if (fseek(in, start, SEEK_SET) != 0 ||
+        fread(m->data, 1, (size_t) m->size, in) != (size_t) m->size) {
+        ods_log_error("[%s] unable to read binary part", backup_str);
+        free(m->data);
+        m->data = NULL;
+        return ODS_STATUS_FREAD_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Release mapped file.
+ *
+ */
+static void
+backup_unmap(struct backup_map_struct* m)
+{
+    if (m->map) {
+        munmap(m->map, m->maplen);
+    } else {
+        free(m->data);
+    }
+    m->map = NULL;
+    m->data = NULL;
+}
+
+
+/**
+ * Read namedb from the binary part of a backup file.
+ *
+ */
+ods_status
+backup_read_namedb_binary(FILE* in, void* zone)
+{
+    zone_type* z = (zone_type*) zone;
+    ods_status result = ODS_STATUS_OK;
+    struct backup_map_struct m;
+    int c;
+
+    ods_log_assert(in);
+    ods_log_assert(z);
+
+    /* the binary part starts on the line after the text part */
+    while ((c = fgetc(in)) != EOF && c != '\n') {
+        if (!isspace(c)) {
+            ods_log_error("[%s] unexpected data before binary part",
+                backup_str);
+            return ODS_STATUS_ERR;
+        }
+    }
+    result = backup_map(in, ftell(in), &m);
+    if (result != ODS_STATUS_OK) {
+        return result;
+    }
+    if (!m.size) {
+        ods_log_error("[%s] binary part missing", backup_str);
+        return ODS_STATUS_ERR;
+    }
+    result = backup_binary_namedb(z, m.data, m.size);
+    backup_unmap(&m);
+    return result;
+}
+
+
+/**
+ * Decode all records of a section.
+ *
+ */
+static ldns_rr**
+backup_binary_rrs(const uint8_t* section, uint64_t len, uint32_t count)
+{
+    ldns_rr** rrs = NULL;
+    uint64_t pos = 0;
+    uint32_t i;
+    CHECKALLOC(rrs = (ldns_rr**) calloc(count ? count : 1, sizeof(ldns_rr*)));
+    for (i = 0; i < count; i++) {
+        if (!(rrs[i] = backup_binary_rr(section, len, &pos))) {
+            ods_log_error("[%s] error reading journal RR #%u", backup_str,
+                i + 1);
+            while (i > 0) {
+                ldns_rr_free(rrs[--i]);
+            }
+            free(rrs);
+            return NULL;
+        }
+    }
+    return rrs;
+}
+
+
+/**
+ * Find the key an RRSIG was made with.
+ *
+ */
+static void
+backup_rrsig_key(zone_type* z, ldns_rr* rr, char** locator, uint32_t* flags)
+{
+    keylist_type* kl = z->signconf->keys;
+    uint16_t keytag = ldns_rdf2native_int16(ldns_rr_rrsig_keytag(rr));
+    uint8_t algorithm = ldns_rdf2native_int8(ldns_rr_rrsig_algorithm(rr));
+    size_t i;
+    *locator = NULL;
+    *flags = 0;
+    for (i = 0; kl && i < kl->count; i++) {
+        if (kl->keys[i].dnskey && kl->keys[i].locator &&
+            kl->keys[i].algorithm == algorithm &&
+            ldns_calc_keytag(kl->keys[i].dnskey) == keytag) {
+            CHECKALLOC(*locator = strdup(kl->keys[i].locator));
+            *flags = kl->keys[i].flags;
+            return;
+        }
+    }
+}
+
+
+/**
+ * Find the RRset an RRSIG belongs to.
+ *
+ */
+static rrset_type*
+backup_rrsig_rrset(zone_type* z, ldns_rr* rr)
+{
+    denial_type* denial = NULL;
+    ldns_rr_type type_covered;
+    type_covered = ldns_rdf2rr_type(ldns_rr_rrsig_typecovered(rr));
+    if (type_covered == LDNS_RR_TYPE_NSEC ||
+        type_covered == LDNS_RR_TYPE_NSEC3) {
+        denial = namedb_lookup_denial(z->db, ldns_rr_owner(rr));
+        return (denial ? denial->rrset : NULL);
+    }
+    return zone_lookup_rrset(z, ldns_rr_owner(rr), type_covered);
+}
+
+
+/**
+ * Replay one journal entry.
+ *
+ */
+static ods_status
+backup_journal_entry(zone_type* z, const uint8_t* data, uint64_t size)
+{
+    const uint8_t* meta = NULL;
+    const uint8_t* section = NULL;
+    ldns_rr** dels = NULL;
+    ldns_rr** adds = NULL;
+    uint32_t ndels = 0, nadds = 0, count = 0, i;
+    uint64_t len = 0;
+    ldns_rr_type type;
+    denial_type* denial = NULL;
+    rrset_type* rrset = NULL;
+    rrsig_type* rrsig = NULL;
+    ldns_rr* rr = NULL;
+    char* locator = NULL;
+    uint32_t flags = 0;
+    ods_status status = ODS_STATUS_OK;
+
+    if (!backup_binary_check(data, size)) {
+        return ODS_STATUS_ERR;
+    }
+    meta = backup_binary_section(data, size, BACKUP_SECTION_JOURNAL, &len,
+        &count);
+    if (!meta || count != 1 || len != 16) {
+        return ODS_STATUS_ERR;
+    }
+    if (ldns_read_uint32(meta) != z->db->outserial &&
+        !util_serial_gt(ldns_read_uint32(meta + 12), z->db->outserial)) {
+        /* left behind by a crash after a newer backup was written */
+        ods_log_warning("[%s] skipping journal entry to serial %u, backup "
+            "is at serial %u", backup_str,
+            (unsigned) ldns_read_uint32(meta + 12),
+            (unsigned) z->db->outserial);
+        return ODS_STATUS_UNCHANGED;
+    }
+    if (ldns_read_uint32(meta) != z->db->outserial) {
+        ods_log_error("[%s] journal entry from serial %u does not follow "
+            "serial %u", backup_str, (unsigned) ldns_read_uint32(meta),
+            (unsigned) z->db->outserial);
+        return ODS_STATUS_ERR;
+    }
+    section = backup_binary_section(data, size, BACKUP_SECTION_DELETES, &len,
+        &ndels);
+    if (!section || !(dels = backup_binary_rrs(section, len, ndels))) {
+        return ODS_STATUS_ERR;
+    }
+    section = backup_binary_section(data, size, BACKUP_SECTION_ADDS, &len,
+        &nadds);
+    if (!section || !(adds = backup_binary_rrs(section, len, nadds))) {
+        for (i = 0; i < ndels; i++) {
+            ldns_rr_free(dels[i]);
+        }
+        free(dels);
+        return ODS_STATUS_ERR;
+    }
+    /* zone data */
+    for (i = 0; i < ndels; i++) {
+        type = ldns_rr_get_type(dels[i]);
+        if (type != LDNS_RR_TYPE_RRSIG && type != LDNS_RR_TYPE_NSEC &&
+            type != LDNS_RR_TYPE_NSEC3) {
+            (void) adapi_del_rr(z, dels[i], 1);
+        }
+    }
+    for (i = 0; i < nadds && status == ODS_STATUS_OK; i++) {
+        type = ldns_rr_get_type(adds[i]);
+        if (type != LDNS_RR_TYPE_RRSIG && type != LDNS_RR_TYPE_NSEC &&
+            type != LDNS_RR_TYPE_NSEC3) {
+            status = adapi_add_rr(z, adds[i], 1);
+            if (status == ODS_STATUS_OK) {
+                adds[i] = NULL; /* owned by the zone now */
+            } else if (status == ODS_STATUS_UNCHANGED) {
+                status = ODS_STATUS_OK;
+            } else {
+                log_rr(adds[i], "error replaying RR", LOG_ERR);
+            }
+        }
+    }
+    if (status == ODS_STATUS_OK) {
+        namedb_diff(z->db, 1, 0);
+    }
+    /* NSEC(3)s, replacing the ones of their denial */
+    for (i = 0; i < nadds && status == ODS_STATUS_OK; i++) {
+        if (!adds[i]) {
+            continue;
+        }
+        type = ldns_rr_get_type(adds[i]);
+        if (type == LDNS_RR_TYPE_NSEC || type == LDNS_RR_TYPE_NSEC3) {
+            denial = namedb_lookup_denial(z->db, ldns_rr_owner(adds[i]));
+            if (!denial) {
+                log_rr(adds[i], "error replaying NSEC(3)", LOG_ERR);
+                status = ODS_STATUS_ERR;
+                break;
+            }
+            denial_add_rr(denial, adds[i]);
+            adds[i] = NULL;
+        }
+    }
+    /* RRSIGs */
+    for (i = 0; i < ndels && status == ODS_STATUS_OK; i++) {
+        if (ldns_rr_get_type(dels[i]) != LDNS_RR_TYPE_RRSIG ||
+            !(rrset = backup_rrsig_rrset(z, dels[i]))) {
+            continue;
+        }
+        while ((rrsig = collection_iterator(rrset->rrsigs))) {
+            rr = rrset_rrsig2ldns(rrset, rrsig);
+            if (ldns_rr_compare(rr, dels[i]) == 0) {
+                collection_del_cursor(rrset->rrsigs);
+            }
+            ldns_rr_free(rr);
+        }
+    }
+    for (i = 0; i < nadds && status == ODS_STATUS_OK; i++) {
+        if (!adds[i] || ldns_rr_get_type(adds[i]) != LDNS_RR_TYPE_RRSIG) {
+            continue;
+        }
+        rrset = backup_rrsig_rrset(z, adds[i]);
+        if (!rrset) {
+            log_rr(adds[i], "error replaying RRSIG", LOG_ERR);
+            status = ODS_STATUS_ERR;
+            break;
+        }
+        backup_rrsig_key(z, adds[i], &locator, &flags);
+        rrset_add_rrsig(rrset, adds[i], locator, flags);
+        rrset->needs_signing = 0;
+        adds[i] = NULL;
+    }
+    if (status == ODS_STATUS_OK) {
+        z->db->inbserial = ldns_read_uint32(meta + 4);
+        z->db->intserial = ldns_read_uint32(meta + 8);
+        z->db->outserial = ldns_read_uint32(meta + 12);
+    }
+    for (i = 0; i < ndels; i++) {
+        ldns_rr_free(dels[i]);
+    }
+    for (i = 0; i < nadds; i++) {
+        ldns_rr_free(adds[i]);
+    }
+    free(dels);
+    free(adds);
+    return status;
+}
+
+
+/**
+ * Replay backup journal.
+ *
+ */
+ods_status
+backup_read_journal(FILE* in, void* zone, uint64_t* size)
+{
+    zone_type* z = (zone_type*) zone;
+    struct backup_map_struct m;
+    ods_status result = ODS_STATUS_OK;
+    uint64_t pos = 0, len;
+    unsigned entries = 0, skipped = 0;
+
+    ods_log_assert(in);
+    ods_log_assert(z);
+    result = backup_map(in, 0, &m);
+    if (result != ODS_STATUS_OK) {
+        return result;
+    }
+    while (m.size - pos >= 8) {
+        len = backup_read_u64(m.data + pos);
+        if (!len || len > m.size - pos - 8) {
+            /* an entry that was not completed */
+            ods_log_warning("[%s] ignoring incomplete journal entry at "
+                "offset %lu", backup_str, (unsigned long) pos);
+            break;
+        }
+        result = backup_journal_entry(z, m.data + pos + 8, len);
+        if (result == ODS_STATUS_UNCHANGED) {
+            result = ODS_STATUS_OK;
+            pos += 8 + len;
+            skipped++;
+            continue;
+        }
+        if (result != ODS_STATUS_OK) {
+            ods_log_error("[%s] error replaying journal entry at offset %lu",
+                backup_str, (unsigned long) pos);
+            break;
+        }
+        pos += 8 + len;
+        entries++;
+    }
+    ods_log_debug("[%s] replayed %u journal entries for zone %s",
+        backup_str, entries, z->name);
+    backup_unmap(&m);
+    if (size) {
+        /* a stale journal is not appended to, the next backup replaces it */
+        *size = (skipped ? 0 : pos);
+    }
+    return result;
+}
+
+
+/**
+ * Append an IXFR part to the backup journal.
+ *
+ */
+ods_status
+backup_write_journal(FILE* fd, void* zone, part_type* part)
+{
+    zone_type* z = (zone_type*) zone;
+    backup_writer_type* writer = NULL;
+    ods_status status = ODS_STATUS_OK;
+    uint8_t meta[16];
+    uint8_t lenbuf[8];
+    long start, end;
+    size_t i;
+
+    ods_log_assert(fd);
+    ods_log_assert(z);
+    ods_log_assert(part);
+    ods_log_assert(part->soamin);
+    start = ftell(fd);
+    memset(lenbuf, 0, sizeof(lenbuf));
+    if (start < 0 || fwrite(lenbuf, 1, sizeof(lenbuf), fd) != sizeof(lenbuf)) {
+        return ODS_STATUS_FWRITE_ERR;
+    }
+    writer = backup_writer_create(fd);
+    backup_writer_section(writer, BACKUP_SECTION_JOURNAL);
+    ldns_write_uint32(meta, ldns_rdf2native_int32(
+        ldns_rr_rdf(part->soamin, SE_SOA_RDATA_SERIAL)));
+    ldns_write_uint32(meta + 4, z->db->inbserial);
+    ldns_write_uint32(meta + 8, z->db->intserial);
+    ldns_write_uint32(meta + 12, z->db->outserial);
+    backup_writer_data(writer, meta, sizeof(meta));
+    backup_writer_section(writer, BACKUP_SECTION_DELETES);
+    for (i = 0; i < ldns_rr_list_rr_count(part->min); i++) {
+        backup_writer_rr(writer, ldns_rr_list_rr(part->min, i));
+    }
+    backup_writer_section(writer, BACKUP_SECTION_ADDS);
+    for (i = 0; i < ldns_rr_list_rr_count(part->plus); i++) {
+        backup_writer_rr(writer, ldns_rr_list_rr(part->plus, i));
+    }
+    status = backup_writer_finish(writer);
+    if (status != ODS_STATUS_OK) {
+        return status;
+    }
+    /* the length goes in last, once the entry itself is on disk */
+    end = ftell(fd);
+    if (end < 0 || fflush(fd) != 0 || fsync(fileno(fd)) != 0) {
+        return ODS_STATUS_FWRITE_ERR;
+    }
+    ldns_write_uint32(lenbuf, (uint32_t) ((uint64_t) (end - start - 8) >> 32));
+    ldns_write_uint32(lenbuf + 4, (uint32_t) (end - start - 8));
+    if (fseek(fd, start, SEEK_SET) != 0 ||
+        fwrite(lenbuf, 1, sizeof(lenbuf), fd) != sizeof(lenbuf) ||
+        fseek(fd, end, SEEK_SET) != 0 || fflush(fd) != 0 ||
+        fsync(fileno(fd)) != 0) {
+        return ODS_STATUS_FWRITE_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
 /**
  * Read ixfr journal from file.
  *
@@ -39,6 +39,49 @@
 
 #include <ldns/ldns.h>
 
+/**
+ * Binary backup.
+ *
+ * Backup files with ODS_SE_FILE_MAGIC_V4 carry the zone, signconf and
+ * key information as text, like before, and the RRs in wire format.
+ * The binary part starts with BACKUP_BINARY_MAGIC, followed by the
+ * sections and an index of them, and ends with a trailer:
+ *
+ *   section:  records, each a 16-bit length and a wire format RR.
+ *             RRSIG records are followed by the 32-bit key flags and
+ *             the 16-bit length and bytes of the key locator.  The
+ *             NSEC3HASHES section holds the NSEC3 hash cache, see
+ *             nsec3hash_backup().
+ *   index:    per section the 32-bit type and record count, the 64-bit
+ *             offset and length, and the 32-bit checksum of its records.
+ *   trailer:  32-bit version and section count, 64-bit index offset and
+ *             BACKUP_BINARY_MAGIC.
+ *
+ * Integers are in network byte order, offsets count from the start of
+ * the binary part.
+ *
+ * The backup journal (<zone>.backup2.journal) holds the changes made
+ * since the backup was written.  Every entry is a 64-bit length followed
+ * by a binary part with a JOURNAL section (the serial the entry starts
+ * from and the new inbound, internal and outbound serials), and the
+ * DELETES and ADDS sections with the RRs removed and added.
+ *
+ */
+#define BACKUP_BINARY_MAGIC "ODSBKP\r\n"
+#define BACKUP_BINARY_MAGIC_LEN 8
+#define BACKUP_BINARY_VERSION 2
+#define BACKUP_SECTION_RRS 1
+#define BACKUP_SECTION_DENIALS 2
+#define BACKUP_SECTION_RRSIGS 3
+#define BACKUP_SECTION_JOURNAL 4
+#define BACKUP_SECTION_DELETES 5
+#define BACKUP_SECTION_ADDS 6
+#define BACKUP_SECTION_NSEC3HASHES 7
+
+typedef struct backup_writer_struct backup_writer_type;
+
+#include "signer/ixfr.h"
+
 /**
  * Read token from backup file.
  * \param[in] in input file descriptor
@@ -128,6 +171,93 @@ int backup_read_uint32_t(FILE* in, uint32_t* v);
  */
 ods_status backup_read_namedb(FILE* in, void* zone);
 
+/**
+ * Read namedb from the binary part of a backup file.
+ * \param[in] in input file descriptor, positioned at the binary part
+ * \param[in] zone zone reference
+ * \return ods_status status
+ *
+ */
+ods_status backup_read_namedb_binary(FILE* in, void* zone);
+
+/**
+ * Create a writer for the binary part of a backup file.
+ * \param[in] fd output file descriptor
+ * \return backup_writer_type* writer
+ *
+ */
+backup_writer_type* backup_writer_create(FILE* fd);
+
+/**
+ * Start a new section.
+ * \param[in] writer writer
+ * \param[in] type section type, one of BACKUP_SECTION_*
+ *
+ */
+void backup_writer_section(backup_writer_type* writer, uint32_t type);
+
+/**
+ * Write RR to the current section.
+ * \param[in] writer writer
+ * \param[in] rr RR
+ *
+ */
+void backup_writer_rr(backup_writer_type* writer, ldns_rr* rr);
+
+/**
+ * Write RRSIG with its key information to the current section.
+ * \param[in] writer writer
+ * \param[in] rr RRSIG
+ * \param[in] locator key locator
+ * \param[in] flags key flags
+ *
+ */
+void backup_writer_rrsig(backup_writer_type* writer, ldns_rr* rr,
+    const char* locator, uint32_t flags);
+
+/**
+ * Write raw record to the current section.
+ * \param[in] writer writer
+ * \param[in] data record
+ * \param[in] len length of the record
+ *
+ */
+void backup_writer_data(backup_writer_type* writer, const uint8_t* data,
+    size_t len);
+
+/**
+ * Finish the binary part: write the section index and clean up the
+ * writer.
+ * \param[in] writer writer
+ * \return ods_status status
+ *
+ */
+ods_status backup_writer_finish(backup_writer_type* writer);
+
+/**
+ * Replay the backup journal.  Entries the backup already has, left
+ * behind by a crash between writing a backup and removing the journal,
+ * are skipped.
+ * \param[in] in input file descriptor
+ * \param[in] zone zone reference
+ * \param[out] size length of the complete journal entries, 0 if
+ *             entries were skipped
+ * \return ods_status status
+ *
+ */
+ods_status backup_read_journal(FILE* in, void* zone, uint64_t* size);
+
+/**
+ * Append the changes of an IXFR part to the backup journal.
+ * \param[in] fd output file descriptor, positioned at the end of the
+ *            complete journal entries
+ * \param[in] zone zone reference
+ * \param[in] part IXFR part
+ * \return ods_status status
+ *
+ */
+ods_status backup_write_journal(FILE* fd, void* zone, part_type* part);
+
 /**
  * Read ixfr journal from file.
  * \param[in] in input file descriptor
@@ -45,22 +45,19 @@ static const char* denial_str = "denial";
  *
  */
 denial_type*
-denial_create(zone_type* zone, ldns_rdf* dname)
+denial_create(zone_type* zone, arena_type* arena, ldns_rdf* dname)
 {
     denial_type* denial = NULL;
-    if (!dname || !zone) {
+    if (!dname || !zone || !arena) {
         return NULL;
     }
-    CHECKALLOC(denial = (denial_type*) malloc(sizeof(denial_type)));
-    if (!denial) {
-        ods_log_error("[%s] unable to create denial: allocator_alloc() "
-            "failed", denial_str);
-        return NULL;
-    }
-    denial->dname = dname;
+    CHECKALLOC(denial = (denial_type*) arena_alloc(arena,
+        arena_dname_size(sizeof(denial_type), dname)));
+    denial->dname = arena_dname_copy(denial, sizeof(denial_type), dname);
     denial->zone = zone;
     denial->domain = NULL; /* no back reference yet */
-    denial->node = NULL; /* not in db yet */
+    denial->node.key = denial->dname;
+    denial->node.data = denial;
     denial->rrset = NULL;
     denial->bitmap_changed = 0;
     denial->nxt_changed = 0;
@@ -275,12 +272,11 @@ denial_add_rr(denial_type* denial, ldns_rr* rr)
             ods_fatal_exit("[%s] unable to nsecify: rrset_create() failed",
                 denial_str);
         }
+        rrset_set_owner(denial->rrset, denial->dname);
     }
     ods_log_assert(denial->rrset);
     record = rrset_add_rr(denial->rrset, rr);
     ods_log_assert(record);
-    ods_log_assert(record->rr);
-    record->owner = (void*) denial;
     denial_diff(denial);
     denial->bitmap_changed = 0;
     denial->nxt_changed = 0;
@@ -288,11 +284,11 @@ denial_add_rr(denial_type* denial, ldns_rr* rr)
 
 
 /**
- * Nsecify Denial of Existence data point.
+ * Create NSEC(3) RR of Denial of Existence data point.
  *
  */
-void
-denial_nsecify(denial_type* denial, denial_type* nxt, uint32_t* num_added)
+ldns_rr*
+denial_create_rr(denial_type* denial, denial_type* nxt)
 {
     ldns_rr* nsec_rr = NULL;
     zone_type* zone = NULL;
@@ -302,19 +298,34 @@ denial_nsecify(denial_type* denial, denial_type* nxt, uint32_t* num_added)
     zone = (zone_type*) denial->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->signconf);
-    if (denial->nxt_changed || denial->bitmap_changed) {
-        ttl = zone->default_ttl;
-        /* SOA MINIMUM */
-        if (zone->signconf->soa_min) {
-            ttl = (uint32_t) duration2time(zone->signconf->soa_min);
-        }
-        /* create new NSEC(3) rr */
-        nsec_rr = denial_create_nsec(denial, nxt, ttl, zone->klass,
-            zone->signconf->nsec3params);
-        if (!nsec_rr) {
-            ods_fatal_exit("[%s] unable to nsecify: denial_create_nsec() "
-                "failed", denial_str);
-        }
+    if (!denial->nxt_changed && !denial->bitmap_changed) {
+        return NULL;
+    }
+    ttl = zone->default_ttl;
+    /* SOA MINIMUM */
+    if (zone->signconf->soa_min) {
+        ttl = (uint32_t) duration2time(zone->signconf->soa_min);
+    }
+    /* create new NSEC(3) rr */
+    nsec_rr = denial_create_nsec(denial, nxt, ttl, zone->klass,
+        zone->signconf->nsec3params);
+    if (!nsec_rr) {
+        ods_fatal_exit("[%s] unable to nsecify: denial_create_nsec() "
+            "failed", denial_str);
+    }
+    return nsec_rr;
+}
+
+
+/**
+ * Nsecify Denial of Existence data point.
+ *
+ */
+void
+denial_nsecify(denial_type* denial, denial_type* nxt, uint32_t* num_added)
+{
+    ldns_rr* nsec_rr = denial_create_rr(denial, nxt);
+    if (nsec_rr) {
         denial_add_rr(denial, nsec_rr);
         if (num_added) {
             (*num_added)++;
@@ -347,12 +358,12 @@ denial_print(FILE* fd, denial_type* denial, ods_status* status)
  *
  */
 void
-denial_cleanup(denial_type* denial)
+denial_cleanup(denial_type* denial, arena_type* arena)
 {
     if (!denial) {
         return;
     }
-    ldns_rdf_deep_free(denial->dname);
     rrset_cleanup(denial->rrset);
-    free(denial);
+    arena_free(arena, denial, arena_dname_size(sizeof(denial_type),
+        denial->dname));
 }
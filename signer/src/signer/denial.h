@@ -39,18 +39,20 @@
 typedef struct denial_struct denial_type;
 
 #include "status.h"
+#include "signer/arena.h"
 #include "signer/nsec3params.h"
 #include "signer/rrset.h"
 #include "signer/domain.h"
 
 /**
- * Denial of Existence data point.
+ * Denial of Existence data point. Like the domain, it is allocated from
+ * the arena of the name database together with its node and name.
  *
  */
 struct denial_struct {
+    ldns_rbnode_t node;
     zone_type* zone;
     domain_type* domain;
-    ldns_rbnode_t* node;
     ldns_rdf* dname;
     rrset_type* rrset;
     unsigned bitmap_changed : 1;
@@ -60,11 +62,13 @@ struct denial_struct {
 /**
  * Create new Denial of Existence data point.
  * \param[in] zoneptr zone reference
- * \param[in] dname owner name
+ * \param[in] arena arena to allocate from
+ * \param[in] dname owner name, copied
  * \return denial_type* denial of existence data point
  *
  */
-denial_type* denial_create(zone_type* zoneptr, ldns_rdf* dname);
+denial_type* denial_create(zone_type* zoneptr, arena_type* arena,
+    ldns_rdf* dname);
 
 /**
  * Apply differences at denial.
@@ -81,6 +85,17 @@ void denial_diff(denial_type* denial);
  */
 void denial_add_rr(denial_type* denial, ldns_rr* rr);
 
+/**
+ * Create the NSEC(3) RR of a Denial of Existence data point if its next
+ * owner or type bitmap changed.  This does not modify the denial, so it
+ * can be done for different denials at the same time.
+ * \param[in] denial Denial of Existence data point
+ * \param[in] nxt next Denial of Existence data point
+ * \return ldns_rr* NSEC(3) RR, NULL if nothing changed
+ *
+ */
+ldns_rr* denial_create_rr(denial_type* denial, denial_type* nxt);
+
 /**
  * Nsecify Denial of Existence data point.
  * \param[in] denial Denial of Existence data point
@@ -102,8 +117,10 @@ void denial_print(FILE* fd, denial_type* denial, ods_status* status);
 /**
  * Cleanup Denial of Existence data point.
  * \param[in] denial denial of existence data point
+ * \param[in] arena arena the denial was allocated from, NULL if the
+ *            arena itself is about to be cleaned up
  *
  */
-void denial_cleanup(denial_type* denial);
+void denial_cleanup(denial_type* denial, arena_type* arena);
 
 #endif /* SIGNER_DENIAL_H */
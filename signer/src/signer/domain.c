@@ -85,23 +85,19 @@ log_dname(ldns_rdf *rdf, const char* pre, int level)
  *
  */
 domain_type*
-domain_create(zone_type* zone, ldns_rdf* dname)
+domain_create(zone_type* zone, arena_type* arena, ldns_rdf* dname)
 {
     domain_type* domain = NULL;
-    if (!dname || !zone) {
-        return NULL;
-    }
-    CHECKALLOC(domain = (domain_type*) malloc(sizeof(domain_type)));
-    domain->dname = ldns_rdf_clone(dname);
-    if (!domain->dname) {
-        ods_log_error("[%s] unable to create domain: ldns_rdf_clone() "
-            "failed", dname_str);
-        free(domain);
+    if (!dname || !zone || !arena) {
         return NULL;
     }
+    CHECKALLOC(domain = (domain_type*) arena_alloc(arena,
+        arena_dname_size(sizeof(domain_type), dname)));
+    domain->dname = arena_dname_copy(domain, sizeof(domain_type), dname);
     domain->zone = zone;
     domain->denial = NULL; /* no reference yet */
-    domain->node = NULL; /* not in db yet */
+    domain->node.key = domain->dname;
+    domain->node.data = domain;
     domain->rrsets = NULL;
     domain->parent = NULL;
     domain->is_apex = 0;
@@ -175,6 +171,7 @@ domain_add_rrset(domain_type* domain, rrset_type* rrset)
     }
     log_rrset(domain->dname, rrset->rrtype, "+RRSET", LOG_DEEEBUG);
     rrset->domain = (void*) domain;
+    rrset_set_owner(rrset, domain->dname);
     if (domain->denial) {
         denial = (denial_type*) domain->denial;
         denial->bitmap_changed = 1;
@@ -316,7 +313,7 @@ domain_ent2unsignedns(domain_type* domain)
     if (domain->rrsets) {
         return 0; /* not an empty non-terminal */
     }
-    n = ldns_rbtree_next(domain->node);
+    n = ldns_rbtree_next(&domain->node);
     while (n && n != LDNS_RBTREE_NULL) {
         d = (domain_type*) n->data;
         if (!ldns_dname_is_subdomain(d->dname, domain->dname)) {
@@ -462,14 +459,14 @@ domain_print(FILE* fd, domain_type* domain, ods_status* status)
  *
  */
 void
-domain_cleanup(domain_type* domain)
+domain_cleanup(domain_type* domain, arena_type* arena)
 {
     if (!domain) {
         return;
     }
-    ldns_rdf_deep_free(domain->dname);
     rrset_cleanup(domain->rrsets);
-    free(domain);
+    arena_free(arena, domain, arena_dname_size(sizeof(domain_type),
+        domain->dname));
 }
 
 
@@ -508,3 +505,27 @@ domain_backup2(FILE* fd, domain_type* domain, int sigs)
         rrset = rrset->next;
     }
 }
+
+
+/**
+ * Backup domain in wire format.
+ *
+ */
+void
+domain_backup_binary(backup_writer_type* writer, domain_type* domain, int sigs)
+{
+    rrset_type* rrset = NULL;
+    if (!domain || !writer) {
+        return;
+    }
+    /* if SOA, do soa first */
+    if (domain->is_apex) {
+        rrset = domain_lookup_rrset(domain, LDNS_RR_TYPE_SOA);
+        rrset_backup_binary(writer, rrset, sigs);
+    }
+    for (rrset = domain->rrsets; rrset; rrset = rrset->next) {
+        if (rrset->rrtype != LDNS_RR_TYPE_SOA) {
+            rrset_backup_binary(writer, rrset, sigs);
+        }
+    }
+}
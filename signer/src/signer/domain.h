@@ -35,6 +35,7 @@
 typedef struct domain_struct domain_type;
 
 #include "status.h"
+#include "signer/arena.h"
 #include "signer/rrset.h"
 #include "signer/signconf.h"
 #include "signer/zone.h"
@@ -46,13 +47,14 @@ typedef struct domain_struct domain_type;
 #define SE_NSEC3_RDATA_BITMAP      5
 
 /**
- * Domain.
+ * Domain. The domain, its tree node and its name are one allocation
+ * from the arena of the name database.
  *
  */
 struct domain_struct {
+    ldns_rbnode_t node;
     denial_type* denial;
     zone_type* zone;
-    ldns_rbnode_t* node;
     ldns_rdf* dname;
     domain_type* parent;
     rrset_type* rrsets;
@@ -72,11 +74,13 @@ void log_dname(ldns_rdf* rdf, const char* pre, int level);
 /**
  * Create domain.
  * \param[in] zoneptr zone reference
- * \param[in] dname owner name
+ * \param[in] arena arena to allocate from
+ * \param[in] dname owner name, copied
  * \return domain_type* domain
  *
  */
-domain_type* domain_create(zone_type* zone, ldns_rdf* dname);
+domain_type* domain_create(zone_type* zone, arena_type* arena,
+    ldns_rdf* dname);
 
 /**
  * Count the number of RRsets at this domain with RRs that have is_added.
@@ -162,9 +166,11 @@ void domain_print(FILE* fd, domain_type* domain, ods_status* status);
 /**
  * Clean up domain.
  * \param[in] domain domain to cleanup
+ * \param[in] arena arena the domain was allocated from, NULL if the
+ *            arena itself is about to be cleaned up
  *
  */
-void domain_cleanup(domain_type* domain);
+void domain_cleanup(domain_type* domain, arena_type* arena);
 
 /**
  * Backup domain.
@@ -175,4 +181,14 @@ void domain_cleanup(domain_type* domain);
  */
 void domain_backup2(FILE* fd, domain_type* domain, int sigs);
 
+/**
+ * Backup domain in wire format.
+ * \param[in] writer backup writer
+ * \param[in] domain domain
+ * \param[in] sigs do RRSIGS if true, otherwise do RRset
+ *
+ */
+void domain_backup_binary(backup_writer_type* writer, domain_type* domain,
+    int sigs);
+
 #endif /* SIGNER_DOMAIN_H */
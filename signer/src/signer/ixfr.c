@@ -35,6 +35,9 @@
 #include "signer/rrset.h"
 #include "signer/zone.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 static const char* ixfr_str = "journal";
 
 
@@ -149,6 +152,159 @@ ixfr_del_rr(ixfr_type* ixfr, ldns_rr* rr)
 }
 
 
+/**
+ * Add +RR to delta, the delta takes over the RR.
+ *
+ */
+void
+ixfr_delta_add_rr(ixfr_delta_type* delta, ldns_rr* rr)
+{
+    ods_log_assert(delta);
+    ods_log_assert(rr);
+    if (delta->plus_count == delta->plus_size) {
+        delta->plus_size = delta->plus_size ? delta->plus_size * 2 : 64;
+        CHECKALLOC(delta->plus = (ldns_rr**) realloc(delta->plus,
+            delta->plus_size * sizeof(ldns_rr*)));
+    }
+    delta->plus[delta->plus_count++] = rr;
+}
+
+
+/**
+ * Add -RR to delta, the delta takes over the RR.
+ *
+ */
+void
+ixfr_delta_del_rr(ixfr_delta_type* delta, ldns_rr* rr)
+{
+    ods_log_assert(delta);
+    ods_log_assert(rr);
+    if (delta->min_count == delta->min_size) {
+        delta->min_size = delta->min_size ? delta->min_size * 2 : 64;
+        CHECKALLOC(delta->min = (ldns_rr**) realloc(delta->min,
+            delta->min_size * sizeof(ldns_rr*)));
+    }
+    delta->min[delta->min_count++] = rr;
+}
+
+
+/**
+ * Compare RRs in canonical order of their owner names.
+ *
+ */
+static int
+ixfr_rr_compare(const void* a, const void* b)
+{
+    ldns_rr* x = *(ldns_rr* const*) a;
+    ldns_rr* y = *(ldns_rr* const*) b;
+    int c = ldns_dname_compare(ldns_rr_owner(x), ldns_rr_owner(y));
+    if (c != 0) {
+        return c;
+    }
+    return ldns_rr_compare(x, y);
+}
+
+
+/**
+ * Move the RRs of the deltas to a list of the journal, in canonical
+ * order.
+ *
+ */
+static void
+ixfr_delta_push(ldns_rr_list* list, ldns_rr** soa, ldns_rr** rrs,
+    size_t count)
+{
+    size_t i;
+    qsort(rrs, count, sizeof(ldns_rr*), ixfr_rr_compare);
+    for (i = 0; i < count; i++) {
+        if (!ldns_rr_list_push_rr(list, rrs[i])) {
+            ods_fatal_exit("[%s] fatal unable to merge delta: "
+                "ldns_rr_list_push_rr() failed", ixfr_str);
+        }
+        if (ldns_rr_get_type(rrs[i]) == LDNS_RR_TYPE_SOA) {
+            *soa = rrs[i];
+        }
+    }
+}
+
+
+/**
+ * Merge deltas into the journal. The deltas are left empty.
+ *
+ */
+void
+ixfr_delta_merge(ixfr_type* ixfr, ixfr_delta_type** deltas, size_t count)
+{
+    ldns_rr** plus = NULL;
+    ldns_rr** min = NULL;
+    size_t plus_count = 0;
+    size_t min_count = 0;
+    size_t i;
+
+    ods_log_assert(ixfr);
+    for (i = 0; i < count; i++) {
+        plus_count += deltas[i]->plus_count;
+        min_count += deltas[i]->min_count;
+    }
+    if (!plus_count && !min_count) {
+        return;
+    }
+    CHECKALLOC(plus = (ldns_rr**) malloc((plus_count + 1) * sizeof(ldns_rr*)));
+    CHECKALLOC(min = (ldns_rr**) malloc((min_count + 1) * sizeof(ldns_rr*)));
+    plus_count = 0;
+    min_count = 0;
+    for (i = 0; i < count; i++) {
+        memcpy(plus + plus_count, deltas[i]->plus,
+            deltas[i]->plus_count * sizeof(ldns_rr*));
+        plus_count += deltas[i]->plus_count;
+        memcpy(min + min_count, deltas[i]->min,
+            deltas[i]->min_count * sizeof(ldns_rr*));
+        min_count += deltas[i]->min_count;
+        deltas[i]->plus_count = 0;
+        deltas[i]->min_count = 0;
+    }
+    pthread_mutex_lock(&ixfr->ixfr_lock);
+    ods_log_assert(ixfr->part[0]);
+    ixfr_delta_push(ixfr->part[0]->min, &ixfr->part[0]->soamin, min,
+        min_count);
+    ixfr_delta_push(ixfr->part[0]->plus, &ixfr->part[0]->soaplus, plus,
+        plus_count);
+    pthread_mutex_unlock(&ixfr->ixfr_lock);
+    ods_log_debug("[%s] merged %lu +RRs and %lu -RRs", ixfr_str,
+        (unsigned long) plus_count, (unsigned long) min_count);
+    free(plus);
+    free(min);
+}
+
+
+/**
+ * Clear delta, freeing the RRs that were not merged.
+ *
+ */
+void
+ixfr_delta_clear(ixfr_delta_type* delta)
+{
+    size_t i;
+    if (!delta) {
+        return;
+    }
+    for (i = 0; i < delta->plus_count; i++) {
+        ldns_rr_free(delta->plus[i]);
+    }
+    for (i = 0; i < delta->min_count; i++) {
+        ldns_rr_free(delta->min[i]);
+    }
+    free(delta->plus);
+    free(delta->min);
+    delta->plus = NULL;
+    delta->plus_count = 0;
+    delta->plus_size = 0;
+    delta->min = NULL;
+    delta->min_count = 0;
+    delta->min_size = 0;
+}
+
+
 /**
  * Print all RRs in list, except SOA RRs.
  *
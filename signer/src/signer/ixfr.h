@@ -37,6 +37,7 @@
 
 typedef struct part_struct part_type;
 typedef struct ixfr_struct ixfr_type;
+typedef struct ixfr_delta_struct ixfr_delta_type;
 
 #include "locks.h"
 #include "zone.h"
@@ -64,6 +65,16 @@ struct ixfr_struct {
     pthread_mutex_t ixfr_lock;
 };
 
+/* changes collected by one thread, merged into the journal later */
+struct ixfr_delta_struct {
+    ldns_rr** plus;
+    size_t plus_count;
+    size_t plus_size;
+    ldns_rr** min;
+    size_t min_count;
+    size_t min_size;
+};
+
 /**
  * Create a new ixfr journal.
  * \param[in] zone zone reference
@@ -88,6 +99,15 @@ void ixfr_add_rr(ixfr_type* ixfr, ldns_rr* rr);
  */
 void ixfr_del_rr(ixfr_type* ixfr, ldns_rr* rr);
 
+void ixfr_delta_add_rr(ixfr_delta_type* delta, ldns_rr* rr);
+
+void ixfr_delta_del_rr(ixfr_delta_type* delta, ldns_rr* rr);
+
+void ixfr_delta_merge(ixfr_type* ixfr, ixfr_delta_type** deltas,
+    size_t count);
+
+void ixfr_delta_clear(ixfr_delta_type* delta);
+
 /**
  * Print the ixfr journal.
  * \param[in] fd file descriptor
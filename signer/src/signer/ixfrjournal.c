@@ -0,0 +1,637 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * IXFR history on disk.
+ *
+ */
+
+#include "config.h"
+#include "file.h"
+#include "log.h"
+#include "util.h"
+#include "signer/ixfrjournal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char* ixfrjournal_str = "ixfrjournal";
+
+static size_t ixfrjournal_depth = ODS_SE_IXFRHISTORY;
+
+struct ixfrjournal_entry_struct {
+    long offset;
+    uint32_t length;
+    uint32_t from;
+    uint32_t to;
+    uint32_t checksum;
+};
+
+
+/**
+ * Set the number of changes kept in the journal.
+ *
+ */
+void
+ixfrjournal_set_depth(int depth)
+{
+    ixfrjournal_depth = (depth > 0 ? (size_t) depth : 0);
+}
+
+
+/**
+ * Update checksum (32-bit FNV-1a).
+ *
+ */
+static uint32_t
+ixfrjournal_checksum(const uint8_t* data, size_t len)
+{
+    uint32_t sum = 2166136261U;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        sum ^= data[i];
+        sum *= 16777619U;
+    }
+    return sum;
+}
+
+
+/**
+ * Put RR in wire format, preceded by its length.
+ *
+ */
+static int
+ixfrjournal_put_rr(ldns_buffer* buf, ldns_rr* rr)
+{
+    size_t start = ldns_buffer_position(buf);
+    if (!ldns_buffer_reserve(buf, 2)) {
+        return 0;
+    }
+    ldns_buffer_write_u16(buf, 0);
+    if (ldns_rr2buffer_wire(buf, rr, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK ||
+        ldns_buffer_position(buf) - start - 2 > 0xffff) {
+        return 0;
+    }
+    ldns_buffer_write_u16_at(buf, start,
+        (uint16_t) (ldns_buffer_position(buf) - start - 2));
+    return 1;
+}
+
+
+/**
+ * Put the RRs of a list, except the SOA RRs.
+ *
+ */
+static int
+ixfrjournal_put_rrs(ldns_buffer* buf, ldns_rr_list* list)
+{
+    size_t i;
+    for (i = 0; i < ldns_rr_list_rr_count(list); i++) {
+        if (ldns_rr_get_type(ldns_rr_list_rr(list, i)) == LDNS_RR_TYPE_SOA) {
+            continue;
+        }
+        if (!ixfrjournal_put_rr(buf, ldns_rr_list_rr(list, i))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Decode the next RR of an entry.
+ *
+ */
+static ldns_rr*
+ixfrjournal_get_rr(const uint8_t* data, size_t len, size_t* pos)
+{
+    ldns_rr* rr = NULL;
+    size_t rrpos = 0;
+    uint16_t rrlen;
+    if (len - *pos < 2) {
+        return NULL;
+    }
+    rrlen = ldns_read_uint16(data + *pos);
+    *pos += 2;
+    if (len - *pos < rrlen ||
+        ldns_wire2rr(&rr, data + *pos, rrlen, &rrpos, LDNS_SECTION_ANSWER)
+        != LDNS_STATUS_OK || rrpos != rrlen) {
+        ldns_rr_free(rr);
+        return NULL;
+    }
+    *pos += rrlen;
+    return rr;
+}
+
+
+/**
+ * Find the complete entries in the journal.
+ *
+ */
+static ods_status
+ixfrjournal_scan(FILE* fd, struct ixfrjournal_entry_struct** entries,
+    size_t* count, long* end)
+{
+    struct ixfrjournal_entry_struct* entry = NULL;
+    uint8_t buf[IXFRJOURNAL_HEADER_LEN];
+    struct stat st;
+    long offset = IXFRJOURNAL_MAGIC_LEN;
+    size_t size = 0;
+
+    *entries = NULL;
+    *count = 0;
+    *end = 0;
+    if (fstat(fileno(fd), &st) != 0 || fseek(fd, 0, SEEK_SET) != 0) {
+        return ODS_STATUS_FREAD_ERR;
+    }
+    if (fread(buf, 1, IXFRJOURNAL_MAGIC_LEN, fd) != IXFRJOURNAL_MAGIC_LEN ||
+        memcmp(buf, IXFRJOURNAL_MAGIC, IXFRJOURNAL_MAGIC_LEN) != 0) {
+        return ODS_STATUS_FREAD_ERR;
+    }
+    while (offset + IXFRJOURNAL_HEADER_LEN <= st.st_size) {
+        if (fseek(fd, offset, SEEK_SET) != 0 ||
+            fread(buf, 1, IXFRJOURNAL_HEADER_LEN, fd) !=
+            IXFRJOURNAL_HEADER_LEN) {
+            break;
+        }
+        if (ldns_read_uint32(buf) == 0 || offset + IXFRJOURNAL_HEADER_LEN +
+            (long) ldns_read_uint32(buf) > st.st_size) {
+            /* torn write */
+            break;
+        }
+        if (*count == size) {
+            size = size ? size * 2 : 16;
+            CHECKALLOC(*entries = (struct ixfrjournal_entry_struct*) realloc(
+                *entries, size * sizeof(struct ixfrjournal_entry_struct)));
+        }
+        entry = &(*entries)[(*count)++];
+        entry->offset = offset;
+        entry->length = ldns_read_uint32(buf);
+        entry->from = ldns_read_uint32(buf + 4);
+        entry->to = ldns_read_uint32(buf + 8);
+        entry->checksum = ldns_read_uint32(buf + 12);
+        offset += IXFRJOURNAL_HEADER_LEN + (long) entry->length;
+    }
+    *end = offset;
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Write an entry at the current position, the length goes in last.
+ *
+ */
+static ods_status
+ixfrjournal_write_entry(FILE* fd, uint32_t from, uint32_t to,
+    ldns_buffer* buf)
+{
+    uint8_t header[IXFRJOURNAL_HEADER_LEN];
+    size_t len = ldns_buffer_position(buf);
+    long start = ftell(fd);
+
+    ldns_write_uint32(header, 0);
+    ldns_write_uint32(header + 4, from);
+    ldns_write_uint32(header + 8, to);
+    ldns_write_uint32(header + 12,
+        ixfrjournal_checksum(ldns_buffer_begin(buf), len));
+    if (start < 0 ||
+        fwrite(header, 1, sizeof(header), fd) != sizeof(header) ||
+        fwrite(ldns_buffer_begin(buf), 1, len, fd) != len ||
+        fflush(fd) != 0 || fsync(fileno(fd)) != 0) {
+        return ODS_STATUS_FWRITE_ERR;
+    }
+    ldns_write_uint32(header, (uint32_t) len);
+    if (fseek(fd, start, SEEK_SET) != 0 ||
+        fwrite(header, 1, 4, fd) != 4 ||
+        fseek(fd, 0, SEEK_END) != 0 || fflush(fd) != 0 ||
+        fsync(fileno(fd)) != 0) {
+        return ODS_STATUS_FWRITE_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Write a new journal with the entries kept and the new entry, and
+ * move it in place.
+ *
+ */
+static ods_status
+ixfrjournal_rewrite(const char* filename, FILE* in,
+    struct ixfrjournal_entry_struct* entries, size_t count, uint32_t from,
+    uint32_t to, ldns_buffer* buf)
+{
+    ods_status status = ODS_STATUS_OK;
+    FILE* out = NULL;
+    char* tmpfile = NULL;
+    uint8_t data[4096];
+    long left = 0;
+    size_t len;
+
+    tmpfile = ods_build_path(filename, ".tmp", 0, 1);
+    if (!tmpfile) {
+        return ODS_STATUS_MALLOC_ERR;
+    }
+    out = ods_fopen(tmpfile, NULL, "w");
+    if (!out) {
+        free((void*) tmpfile);
+        return ODS_STATUS_FOPEN_ERR;
+    }
+    if (fwrite(IXFRJOURNAL_MAGIC, 1, IXFRJOURNAL_MAGIC_LEN, out) !=
+        IXFRJOURNAL_MAGIC_LEN) {
+        status = ODS_STATUS_FWRITE_ERR;
+    }
+    if (status == ODS_STATUS_OK && count) {
+        /* the entries kept follow each other */
+        left = entries[count-1].offset + IXFRJOURNAL_HEADER_LEN +
+            (long) entries[count-1].length - entries[0].offset;
+        if (fseek(in, entries[0].offset, SEEK_SET) != 0) {
+            status = ODS_STATUS_FSEEK_ERR;
+        }
+    }
+    while (status == ODS_STATUS_OK && left > 0) {
+        len = (left < (long) sizeof(data) ? (size_t) left : sizeof(data));
+        if (fread(data, 1, len, in) != len) {
+            status = ODS_STATUS_FREAD_ERR;
+        } else if (fwrite(data, 1, len, out) != len) {
+            status = ODS_STATUS_FWRITE_ERR;
+        }
+        left -= (long) len;
+    }
+    if (status == ODS_STATUS_OK) {
+        status = ixfrjournal_write_entry(out, from, to, buf);
+    }
+    ods_fclose(out);
+    if (status == ODS_STATUS_OK && rename(tmpfile, filename) != 0) {
+        ods_log_error("[%s] unable to rename file %s to %s: %s",
+            ixfrjournal_str, tmpfile, filename, strerror(errno));
+        status = ODS_STATUS_RENAME_ERR;
+    }
+    if (status != ODS_STATUS_OK) {
+        (void) unlink(tmpfile);
+    }
+    free((void*) tmpfile);
+    return status;
+}
+
+
+/**
+ * Append an IXFR part to the journal.
+ *
+ */
+ods_status
+ixfrjournal_append(const char* filename, part_type* part)
+{
+    struct ixfrjournal_entry_struct* entries = NULL;
+    ods_status status = ODS_STATUS_OK;
+    ldns_buffer* buf = NULL;
+    FILE* fd = NULL;
+    size_t count = 0;
+    size_t first = 0;
+    long end = 0;
+    uint32_t from, to;
+
+    ods_log_assert(filename);
+    ods_log_assert(part);
+    ods_log_assert(part->soamin);
+    ods_log_assert(part->soaplus);
+    if (!ixfrjournal_depth) {
+        if (unlink(filename) != 0 && errno != ENOENT) {
+            ods_log_error("[%s] unable to remove %s: %s", ixfrjournal_str,
+                filename, strerror(errno));
+            return ODS_STATUS_UNLINK_ERR;
+        }
+        return ODS_STATUS_OK;
+    }
+    from = ldns_rdf2native_int32(ldns_rr_rdf(part->soamin,
+        SE_SOA_RDATA_SERIAL));
+    to = ldns_rdf2native_int32(ldns_rr_rdf(part->soaplus,
+        SE_SOA_RDATA_SERIAL));
+    CHECKALLOC(buf = ldns_buffer_new(LDNS_MAX_PACKETLEN));
+    if (!ixfrjournal_put_rr(buf, part->soamin) ||
+        !ixfrjournal_put_rrs(buf, part->min) ||
+        !ixfrjournal_put_rr(buf, part->soaplus) ||
+        !ixfrjournal_put_rrs(buf, part->plus)) {
+        ods_log_error("[%s] unable to journal serial %u to %u: wire format "
+            "conversion failed", ixfrjournal_str, from, to);
+        ldns_buffer_free(buf);
+        return ODS_STATUS_ERR;
+    }
+
+    fd = ods_fopen(filename, NULL, "r+");
+    if (fd && ixfrjournal_scan(fd, &entries, &count, &end) !=
+        ODS_STATUS_OK) {
+        ods_log_warning("[%s] journal %s is corrupted, starting over",
+            ixfrjournal_str, filename);
+        ods_fclose(fd);
+        fd = NULL;
+    }
+    if (count && entries[count-1].from == from && entries[count-1].to == to) {
+        /* written before */
+        ods_fclose(fd);
+        free(entries);
+        ldns_buffer_free(buf);
+        return ODS_STATUS_OK;
+    }
+    if (count && entries[count-1].to != from) {
+        /* the history does not lead up to this change */
+        ods_log_debug("[%s] journal %s ends at serial %u, starting over at "
+            "serial %u", ixfrjournal_str, filename, entries[count-1].to,
+            from);
+        first = count;
+    } else if (count >= ixfrjournal_depth) {
+        first = count - ixfrjournal_depth + 1;
+    }
+
+    if (!fd || first) {
+        status = ixfrjournal_rewrite(filename, fd, entries + first,
+            count - first, from, to, buf);
+    } else if (ftruncate(fileno(fd), (off_t) end) != 0 ||
+        fseek(fd, end, SEEK_SET) != 0) {
+        ods_log_error("[%s] unable to append to %s: %s", ixfrjournal_str,
+            filename, strerror(errno));
+        status = ODS_STATUS_FWRITE_ERR;
+    } else {
+        status = ixfrjournal_write_entry(fd, from, to, buf);
+    }
+    if (fd) {
+        ods_fclose(fd);
+    }
+    free(entries);
+    ldns_buffer_free(buf);
+    return status;
+}
+
+
+/**
+ * Compare RRs in canonical order, TTL included.
+ *
+ */
+static int
+ixfrjournal_compare(const void* a, const void* b)
+{
+    ldns_rr* x = (ldns_rr*) a;
+    ldns_rr* y = (ldns_rr*) b;
+    int c = ldns_dname_compare(ldns_rr_owner(x), ldns_rr_owner(y));
+    if (c != 0) {
+        return c;
+    }
+    c = ldns_rr_compare(x, y);
+    if (c != 0) {
+        return c;
+    }
+    if (ldns_rr_ttl(x) != ldns_rr_ttl(y)) {
+        return (ldns_rr_ttl(x) < ldns_rr_ttl(y) ? -1 : 1);
+    }
+    return 0;
+}
+
+
+/**
+ * Record a change: if it undoes an earlier one, both go, otherwise it is
+ * added to the pending changes.
+ *
+ */
+static void
+ixfrjournal_change(ldns_rbtree_t* undo, ldns_rbtree_t* todo, ldns_rr* rr)
+{
+    ldns_rbnode_t* node = ldns_rbtree_delete(undo, rr);
+    if (node) {
+        ldns_rr_free((ldns_rr*) node->data);
+        free(node);
+        ldns_rr_free(rr);
+        return;
+    }
+    CHECKALLOC(node = (ldns_rbnode_t*) malloc(sizeof(ldns_rbnode_t)));
+    node->key = rr;
+    node->data = rr;
+    if (!ldns_rbtree_insert(todo, node)) {
+        ldns_rr_free(rr);
+        free(node);
+    }
+}
+
+
+/**
+ * Free a node of the pending changes, and its RR if there is an
+ * argument.
+ *
+ */
+static void
+ixfrjournal_node_free(ldns_rbnode_t* node, void* arg)
+{
+    if (arg) {
+        ldns_rr_free((ldns_rr*) node->data);
+    }
+    free(node);
+}
+
+
+/**
+ * Free the pending changes.
+ *
+ */
+static void
+ixfrjournal_tree_free(ldns_rbtree_t* tree, int rrs)
+{
+    ldns_traverse_postorder(tree, ixfrjournal_node_free,
+        (rrs ? (void*) tree : NULL));
+    ldns_rbtree_free(tree);
+}
+
+
+/**
+ * Read an entry and apply it to the pending changes.
+ *
+ */
+static ods_status
+ixfrjournal_read_entry(FILE* fd, struct ixfrjournal_entry_struct* entry,
+    ldns_rbtree_t* min, ldns_rbtree_t* plus, ldns_rr** soamin,
+    ldns_rr** soaplus)
+{
+    ods_status status = ODS_STATUS_OK;
+    ldns_rr* rr = NULL;
+    uint8_t* data = NULL;
+    size_t pos = 0;
+    int nsoa = 0;
+
+    CHECKALLOC(data = (uint8_t*) malloc(entry->length));
+    if (fseek(fd, entry->offset + IXFRJOURNAL_HEADER_LEN, SEEK_SET) != 0 ||
+        fread(data, 1, entry->length, fd) != entry->length ||
+        ixfrjournal_checksum(data, entry->length) != entry->checksum) {
+        free(data);
+        return ODS_STATUS_FREAD_ERR;
+    }
+    while (status == ODS_STATUS_OK && pos < entry->length) {
+        rr = ixfrjournal_get_rr(data, entry->length, &pos);
+        if (!rr) {
+            status = ODS_STATUS_FREAD_ERR;
+        } else if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
+            if (++nsoa == 1 && !*soamin) {
+                /* the serial the condensed change starts from */
+                *soamin = rr;
+            } else if (nsoa == 2) {
+                ldns_rr_free(*soaplus);
+                *soaplus = rr;
+            } else {
+                ldns_rr_free(rr);
+                status = (nsoa > 2 ? ODS_STATUS_FREAD_ERR : status);
+            }
+        } else if (nsoa == 1) {
+            ixfrjournal_change(plus, min, rr);
+        } else if (nsoa == 2) {
+            ixfrjournal_change(min, plus, rr);
+        } else {
+            ldns_rr_free(rr);
+            status = ODS_STATUS_FREAD_ERR;
+        }
+    }
+    free(data);
+    if (status == ODS_STATUS_OK && nsoa != 2) {
+        status = ODS_STATUS_FREAD_ERR;
+    }
+    return status;
+}
+
+
+/**
+ * Move the pending changes to a list, in canonical order.
+ *
+ */
+static void
+ixfrjournal_push(ldns_rr_list* list, ldns_rbtree_t* tree)
+{
+    ldns_rbnode_t* node = ldns_rbtree_first(tree);
+    while (node != LDNS_RBTREE_NULL) {
+        if (!ldns_rr_list_push_rr(list, (ldns_rr*) node->data)) {
+            ods_fatal_exit("[%s] fatal unable to condense journal: "
+                "ldns_rr_list_push_rr() failed", ixfrjournal_str);
+        }
+        node = ldns_rbtree_next(node);
+    }
+}
+
+
+/**
+ * Read the changes since a serial, condensed.
+ *
+ */
+ods_status
+ixfrjournal_read(const char* filename, uint32_t serial, ldns_rr_list** rrs)
+{
+    struct ixfrjournal_entry_struct* entries = NULL;
+    ods_status status = ODS_STATUS_OK;
+    ldns_rbtree_t* min = NULL;
+    ldns_rbtree_t* plus = NULL;
+    ldns_rr* soamin = NULL;
+    ldns_rr* soaplus = NULL;
+    FILE* fd = NULL;
+    size_t count = 0;
+    size_t first = 0;
+    size_t i;
+    long end = 0;
+
+    ods_log_assert(filename);
+    ods_log_assert(rrs);
+    *rrs = NULL;
+    fd = ods_fopen(filename, NULL, "r");
+    if (!fd) {
+        return ODS_STATUS_FOPEN_ERR;
+    }
+    status = ixfrjournal_scan(fd, &entries, &count, &end);
+    if (status != ODS_STATUS_OK) {
+        ods_fclose(fd);
+        return status;
+    }
+    /* the entries form a chain, find where serial comes in */
+    for (first = 0; first < count; first++) {
+        if (entries[first].from == serial) {
+            break;
+        }
+    }
+    if (first == count) {
+        if (!count || entries[count-1].to != serial) {
+            ods_fclose(fd);
+            free(entries);
+            return ODS_STATUS_REQAXFR;
+        }
+        /* up to date, only the newest SOA is needed */
+        first = count - 1;
+    }
+    min = ldns_rbtree_create(ixfrjournal_compare);
+    plus = ldns_rbtree_create(ixfrjournal_compare);
+    if (!min || !plus) {
+        ods_fatal_exit("[%s] fatal unable to condense journal: "
+            "ldns_rbtree_create() failed", ixfrjournal_str);
+    }
+    for (i = first; status == ODS_STATUS_OK && i < count; i++) {
+        if (i > first && entries[i].from != entries[i-1].to) {
+            status = ODS_STATUS_FREAD_ERR;
+            break;
+        }
+        status = ixfrjournal_read_entry(fd, &entries[i], min, plus, &soamin,
+            &soaplus);
+    }
+    ods_fclose(fd);
+    if (status != ODS_STATUS_OK) {
+        ods_log_error("[%s] journal %s is corrupted at entry %u",
+            ixfrjournal_str, filename, (unsigned) i);
+        ixfrjournal_tree_free(min, 1);
+        ixfrjournal_tree_free(plus, 1);
+        ldns_rr_free(soamin);
+        ldns_rr_free(soaplus);
+        free(entries);
+        return status;
+    }
+
+    *rrs = ldns_rr_list_new();
+    if (!*rrs) {
+        ods_fatal_exit("[%s] fatal unable to condense journal: "
+            "ldns_rr_list_new() failed", ixfrjournal_str);
+    }
+    ldns_rr_list_push_rr(*rrs, soaplus);
+    if (entries[first].from == serial) {
+        ldns_rr_list_push_rr(*rrs, soamin);
+        ixfrjournal_push(*rrs, min);
+        ldns_rr_list_push_rr(*rrs, ldns_rr_clone(soaplus));
+        ixfrjournal_push(*rrs, plus);
+        ldns_rr_list_push_rr(*rrs, ldns_rr_clone(soaplus));
+        ixfrjournal_tree_free(min, 0);
+        ixfrjournal_tree_free(plus, 0);
+    } else {
+        ldns_rr_free(soamin);
+        ixfrjournal_tree_free(min, 1);
+        ixfrjournal_tree_free(plus, 1);
+    }
+    ods_log_debug("[%s] journal %s has %u RRs since serial %u",
+        ixfrjournal_str, filename, (unsigned) ldns_rr_list_rr_count(*rrs),
+        serial);
+    free(entries);
+    return ODS_STATUS_OK;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * IXFR history on disk.
+ *
+ */
+
+#ifndef SIGNER_IXFRJOURNAL_H
+#define SIGNER_IXFRJOURNAL_H
+
+#include "config.h"
+#include "status.h"
+#include "signer/ixfr.h"
+
+#include <ldns/ldns.h>
+
+/**
+ * IXFR journal.
+ *
+ * The IXFR journal (<zone>.ixfr.journal) keeps the changes between the
+ * last outbound serials, so that IXFR requests can be answered without
+ * parsing a zone file.  It starts with IXFRJOURNAL_MAGIC, followed by
+ * the entries, oldest first:
+ *
+ *   header:  32-bit length of the RRs, the 32-bit serials the change
+ *            goes from and to, and the 32-bit checksum of the RRs.
+ *   RRs:     the old SOA, the RRs removed, the new SOA and the RRs
+ *            added, each a 16-bit length and a wire format RR.
+ *
+ * Integers are in network byte order.  The length goes in last, an
+ * entry with length zero or one that runs past the end of the file was
+ * not written completely and is dropped.
+ *
+ */
+#define IXFRJOURNAL_MAGIC "ODSIXJ\r\n"
+#define IXFRJOURNAL_MAGIC_LEN 8
+#define IXFRJOURNAL_HEADER_LEN 16
+
+/**
+ * Set the number of changes kept in the journal.
+ * \param[in] depth number of changes, 0 to keep no journal
+ *
+ */
+void ixfrjournal_set_depth(int depth);
+
+/**
+ * Append an IXFR part to the journal, dropping the oldest changes if
+ * the journal is full.
+ * \param[in] filename journal file
+ * \param[in] part IXFR part
+ * \return ods_status status
+ *
+ */
+ods_status ixfrjournal_append(const char* filename, part_type* part);
+
+/**
+ * Read the changes since a serial, condensed into one difference
+ * sequence: RRs added and removed again, or removed and added again,
+ * cancel out.
+ * \param[in] filename journal file
+ * \param[in] serial serial to start from
+ * \param[out] rrs the IXFR answer: the newest SOA, the old SOA, the RRs
+ *             removed, the newest SOA, the RRs added and the newest SOA
+ *             again; only the newest SOA if serial is up to date
+ * \return ods_status status, ODS_STATUS_REQAXFR if the journal does not
+ *         go back to serial
+ *
+ */
+ods_status ixfrjournal_read(const char* filename, uint32_t serial,
+    ldns_rr_list** rrs);
+
+#endif /* SIGNER_IXFRJOURNAL_H */
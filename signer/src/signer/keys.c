@@ -38,6 +38,7 @@
 #include "status.h"
 
 static const char* key_str = "keys";
+static unsigned keylist_generation = 0;
 
 
 /**
@@ -61,6 +62,8 @@ keylist_create(signconf_type* signconf)
     kl->sc = signconf;
     kl->count = 0;
     kl->keys = NULL;
+    kl->generation = __atomic_add_fetch(&keylist_generation, 1,
+        __ATOMIC_RELAXED);
     return kl;
 }
 
@@ -119,6 +122,8 @@ keylist_push(keylist_type* kl, const char* locator, const char* resourcerecord,
     kl->keys[kl->count -1].zsk = zsk;
     kl->keys[kl->count -1].dnskey = NULL;
     kl->keys[kl->count -1].params = NULL;
+    kl->generation = __atomic_add_fetch(&keylist_generation, 1,
+        __ATOMIC_RELAXED);
     return &kl->keys[kl->count -1];
 }
 
@@ -166,10 +171,8 @@ key_delfunc(key_type* key)
     if (!key) {
         return;
     }
-    /*We leak this every time the signconf is reloaded. Although the IXFR structure*/
-    /*copies this RR there is a race condition between this func and the ixfr_del*/
-    /*function to copy / delete it. */
-    /* ldns_rr_free(key->dnskey); */
+    /* the zone has its own copy of the DNSKEY */
+    ldns_rr_free(key->dnskey);
     hsm_sign_params_free(key->params);
     free((void*) key->locator);
 }
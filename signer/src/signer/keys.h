@@ -67,6 +67,7 @@ struct keylist_struct {
     signconf_type* sc;
     key_type* keys;
     size_t count;
+    unsigned generation; /* changes whenever the list changes */
 };
 
 /**
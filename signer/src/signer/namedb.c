@@ -36,43 +36,13 @@
 #include "util.h"
 #include "signer/backup.h"
 #include "signer/namedb.h"
+#include "signer/parallel.h"
 #include "signer/zone.h"
 
 const char* db_str = "namedb";
 
-/**
- * Convert a domain to a tree node.
- *
- */
-static ldns_rbnode_t*
-domain2node(domain_type* domain)
-{
-    ldns_rbnode_t* node = (ldns_rbnode_t*) malloc(sizeof(ldns_rbnode_t));
-    if (!node) {
-        return NULL;
-    }
-    node->key = domain->dname;
-    node->data = domain;
-    return node;
-}
-
-
-/**
- * Convert a denial to a tree node.
- *
- */
-static ldns_rbnode_t*
-denial2node(denial_type* denial)
-{
-    ldns_rbnode_t* node = (ldns_rbnode_t*) malloc(sizeof(ldns_rbnode_t));
-    if (!node) {
-        return NULL;
-    }
-    node->key = denial->dname;
-    node->data = denial;
-    return node;
-}
-
+/* minimum number of denials worth an nsecify job of its own */
+#define NAMEDB_NSECIFY_JOB_MIN 512
 
 /**
  * Compare domains.
@@ -132,6 +102,9 @@ namedb_create(void* zone)
         return NULL;
     }
     db->zone = zone;
+    db->arena = arena_create();
+    db->resign = resign_create();
+    db->hashes = nsec3hash_create();
 
     namedb_init_domains(db);
     if (!db->domains) {
@@ -356,27 +329,19 @@ namedb_add_domain(namedb_type* db, ldns_rdf* dname)
     if (!dname || !db || !db->domains) {
         return NULL;
     }
-    domain = domain_create(db->zone, dname);
+    domain = domain_create(db->zone, db->arena, dname);
     if (!domain) {
         ods_log_error("[%s] unable to add domain: domain_create() failed",
             db_str);
         return NULL;
     }
-    new_node = domain2node(domain);
-    if (!new_node) {
-        ods_log_error("[%s] unable to add domain: domain2node() failed",
-            db_str);
-        return NULL;
-    }
+    new_node = &domain->node;
     if (ldns_rbtree_insert(db->domains, new_node) == NULL) {
         ods_log_error("[%s] unable to add domain: already present", db_str);
         log_dname(domain->dname, "ERR +DOMAIN", LOG_ERR);
-        domain_cleanup(domain);
-        free((void*)new_node);
+        domain_cleanup(domain, db->arena);
         return NULL;
     }
-    domain = (domain_type*) new_node->data;
-    domain->node = new_node;
     domain->is_new = 1;
     log_dname(domain->dname, "+DOMAIN", LOG_DEEEBUG);
     return domain;
@@ -402,11 +367,10 @@ namedb_del_domain(namedb_type* db, domain_type* domain)
     }
     node = ldns_rbtree_delete(db->domains, (const void*)domain->dname);
     if (node) {
-        ods_log_assert(domain->node == node);
+        ods_log_assert(&domain->node == node);
         ods_log_assert(!domain->rrsets);
         ods_log_assert(!domain->denial);
-        free((void*)node);
-        domain->node = NULL;
+        nsec3hash_remove(db->hashes, domain->dname);
         log_dname(domain->dname, "-DOMAIN", LOG_DEEEBUG);
         return domain;
     }
@@ -446,7 +410,7 @@ domain_is_empty_terminal(domain_type* domain)
     if (domain->rrsets) {
         return 0;
     }
-    n = ldns_rbtree_next(domain->node);
+    n = ldns_rbtree_next(&domain->node);
     if (n) {
         d = (domain_type*) n->data;
     }
@@ -578,7 +542,7 @@ namedb_del_nsec_trigger(namedb_type* db, domain_type* domain)
        /* domain has become occluded/glue or empty non-terminal*/
        denial_diff((denial_type*) domain->denial);
        denial = namedb_del_denial(db, domain->denial);
-       denial_cleanup(denial);
+       denial_cleanup(denial, db->arena);
        domain->denial = NULL;
     }
 }
@@ -604,7 +568,7 @@ namedb_del_nsec3_trigger(namedb_type* db, domain_type* domain,
        /* domain has become occluded/glue */
        denial_diff((denial_type*) domain->denial);
        denial = namedb_del_denial(db, domain->denial);
-       denial_cleanup(denial);
+       denial_cleanup(denial, db->arena);
        domain->denial = NULL;
     } else if (n3p->flags) {
         dstatus = domain_is_delegpt(domain);
@@ -613,7 +577,7 @@ namedb_del_nsec3_trigger(namedb_type* db, domain_type* domain,
         if (dstatus == LDNS_RR_TYPE_NS) {
             denial_diff((denial_type*) domain->denial);
             denial = namedb_del_denial(db, domain->denial);
-            denial_cleanup(denial);
+            denial_cleanup(denial, db->arena);
             domain->denial = NULL;
         }
     }
@@ -653,7 +617,7 @@ namedb_del_denial_trigger(namedb_type* db, domain_type* domain, int rollback)
         if (domain_can_be_deleted(domain)) {
             /* -DOMAIN */
             domain = namedb_del_domain(db, domain);
-            domain_cleanup(domain);
+            domain_cleanup(domain, db->arena);
             is_deleted = 1;
         }
         /* continue with parent */
@@ -663,38 +627,6 @@ namedb_del_denial_trigger(namedb_type* db, domain_type* domain, int rollback)
 }
 
 
-/**
- * Hash domain name.
- *
- */
-static ldns_rdf*
-dname_hash(ldns_rdf* dname, ldns_rdf* apex, nsec3params_type* nsec3params)
-{
-    ldns_rdf* hashed_ownername = NULL;
-    ldns_rdf* hashed_label = NULL;
-    ods_log_assert(dname);
-    ods_log_assert(apex);
-    ods_log_assert(nsec3params);
-    /**
-     * The owner name of the NSEC3 RR is the hash of the original owner
-     * name, prepended as a single label to the zone name.
-     */
-    hashed_label = ldns_nsec3_hash_name(dname, nsec3params->algorithm,
-        nsec3params->iterations, nsec3params->salt_len,
-        nsec3params->salt_data);
-    if (!hashed_label) {
-        return NULL;
-    }
-    hashed_ownername = ldns_dname_cat_clone((const ldns_rdf*) hashed_label,
-        (const ldns_rdf*) apex);
-    if (!hashed_ownername) {
-        return NULL;
-    }
-    ldns_rdf_deep_free(hashed_label);
-    return hashed_ownername;
-}
-
-
 /**
  * Add denial to namedb.
  *
@@ -715,37 +647,30 @@ namedb_add_denial(namedb_type* db, ldns_rdf* dname, nsec3params_type* n3p)
     /* nsec or nsec3 */
     if (n3p) {
         z = (zone_type*) db->zone;
-        owner = dname_hash(dname, z->apex, n3p);
+        owner = nsec3hash_get(db->hashes, dname, z->apex, n3p);
+        if (!owner) {
+            ods_log_error("[%s] unable to add denial: create owner failed",
+                db_str);
+            return NULL;
+        }
+        denial = denial_create(db->zone, db->arena, owner);
+        ldns_rdf_deep_free(owner);
     } else {
-        owner = ldns_rdf_clone(dname);
+        denial = denial_create(db->zone, db->arena, dname);
     }
-    if (!owner) {
-        ods_log_error("[%s] unable to add denial: create owner failed",
-            db_str);
-        return NULL;
-    }
-    denial = denial_create(db->zone, owner);
     if (!denial) {
         ods_log_error("[%s] unable to add denial: denial_create() failed",
             db_str);
         return NULL;
     }
-    new_node = denial2node(denial);
-    if (!new_node) {
-        ods_log_error("[%s] unable to add denial: denial2node() failed",
-            db_str);
-        return NULL;
-    }
+    new_node = &denial->node;
     if (!ldns_rbtree_insert(db->denials, new_node)) {
         ods_log_error("[%s] unable to add denial: already present", db_str);
         log_dname(denial->dname, "ERR +DENIAL", LOG_ERR);
-        denial_cleanup(denial);
-        free((void*)new_node);
+        denial_cleanup(denial, db->arena);
         return NULL;
     }
     /* denial of existence data point added */
-    denial = (denial_type*) new_node->data;
-    denial->node = new_node;
     denial->nxt_changed = 1;
     pnode = ldns_rbtree_previous(new_node);
     if (!pnode || pnode == LDNS_RBTREE_NULL) {
@@ -780,7 +705,7 @@ namedb_del_denial(namedb_type* db, denial_type* denial)
         log_dname(denial->dname, "ERR -DENIAL", LOG_ERR);
         return NULL;
     }
-    pnode = ldns_rbtree_previous(denial->node);
+    pnode = ldns_rbtree_previous(&denial->node);
     if (!pnode || pnode == LDNS_RBTREE_NULL) {
         pnode = ldns_rbtree_last(db->denials);
     }
@@ -793,16 +718,61 @@ namedb_del_denial(namedb_type* db, denial_type* denial)
         log_dname(denial->dname, "ERR -DENIAL", LOG_ERR);
         return NULL;
     }
-    ods_log_assert(denial->node == node);
+    ods_log_assert(&denial->node == node);
     pdenial->nxt_changed = 1;
-    free((void*)node);
     denial->domain = NULL;
-    denial->node = NULL;
     log_dname(denial->dname, "-DENIAL", LOG_DEEEBUG);
     return denial;
 }
 
 
+/**
+ * Hash the owner names that are about to get an NSEC3 in one go, so
+ * that the iterated hashing can be spread over multiple threads.
+ *
+ */
+static void
+namedb_hash_denials(namedb_type* db)
+{
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    domain_type* domain = NULL;
+    zone_type* zone = (zone_type*) db->zone;
+    nsec3params_type* n3p = NULL;
+    ldns_rdf** dnames = NULL;
+    ldns_rr_type dstatus;
+    size_t count = 0;
+
+    if (!zone->signconf || zone->signconf->passthrough ||
+        zone->signconf->nsec_type != LDNS_RR_TYPE_NSEC3 ||
+        !zone->signconf->nsec3params) {
+        return;
+    }
+    n3p = zone->signconf->nsec3params;
+    nsec3hash_rekey(db->hashes, n3p);
+    CHECKALLOC(dnames = (ldns_rdf**) malloc(db->domains->count *
+        sizeof(ldns_rdf*)));
+    for (node = ldns_rbtree_first(db->domains); node != LDNS_RBTREE_NULL;
+        node = ldns_rbtree_next(node)) {
+        domain = (domain_type*) node->data;
+        if (domain->denial || domain_can_be_deleted(domain) ||
+            nsec3hash_lookup(db->hashes, domain->dname)) {
+            continue;
+        }
+        /* same selection as namedb_add_nsec3_trigger */
+        dstatus = domain_is_occluded(domain);
+        if (dstatus == LDNS_RR_TYPE_DNAME || dstatus == LDNS_RR_TYPE_A) {
+            continue;
+        }
+        if (n3p->flags && domain_is_delegpt(domain) == LDNS_RR_TYPE_NS) {
+            continue;
+        }
+        dnames[count++] = domain->dname;
+    }
+    nsec3hash_prepare(db->hashes, dnames, count, zone->apex, n3p);
+    free(dnames);
+}
+
+
 /**
  * Apply differences in db.
  *
@@ -824,6 +794,7 @@ namedb_diff(namedb_type* db, unsigned is_ixfr, unsigned more_coming)
         node = ldns_rbtree_next(node);
         domain_diff(domain, is_ixfr, more_coming);
     }
+    namedb_hash_denials(db);
     node = ldns_rbtree_first(db->domains);
     if (!node || node == LDNS_RBTREE_NULL) {
         return;
@@ -864,9 +835,42 @@ namedb_rollback(namedb_type* db, unsigned keepsc)
 }
 
 
+/**
+ * Range of the denial chain to create NSEC(3) RRs for.
+ *
+ */
+struct namedb_nsecify_job {
+    denial_type** denials;
+    denial_type** nxts;
+    ldns_rr** rrs;
+    size_t count;
+};
+
+
+/**
+ * Create the NSEC(3) RRs of a range of the denial chain.
+ *
+ */
+static void
+namedb_nsecify_run(void* arg)
+{
+    struct namedb_nsecify_job* job = (struct namedb_nsecify_job*) arg;
+    size_t i;
+    for (i = 0; i < job->count; i++) {
+        job->rrs[i] = denial_create_rr(job->denials[i], job->nxts[i]);
+    }
+}
+
+
 /**
  * Nsecify db.
  *
+ * Only the denials whose next owner or type bitmap changed get a new
+ * NSEC(3) RR.  These are collected in chain order together with their
+ * successor, so that the RRs can be created for contiguous ranges of
+ * the chain at the same time.  Adding them to the denials updates the
+ * resign index and the IXFR and is done afterwards, in chain order.
+ *
  */
 void
 namedb_nsecify(namedb_type* db, uint32_t* num_added)
@@ -874,20 +878,58 @@ namedb_nsecify(namedb_type* db, uint32_t* num_added)
     ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     ldns_rbnode_t* nxt_node = LDNS_RBTREE_NULL;
     denial_type* denial = NULL;
-    denial_type* nxt = NULL;
+    denial_type** denials = NULL;
+    denial_type** nxts = NULL;
+    ldns_rr** rrs = NULL;
+    struct namedb_nsecify_job* jobs = NULL;
+    size_t count = 0, njobs, from, i;
     uint32_t nsec_added = 0;
     ods_log_assert(db);
+    if (db->denials->count > 0) {
+        CHECKALLOC(denials = (denial_type**) malloc(db->denials->count *
+            sizeof(denial_type*)));
+        CHECKALLOC(nxts = (denial_type**) malloc(db->denials->count *
+            sizeof(denial_type*)));
+    }
     node = ldns_rbtree_first(db->denials);
     while (node && node != LDNS_RBTREE_NULL) {
         denial = (denial_type*) node->data;
         nxt_node = ldns_rbtree_next(node);
-        if (!nxt_node || nxt_node == LDNS_RBTREE_NULL) {
-             nxt_node = ldns_rbtree_first(db->denials);
+        if (denial->nxt_changed || denial->bitmap_changed) {
+            if (!nxt_node || nxt_node == LDNS_RBTREE_NULL) {
+                 nxt_node = ldns_rbtree_first(db->denials);
+            }
+            denials[count] = denial;
+            nxts[count] = (denial_type*) nxt_node->data;
+            count++;
         }
-        nxt = (denial_type*) nxt_node->data;
-        denial_nsecify(denial, nxt, &nsec_added);
         node = ldns_rbtree_next(node);
     }
+    if (count > 0) {
+        njobs = parallel_jobs(count, NAMEDB_NSECIFY_JOB_MIN);
+        CHECKALLOC(rrs = (ldns_rr**) malloc(count * sizeof(ldns_rr*)));
+        CHECKALLOC(jobs = (struct namedb_nsecify_job*) malloc(njobs *
+            sizeof(struct namedb_nsecify_job)));
+        for (i = 0; i < njobs; i++) {
+            from = i * count / njobs;
+            jobs[i].denials = &denials[from];
+            jobs[i].nxts = &nxts[from];
+            jobs[i].rrs = &rrs[from];
+            jobs[i].count = (i + 1) * count / njobs - from;
+        }
+        parallel_run(namedb_nsecify_run, jobs,
+            sizeof(struct namedb_nsecify_job), njobs);
+        for (i = 0; i < count; i++) {
+            if (rrs[i]) {
+                denial_add_rr(denials[i], rrs[i]);
+                nsec_added++;
+            }
+        }
+        free(jobs);
+        free(rrs);
+    }
+    free(nxts);
+    free(denials);
     if (num_added) {
         *num_added = nsec_added;
     }
@@ -981,6 +1023,7 @@ namedb_wipe_denial(namedb_type* db)
     ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     denial_type* denial = NULL;
     zone_type* zone = NULL;
+    ldns_rr* rr = NULL;
     size_t i = 0;
 
     if (db && db->denials) {
@@ -997,13 +1040,15 @@ namedb_wipe_denial(namedb_type* db)
                 continue;
             }
             for (i=0; i < denial->rrset->rr_count; i++) {
-                if (denial->rrset->rrs[i].exists) {
+                if (denial->rrset->rrs[i].exists &&
+                    zone->db->is_initialized) {
                     /* ixfr -RR */
+                    rr = rrset_rr2ldns(denial->rrset,
+                        &denial->rrset->rrs[i]);
                     pthread_mutex_lock(&zone->ixfr->ixfr_lock);
-                    if (zone->db->is_initialized) {
-                        ixfr_del_rr(zone->ixfr, denial->rrset->rrs[i].rr);
-                    }
+                    ixfr_del_rr(zone->ixfr, rr);
                     pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+                    ldns_rr_free(rr);
                 }
                 denial->rrset->rrs[i].exists = 0;
                 rrset_del_rr(denial->rrset, i);
@@ -1057,15 +1102,14 @@ namedb_export(FILE* fd, namedb_type* db, ods_status* status)
  *
  */
 static void
-domain_delfunc(ldns_rbnode_t* elem)
+domain_delfunc(ldns_rbnode_t* elem, arena_type* arena)
 {
     domain_type* domain = NULL;
     if (elem && elem != LDNS_RBTREE_NULL) {
         domain = (domain_type*) elem->data;
-        domain_delfunc(elem->left);
-        domain_delfunc(elem->right);
-        domain_cleanup(domain);
-        free((void*)elem);
+        domain_delfunc(elem->left, arena);
+        domain_delfunc(elem->right, arena);
+        domain_cleanup(domain, arena);
     }
 }
 
@@ -1075,20 +1119,19 @@ domain_delfunc(ldns_rbnode_t* elem)
  *
  */
 static void
-denial_delfunc(ldns_rbnode_t* elem)
+denial_delfunc(ldns_rbnode_t* elem, arena_type* arena)
 {
     denial_type* denial = NULL;
     domain_type* domain = NULL;
     if (elem && elem != LDNS_RBTREE_NULL) {
         denial = (denial_type*) elem->data;
-        denial_delfunc(elem->left);
-        denial_delfunc(elem->right);
+        denial_delfunc(elem->left, arena);
+        denial_delfunc(elem->right, arena);
         domain = (domain_type*) denial->domain;
         if (domain) {
             domain->denial = NULL;
         }
-        denial_cleanup(denial);
-        free((void*)elem);
+        denial_cleanup(denial, arena);
     }
 }
 
@@ -1101,7 +1144,7 @@ static void
 namedb_cleanup_domains(namedb_type* db)
 {
     if (db && db->domains) {
-        domain_delfunc(db->domains->root);
+        domain_delfunc(db->domains->root, db->arena);
         ldns_rbtree_free(db->domains);
         db->domains = NULL;
     }
@@ -1116,7 +1159,7 @@ void
 namedb_cleanup_denials(namedb_type* db)
 {
     if (db && db->denials) {
-        denial_delfunc(db->denials->root);
+        denial_delfunc(db->denials->root, db->arena);
         ldns_rbtree_free(db->denials);
         db->denials = NULL;
     }
@@ -1131,6 +1174,7 @@ void
 namedb_cleanup(namedb_type* db)
 {
     zone_type* z = NULL;
+    arena_type* arena = NULL;
     if (!db) {
         return;
     }
@@ -1138,8 +1182,16 @@ namedb_cleanup(namedb_type* db)
     if (!z) {
         return;
     }
+    resign_cleanup(db->resign);
+    db->resign = NULL;
+    nsec3hash_cleanup(db->hashes);
+    db->hashes = NULL;
+    /* domains and denials go with the arena, in one go */
+    arena = db->arena;
+    db->arena = NULL;
     namedb_cleanup_denials(db);
     namedb_cleanup_domains(db);
+    arena_cleanup(arena);
     free(db);
 }
 
@@ -1190,3 +1242,46 @@ namedb_backup2(FILE* fd, namedb_type* db)
     }
     fprintf(fd, ";\n");
 }
+
+
+/**
+ * Backup namedb in wire format.
+ *
+ */
+ods_status
+namedb_backup_binary(FILE* fd, namedb_type* db)
+{
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    denial_type* denial = NULL;
+    backup_writer_type* writer = NULL;
+    if (!fd || !db) {
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    writer = backup_writer_create(fd);
+    /* hashed owner names, needed before the RRs are added back */
+    backup_writer_section(writer, BACKUP_SECTION_NSEC3HASHES);
+    nsec3hash_backup(writer, db->hashes);
+    backup_writer_section(writer, BACKUP_SECTION_RRS);
+    for (node = ldns_rbtree_first(db->domains); node != LDNS_RBTREE_NULL;
+        node = ldns_rbtree_next(node)) {
+        domain_backup_binary(writer, (domain_type*) node->data, 0);
+    }
+    backup_writer_section(writer, BACKUP_SECTION_DENIALS);
+    for (node = ldns_rbtree_first(db->denials); node != LDNS_RBTREE_NULL;
+        node = ldns_rbtree_next(node)) {
+        denial = (denial_type*) node->data;
+        rrset_backup_binary(writer, denial->rrset, 0);
+    }
+    /* signatures */
+    backup_writer_section(writer, BACKUP_SECTION_RRSIGS);
+    for (node = ldns_rbtree_first(db->domains); node != LDNS_RBTREE_NULL;
+        node = ldns_rbtree_next(node)) {
+        domain_backup_binary(writer, (domain_type*) node->data, 1);
+    }
+    for (node = ldns_rbtree_first(db->denials); node != LDNS_RBTREE_NULL;
+        node = ldns_rbtree_next(node)) {
+        denial = (denial_type*) node->data;
+        rrset_backup_binary(writer, denial->rrset, 1);
+    }
+    return backup_writer_finish(writer);
+}
@@ -37,10 +37,13 @@
 
 typedef struct namedb_struct namedb_type;
 
+#include "signer/arena.h"
 #include "signer/denial.h"
 #include "signer/domain.h"
 #include "signer/zone.h"
 #include "signer/nsec3params.h"
+#include "signer/nsec3hash.h"
+#include "signer/resign.h"
 
 /**
  * Domain name database.
@@ -48,8 +51,11 @@ typedef struct namedb_struct namedb_type;
  */
 struct namedb_struct {
     zone_type* zone;
+    arena_type* arena; /* domains and denials, with their names */
     ldns_rbtree_t* domains;
     ldns_rbtree_t* denials;
+    resign_type* resign;
+    nsec3hash_type* hashes;
     uint32_t inbserial;
     uint32_t intserial;
     uint32_t outserial;
@@ -225,4 +231,13 @@ void namedb_cleanup(namedb_type* db);
  */
 void namedb_backup2(FILE* fd, namedb_type* db);
 
+/**
+ * Backup namedb in wire format.
+ * \param[in] fd output file descriptor
+ * \param[in] db namedb
+ * \return ods_status status
+ *
+ */
+ods_status namedb_backup_binary(FILE* fd, namedb_type* db);
+
 #endif /* SIGNER_NAMEDB_H */
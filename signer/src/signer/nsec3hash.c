@@ -0,0 +1,449 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Cache of NSEC3 hashed owner names.
+ *
+ */
+
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "signer/backup.h"
+#include "signer/nsec3hash.h"
+#include "signer/parallel.h"
+
+static const char* nsec3hash_str = "nsec3hash";
+
+/* minimum number of names worth a hash job of its own */
+#define NSEC3HASH_JOB_MIN 128
+
+struct nsec3hash_job {
+    ldns_rdf** dnames;
+    ldns_rdf** hashed;
+    size_t count;
+    ldns_rdf* apex;
+    nsec3params_type* n3p;
+};
+
+
+/**
+ * Compare owner names.
+ *
+ */
+static int
+nsec3hash_compare(const void* a, const void* b)
+{
+    ldns_rdf* x = (ldns_rdf*)a;
+    ldns_rdf* y = (ldns_rdf*)b;
+    return ldns_dname_compare(x, y);
+}
+
+
+/**
+ * Hash owner name.
+ *
+ */
+static ldns_rdf*
+nsec3hash_name(ldns_rdf* dname, ldns_rdf* apex, nsec3params_type* n3p)
+{
+    ldns_rdf* hashed_ownername = NULL;
+    ldns_rdf* hashed_label = NULL;
+    ods_log_assert(dname);
+    ods_log_assert(apex);
+    ods_log_assert(n3p);
+    /**
+     * The owner name of the NSEC3 RR is the hash of the original owner
+     * name, prepended as a single label to the zone name.
+     */
+    hashed_label = ldns_nsec3_hash_name(dname, n3p->algorithm,
+        n3p->iterations, n3p->salt_len, n3p->salt_data);
+    if (!hashed_label) {
+        return NULL;
+    }
+    hashed_ownername = ldns_dname_cat_clone((const ldns_rdf*) hashed_label,
+        (const ldns_rdf*) apex);
+    ldns_rdf_deep_free(hashed_label);
+    return hashed_ownername;
+}
+
+
+/**
+ * Create NSEC3 hash cache.
+ *
+ */
+nsec3hash_type*
+nsec3hash_create(void)
+{
+    nsec3hash_type* cache = NULL;
+    CHECKALLOC(cache = (nsec3hash_type*) malloc(sizeof(nsec3hash_type)));
+    cache->hashes = ldns_rbtree_create(nsec3hash_compare);
+    cache->algorithm = 0;
+    cache->iterations = 0;
+    cache->salt_len = 0;
+    cache->salt_data = NULL;
+    return cache;
+}
+
+
+/**
+ * Free all entries in a subtree.
+ *
+ */
+static void
+nsec3hash_delfunc(ldns_rbnode_t* elem)
+{
+    if (elem && elem != LDNS_RBTREE_NULL) {
+        nsec3hash_delfunc(elem->left);
+        nsec3hash_delfunc(elem->right);
+        ldns_rdf_deep_free((ldns_rdf*) elem->key);
+        ldns_rdf_deep_free((ldns_rdf*) elem->data);
+        free((void*)elem);
+    }
+}
+
+
+/**
+ * Drop all entries.
+ *
+ */
+static void
+nsec3hash_flush(nsec3hash_type* cache)
+{
+    if (cache->hashes->count > 0) {
+        ods_log_debug("[%s] flush %lu hashed owner names", nsec3hash_str,
+            (unsigned long) cache->hashes->count);
+    }
+    nsec3hash_delfunc(cache->hashes->root);
+    cache->hashes->root = LDNS_RBTREE_NULL;
+    cache->hashes->count = 0;
+}
+
+
+/**
+ * Set the NSEC3 parameters of the cache.
+ *
+ */
+static void
+nsec3hash_setparams(nsec3hash_type* cache, uint8_t algorithm,
+    uint16_t iterations, uint8_t salt_len, uint8_t* salt_data)
+{
+    free(cache->salt_data);
+    cache->salt_data = NULL;
+    if (salt_len) {
+        CHECKALLOC(cache->salt_data = (uint8_t*) malloc(salt_len));
+        memcpy(cache->salt_data, salt_data, salt_len);
+    }
+    cache->algorithm = algorithm;
+    cache->iterations = iterations;
+    cache->salt_len = salt_len;
+}
+
+
+/**
+ * Make sure the cache holds hashes computed with these NSEC3 parameters.
+ *
+ */
+void
+nsec3hash_rekey(nsec3hash_type* cache, nsec3params_type* n3p)
+{
+    if (!cache || !n3p) {
+        return;
+    }
+    if (cache->algorithm == n3p->algorithm &&
+        cache->iterations == n3p->iterations &&
+        cache->salt_len == n3p->salt_len &&
+        (!n3p->salt_len ||
+         memcmp(cache->salt_data, n3p->salt_data, n3p->salt_len) == 0)) {
+        return;
+    }
+    nsec3hash_flush(cache);
+    nsec3hash_setparams(cache, n3p->algorithm, n3p->iterations,
+        n3p->salt_len, n3p->salt_data);
+}
+
+
+/**
+ * Lookup hashed owner name.
+ *
+ */
+ldns_rdf*
+nsec3hash_lookup(nsec3hash_type* cache, ldns_rdf* dname)
+{
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    if (!cache || !dname) {
+        return NULL;
+    }
+    node = ldns_rbtree_search(cache->hashes, dname);
+    if (node && node != LDNS_RBTREE_NULL) {
+        return (ldns_rdf*) node->data;
+    }
+    return NULL;
+}
+
+
+/**
+ * Add hashed owner name, the cache takes ownership of hashed.
+ *
+ */
+static void
+nsec3hash_insert(nsec3hash_type* cache, ldns_rdf* dname, ldns_rdf* hashed)
+{
+    ldns_rbnode_t* node = NULL;
+    CHECKALLOC(node = (ldns_rbnode_t*) malloc(sizeof(ldns_rbnode_t)));
+    node->key = ldns_rdf_clone(dname);
+    node->data = hashed;
+    if (!node->key || !ldns_rbtree_insert(cache->hashes, node)) {
+        ldns_rdf_deep_free((ldns_rdf*) node->key);
+        ldns_rdf_deep_free(hashed);
+        free((void*)node);
+    }
+}
+
+
+/**
+ * Get hashed owner name, hash it if not yet in the cache.
+ *
+ */
+ldns_rdf*
+nsec3hash_get(nsec3hash_type* cache, ldns_rdf* dname, ldns_rdf* apex,
+    nsec3params_type* n3p)
+{
+    ldns_rdf* hashed = NULL;
+    if (!cache) {
+        return nsec3hash_name(dname, apex, n3p);
+    }
+    nsec3hash_rekey(cache, n3p);
+    hashed = nsec3hash_lookup(cache, dname);
+    if (hashed) {
+        return ldns_rdf_clone(hashed);
+    }
+    hashed = nsec3hash_name(dname, apex, n3p);
+    if (hashed) {
+        nsec3hash_insert(cache, dname, ldns_rdf_clone(hashed));
+    }
+    return hashed;
+}
+
+
+/**
+ * Hash a slice of owner names.
+ *
+ */
+static void
+nsec3hash_run(void* arg)
+{
+    struct nsec3hash_job* job = (struct nsec3hash_job*) arg;
+    size_t i;
+    for (i = 0; i < job->count; i++) {
+        job->hashed[i] = nsec3hash_name(job->dnames[i], job->apex, job->n3p);
+    }
+}
+
+
+/**
+ * Hash owner names in bulk.
+ *
+ */
+void
+nsec3hash_prepare(nsec3hash_type* cache, ldns_rdf** dnames, size_t count,
+    ldns_rdf* apex, nsec3params_type* n3p)
+{
+    struct nsec3hash_job* jobs = NULL;
+    ldns_rdf** hashed = NULL;
+    size_t njobs, from, i;
+
+    if (!cache || !dnames || !count || !apex || !n3p) {
+        return;
+    }
+    nsec3hash_rekey(cache, n3p);
+    njobs = parallel_jobs(count, NSEC3HASH_JOB_MIN);
+    CHECKALLOC(hashed = (ldns_rdf**) calloc(count, sizeof(ldns_rdf*)));
+    CHECKALLOC(jobs = (struct nsec3hash_job*) malloc(njobs *
+        sizeof(struct nsec3hash_job)));
+    for (i = 0; i < njobs; i++) {
+        from = i * count / njobs;
+        jobs[i].dnames = &dnames[from];
+        jobs[i].hashed = &hashed[from];
+        jobs[i].count = (i + 1) * count / njobs - from;
+        jobs[i].apex = apex;
+        jobs[i].n3p = n3p;
+    }
+    parallel_run(nsec3hash_run, jobs, sizeof(struct nsec3hash_job), njobs);
+    ods_log_debug("[%s] hashed %lu owner names in %lu jobs",
+        nsec3hash_str, (unsigned long) count, (unsigned long) njobs);
+    for (i = 0; i < count; i++) {
+        if (hashed[i]) {
+            nsec3hash_insert(cache, dnames[i], hashed[i]);
+        }
+    }
+    free(jobs);
+    free(hashed);
+}
+
+
+/**
+ * Remove owner name from the cache.
+ *
+ */
+void
+nsec3hash_remove(nsec3hash_type* cache, ldns_rdf* dname)
+{
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    if (!cache || !dname) {
+        return;
+    }
+    node = ldns_rbtree_delete(cache->hashes, dname);
+    if (node && node != LDNS_RBTREE_NULL) {
+        ldns_rdf_deep_free((ldns_rdf*) node->key);
+        ldns_rdf_deep_free((ldns_rdf*) node->data);
+        free((void*)node);
+    }
+}
+
+
+/**
+ * Backup NSEC3 hash cache.
+ *
+ * The first record holds the NSEC3 parameters the hashes were computed
+ * with: algorithm, 16-bit iterations, salt length and salt.  Every next
+ * record holds an owner name and the first label of its hashed owner
+ * name, each in wire format preceded by its length.
+ *
+ */
+void
+nsec3hash_backup(backup_writer_type* writer, nsec3hash_type* cache)
+{
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    ldns_rdf* dname = NULL;
+    ldns_rdf* hashed = NULL;
+    uint8_t rec[2 + LDNS_MAX_DOMAINLEN + LDNS_MAX_LABELLEN + 1];
+    size_t len;
+    if (!writer || !cache || !cache->hashes->count) {
+        return;
+    }
+    rec[0] = cache->algorithm;
+    ldns_write_uint16(rec + 1, cache->iterations);
+    rec[3] = cache->salt_len;
+    if (cache->salt_len) {
+        memcpy(rec + 4, cache->salt_data, cache->salt_len);
+    }
+    backup_writer_data(writer, rec, 4 + (size_t) cache->salt_len);
+    for (node = ldns_rbtree_first(cache->hashes); node != LDNS_RBTREE_NULL;
+        node = ldns_rbtree_next(node)) {
+        dname = (ldns_rdf*) node->key;
+        hashed = (ldns_rdf*) node->data;
+        len = ldns_rdf_size(dname);
+        rec[0] = (uint8_t) len;
+        memcpy(rec + 1, ldns_rdf_data(dname), len);
+        /* hashed label: its length byte and the label itself */
+        memcpy(rec + 1 + len, ldns_rdf_data(hashed),
+            1 + (size_t) ldns_rdf_data(hashed)[0]);
+        len += 2 + (size_t) ldns_rdf_data(hashed)[0];
+        backup_writer_data(writer, rec, len);
+    }
+}
+
+
+/**
+ * Recover NSEC3 hash cache from backup.
+ *
+ */
+int
+nsec3hash_recover(nsec3hash_type* cache, const uint8_t* data, uint64_t len,
+    uint32_t count, ldns_rdf* apex)
+{
+    uint8_t buf[LDNS_MAX_DOMAINLEN];
+    ldns_rdf* dname = NULL;
+    ldns_rdf* hashed = NULL;
+    uint64_t pos = 0;
+    size_t dlen, hlen;
+    uint32_t i;
+
+    if (!cache || !apex) {
+        return 0;
+    }
+    nsec3hash_flush(cache);
+    if (!count) {
+        return 1;
+    }
+    if (len < 4 || len - 4 < data[3]) {
+        goto recover_error;
+    }
+    nsec3hash_setparams(cache, data[0], ldns_read_uint16(data + 1), data[3],
+        (uint8_t*) data + 4);
+    pos = 4 + (uint64_t) data[3];
+    for (i = 1; i < count; i++) {
+        if (len - pos < 1 || len - pos - 1 < data[pos]) {
+            goto recover_error;
+        }
+        dlen = data[pos];
+        dname = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_DNAME, dlen,
+            data + pos + 1);
+        pos += 1 + dlen;
+        if (!dname || len - pos < 1 || len - pos - 1 < data[pos]) {
+            ldns_rdf_deep_free(dname);
+            goto recover_error;
+        }
+        /* hashed owner name is the hashed label prepended to the apex */
+        hlen = 1 + (size_t) data[pos];
+        if (hlen + ldns_rdf_size(apex) > sizeof(buf)) {
+            ldns_rdf_deep_free(dname);
+            goto recover_error;
+        }
+        memcpy(buf, data + pos, hlen);
+        memcpy(buf + hlen, ldns_rdf_data(apex), ldns_rdf_size(apex));
+        pos += hlen;
+        CHECKALLOC(hashed = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_DNAME,
+            hlen + ldns_rdf_size(apex), buf));
+        nsec3hash_insert(cache, dname, hashed);
+        ldns_rdf_deep_free(dname);
+    }
+    return 1;
+
+recover_error:
+    ods_log_error("[%s] unable to recover NSEC3 hashes: corrupted entry",
+        nsec3hash_str);
+    nsec3hash_flush(cache);
+    return 0;
+}
+
+
+/**
+ * Clean up NSEC3 hash cache.
+ *
+ */
+void
+nsec3hash_cleanup(nsec3hash_type* cache)
+{
+    if (!cache) {
+        return;
+    }
+    nsec3hash_delfunc(cache->hashes->root);
+    ldns_rbtree_free(cache->hashes);
+    free(cache->salt_data);
+    free(cache);
+}
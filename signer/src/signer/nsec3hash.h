@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Cache of NSEC3 hashed owner names.
+ *
+ */
+
+#ifndef SIGNER_NSEC3HASH_H
+#define SIGNER_NSEC3HASH_H
+
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <ldns/ldns.h>
+
+typedef struct nsec3hash_struct nsec3hash_type;
+
+#include "signer/backup.h"
+#include "signer/nsec3params.h"
+
+/**
+ * NSEC3 hash cache.
+ *
+ * Maps owner names to their hashed owner names.  Hashing is an iterated
+ * digest per name, so the result is kept for as long as the NSEC3
+ * parameters stay the same.  The parameters the hashes were computed
+ * with are part of the cache: a resalt, or a change in algorithm or
+ * iterations, flushes it.
+ *
+ */
+struct nsec3hash_struct {
+    ldns_rbtree_t* hashes;
+    uint8_t algorithm;
+    uint16_t iterations;
+    uint8_t salt_len;
+    uint8_t* salt_data;
+};
+
+/**
+ * Create NSEC3 hash cache.
+ * \return nsec3hash_type* cache
+ *
+ */
+nsec3hash_type* nsec3hash_create(void);
+
+/**
+ * Make sure the cache holds hashes computed with these NSEC3 parameters,
+ * flush it if not.
+ * \param[in] cache cache
+ * \param[in] n3p NSEC3 parameters
+ *
+ */
+void nsec3hash_rekey(nsec3hash_type* cache, nsec3params_type* n3p);
+
+/**
+ * Lookup hashed owner name.
+ * \param[in] cache cache
+ * \param[in] dname owner name
+ * \return ldns_rdf* hashed owner name, owned by the cache, NULL if unknown
+ *
+ */
+ldns_rdf* nsec3hash_lookup(nsec3hash_type* cache, ldns_rdf* dname);
+
+/**
+ * Get hashed owner name, hash it if not yet in the cache.
+ * \param[in] cache cache
+ * \param[in] dname owner name
+ * \param[in] apex zone apex
+ * \param[in] n3p NSEC3 parameters
+ * \return ldns_rdf* hashed owner name, to be freed by the caller
+ *
+ */
+ldns_rdf* nsec3hash_get(nsec3hash_type* cache, ldns_rdf* dname,
+    ldns_rdf* apex, nsec3params_type* n3p);
+
+/**
+ * Hash owner names in bulk, spread over multiple threads, and add them
+ * to the cache.
+ * \param[in] cache cache
+ * \param[in] dnames owner names, not yet in the cache
+ * \param[in] count number of owner names
+ * \param[in] apex zone apex
+ * \param[in] n3p NSEC3 parameters
+ *
+ */
+void nsec3hash_prepare(nsec3hash_type* cache, ldns_rdf** dnames,
+    size_t count, ldns_rdf* apex, nsec3params_type* n3p);
+
+/**
+ * Remove owner name from the cache.
+ * \param[in] cache cache
+ * \param[in] dname owner name
+ *
+ */
+void nsec3hash_remove(nsec3hash_type* cache, ldns_rdf* dname);
+
+/**
+ * Backup NSEC3 hash cache to the current section of a binary backup.
+ * \param[in] writer backup writer
+ * \param[in] cache cache
+ *
+ */
+void nsec3hash_backup(backup_writer_type* writer, nsec3hash_type* cache);
+
+/**
+ * Recover NSEC3 hash cache from the section of a binary backup.
+ * \param[in] cache cache
+ * \param[in] data section
+ * \param[in] len length of the section
+ * \param[in] count number of records in the section
+ * \param[in] apex zone apex
+ * \return int 1 on success, 0 on error
+ *
+ */
+int nsec3hash_recover(nsec3hash_type* cache, const uint8_t* data,
+    uint64_t len, uint32_t count, ldns_rdf* apex);
+
+/**
+ * Clean up NSEC3 hash cache.
+ * \param[in] cache cache
+ *
+ */
+void nsec3hash_cleanup(nsec3hash_type* cache);
+
+#endif /* SIGNER_NSEC3HASH_H */
@@ -168,5 +168,6 @@ nsec3params_cleanup(nsec3params_type* nsec3params)
         return;
     }
     free(nsec3params->salt_data);
+    ldns_rr_free(nsec3params->rr);
     free(nsec3params);
 }
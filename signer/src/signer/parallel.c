@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Run a bulk operation as a batch of jobs.  The jobs are offered to the
+ * drudgers through the sign queue, the calling thread runs jobs too and
+ * returns when all of them are done.
+ *
+ */
+
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "signer/parallel.h"
+
+static const char* parallel_str = "parallel";
+
+static int parallel_threads = 1;
+static fifoq_type* parallel_queue = NULL;
+
+/* owner of the queued jobs, tells them apart from signing batches */
+static char parallel_owner;
+
+/**
+ * Bulk operation, shared by the calling thread and the drudgers that
+ * help out.  Every thread claims jobs until there are none left.  The
+ * operation is freed by whoever drops the last reference: the caller
+ * or a drudger that popped it from the queue late.
+ *
+ */
+struct parallel_struct {
+    void (*func)(void*);
+    char* jobs;
+    size_t jobsize;
+    size_t njobs;
+    size_t next; /* next job to claim */
+    size_t done; /* number of jobs finished */
+    int refs;
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+};
+
+
+/**
+ * Set the queue and number of threads bulk operations may use.
+ *
+ */
+void
+parallel_setup(fifoq_type* q, int nthreads)
+{
+    parallel_queue = q;
+    parallel_threads = (nthreads > 0 ? nthreads + 1 : 1);
+}
+
+
+/**
+ * Number of jobs to split a bulk operation into.
+ *
+ */
+size_t
+parallel_jobs(size_t count, size_t minimum)
+{
+    size_t njobs = (size_t) parallel_threads;
+    if (minimum && njobs > count / minimum) {
+        njobs = count / minimum;
+    }
+    return (njobs ? njobs : 1);
+}
+
+
+/**
+ * Claim and run jobs until there are none left.
+ *
+ */
+static void
+parallel_work(struct parallel_struct* op)
+{
+    size_t i;
+    while ((i = __atomic_fetch_add(&op->next, 1, __ATOMIC_RELAXED)) <
+        op->njobs) {
+        op->func(op->jobs + i * op->jobsize);
+        pthread_mutex_lock(&op->lock);
+        op->done++;
+        if (op->done == op->njobs) {
+            pthread_cond_signal(&op->done_cond);
+        }
+        pthread_mutex_unlock(&op->lock);
+    }
+}
+
+
+/**
+ * Drop reference to bulk operation.
+ *
+ */
+static void
+parallel_release(struct parallel_struct* op)
+{
+    if (__atomic_sub_fetch(&op->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    pthread_cond_destroy(&op->done_cond);
+    pthread_mutex_destroy(&op->lock);
+    free(op);
+}
+
+
+/**
+ * Is this the owner of a queued job.
+ *
+ */
+int
+parallel_owns(void* owner)
+{
+    return owner == (void*) &parallel_owner;
+}
+
+
+/**
+ * Help out with a queued bulk operation.
+ *
+ */
+void
+parallel_drudge(void* item)
+{
+    struct parallel_struct* op = (struct parallel_struct*) item;
+    parallel_work(op);
+    parallel_release(op);
+}
+
+
+/**
+ * Run jobs.
+ *
+ */
+void
+parallel_run(void (*func)(void*), void* jobs, size_t jobsize, size_t njobs)
+{
+    struct parallel_struct* op = NULL;
+    size_t i;
+
+    if (!func || !jobs || !njobs) {
+        return;
+    }
+    if (njobs == 1 || !parallel_queue) {
+        for (i = 0; i < njobs; i++) {
+            func((char*)jobs + i * jobsize);
+        }
+        return;
+    }
+    CHECKALLOC(op = (struct parallel_struct*) malloc(
+        sizeof(struct parallel_struct)));
+    op->func = func;
+    op->jobs = (char*) jobs;
+    op->jobsize = jobsize;
+    op->njobs = njobs;
+    op->next = 0;
+    op->done = 0;
+    op->refs = 1;
+    pthread_mutex_init(&op->lock, NULL);
+    pthread_cond_init(&op->done_cond, NULL);
+    /* one queue item per drudger that can help, the caller works too */
+    for (i = 1; i < njobs; i++) {
+        __atomic_add_fetch(&op->refs, 1, __ATOMIC_RELAXED);
+        if (fifoq_trypush(parallel_queue, op, &parallel_owner) !=
+            ODS_STATUS_OK) {
+            /* queue is full, do the remaining jobs ourselves */
+            __atomic_sub_fetch(&op->refs, 1, __ATOMIC_RELAXED);
+            ods_log_deeebug("[%s] queue full, running jobs inline",
+                parallel_str);
+            break;
+        }
+    }
+    parallel_work(op);
+    pthread_mutex_lock(&op->lock);
+    while (op->done < op->njobs) {
+        pthread_cond_wait(&op->done_cond, &op->lock);
+    }
+    pthread_mutex_unlock(&op->lock);
+    parallel_release(op);
+}
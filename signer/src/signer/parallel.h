@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Run a bulk operation as a batch of jobs.  The jobs are offered to the
+ * drudgers through the sign queue, the calling thread runs jobs too and
+ * returns when all of them are done.
+ *
+ */
+
+#ifndef SIGNER_PARALLEL_H
+#define SIGNER_PARALLEL_H
+
+#include "config.h"
+#include <stddef.h>
+
+#include "scheduler/fifoq.h"
+
+/**
+ * Set the queue and number of threads bulk operations may use, normally
+ * the signing queue and the number of signer threads.  Without a queue,
+ * jobs run on the calling thread.
+ * \param[in] q queue the drudgers take work from
+ * \param[in] nthreads number of drudgers
+ *
+ */
+void parallel_setup(fifoq_type* q, int nthreads);
+
+/**
+ * Number of jobs to split a bulk operation into.
+ * \param[in] count number of items
+ * \param[in] minimum minimum number of items per job
+ * \return size_t number of jobs, at least 1
+ *
+ */
+size_t parallel_jobs(size_t count, size_t minimum);
+
+/**
+ * Run jobs on the calling thread and on the drudgers that pick them up
+ * from the queue, and wait for all of them to finish.
+ * \param[in] func job function
+ * \param[in] jobs array of job arguments
+ * \param[in] jobsize size of a job argument
+ * \param[in] njobs number of jobs
+ *
+ */
+void parallel_run(void (*func)(void*), void* jobs, size_t jobsize,
+    size_t njobs);
+
+/**
+ * Whether a queue item with this owner is a bulk operation.
+ * \param[in] owner owner of the queue item
+ * \return int 1 if it is, 0 if not
+ *
+ */
+int parallel_owns(void* owner);
+
+/**
+ * Help out with a bulk operation popped from the queue.
+ * \param[in] item queue item
+ *
+ */
+void parallel_drudge(void* item);
+
+#endif /* SIGNER_PARALLEL_H */
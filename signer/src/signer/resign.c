@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Index of RRsets that need to be (re)signed.
+ *
+ */
+
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "signer/resign.h"
+
+static const char* resign_str = "resign";
+
+#define RESIGN_INITIAL_CAPACITY 64
+
+
+/**
+ * The key of the RRset in the index, the time it is due for signing.
+ *
+ */
+static uint32_t
+resign_key(resign_type* idx, rrset_type* rrset)
+{
+    if (rrset->needs_signing) {
+        return 0;
+    }
+    if (rrset->sig_expiration <= idx->refresh) {
+        return 1;
+    }
+    return rrset->sig_expiration - idx->refresh;
+}
+
+
+/**
+ * Put RRset at position in the heap.
+ *
+ */
+static void
+resign_set(resign_type* idx, size_t pos, rrset_type* rrset)
+{
+    idx->heap[pos] = rrset;
+    rrset->resign_idx = pos;
+}
+
+
+/**
+ * Move RRset towards the top of the heap.
+ *
+ */
+static void
+resign_sift_up(resign_type* idx, size_t pos)
+{
+    rrset_type* rrset = idx->heap[pos];
+    uint32_t key = resign_key(idx, rrset);
+    while (pos > 1 && resign_key(idx, idx->heap[pos/2]) > key) {
+        resign_set(idx, pos, idx->heap[pos/2]);
+        pos /= 2;
+    }
+    resign_set(idx, pos, rrset);
+}
+
+
+/**
+ * Move RRset towards the bottom of the heap.
+ *
+ */
+static void
+resign_sift_down(resign_type* idx, size_t pos)
+{
+    rrset_type* rrset = idx->heap[pos];
+    uint32_t key = resign_key(idx, rrset);
+    size_t child;
+    while ((child = pos*2) <= idx->count) {
+        if (child < idx->count &&
+            resign_key(idx, idx->heap[child+1]) < resign_key(idx, idx->heap[child])) {
+            child++;
+        }
+        if (resign_key(idx, idx->heap[child]) >= key) {
+            break;
+        }
+        resign_set(idx, pos, idx->heap[child]);
+        pos = child;
+    }
+    resign_set(idx, pos, rrset);
+}
+
+
+/**
+ * Create resign index.
+ *
+ */
+resign_type*
+resign_create(void)
+{
+    resign_type* idx = NULL;
+    CHECKALLOC(idx = (resign_type*) malloc(sizeof(resign_type)));
+    idx->capacity = RESIGN_INITIAL_CAPACITY;
+    idx->count = 0;
+    idx->refresh = 0;
+    idx->sign_all = 1;
+    CHECKALLOC(idx->heap = (rrset_type**) malloc((idx->capacity + 1) *
+        sizeof(rrset_type*)));
+    return idx;
+}
+
+
+/**
+ * Add RRset to, or reposition RRset in, the resign index.
+ *
+ */
+void
+resign_update(resign_type* idx, rrset_type* rrset)
+{
+    if (!idx || !rrset || idx->sign_all) {
+        return;
+    }
+    if (!rrset->needs_signing && !rrset->sig_expiration) {
+        /* nothing to sign, nothing to refresh */
+        resign_remove(idx, rrset);
+        return;
+    }
+    if (!rrset->resign_idx) {
+        if (idx->count == idx->capacity) {
+            idx->capacity *= 2;
+            CHECKALLOC(idx->heap = (rrset_type**) realloc(idx->heap,
+                (idx->capacity + 1) * sizeof(rrset_type*)));
+        }
+        idx->count++;
+        resign_set(idx, idx->count, rrset);
+        resign_sift_up(idx, idx->count);
+        return;
+    }
+    ods_log_assert(idx->heap[rrset->resign_idx] == rrset);
+    resign_sift_up(idx, rrset->resign_idx);
+    resign_sift_down(idx, rrset->resign_idx);
+}
+
+
+/**
+ * Remove RRset from the resign index.
+ *
+ */
+void
+resign_remove(resign_type* idx, rrset_type* rrset)
+{
+    rrset_type* moved;
+    size_t pos;
+    if (!idx || !rrset || !rrset->resign_idx) {
+        return;
+    }
+    pos = rrset->resign_idx;
+    ods_log_assert(pos <= idx->count);
+    ods_log_assert(idx->heap[pos] == rrset);
+    rrset->resign_idx = 0;
+    moved = idx->heap[idx->count];
+    idx->count--;
+    if (moved != rrset) {
+        resign_set(idx, pos, moved);
+        resign_sift_up(idx, pos);
+        resign_sift_down(idx, moved->resign_idx);
+    }
+}
+
+
+/**
+ * Pop the RRset that is due first.
+ *
+ */
+rrset_type*
+resign_pop(resign_type* idx, uint32_t until)
+{
+    rrset_type* rrset;
+    if (!idx || !idx->count) {
+        return NULL;
+    }
+    rrset = idx->heap[1];
+    if (resign_key(idx, rrset) >= until) {
+        return NULL;
+    }
+    resign_remove(idx, rrset);
+    return rrset;
+}
+
+
+/**
+ * Time at which the first RRset in the index is due.
+ *
+ */
+uint32_t
+resign_next(resign_type* idx)
+{
+    if (!idx || idx->sign_all || !idx->count) {
+        return 0;
+    }
+    return resign_key(idx, idx->heap[1]);
+}
+
+
+/**
+ * Empty the resign index.
+ *
+ */
+void
+resign_reset(resign_type* idx)
+{
+    size_t i;
+    if (!idx) {
+        return;
+    }
+    if (!idx->sign_all) {
+        ods_log_debug("[%s] drop index of %lu RRsets, sign all RRsets",
+            resign_str, (unsigned long) idx->count);
+    }
+    for (i=1; i <= idx->count; i++) {
+        idx->heap[i]->resign_idx = 0;
+    }
+    idx->count = 0;
+    idx->sign_all = 1;
+}
+
+
+/**
+ * Clean up resign index.
+ *
+ */
+void
+resign_cleanup(resign_type* idx)
+{
+    if (!idx) {
+        return;
+    }
+    idx->sign_all = 1;
+    resign_reset(idx);
+    free(idx->heap);
+    free(idx);
+}
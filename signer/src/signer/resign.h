@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Index of RRsets that need to be (re)signed.
+ *
+ */
+
+#ifndef SIGNER_RESIGN_H
+#define SIGNER_RESIGN_H
+
+#include "config.h"
+#include <stdint.h>
+#include <ldns/ldns.h>
+
+typedef struct resign_struct resign_type;
+
+#include "signer/rrset.h"
+
+/**
+ * Resign index.
+ *
+ * Binary min-heap over the RRsets of a zone, keyed on the time their
+ * signatures need to be refreshed: the earliest expiration of the RRset
+ * signatures minus the refresh interval.  RRsets that have changed since
+ * the last sign run are keyed on zero, RRsets without signatures that
+ * do not need signing are not in the index.  As long as sign_all is set
+ * the index is not maintained and the next sign run visits every RRset.
+ *
+ */
+struct resign_struct {
+    rrset_type** heap;
+    size_t count;
+    size_t capacity;
+    uint32_t refresh;
+    unsigned sign_all : 1;
+};
+
+/**
+ * Create resign index.
+ * \return resign_type* resign index
+ *
+ */
+resign_type* resign_create(void);
+
+/**
+ * Add RRset to, or reposition RRset in, the resign index.
+ * \param[in] idx resign index
+ * \param[in] rrset RRset
+ *
+ */
+void resign_update(resign_type* idx, rrset_type* rrset);
+
+/**
+ * Remove RRset from the resign index.
+ * \param[in] idx resign index
+ * \param[in] rrset RRset
+ *
+ */
+void resign_remove(resign_type* idx, rrset_type* rrset);
+
+/**
+ * Pop the RRset that is due first, if it is due before a given time.
+ * \param[in] idx resign index
+ * \param[in] until pop only RRsets that are due before this time
+ * \return rrset_type* RRset, NULL if no RRset is due
+ *
+ */
+rrset_type* resign_pop(resign_type* idx, uint32_t until);
+
+/**
+ * Time at which the first RRset in the index is due.
+ * \param[in] idx resign index
+ * \return uint32_t due time, 0 if the index is empty or not maintained
+ *
+ */
+uint32_t resign_next(resign_type* idx);
+
+/**
+ * Empty the resign index and have the next sign run visit every RRset.
+ * \param[in] idx resign index
+ *
+ */
+void resign_reset(resign_type* idx);
+
+/**
+ * Clean up resign index.
+ * \param[in] idx resign index
+ *
+ */
+void resign_cleanup(resign_type* idx);
+
+#endif /* SIGNER_RESIGN_H */
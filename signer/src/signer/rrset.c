@@ -35,6 +35,7 @@
 #include "log.h"
 #include "util.h"
 #include "compat.h"
+#include "signer/arena.h"
 #include "signer/rrset.h"
 #include "signer/zone.h"
 
@@ -183,14 +184,127 @@ memberdestroy(void* dummy, void* member)
     (void)dummy;
     free((void*) sig->key_locator);
     sig->key_locator = NULL;
-    /* The rrs may still be in use by IXFRs so cannot do ldns_rr_free(sig->rr); */
-    ldns_rr_free(sig->rr);
-    sig->owner = NULL;
-    sig->rr = NULL;
+    free(sig->rdata);
+    sig->rdata = NULL;
     return 0;
 }
 
 
+/**
+ * Arena the RRset and its RRs are allocated from, NULL if the arena
+ * is about to be cleaned up.
+ *
+ */
+static arena_type*
+rrset_arena(rrset_type* rrset)
+{
+    zone_type* zone = (zone_type*) rrset->zone;
+    return zone->db ? zone->db->arena : NULL;
+}
+
+
+/**
+ * Copy the RDATA of an RR in wire format, from the arena if one is given.
+ *
+ */
+static uint8_t*
+rrset_rdata_pack(ldns_rr* rr, arena_type* arena, uint16_t* rdlen)
+{
+    uint8_t* rdata = NULL;
+    size_t len = 0;
+    size_t i;
+    for (i = 0; i < ldns_rr_rd_count(rr); i++) {
+        len += ldns_rdf_size(ldns_rr_rdf(rr, i));
+    }
+    if (len > 0xffff) {
+        log_rr(rr, "RDATA too large", LOG_EMERG);
+    }
+    if (arena) {
+        rdata = (uint8_t*) arena_alloc(arena, len);
+    } else {
+        CHECKALLOC(rdata = (uint8_t*) malloc(len ? len : 1));
+    }
+    *rdlen = (uint16_t) len;
+    len = 0;
+    for (i = 0; i < ldns_rr_rd_count(rr); i++) {
+        memcpy(rdata + len, ldns_rdf_data(ldns_rr_rdf(rr, i)),
+            ldns_rdf_size(ldns_rr_rdf(rr, i)));
+        len += ldns_rdf_size(ldns_rr_rdf(rr, i));
+    }
+    return rdata;
+}
+
+
+/**
+ * Build an ldns RR from the owner name of the RRset and wire format RDATA.
+ *
+ */
+static ldns_rr*
+rrset_rdata2ldns(rrset_type* rrset, ldns_rr_type type, uint32_t ttl,
+    const uint8_t* rdata, uint16_t rdlen)
+{
+    zone_type* zone = (zone_type*) rrset->zone;
+    uint8_t local[512];
+    uint8_t* wire = local;
+    size_t owner_len = 0;
+    size_t len = 0;
+    size_t pos = 0;
+    ldns_rr* rr = NULL;
+    ldns_status status = LDNS_STATUS_OK;
+
+    ods_log_assert(rrset->owner);
+    owner_len = ldns_rdf_size(rrset->owner);
+    len = owner_len + 10 + rdlen;
+    if (len > sizeof(local)) {
+        CHECKALLOC(wire = (uint8_t*) malloc(len));
+    }
+    memcpy(wire, ldns_rdf_data(rrset->owner), owner_len);
+    ldns_write_uint16(wire + owner_len, type);
+    ldns_write_uint16(wire + owner_len + 2, zone->klass);
+    ldns_write_uint32(wire + owner_len + 4, ttl);
+    ldns_write_uint16(wire + owner_len + 8, rdlen);
+    memcpy(wire + owner_len + 10, rdata, rdlen);
+    status = ldns_wire2rr(&rr, wire, len, &pos, LDNS_SECTION_ANSWER);
+    if (wire != local) {
+        free(wire);
+    }
+    if (status != LDNS_STATUS_OK) {
+        /* the RDATA came from an RR, only memory can run out */
+        log_rrset(rrset->owner, type, "fatal unable to convert RR",
+            LOG_EMERG);
+    }
+    return rr;
+}
+
+
+/**
+ * Get an RR of the RRset as ldns RR.
+ *
+ */
+ldns_rr*
+rrset_rr2ldns(rrset_type* rrset, rr_type* rr)
+{
+    ods_log_assert(rrset);
+    ods_log_assert(rr);
+    return rrset_rdata2ldns(rrset, rrset->rrtype, rr->ttl, rr->rdata,
+        rr->rdlen);
+}
+
+
+/**
+ * Get an RRSIG of the RRset as ldns RR.
+ *
+ */
+ldns_rr*
+rrset_rrsig2ldns(rrset_type* rrset, rrsig_type* rrsig)
+{
+    ods_log_assert(rrset);
+    ods_log_assert(rrsig);
+    return rrset_rdata2ldns(rrset, LDNS_RR_TYPE_RRSIG, rrsig->ttl,
+        rrsig->rdata, rrsig->rdlen);
+}
+
+
 /**
  * Create RRset.
  *
@@ -199,26 +313,74 @@ rrset_type*
 rrset_create(zone_type* zone, ldns_rr_type type)
 {
     rrset_type* rrset = NULL;
-    if (!type || !zone) {
-        return NULL;
-    }
-    CHECKALLOC(rrset = (rrset_type*) malloc(sizeof(rrset_type)));
-    if (!rrset) {
-        ods_log_error("[%s] unable to create RRset %u: allocator_alloc() "
-            "failed", rrset_str, (unsigned) type);
+    if (!type || !zone || !zone->db) {
         return NULL;
     }
+    rrset = (rrset_type*) arena_alloc(zone->db->arena, sizeof(rrset_type));
     rrset->next = NULL;
     rrset->rrs = NULL;
     rrset->domain = NULL;
+    rrset->owner = NULL;
     rrset->zone = zone;
     rrset->rrtype = type;
     rrset->rr_count = 0;
     collection_create_array(&rrset->rrsigs, sizeof(rrsig_type), rrset->zone->rrstore);
+    rrset->sig_expiration = 0;
+    rrset->resign_idx = 0;
+    rrset->wire = NULL;
+    rrset->wire_len = 0;
     rrset->needs_signing = 0;
     return rrset;
 }
 
+
+/**
+ * Set the owner name of the RRset.
+ *
+ */
+void
+rrset_set_owner(rrset_type* rrset, ldns_rdf* owner)
+{
+    ods_log_assert(rrset);
+    rrset->owner = owner;
+}
+
+/**
+ * Backup RRset in wire format.
+ *
+ */
+void
+rrset_backup_binary(backup_writer_type* writer, rrset_type* rrset, int sigs)
+{
+    rrsig_type* rrsig;
+    ldns_rr* rr = NULL;
+    uint16_t i;
+    if (!rrset || !writer) {
+        return;
+    }
+    if (sigs) {
+        while((rrsig = collection_iterator(rrset->rrsigs))) {
+            rr = rrset_rrsig2ldns(rrset, rrsig);
+            backup_writer_rrsig(writer, rr, rrsig->key_locator,
+                rrsig->key_flags);
+            ldns_rr_free(rr);
+        }
+        return;
+    }
+    for (i=0; i < rrset->rr_count; i++) {
+        if (rrset->rrs[i].exists) {
+            rr = rrset_rr2ldns(rrset, &rrset->rrs[i]);
+            backup_writer_rr(writer, rr);
+            ldns_rr_free(rr);
+            if (rrset->rrtype == LDNS_RR_TYPE_CNAME ||
+                rrset->rrtype == LDNS_RR_TYPE_DNAME) {
+                /* singleton types */
+                break;
+            }
+        }
+    }
+}
+
 collection_class
 rrset_store_initialize()
 {
@@ -235,25 +397,45 @@ rrset_store_initialize()
 rr_type*
 rrset_lookup_rr(rrset_type* rrset, ldns_rr* rr)
 {
+    const ldns_rr_descriptor* descriptor = NULL;
     ldns_status lstatus = LDNS_STATUS_OK;
+    ldns_rr* cur = NULL;
+    uint8_t* rdata = NULL;
+    uint16_t rdlen = 0;
+    rr_type* found = NULL;
     int cmp = 0;
     size_t i = 0;
 
     if (!rrset || !rr || rrset->rr_count <= 0) {
        return NULL;
     }
-    for (i=0; i < rrset->rr_count; i++) {
-        lstatus = util_dnssec_rrs_compare(rrset->rrs[i].rr, rr, &cmp);
+    descriptor = ldns_rr_descript(rrset->rrtype);
+    if (!descriptor || !descriptor->_dname_count) {
+        /* no names in the RDATA, the RDATA is in canonical form already */
+        rdata = rrset_rdata_pack(rr, NULL, &rdlen);
+        for (i=0; i < rrset->rr_count && !found; i++) {
+            if (rrset->rrs[i].rdlen == rdlen &&
+                memcmp(rrset->rrs[i].rdata, rdata, rdlen) == 0) {
+                found = &rrset->rrs[i];
+            }
+        }
+        free(rdata);
+        return found;
+    }
+    for (i=0; i < rrset->rr_count && !found; i++) {
+        cur = rrset_rr2ldns(rrset, &rrset->rrs[i]);
+        lstatus = util_dnssec_rrs_compare(cur, rr, &cmp);
+        ldns_rr_free(cur);
         if (lstatus != LDNS_STATUS_OK) {
             ods_log_error("[%s] unable to lookup RR: compare failed (%s)",
                 rrset_str, ldns_get_errorstr_by_id(lstatus));
             return NULL;
         }
         if (!cmp) { /* equal */
-            return &rrset->rrs[i];
+            found = &rrset->rrs[i];
         }
     }
-    return NULL;
+    return found;
 }
 
 
@@ -278,6 +460,45 @@ rrset_count_rr_is_added(rrset_type* rrset)
 }
 
 
+/**
+ * Drop the cached wire format of the RRset.
+ *
+ */
+void
+rrset_wire_invalidate(rrset_type* rrset)
+{
+    if (!rrset) {
+        return;
+    }
+    free(rrset->wire);
+    rrset->wire = NULL;
+    rrset->wire_len = 0;
+}
+
+
+/**
+ * Mark RRset as changed in the resign index.
+ *
+ */
+static void
+rrset_touch(rrset_type* rrset)
+{
+    zone_type* zone = (zone_type*) rrset->zone;
+    domain_type* domain = (domain_type*) rrset->domain;
+    rrset_wire_invalidate(rrset);
+    if (!zone->db || !zone->db->resign) {
+        return;
+    }
+    if ((rrset->rrtype == LDNS_RR_TYPE_NS ||
+         rrset->rrtype == LDNS_RR_TYPE_DNAME) && domain && !domain->is_apex) {
+        /* delegations and glue below this domain may have changed */
+        resign_reset(zone->db->resign);
+    } else {
+        resign_update(zone->db->resign, rrset);
+    }
+}
+
+
 /**
  * Add RR to RRset.
  *
@@ -285,31 +506,35 @@ rrset_count_rr_is_added(rrset_type* rrset)
 rr_type*
 rrset_add_rr(rrset_type* rrset, ldns_rr* rr)
 {
+    arena_type* arena = NULL;
     rr_type* rrs_old = NULL;
+    rr_type* record = NULL;
 
     ods_log_assert(rrset);
+    ods_log_assert(rrset->owner);
     ods_log_assert(rr);
     ods_log_assert(rrset->rrtype == ldns_rr_get_type(rr));
 
+    arena = rrset_arena(rrset);
     rrs_old = rrset->rrs;
-    CHECKALLOC(rrset->rrs = (rr_type*) malloc((rrset->rr_count + 1) * sizeof(rr_type)));
-    if (!rrset->rrs) {
-        ods_fatal_exit("[%s] fatal unable to add RR: allocator_alloc() failed",
-            rrset_str);
-    }
+    rrset->rrs = (rr_type*) arena_alloc(arena,
+        (rrset->rr_count + 1) * sizeof(rr_type));
     if (rrs_old) {
         memcpy(rrset->rrs, rrs_old, (rrset->rr_count) * sizeof(rr_type));
     }
-    free(rrs_old);
+    arena_free(arena, rrs_old, rrset->rr_count * sizeof(rr_type));
     rrset->rr_count++;
-    rrset->rrs[rrset->rr_count - 1].owner = rrset->domain;
-    rrset->rrs[rrset->rr_count - 1].rr = rr;
-    rrset->rrs[rrset->rr_count - 1].exists = 0;
-    rrset->rrs[rrset->rr_count - 1].is_added = 1;
-    rrset->rrs[rrset->rr_count - 1].is_removed = 0;
+    record = &rrset->rrs[rrset->rr_count - 1];
+    record->rdata = rrset_rdata_pack(rr, arena, &record->rdlen);
+    record->ttl = ldns_rr_ttl(rr);
+    record->exists = 0;
+    record->is_added = 1;
+    record->is_removed = 0;
     rrset->needs_signing = 1;
+    rrset_touch(rrset);
     log_rr(rr, "+RR", LOG_DEEEBUG);
-    return &rrset->rrs[rrset->rr_count -1];
+    ldns_rr_free(rr);
+    return record;
 }
 
 
@@ -320,29 +545,30 @@ rrset_add_rr(rrset_type* rrset, ldns_rr* rr)
 void
 rrset_del_rr(rrset_type* rrset, uint16_t rrnum)
 {
+    arena_type* arena = NULL;
     rr_type* rrs_orig = NULL;
 
     ods_log_assert(rrset);
     ods_log_assert(rrnum < rrset->rr_count);
 
-    log_rr(rrset->rrs[rrnum].rr, "-RR", LOG_DEEEBUG);
-    rrset->rrs[rrnum].owner = NULL; /* who owns owner? */
-    ldns_rr_free(rrset->rrs[rrnum].rr);
+    log_rrset(rrset->owner, rrset->rrtype, "-RR", LOG_DEEEBUG);
+    arena = rrset_arena(rrset);
+    arena_free(arena, rrset->rrs[rrnum].rdata, rrset->rrs[rrnum].rdlen);
     while (rrnum < rrset->rr_count-1) {
         rrset->rrs[rrnum] = rrset->rrs[rrnum+1];
         rrnum++;
     }
-    memset(&rrset->rrs[rrset->rr_count-1], 0, sizeof(rr_type));
     rrs_orig = rrset->rrs;
-    CHECKALLOC(rrset->rrs = (rr_type*) malloc((rrset->rr_count - 1) * sizeof(rr_type)));
-    if(!rrset->rrs) {
-        ods_fatal_exit("[%s] fatal unable to delete RR: allocator_alloc() failed",
-            rrset_str);
+    rrset->rrs = NULL;
+    if (rrset->rr_count > 1) {
+        rrset->rrs = (rr_type*) arena_alloc(arena,
+            (rrset->rr_count - 1) * sizeof(rr_type));
+        memcpy(rrset->rrs, rrs_orig, (rrset->rr_count -1) * sizeof(rr_type));
     }
-    memcpy(rrset->rrs, rrs_orig, (rrset->rr_count -1) * sizeof(rr_type));
-    free(rrs_orig);
+    arena_free(arena, rrs_orig, rrset->rr_count * sizeof(rr_type));
     rrset->rr_count--;
     rrset->needs_signing = 1;
+    rrset_touch(rrset);
 }
 
 /**
@@ -353,6 +579,7 @@ void
 rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming)
 {
     zone_type* zone = NULL;
+    ldns_rr* rr = NULL;
     uint16_t i = 0;
     uint8_t del_sigs = 0;
     if (!rrset) {
@@ -366,9 +593,11 @@ rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming)
             if (!rrset->rrs[i].exists) {
                 /* ixfr +RR */
                 if (zone->db->is_initialized) {
+                    rr = rrset_rr2ldns(rrset, &rrset->rrs[i]);
                     pthread_mutex_lock(&zone->ixfr->ixfr_lock);
-                    ixfr_add_rr(zone->ixfr, rrset->rrs[i].rr);
+                    ixfr_add_rr(zone->ixfr, rr);
                     pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+                    ldns_rr_free(rr);
                 }
                 del_sigs = 1;
             }
@@ -380,9 +609,11 @@ rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming)
         } else if (!is_ixfr || rrset->rrs[i].is_removed) {
             if (rrset->rrs[i].exists && zone->db->is_initialized) {
                 /* ixfr -RR */
+                rr = rrset_rr2ldns(rrset, &rrset->rrs[i]);
                 pthread_mutex_lock(&zone->ixfr->ixfr_lock);
-                ixfr_del_rr(zone->ixfr, rrset->rrs[i].rr);
+                ixfr_del_rr(zone->ixfr, rr);
                 pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+                ldns_rr_free(rr);
             }
             rrset->rrs[i].exists = 0;
             rrset_del_rr(rrset, i);
@@ -391,6 +622,7 @@ rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming)
         }
     }
     if (del_sigs) {
+        rrset_wire_invalidate(rrset);
         rrset_drop_rrsigs(zone, rrset);
     }
 }
@@ -403,17 +635,58 @@ void
 rrset_drop_rrsigs(zone_type* zone, rrset_type* rrset)
 {
     rrsig_type* rrsig;
+    ldns_rr* rr = NULL;
     while((rrsig = collection_iterator(rrset->rrsigs))) {
         /* ixfr -RRSIG */
         if (zone->db->is_initialized) {
+            rr = rrset_rrsig2ldns(rrset, rrsig);
             pthread_mutex_lock(&zone->ixfr->ixfr_lock);
-            ixfr_del_rr(zone->ixfr, rrsig->rr);
+            ixfr_del_rr(zone->ixfr, rr);
             pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+            ldns_rr_free(rr);
         }
         collection_del_cursor(rrset->rrsigs);
     }
+    rrset->sig_expiration = 0;
 }
 
+/**
+ * Get the key of the signature from the current key list.
+ * The position in the key list is looked up by locator only when the
+ * key list changed since the last time.  A key with the same locator
+ * but a different algorithm or key tag (e.g. after a flags change) did
+ * not make this signature.
+ *
+ */
+static key_type*
+rrsig_key(zone_type* zone, rrsig_type* rrsig)
+{
+    keylist_type* kl = NULL;
+    key_type* key = NULL;
+    if (!zone || !zone->signconf || !zone->signconf->keys) {
+        return NULL;
+    }
+    kl = zone->signconf->keys;
+    if (rrsig->key_generation != kl->generation) {
+        key = keylist_lookup_by_locator(kl, rrsig->key_locator);
+        if (key && key->algorithm != rrsig->algorithm) {
+            key = NULL;
+        }
+        rrsig->key_index = key ? (int) (key - kl->keys) : -1;
+        rrsig->key_generation = kl->generation;
+    }
+    if (rrsig->key_index < 0) {
+        return NULL;
+    }
+    key = &kl->keys[rrsig->key_index];
+    /* the key tag is only known once the key has been read from the HSM */
+    if (key->params && key->params->keytag != rrsig->keytag) {
+        return NULL;
+    }
+    return key;
+}
+
+
 /**
  * Add RRSIG to RRset.
  *
@@ -426,11 +699,25 @@ rrset_add_rrsig(rrset_type* rrset, ldns_rr* rr,
     ods_log_assert(rrset);
     ods_log_assert(rr);
     ods_log_assert(ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG);
-    rrsig.owner = rrset->domain;
-    rrsig.rr = rr;
+    /* signatures are added by the signer threads at the same time, so
+     * their RDATA does not come from the arena */
+    rrsig.rdata = rrset_rdata_pack(rr, NULL, &rrsig.rdlen);
+    rrsig.ttl = ldns_rr_ttl(rr);
     rrsig.key_locator = locator;
     rrsig.key_flags = flags;
+    /* decode once, recycling only looks at these */
+    rrsig.inception = ldns_rdf2native_int32(ldns_rr_rrsig_inception(rr));
+    rrsig.expiration = ldns_rdf2native_int32(ldns_rr_rrsig_expiration(rr));
+    rrsig.keytag = ldns_rdf2native_int16(ldns_rr_rrsig_keytag(rr));
+    rrsig.algorithm = ldns_rdf2native_int8(ldns_rr_rrsig_algorithm(rr));
+    rrsig.key_index = -1;
+    rrsig.key_generation = 0;
+    rrsig_key((zone_type*) rrset->zone, &rrsig);
+    if (!rrset->sig_expiration || rrsig.expiration < rrset->sig_expiration) {
+        rrset->sig_expiration = rrsig.expiration;
+    }
     collection_add(rrset->rrsigs, &rrsig);
+    ldns_rr_free(rr);
 }
 
 /**
@@ -439,16 +726,16 @@ rrset_add_rrsig(rrset_type* rrset, ldns_rr* rr,
  */
 static uint32_t
 rrset_recycle(rrset_type* rrset, time_t signtime, ldns_rr_type dstatus,
-    ldns_rr_type delegpt)
+    ldns_rr_type delegpt, uint8_t* signedby, uint16_t* sigalgos,
+    ixfr_delta_type* delta)
 {
     uint32_t refresh = 0;
-    uint32_t expiration = 0;
-    uint32_t inception = 0;
     uint32_t reusedsigs = 0;
     unsigned drop_sig = 0;
     key_type* key = NULL;
     zone_type* zone = NULL;
     rrsig_type* rrsig;
+    ldns_rr* rr = NULL;
 
     if (!rrset) {
         return 0;
@@ -459,6 +746,7 @@ rrset_recycle(rrset_type* rrset, time_t signtime, ldns_rr_type dstatus,
         refresh = (uint32_t) (signtime +
             duration2time(zone->signconf->sig_refresh_interval));
     }
+    rrset->sig_expiration = 0;
     /* Check every signature if it matches the recycling logic. */
     while((rrsig = collection_iterator(rrset->rrsigs))) {
         drop_sig = 0;
@@ -477,22 +765,17 @@ rrset_recycle(rrset_type* rrset, time_t signtime, ldns_rr_type dstatus,
             goto recycle_drop_sig;
         }
         /* 3. Expiration - Refresh has passed */
-        expiration = ldns_rdf2native_int32(
-            ldns_rr_rrsig_expiration(rrsig->rr));
-        if (expiration < refresh) {
+        if (rrsig->expiration < refresh) {
             drop_sig = 1;
             goto recycle_drop_sig;
         }
         /* 4. Inception has not yet passed */
-        inception = ldns_rdf2native_int32(
-            ldns_rr_rrsig_inception(rrsig->rr));
-        if (inception > (uint32_t) signtime) {
+        if (rrsig->inception > (uint32_t) signtime) {
             drop_sig = 1;
             goto recycle_drop_sig;
         }
-        /* 5. Corresponding key is dead (key is locator+flags) */
-        key = keylist_lookup_by_locator(zone->signconf->keys,
-            rrsig->key_locator);
+        /* 5. Corresponding key is dead (key is locator+flags+keytag) */
+        key = rrsig_key(zone, rrsig);
         if (!key || key->flags != rrsig->key_flags) {
             drop_sig = 1;
         }
@@ -501,15 +784,26 @@ recycle_drop_sig:
         if (drop_sig) {
             /* A rule mismatched, refresh signature */
             /* ixfr -RRSIG */
-            if (zone->db->is_initialized) {
+            if (zone->db->is_initialized && delta) {
+                /* the delta takes over the dropped signature */
+                ixfr_delta_del_rr(delta, rrset_rrsig2ldns(rrset, rrsig));
+            } else if (zone->db->is_initialized) {
+                rr = rrset_rrsig2ldns(rrset, rrsig);
                 pthread_mutex_lock(&zone->ixfr->ixfr_lock);
-                ixfr_del_rr(zone->ixfr, rrsig->rr);
+                ixfr_del_rr(zone->ixfr, rr);
                 pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+                ldns_rr_free(rr);
             }
             collection_del_cursor(rrset->rrsigs);
         } else {
             /* All rules ok, recycle signature */
             reusedsigs += 1;
+            if (!rrset->sig_expiration ||
+                rrsig->expiration < rrset->sig_expiration) {
+                rrset->sig_expiration = rrsig->expiration;
+            }
+            signedby[rrsig->key_index] = 1;
+            sigalgos[rrsig->algorithm]++;
         }
     }
     return reusedsigs;
@@ -527,45 +821,7 @@ rrset_sigalgo(rrset_type* rrset, uint8_t algorithm)
     int match = 0;
     if (rrset) {
         while((rrsig = collection_iterator(rrset->rrsigs))) {
-            if (algorithm == ldns_rdf2native_int8(ldns_rr_rrsig_algorithm(rrsig->rr))) {
-                match = 1;
-            }
-        }
-    }
-    return match;
-}
-
-
-/**
- * Count the signatures with this algorithm for this RRset?
- *
- */
-static int
-rrset_sigalgo_count(rrset_type* rrset, uint8_t algorithm)
-{
-    rrsig_type* rrsig;
-    int match = 0;
-    if (!rrset) return 0;
-    while((rrsig = collection_iterator(rrset->rrsigs))) {
-        if (algorithm == ldns_rdf2native_int8(ldns_rr_rrsig_algorithm(rrsig->rr))) {
-            match++;
-        }
-    }
-    return match;
-}
-
-/**
- * Is the RRset signed with this locator?
- *
- */
-static int
-rrset_siglocator(rrset_type* rrset, const char* locator)
-{
-    rrsig_type* rrsig;
-    int match = 0;
-    if (rrset) {
-        while ((rrsig = collection_iterator(rrset->rrsigs))) {
-            if (!ods_strcmp(locator, rrsig->key_locator)) {
+            if (algorithm == rrsig->algorithm) {
                 match = 1;
             }
         }
@@ -575,24 +831,28 @@ rrset_siglocator(rrset_type* rrset, const char* locator)
 
 
 /**
- * Transmogrify the RRset to a RRlist.
+ * Transmogrify the RRset to a RRlist, of new RRs.
  *
  */
 static ldns_rr_list*
 rrset2rrlist(rrset_type* rrset)
 {
     ldns_rr_list* rr_list = NULL;
+    ldns_rr* rr = NULL;
     int ret = 0;
     size_t i = 0;
     rr_list = ldns_rr_list_new();
     for (i=0; i < rrset->rr_count; i++) {
         if (!rrset->rrs[i].exists) {
-            log_rr(rrset->rrs[i].rr, "RR does not exist", LOG_WARNING);
+            log_rrset(rrset->owner, rrset->rrtype, "RR does not exist",
+                LOG_WARNING);
             continue;
         }
-        ret = (int) ldns_rr_list_push_rr(rr_list, rrset->rrs[i].rr);
+        rr = rrset_rr2ldns(rrset, &rrset->rrs[i]);
+        ret = (int) ldns_rr_list_push_rr(rr_list, rr);
         if (!ret) {
-            ldns_rr_list_free(rr_list);
+            ldns_rr_free(rr);
+            ldns_rr_list_deep_free(rr_list);
             return NULL;
         }
         if (rrset->rrtype == LDNS_RR_TYPE_CNAME ||
@@ -606,6 +866,48 @@ rrset2rrlist(rrset_type* rrset)
 }
 
 
+/**
+ * Get the canonical wire format of the RRset, as it is signed.
+ * The RRs are serialized once in canonical order and kept until the
+ * RRset changes.
+ *
+ */
+static const uint8_t*
+rrset_wire(rrset_type* rrset)
+{
+    ldns_rr_list* rr_list = NULL;
+    ldns_buffer* buffer = NULL;
+    size_t i;
+
+    if (rrset->wire) {
+        return rrset->wire;
+    }
+    rr_list = rrset2rrlist(rrset);
+    if (!rr_list || ldns_rr_list_rr_count(rr_list) <= 0) {
+        ldns_rr_list_deep_free(rr_list);
+        return NULL;
+    }
+    CHECKALLOC(buffer = ldns_buffer_new(LDNS_MIN_BUFLEN));
+    for (i=0; i < ldns_rr_list_rr_count(rr_list); i++) {
+        if (ldns_rr2buffer_wire_canonical(buffer, ldns_rr_list_rr(rr_list, i),
+            LDNS_SECTION_ANSWER) != LDNS_STATUS_OK) {
+            log_rr(ldns_rr_list_rr(rr_list, i), "unable to serialize RR",
+                LOG_ERR);
+            ldns_buffer_free(buffer);
+            ldns_rr_list_deep_free(rr_list);
+            return NULL;
+        }
+    }
+    rrset->wire_len = ldns_buffer_position(buffer);
+    rrset->wire = (uint8_t*) ldns_buffer_export(buffer);
+    ldns_buffer_free(buffer);
+    /* drop the slack of the buffer, the image is kept around */
+    CHECKALLOC(rrset->wire = (uint8_t*) realloc(rrset->wire, rrset->wire_len));
+    ldns_rr_list_deep_free(rr_list);
+    return rrset->wire;
+}
+
+
 /**
  * Calculate the signature validation period.
  *
@@ -647,20 +949,30 @@ rrset_sigvalid_period(signconf_type* sc, ldns_rr_type rrtype, time_t signtime,
 
 
 /**
- * Sign RRset.
+ * RRset that is being signed as part of a batch.
  *
  */
-ods_status
-rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
+struct rrset_signing {
+    rrset_type* rrset;
+    ixfr_delta_type* delta; /* IXFR changes, NULL to add to the journal */
+    ldns_rr* rr; /* RR of the RRset the signatures are made for */
+    uint32_t reusedsigs;
+    unsigned is_signed : 1;
+    size_t first; /* first of the signatures to make for this RRset */
+    size_t count; /* number of signatures to make for this RRset */
+};
+
+
+/**
+ * Recycle the signatures of an RRset and queue the signatures it needs.
+ *
+ */
+static void
+rrset_sign_prepare(struct rrset_signing* signing, time_t signtime,
+    lhsm_sign_type** sigs, size_t* nsigs, size_t* capacity)
 {
-    ods_status status;
+    rrset_type* rrset = signing->rrset;
     zone_type* zone = NULL;
-    uint32_t newsigs = 0;
-    uint32_t reusedsigs = 0;
-    ldns_rr* rrsig = NULL;
-    ldns_rr_list* rr_list = NULL;
-    ldns_rr_list* rr_list_clone = NULL;
-    const char* locator = NULL;
     time_t inception = 0;
     time_t expiration = 0;
     size_t i = 0, j;
@@ -669,12 +981,21 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
     ldns_rr_type delegpt = LDNS_RR_TYPE_FIRST;
     uint8_t algorithm = 0;
     int sigcount, keycount;
+    uint8_t signedby_local[16];
+    uint8_t* signedby = signedby_local;
+    uint16_t sigalgos[256];
 
-    ods_log_assert(ctx);
-    ods_log_assert(rrset);
     zone = (zone_type*) rrset->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->signconf);
+    signing->first = *nsigs;
+    /* Which keys sign the RRset, and with how many signatures per
+     * algorithm, is filled in while recycling */
+    if (zone->signconf->keys->count > sizeof(signedby_local)) {
+        CHECKALLOC(signedby = (uint8_t*) malloc(zone->signconf->keys->count));
+    }
+    memset(signedby, 0, zone->signconf->keys->count);
+    memset(sigalgos, 0, sizeof(sigalgos));
     /* Recycle signatures */
     if (rrset->rrtype == LDNS_RR_TYPE_NSEC ||
         rrset->rrtype == LDNS_RR_TYPE_NSEC3) {
@@ -685,37 +1006,39 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
         dstatus = domain_is_occluded(domain);
         delegpt = domain_is_delegpt(domain);
     }
-    reusedsigs = rrset_recycle(rrset, signtime, dstatus, delegpt);
+    signing->reusedsigs = rrset_recycle(rrset, signtime, dstatus, delegpt,
+        signedby, sigalgos, signing->delta);
     rrset->needs_signing = 0;
 
     ods_log_assert(rrset->rrs);
-    ods_log_assert(rrset->rrs[0].rr);
 
     /* Skip delegation, glue and occluded RRsets */
     if (dstatus != LDNS_RR_TYPE_SOA) {
-        log_rrset(ldns_rr_owner(rrset->rrs[0].rr), rrset->rrtype,
+        log_rrset(rrset->owner, rrset->rrtype,
             "skip signing occluded RRset", LOG_DEEEBUG);
-        return ODS_STATUS_OK;
+        goto prepare_done;
     }
     if (delegpt != LDNS_RR_TYPE_SOA && rrset->rrtype != LDNS_RR_TYPE_DS) {
-        log_rrset(ldns_rr_owner(rrset->rrs[0].rr), rrset->rrtype,
+        log_rrset(rrset->owner, rrset->rrtype,
             "skip signing delegation RRset", LOG_DEEEBUG);
-        return ODS_STATUS_OK;
+        goto prepare_done;
     }
 
-    log_rrset(ldns_rr_owner(rrset->rrs[0].rr), rrset->rrtype,
-        "sign RRset", LOG_DEEEBUG);
+    log_rrset(rrset->owner, rrset->rrtype, "sign RRset", LOG_DEEEBUG);
     ods_log_assert(dstatus == LDNS_RR_TYPE_SOA ||
         (delegpt == LDNS_RR_TYPE_SOA || rrset->rrtype == LDNS_RR_TYPE_DS));
-    /* Transmogrify rrset */
-    rr_list = rrset2rrlist(rrset);
-    if (ldns_rr_list_rr_count(rr_list) <= 0) {
+    /* Canonical wire format, the RRs themselves are left untouched for case preservation */
+    if (!rrset_wire(rrset)) {
         /* Empty RRset, no signatures needed */
-        ldns_rr_list_free(rr_list);
-        return ODS_STATUS_OK;
+        goto prepare_done;
+    }
+    signing->is_signed = 1;
+    /* The signatures take owner, class, type and TTL from this RR */
+    for (i=0; i < rrset->rr_count && !signing->rr; i++) {
+        if (rrset->rrs[i].exists) {
+            signing->rr = rrset_rr2ldns(rrset, &rrset->rrs[i]);
+        }
     }
-    /* Use rr_list_clone for signing, keep the original rr_list untouched for case preservation */
-    rr_list_clone = ldns_rr_list_clone(rr_list);
 
     /* Calculate signature validity */
     rrset_sigvalid_period(zone->signconf, rrset->rrtype, signtime,
@@ -733,7 +1056,7 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
             continue;
         }
         /* Additional rules for signatures */
-        if (rrset_siglocator(rrset, zone->signconf->keys->keys[i].locator)) {
+        if (signedby[i]) {
             continue;
         }
 
@@ -751,7 +1074,7 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
                 }
             }
         }
-        sigcount = rrset_sigalgo_count(rrset, algorithm);
+        sigcount = sigalgos[algorithm];
         if (rrset->rrtype != LDNS_RR_TYPE_DNSKEY && sigcount >= keycount)
             continue;
 
@@ -763,26 +1086,79 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
         /* Sign the RRset with this key */
         ods_log_deeebug("[%s] signing RRset[%i] with key %s", rrset_str,
             rrset->rrtype, zone->signconf->keys->keys[i].locator);
-        rrsig = lhsm_sign(ctx, rr_list_clone, &zone->signconf->keys->keys[i],
-            zone->apex, inception, expiration);
-        if (!rrsig) {
-            ods_log_crit("[%s] unable to sign RRset[%i]: lhsm_sign() failed",
-                rrset_str, rrset->rrtype);
-            ldns_rr_list_free(rr_list);
-            ldns_rr_list_free(rr_list_clone);
-            return ODS_STATUS_HSM_ERR;
+        if (*nsigs == *capacity) {
+            *capacity = *capacity ? *capacity * 2 : 8;
+            CHECKALLOC(*sigs = (lhsm_sign_type*) realloc(*sigs,
+                *capacity * sizeof(lhsm_sign_type)));
         }
+        (*sigs)[*nsigs].rr = signing->rr;
+        (*sigs)[*nsigs].wire = rrset->wire;
+        (*sigs)[*nsigs].wire_len = rrset->wire_len;
+        (*sigs)[*nsigs].key_id = &zone->signconf->keys->keys[i];
+        (*sigs)[*nsigs].inception = inception;
+        (*sigs)[*nsigs].expiration = expiration;
+        (*sigs)[*nsigs].rrsig = NULL;
+        (*nsigs)++;
+        /* Signatures queued for this RRset count as made */
+        sigalgos[zone->signconf->keys->keys[i].algorithm]++;
+    }
+    signing->count = *nsigs - signing->first;
+prepare_done:
+    if (signedby != signedby_local) {
+        free(signedby);
+    }
+}
+
+
+/**
+ * Add a new signature to the IXFR changes.
+ *
+ */
+static void
+rrset_ixfr_add_rrsig(struct rrset_signing* signing, ldns_rr* rrsig)
+{
+    zone_type* zone = (zone_type*) signing->rrset->zone;
+    if (!zone->db->is_initialized) {
+        return;
+    }
+    if (signing->delta) {
+        ixfr_delta_add_rr(signing->delta, ldns_rr_clone(rrsig));
+        return;
+    }
+    pthread_mutex_lock(&zone->ixfr->ixfr_lock);
+    ixfr_add_rr(zone->ixfr, rrsig);
+    pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+}
+
+
+/**
+ * Add the signatures made for an RRset.
+ *
+ */
+static ods_status
+rrset_sign_complete(struct rrset_signing* signing, lhsm_sign_type* sigs)
+{
+    ods_status status;
+    rrset_type* rrset = signing->rrset;
+    zone_type* zone = (zone_type*) rrset->zone;
+    uint32_t newsigs = 0;
+    ldns_rr* rrsig = NULL;
+    const char* locator = NULL;
+    size_t i;
+
+    if (!signing->is_signed) {
+        /* Skipped or empty RRset, no signatures needed */
+        return ODS_STATUS_OK;
+    }
+    for (i = signing->first; i < signing->first + signing->count; i++) {
+        rrsig = sigs[i].rrsig;
+        sigs[i].rrsig = NULL;
+        /* ixfr +RRSIG */
+        rrset_ixfr_add_rrsig(signing, rrsig);
         /* Add signature */
-        locator = strdup(zone->signconf->keys->keys[i].locator);
-        rrset_add_rrsig(rrset, rrsig, locator,
-            zone->signconf->keys->keys[i].flags);
+        locator = strdup(sigs[i].key_id->locator);
+        rrset_add_rrsig(rrset, rrsig, locator, sigs[i].key_id->flags);
         newsigs++;
-        /* ixfr +RRSIG */
-        if (zone->db->is_initialized) {
-            pthread_mutex_lock(&zone->ixfr->ixfr_lock);
-            ixfr_add_rr(zone->ixfr, rrsig);
-            pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
-        }
     }
     if(rrset->rrtype == LDNS_RR_TYPE_DNSKEY && zone->signconf->dnskey_signature) {
         for(i=0; zone->signconf->dnskey_signature[i]; i++) {
@@ -790,33 +1166,86 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
             if ((status = rrset_getliteralrr(&rrsig, zone->signconf->dnskey_signature[i], duration2time(zone->signconf->dnskey_ttl), zone->apex)) != ODS_STATUS_OK) {
                     ods_log_error("[%s] unable to publish dnskeys for zone %s: "
                             "error decoding literal dnskey", rrset_str, zone->name);
-                    ldns_rr_list_deep_free(rr_list_clone);
                     return status;
             }
+            /* ixfr +RRSIG */
+            rrset_ixfr_add_rrsig(signing, rrsig);
             /* Add signature */
             rrset_add_rrsig(rrset, rrsig, NULL, 0);
             newsigs++;
-            /* ixfr +RRSIG */
-            if (zone->db->is_initialized) {
-                pthread_mutex_lock(&zone->ixfr->ixfr_lock);
-                ixfr_add_rr(zone->ixfr, rrsig);
-                pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
-            }
         }
     }
     /* RRset signing completed */
-    ldns_rr_list_free(rr_list);
-    ldns_rr_list_deep_free(rr_list_clone);
     pthread_mutex_lock(&zone->stats->stats_lock);
     if (rrset->rrtype == LDNS_RR_TYPE_SOA) {
         zone->stats->sig_soa_count += newsigs;
     }
     zone->stats->sig_count += newsigs;
-    zone->stats->sig_reuse += reusedsigs;
+    zone->stats->sig_reuse += signing->reusedsigs;
     pthread_mutex_unlock(&zone->stats->stats_lock);
     return ODS_STATUS_OK;
 }
 
+
+/**
+ * Sign a batch of RRsets.
+ *
+ */
+ods_status
+rrset_sign_batch(hsm_ctx_t* ctx, rrset_type** rrsets, size_t count,
+    time_t signtime, ixfr_delta_type* delta)
+{
+    ods_status status;
+    struct rrset_signing* signings = NULL;
+    lhsm_sign_type* sigs = NULL;
+    size_t nsigs = 0;
+    size_t capacity = 0;
+    size_t i;
+
+    ods_log_assert(ctx);
+    ods_log_assert(rrsets);
+    if (!count) {
+        return ODS_STATUS_OK;
+    }
+    CHECKALLOC(signings = (struct rrset_signing*) calloc(count, sizeof(struct rrset_signing)));
+    for (i=0; i < count; i++) {
+        ods_log_assert(rrsets[i]);
+        signings[i].rrset = rrsets[i];
+        signings[i].delta = delta;
+        rrset_sign_prepare(&signings[i], signtime, &sigs, &nsigs, &capacity);
+    }
+    /* Have the HSM make all signatures of the batch back-to-back */
+    status = lhsm_sign_batch(ctx, sigs, nsigs);
+    if (status != ODS_STATUS_OK) {
+        ods_log_crit("[%s] unable to sign RRset[%i]: lhsm_sign_batch() failed",
+            rrset_str, rrsets[0]->rrtype);
+    }
+    for (i=0; i < count; i++) {
+        if (status == ODS_STATUS_OK) {
+            status = rrset_sign_complete(&signings[i], sigs);
+        }
+        ldns_rr_free(signings[i].rr);
+    }
+    for (i=0; i < nsigs; i++) {
+        /* not added after an error */
+        ldns_rr_free(sigs[i].rrsig);
+    }
+    free(sigs);
+    free(signings);
+    return status;
+}
+
+
+/**
+ * Sign RRset.
+ *
+ */
+ods_status
+rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
+{
+    return rrset_sign_batch(ctx, &rrset, 1, signtime, NULL);
+}
+
 ods_status
 rrset_getliteralrr(ldns_rr** dnskey, const char *resourcerecord, uint32_t ttl, ldns_rdf* apex)
 {
@@ -842,6 +1271,7 @@ rrset_print(FILE* fd, rrset_type* rrset, int skip_rrsigs,
     ods_status* status)
 {
     rrsig_type* rrsig;
+    ldns_rr* rr = NULL;
     uint16_t i = 0;
     ods_status result = ODS_STATUS_OK;
 
@@ -854,7 +1284,9 @@ rrset_print(FILE* fd, rrset_type* rrset, int skip_rrsigs,
     } else {
         for (i=0; i < rrset->rr_count; i++) {
             if (rrset->rrs[i].exists) {
-                result = util_rr_print(fd, rrset->rrs[i].rr);
+                rr = rrset_rr2ldns(rrset, &rrset->rrs[i]);
+                result = util_rr_print(fd, rr);
+                ldns_rr_free(rr);
                 if (rrset->rrtype == LDNS_RR_TYPE_CNAME ||
                     rrset->rrtype == LDNS_RR_TYPE_DNAME) {
                     /* singleton types */
@@ -862,7 +1294,7 @@ rrset_print(FILE* fd, rrset_type* rrset, int skip_rrsigs,
                 }
                 if (result != ODS_STATUS_OK) {
                     zone_type* zone = (zone_type*) rrset->zone;
-                    log_rrset(ldns_rr_owner(rrset->rrs[i].rr), rrset->rrtype,
+                    log_rrset(rrset->owner, rrset->rrtype,
                         "error printing RRset", LOG_CRIT);
                     zone->adoutbound->error = 1;
                     break;
@@ -873,10 +1305,12 @@ rrset_print(FILE* fd, rrset_type* rrset, int skip_rrsigs,
             result = ODS_STATUS_OK;
             while((rrsig = collection_iterator(rrset->rrsigs))) {
                 if (result == ODS_STATUS_OK) {
-                    result = util_rr_print(fd, rrsig->rr);
+                    rr = rrset_rrsig2ldns(rrset, rrsig);
+                    result = util_rr_print(fd, rr);
+                    ldns_rr_free(rr);
                     if (result != ODS_STATUS_OK) {
                         zone_type* zone = rrset->zone;
-                        log_rrset(ldns_rr_owner(rrset->rrs[i].rr), rrset->rrtype,
+                        log_rrset(rrset->owner, rrset->rrtype,
                             "error printing RRset", LOG_CRIT);
                         zone->adoutbound->error = 1;
                     }
@@ -897,20 +1331,28 @@ rrset_print(FILE* fd, rrset_type* rrset, int skip_rrsigs,
 void
 rrset_cleanup(rrset_type* rrset)
 {
+    arena_type* arena = NULL;
     uint16_t i = 0;
     if (!rrset) {
        return;
     }
     rrset_cleanup(rrset->next);
+    if (rrset->resign_idx && rrset->zone->db) {
+        resign_remove(rrset->zone->db->resign, rrset);
+    }
     rrset->next = NULL;
     rrset->domain = NULL;
-    for (i=0; i < rrset->rr_count; i++) {
-        ldns_rr_free(rrset->rrs[i].rr);
-        rrset->rrs[i].owner = NULL;
+    /* nothing to give back if the arena goes as a whole */
+    arena = rrset_arena(rrset);
+    if (arena) {
+        for (i=0; i < rrset->rr_count; i++) {
+            arena_free(arena, rrset->rrs[i].rdata, rrset->rrs[i].rdlen);
+        }
+        arena_free(arena, rrset->rrs, rrset->rr_count * sizeof(rr_type));
     }
     collection_destroy(&rrset->rrsigs);
-    free(rrset->rrs);
-    free(rrset);
+    free(rrset->wire);
+    arena_free(arena, rrset, sizeof(rrset_type));
 }
 
 /**
@@ -921,12 +1363,16 @@ void
 rrset_backup2(FILE* fd, rrset_type* rrset)
 {
     rrsig_type* rrsig;
+    ldns_rr* rr = NULL;
     char* str = NULL;
     if (!rrset || !fd) {
         return;
     }
     while((rrsig = collection_iterator(rrset->rrsigs))) {
-        if ((str = ldns_rr2str(rrsig->rr))) {
+        rr = rrset_rrsig2ldns(rrset, rrsig);
+        str = ldns_rr2str(rr);
+        ldns_rr_free(rr);
+        if (str) {
             fprintf(fd, "%.*s; {locator %s flags %u}\n", (int)strlen(str)-1, str,
                     rrsig->key_locator, rrsig->key_flags);
             free(str);
@@ -35,35 +35,65 @@ typedef struct rr_struct rr_type;
 typedef struct rrset_struct rrset_type;
 
 #include "status.h"
+#include "signer/backup.h"
+#include "signer/ixfr.h"
 #include "signer/stats.h"
 #include "libhsm.h"
 #include "domain.h"
 #include "zone.h"
 #include "datastructure.h"
 
+/**
+ * RRSIG of an RRset. The RDATA is kept in wire format, the owner name,
+ * class and type go with the RRset.
+ *
+ */
 struct rrsig_struct {
-    ldns_rr* rr;
-    domain_type* owner;
+    uint8_t* rdata;
+    uint32_t ttl;
+    uint16_t rdlen;
     const char* key_locator;
     uint32_t key_flags;
+    uint32_t inception;
+    uint32_t expiration;
+    uint16_t keytag;
+    uint8_t algorithm;
+    int key_index; /* position in the key list, -1 if there is no such key */
+    unsigned key_generation; /* key list generation key_index belongs to */
 };
 
+/**
+ * RR of an RRset. The RDATA is kept in wire format, allocated from the
+ * arena of the name database. The owner name, class and type go with
+ * the RRset.
+ *
+ */
 struct rr_struct {
-    ldns_rr* rr;
-    domain_type* owner;
+    uint8_t* rdata;
+    uint32_t ttl;
+    uint16_t rdlen;
     unsigned exists : 1;
     unsigned is_added : 1;
     unsigned is_removed : 1;
 };
 
+/**
+ * RRset. Allocated from the arena of the name database.
+ *
+ */
 struct rrset_struct {
     rrset_type* next;
     zone_type* zone;
     domain_type* domain;
+    ldns_rdf* owner; /* name of the domain or denial */
     ldns_rr_type rrtype;
     rr_type* rrs;
     size_t rr_count;
     collection_t rrsigs;
+    uint32_t sig_expiration; /* earliest expiration of the signatures */
+    size_t resign_idx; /* position in the resign index, 0 if not indexed */
+    uint8_t* wire; /* cached canonical wire format of the RRs, NULL if stale */
+    size_t wire_len;
     unsigned needs_signing : 1;
 };
 
@@ -103,6 +133,32 @@ const char* rrset_type2str(ldns_rr_type type);
  */
 rrset_type* rrset_create(zone_type* zone, ldns_rr_type type);
 
+/**
+ * Set the owner name of the RRset, before RRs are added to it.
+ * \param[in] rrset RRset
+ * \param[in] owner name of the domain or denial, not copied
+ *
+ */
+void rrset_set_owner(rrset_type* rrset, ldns_rdf* owner);
+
+/**
+ * Get an RR of the RRset as ldns RR.
+ * \param[in] rrset RRset
+ * \param[in] rr RR of the RRset
+ * \return ldns_rr* new RR, to be freed by the caller
+ *
+ */
+ldns_rr* rrset_rr2ldns(rrset_type* rrset, rr_type* rr);
+
+/**
+ * Get an RRSIG of the RRset as ldns RR.
+ * \param[in] rrset RRset
+ * \param[in] rrsig RRSIG of the RRset
+ * \return ldns_rr* new RR, to be freed by the caller
+ *
+ */
+ldns_rr* rrset_rrsig2ldns(rrset_type* rrset, rrsig_type* rrsig);
+
 /**
  * Lookup RR in RRset.
  * \param[in] rrset RRset
@@ -121,7 +177,8 @@ rr_type* rrset_lookup_rr(rrset_type* rrset, ldns_rr* rr);
 size_t rrset_count_rr_is_added(rrset_type* rrset);
 
 /**
- * Add RR to RRset.
+ * Add RR to RRset. The RRset takes over the RR: its RDATA is copied and
+ * the RR is freed.
  * \param[in] rrset RRset
  * \param[in] rr RR
  * \return rr_type* added RR
@@ -138,7 +195,7 @@ rr_type* rrset_add_rr(rrset_type* rrset, ldns_rr* rr);
 void rrset_del_rr(rrset_type* rrset, uint16_t rrnum);
 
 /**
- * Add RRSIG to RRset.
+ * Add RRSIG to RRset. Like with RRs, the RRset takes over the RRSIG.
  * \param[in] rrset RRset
  * \param[in] rr RRSIG
  * \param[in] locator key locator
@@ -150,12 +207,20 @@ void rrset_add_rrsig(rrset_type* rrset, ldns_rr* rr,
 
 /**
  * Delete all RRSIG from RRset and add then to the zone's outgoing IXFR as change.
+ * \param[in] zone zone
  * \param[in] rrset RRset
- * \param[in] rrnum position of RRSIG
  *
  */
 void rrset_drop_rrsigs(zone_type* zone, rrset_type* rrset);
 
+/**
+ * Drop the cached wire format of the RRset, for when its RRs were
+ * changed in place.
+ * \param[in] rrset RRset
+ *
+ */
+void rrset_wire_invalidate(rrset_type* rrset);
+
 /**
  * Apply differences at RRset.
  * \param[in] rrset RRset
@@ -175,6 +240,20 @@ void rrset_diff(rrset_type* rrset, unsigned is_ixfr, unsigned more_coming);
  */
 ods_status rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime);
 
+/**
+ * Sign a batch of RRsets, with all HSM operations done in one go.
+ * \param[in] ctx HSM context
+ * \param[in] rrsets RRsets
+ * \param[in] count number of RRsets
+ * \param[in] signtime time when the zone is being signed
+ * \param[in] delta collects the IXFR changes without locking, to be
+ *            merged into the journal later; NULL to add them right away
+ * \return ods_status status
+ *
+ */
+ods_status rrset_sign_batch(hsm_ctx_t* ctx, rrset_type** rrsets, size_t count,
+    time_t signtime, ixfr_delta_type* delta);
+
 /**
  * Obtain a resource record (containing a signature of a dnskeyset or
  * a dnskeyset, but that is not a hard requirement), from a raw string
@@ -211,6 +290,16 @@ void rrset_cleanup(rrset_type* rrset);
  */
 void rrset_backup2(FILE* fd, rrset_type* rrset);
 
+/**
+ * Backup RRset in wire format.
+ * \param[in] writer backup writer
+ * \param[in] rrset RRset
+ * \param[in] sigs do RRSIGS if true, otherwise do RRs
+ *
+ */
+void rrset_backup_binary(backup_writer_type* writer, rrset_type* rrset,
+    int sigs);
+
 collection_class rrset_store_initialize(void);
 
 #endif /* SIGNER_RRSET_H */
@@ -76,6 +76,8 @@ tools_signconf(zone_type* zone)
             zone->name);
         zone->signconf = new_signconf;
         signconf_log(zone->signconf, zone->name);
+        /* keys and signature parameters may have changed */
+        resign_reset(zone->db->resign);
         zone->default_ttl = (uint32_t) duration2time(zone->signconf->soa_min);
     } else if (status != ODS_STATUS_UNCHANGED) {
         ods_log_error("[%s] unable to load signconf for zone %s: %s",
@@ -106,8 +108,6 @@ tools_input(zone_type* zone)
         ods_log_error("[%s] unable to read zone %s: failed to "
             "publish dnskeys (%s)", tools_str, zone->name,
             ods_status2str(status));
-        zone_rollback_dnskeys(zone);
-        zone_rollback_nsec3param(zone);
         namedb_rollback(zone->db, 0);
         return status;
     }
@@ -118,8 +118,6 @@ tools_input(zone_type* zone)
         ods_log_error("[%s] unable to read zone %s: failed to "
             "publish nsec3param (%s)", tools_str, zone->name,
             ods_status2str(status));
-        zone_rollback_dnskeys(zone);
-        zone_rollback_nsec3param(zone);
         namedb_rollback(zone->db, 0);
         return status;
     }
@@ -142,8 +140,6 @@ tools_input(zone_type* zone)
             ods_log_error("[%s] unable to read zone %s: adapter failed (%s)",
                 tools_str, zone->name, ods_status2str(status));
         }
-        zone_rollback_dnskeys(zone);
-        zone_rollback_nsec3param(zone);
         namedb_rollback(zone->db, 0);
     }
     end = time(NULL);
@@ -42,7 +42,10 @@
 #include "compat.h"
 #include "daemon/signertasks.h"
 
+#include <errno.h>
 #include <ldns/ldns.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static const char* zone_str = "zone";
 
@@ -189,8 +192,7 @@ zone_publish_dnskeys(zone_type* zone, int skip_hsm_access)
     uint32_t ttl = 0;
     unsigned int i;
     ods_status status = ODS_STATUS_OK;
-    rrset_type* rrset = NULL;
-    rr_type* dnskey = NULL;
+    ldns_rr* dnskey = NULL;
 
     if (!zone || !zone->db || !zone->signconf || !zone->signconf->keys) {
         return ODS_STATUS_ASSERT_ERR;
@@ -243,20 +245,15 @@ zone_publish_dnskeys(zone_type* zone, int skip_hsm_access)
             ods_log_assert(zone->signconf->keys->keys[i].dnskey);
             ldns_rr_set_ttl(zone->signconf->keys->keys[i].dnskey, ttl);
             ldns_rr_set_class(zone->signconf->keys->keys[i].dnskey, zone->klass);
-            status = zone_add_rr(zone, zone->signconf->keys->keys[i].dnskey, 0);
+            /* the zone keeps its own copy of the RR */
+            dnskey = ldns_rr_clone(zone->signconf->keys->keys[i].dnskey);
+            status = zone_add_rr(zone, dnskey, 0);
             if (status == ODS_STATUS_UNCHANGED) {
-                /* rr already exists, adjust pointer */
-                rrset = zone_lookup_rrset(zone, zone->apex, LDNS_RR_TYPE_DNSKEY);
-                ods_log_assert(rrset);
-                dnskey = rrset_lookup_rr(rrset,
-                    zone->signconf->keys->keys[i].dnskey);
-                ods_log_assert(dnskey);
-                if (dnskey->rr != zone->signconf->keys->keys[i].dnskey) {
-                    ldns_rr_free(zone->signconf->keys->keys[i].dnskey);
-                }
-                zone->signconf->keys->keys[i].dnskey = dnskey->rr;
+                /* rr already exists */
+                ldns_rr_free(dnskey);
                 status = ODS_STATUS_OK;
             } else if (status != ODS_STATUS_OK) {
+                ldns_rr_free(dnskey);
                 ods_log_error("[%s] unable to publish dnskeys for zone %s: "
                     "error adding dnskey", zone_str, zone->name);
                 break;
@@ -271,34 +268,6 @@ zone_publish_dnskeys(zone_type* zone, int skip_hsm_access)
 }
 
 
-/**
- * Unlink DNSKEY RRs.
- *
- */
-void
-zone_rollback_dnskeys(zone_type* zone)
-{
-    uint16_t i = 0;
-    rrset_type* rrset = NULL;
-    rr_type* dnskey = NULL;
-    if (!zone || !zone->signconf || !zone->signconf->keys) {
-        return;
-    }
-    rrset = zone_lookup_rrset(zone, zone->apex, LDNS_RR_TYPE_DNSKEY);
-    /* unlink dnskey rrs */
-    for (i=0; i < zone->signconf->keys->count; i++) {
-        if (rrset && zone->signconf->keys->keys[i].dnskey) {
-            dnskey = rrset_lookup_rr(rrset,
-                zone->signconf->keys->keys[i].dnskey);
-            if (dnskey && !dnskey->exists &&
-                dnskey->rr == zone->signconf->keys->keys[i].dnskey) {
-                zone->signconf->keys->keys[i].dnskey = NULL;
-            }
-        }
-    }
-}
-
-
 /**
  * Publish the NSEC3 parameters as indicated by the signer configuration.
  *
@@ -306,8 +275,6 @@ zone_rollback_dnskeys(zone_type* zone)
 ods_status
 zone_publish_nsec3param(zone_type* zone)
 {
-    rrset_type* rrset = NULL;
-    rr_type* n3prr = NULL;
     ldns_rr* rr = NULL;
     ods_status status = ODS_STATUS_OK;
 
@@ -350,19 +317,15 @@ zone_publish_nsec3param(zone_type* zone)
     (void) zone_del_nsec3params(zone);
 
     ods_log_assert(zone->signconf->nsec3params->rr);
-    status = zone_add_rr(zone, zone->signconf->nsec3params->rr, 0);
+    /* the zone keeps its own copy of the RR */
+    rr = ldns_rr_clone(zone->signconf->nsec3params->rr);
+    status = zone_add_rr(zone, rr, 0);
     if (status == ODS_STATUS_UNCHANGED) {
-        /* rr already exists, adjust pointer */
-        rrset = zone_lookup_rrset(zone, zone->apex, LDNS_RR_TYPE_NSEC3PARAMS);
-        ods_log_assert(rrset);
-        n3prr = rrset_lookup_rr(rrset, zone->signconf->nsec3params->rr);
-        ods_log_assert(n3prr);
-        if (n3prr->rr != zone->signconf->nsec3params->rr) {
-            ldns_rr_free(zone->signconf->nsec3params->rr);
-        }
-        zone->signconf->nsec3params->rr = n3prr->rr;
+        /* rr already exists */
+        ldns_rr_free(rr);
         status = ODS_STATUS_OK;
     } else if (status != ODS_STATUS_OK) {
+        ldns_rr_free(rr);
         ods_log_error("[%s] unable to publish nsec3params for zone %s: "
             "error adding nsec3params (%s)", zone_str,
             zone->name, ods_status2str(status));
@@ -371,30 +334,6 @@ zone_publish_nsec3param(zone_type* zone)
 }
 
 
-/**
- * Unlink NSEC3PARAM RR.
- *
- */
-void
-zone_rollback_nsec3param(zone_type* zone)
-{
-    rrset_type* rrset = NULL;
-    rr_type* n3prr = NULL;
-
-    if (!zone || !zone->signconf || !zone->signconf->nsec3params) {
-        return;
-    }
-    rrset = zone_lookup_rrset(zone, zone->apex, LDNS_RR_TYPE_NSEC3PARAMS);
-    if (rrset && zone->signconf->nsec3params->rr) {
-        n3prr = rrset_lookup_rr(rrset, zone->signconf->nsec3params->rr);
-        if (n3prr && !n3prr->exists &&
-            n3prr->rr == zone->signconf->nsec3params->rr) {
-            zone->signconf->nsec3params->rr = NULL;
-        }
-    }
-}
-
-
 /**
  * Prepare keys for signing.
  *
@@ -421,6 +360,11 @@ zone_prepare_keys(zone_type* zone)
     for (i=0; i < zone->signconf->keys->count; i++) {
         if(zone->signconf->dnskey_signature != NULL && zone->signconf->keys->keys[i].ksk)
             continue;
+        if (!zone->signconf->keys->keys[i].dnskey ||
+            !zone->signconf->keys->keys[i].params) {
+            /* new or reloaded key, existing signatures need review */
+            resign_reset(zone->db->resign);
+        }
         /* get dnskey */
         status = lhsm_get_key(ctx, zone->apex, &zone->signconf->keys->keys[i], 0);
         if (status != ODS_STATUS_OK) {
@@ -464,18 +408,17 @@ zone_update_serial(zone_type* zone)
         return ODS_STATUS_OK;
     }
     rrset = zone_lookup_rrset(zone, zone->apex, LDNS_RR_TYPE_SOA);
-    if (!rrset || !rrset->rrs || !rrset->rrs[0].rr) {
+    if (!rrset || !rrset->rrs || !rrset->rr_count) {
         ods_log_error("[%s] unable to update zone %s soa serial: failed to "
             "find soa rrset", zone_str, zone->name);
         return ODS_STATUS_ERR;
     }
     ods_log_assert(rrset);
     ods_log_assert(rrset->rrs);
-    ods_log_assert(rrset->rrs[0].rr);
-    rr = ldns_rr_clone(rrset->rrs[0].rr);
+    rr = rrset_rr2ldns(rrset, &rrset->rrs[0]);
     if (!rr) {
         ods_log_error("[%s] unable to update zone %s soa serial: failed to "
-            "clone soa rr", zone_str, zone->name);
+            "copy soa rr", zone_str, zone->name);
         return ODS_STATUS_ERR;
     }
     status = namedb_update_serial(zone->db, zone->name,
@@ -583,7 +526,7 @@ zone_add_rr(zone_type* zone, ldns_rr* rr, int do_stats)
     }
     record = rrset_lookup_rr(rrset, rr);
 
-    if (record && ldns_rr_ttl(rr) != ldns_rr_ttl(record->rr))
+    if (record && ldns_rr_ttl(rr) != record->ttl)
         record = NULL;
 
     if (record) {
@@ -591,11 +534,7 @@ zone_add_rr(zone_type* zone, ldns_rr* rr, int do_stats)
         record->is_removed = 0; /* unset is_removed */
         return ODS_STATUS_UNCHANGED;
     } else {
-        record = rrset_add_rr(rrset, rr);
-        ods_log_assert(record);
-        ods_log_assert(record->rr);
-        ods_log_assert(record->is_added);
-        if (ldns_rr_ttl(rr) != ldns_rr_ttl(rrset->rrs[0].rr)) {
+        if (rrset->rr_count && ldns_rr_ttl(rr) != rrset->rrs[0].ttl) {
             str = ldns_rr2str(rr);
             str[(strlen(str)) - 1] = '\0';
             for (i = 0; i < strlen(str); i++) {
@@ -603,9 +542,12 @@ zone_add_rr(zone_type* zone, ldns_rr* rr, int do_stats)
                     str[i] = ' ';
                 }
             }
-            ods_log_error("In zone file %s: TTL for the record '%s' set to %d", zone->name, str, ldns_rr_ttl(rrset->rrs[0].rr));
+            ods_log_error("In zone file %s: TTL for the record '%s' set to %d", zone->name, str, rrset->rrs[0].ttl);
             LDNS_FREE(str);
         }
+        record = rrset_add_rr(rrset, rr);
+        ods_log_assert(record);
+        ods_log_assert(record->is_added);
     }
     /* update stats */
     if (do_stats && zone->stats) {
@@ -794,6 +736,31 @@ zone_cleanup(zone_type* zone)
 }
 
 
+/**
+ * Remember what the backup files hold.
+ *
+ */
+static void
+zone_backup_mark(zone_type* zone, uint64_t journal_size)
+{
+    char* filename = NULL;
+    struct stat st;
+
+    zone->backup_serial = zone->db->outserial;
+    zone->backup_keys = zone->signconf->keys ?
+        zone->signconf->keys->generation : 0;
+    zone->backup_signconf = zone->signconf->last_modified;
+    zone->backup_size = 0;
+    filename = ods_build_path(zone->name, ".backup2", 0, 1);
+    if (filename && stat(filename, &st) == 0) {
+        zone->backup_size = (uint64_t) st.st_size;
+    }
+    free(filename);
+    zone->journal_size = journal_size;
+    zone->backup_valid = 1;
+}
+
+
 /**
  * Recover zone from backup.
  *
@@ -805,6 +772,7 @@ zone_recover2(engine_type* engine, zone_type* zone)
     FILE* fd = NULL;
     const char* token = NULL;
     time_t when = 0;
+    int binary = 0;
     ods_status status = ODS_STATUS_OK;
     /* zone part */
     int klass = 0;
@@ -813,6 +781,9 @@ zone_recover2(engine_type* engine, zone_type* zone)
     time_t lastmod = 0;
     /* nsec3params part */
     const char* salt = NULL;
+    /* journal part */
+    uint64_t journal_size = 0;
+    int journal_valid = 1;
 
     ods_log_assert(zone);
     ods_log_assert(zone->name);
@@ -826,11 +797,16 @@ zone_recover2(engine_type* engine, zone_type* zone)
     fd = ods_fopen(filename, NULL, "r");
     if (fd) {
         /* start recovery */
-        if (!backup_read_check_str(fd, ODS_SE_FILE_MAGIC_V3)) {
+        if (!backup_read_str(fd, &token) ||
+            (ods_strcmp(token, ODS_SE_FILE_MAGIC_V3) != 0 &&
+             ods_strcmp(token, ODS_SE_FILE_MAGIC_V4) != 0)) {
             ods_log_error("[%s] corrupted backup file zone %s: read magic "
                 "error", zone_str, zone->name);
             goto recover_error2;
         }
+        binary = (ods_strcmp(token, ODS_SE_FILE_MAGIC_V4) == 0);
+        free((void*) token);
+        token = NULL;
         if (!backup_read_check_str(fd, ";;Time:") |
             !backup_read_time_t(fd, &when)) {
             ods_log_error("[%s] corrupted backup file zone %s: read time "
@@ -971,17 +947,41 @@ zone_recover2(engine_type* engine, zone_type* zone)
             goto recover_error2;
         }
         /* publish other records */
-        status = backup_read_namedb(fd, zone);
+        if (binary) {
+            status = backup_read_namedb_binary(fd, zone);
+        } else {
+            status = backup_read_namedb(fd, zone);
+        }
         if (status != ODS_STATUS_OK) {
             ods_log_error("[%s] corrupted backup file zone %s: unable to "
                 "read resource records (%s)", zone_str, zone->name,
                 ods_status2str(status));
             goto recover_error2;
         }
+        ods_fclose(fd);
+        free((void*)filename);
+        /* changes since the backup */
+        filename = ods_build_path(zone->name, ".backup2.journal", 0, 1);
+        fd = filename ? ods_fopen(filename, NULL, "r") : NULL;
+        if (fd) {
+            status = backup_read_journal(fd, zone, &journal_size);
+            if (status != ODS_STATUS_OK) {
+                ods_log_error("[%s] corrupted backup journal zone %s (%s)",
+                    zone_str, zone->name, ods_status2str(status));
+                goto recover_error2;
+            }
+            journal_valid = (fseek(fd, 0, SEEK_END) == 0 &&
+                ftell(fd) == (long) journal_size);
+        }
+        zone_backup_mark(zone, journal_size);
+        zone->backup_resign = when;
+        /* an incomplete journal is replaced by the next backup */
+        zone->backup_valid = journal_valid;
         /* task */
         schedule_scheduletask(engine->taskq, TASK_SIGN, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
         free((void*)filename);
         ods_fclose(fd);
+        fd = NULL;
         zone->db->is_initialized = 1;
         zone->db->have_serial = 1;
         /* journal */
@@ -1021,6 +1021,7 @@ zone_recover2(engine_type* engine, zone_type* zone)
 
 recover_error2:
     free((void*)filename);
+    free((void*)token);
     ods_fclose(fd);
     /* signconf cleanup */
     free((void*)salt);
@@ -1043,11 +1044,12 @@ recover_error2:
 
 
 /**
- * Backup zone.
+ * Write zone backup, with the RRs in wire format or as text.
  *
  */
-ods_status
-zone_backup2(zone_type* zone, time_t nextResign)
+static ods_status
+zone_backup_write(zone_type* zone, time_t nextResign, const char* ext,
+    const char* tmpext, int binary)
 {
     char* filename = NULL;
     char* tmpfile = NULL;
@@ -1060,8 +1062,8 @@ zone_backup2(zone_type* zone, time_t nextResign)
     ods_log_assert(zone->db);
     ods_log_assert(zone->signconf);
 
-    tmpfile = ods_build_path(zone->name, ".backup2.tmp", 0, 1);
-    filename = ods_build_path(zone->name, ".backup2", 0, 1);
+    tmpfile = ods_build_path(zone->name, tmpext, 0, 1);
+    filename = ods_build_path(zone->name, ext, 0, 1);
     if (!tmpfile || !filename) {
         free(tmpfile);
         free(filename);
@@ -1069,7 +1071,8 @@ zone_backup2(zone_type* zone, time_t nextResign)
     }
     fd = ods_fopen(tmpfile, NULL, "w");
     if (fd) {
-        fprintf(fd, "%s\n", ODS_SE_FILE_MAGIC_V3);
+        fprintf(fd, "%s\n", binary ? ODS_SE_FILE_MAGIC_V4 :
+            ODS_SE_FILE_MAGIC_V3);
         fprintf(fd, ";;Time: %u\n", (unsigned) nextResign);
         /** Backup zone */
         fprintf(fd, ";;Zone: name %s class %i inbound %u internal %u "
@@ -1093,15 +1096,29 @@ zone_backup2(zone_type* zone, time_t nextResign)
         keylist_backup(fd, zone->signconf->keys, ODS_SE_FILE_MAGIC_V3);
         fprintf(fd, ";;\n");
         /** Backup domains and stuff */
-        namedb_backup2(fd, zone->db);
-        /** Done */
-        fprintf(fd, "%s\n", ODS_SE_FILE_MAGIC_V3);
+        if (binary) {
+            status = namedb_backup_binary(fd, zone->db);
+        } else {
+            namedb_backup2(fd, zone->db);
+            /** Done */
+            fprintf(fd, "%s\n", ODS_SE_FILE_MAGIC_V3);
+        }
+        if (ferror(fd) && status == ODS_STATUS_OK) {
+            status = ODS_STATUS_FWRITE_ERR;
+        }
         ods_fclose(fd);
-        ret = rename(tmpfile, filename);
-        if (ret != 0) {
-            ods_log_error("[%s] unable to rename zone %s backup %s to %s: %s",
-                zone_str, zone->name, tmpfile, filename, strerror(errno));
-            status = ODS_STATUS_RENAME_ERR;
+        if (status != ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to write zone %s backup %s: %s",
+                zone_str, zone->name, tmpfile, ods_status2str(status));
+            (void) unlink(tmpfile);
+        } else {
+            ret = rename(tmpfile, filename);
+            if (ret != 0) {
+                ods_log_error("[%s] unable to rename zone %s backup %s to "
+                    "%s: %s", zone_str, zone->name, tmpfile, filename,
+                    strerror(errno));
+                status = ODS_STATUS_RENAME_ERR;
+            }
         }
     } else {
         status = ODS_STATUS_FOPEN_ERR;
@@ -1111,3 +1128,146 @@ zone_backup2(zone_type* zone, time_t nextResign)
     free((void*) filename);
     return status;
 }
+
+
+/**
+ * Append the last sign pass to the backup journal.
+ *
+ */
+static ods_status
+zone_backup_journal(zone_type* zone)
+{
+    char* filename = NULL;
+    FILE* fd = NULL;
+    part_type* part = NULL;
+    ods_status status = ODS_STATUS_OK;
+
+    filename = ods_build_path(zone->name, ".backup2.journal", 0, 1);
+    if (!filename) {
+        return ODS_STATUS_MALLOC_ERR;
+    }
+    fd = ods_fopen(filename, NULL, zone->journal_size ? "r+" : "w");
+    if (!fd) {
+        free(filename);
+        return ODS_STATUS_FOPEN_ERR;
+    }
+    pthread_mutex_lock(&zone->ixfr->ixfr_lock);
+    part = zone->ixfr->part[1];
+    if (fseek(fd, (long) zone->journal_size, SEEK_SET) != 0) {
+        status = ODS_STATUS_FSEEK_ERR;
+    } else {
+        status = backup_write_journal(fd, zone, part);
+    }
+    pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+    if (status == ODS_STATUS_OK) {
+        long end = ftell(fd);
+        zone->journal_size = (uint64_t) end;
+        zone->backup_serial = zone->db->outserial;
+        /* a torn entry is dropped at recovery, cut it off anyway */
+        if (end < 0 || ftruncate(fileno(fd), end) != 0) {
+            status = ODS_STATUS_FWRITE_ERR;
+        }
+    }
+    ods_fclose(fd);
+    if (status != ODS_STATUS_OK) {
+        ods_log_warning("[%s] unable to append to zone %s backup journal "
+            "%s: %s", zone_str, zone->name, filename, ods_status2str(status));
+    }
+    free(filename);
+    return status;
+}
+
+
+/**
+ * Check whether the last sign pass can go to the backup journal,
+ * instead of writing the whole zone.
+ *
+ */
+static int
+zone_backup_journal_ok(zone_type* zone)
+{
+    part_type* part = NULL;
+    int ok = 0;
+
+    if (!zone->backup_valid || !zone->signconf->keys ||
+        zone->signconf->keys->generation != zone->backup_keys ||
+        zone->signconf->last_modified != zone->backup_signconf) {
+        return 0;
+    }
+    /* compact when the journal outgrows half the backup */
+    if (zone->journal_size > zone->backup_size / 2) {
+        return 0;
+    }
+    pthread_mutex_lock(&zone->ixfr->ixfr_lock);
+    part = zone->ixfr->part[1];
+    if (part && part->soamin && part->soaplus) {
+        ok = (ldns_rdf2native_int32(ldns_rr_rdf(part->soamin,
+                SE_SOA_RDATA_SERIAL)) == zone->backup_serial &&
+            ldns_rdf2native_int32(ldns_rr_rdf(part->soaplus,
+                SE_SOA_RDATA_SERIAL)) == zone->db->outserial);
+    }
+    pthread_mutex_unlock(&zone->ixfr->ixfr_lock);
+    return ok;
+}
+
+
+/**
+ * Backup zone.
+ *
+ */
+ods_status
+zone_backup2(zone_type* zone, time_t nextResign)
+{
+    char* filename = NULL;
+    ods_status status = ODS_STATUS_OK;
+
+    ods_log_assert(zone);
+    ods_log_assert(zone->db);
+    ods_log_assert(zone->signconf);
+
+    zone->backup_resign = nextResign;
+    if (zone->backup_valid && zone->backup_serial == zone->db->outserial &&
+        zone->signconf->keys &&
+        zone->signconf->keys->generation == zone->backup_keys &&
+        zone->signconf->last_modified == zone->backup_signconf) {
+        /* nothing was published since the last backup */
+        return ODS_STATUS_OK;
+    }
+    if (zone_backup_journal_ok(zone)) {
+        if (zone_backup_journal(zone) == ODS_STATUS_OK) {
+            return ODS_STATUS_OK;
+        }
+        /* fall back to writing the whole zone */
+    }
+    zone->backup_valid = 0;
+    status = zone_backup_write(zone, nextResign, ".backup2", ".backup2.tmp",
+        1);
+    if (status != ODS_STATUS_OK) {
+        return status;
+    }
+    /* should we crash before this, recovery skips the stale entries */
+    filename = ods_build_path(zone->name, ".backup2.journal", 0, 1);
+    if (filename && unlink(filename) != 0 && errno != ENOENT) {
+        ods_log_warning("[%s] unable to remove zone %s backup journal %s: %s",
+            zone_str, zone->name, filename, strerror(errno));
+        free(filename);
+        return ODS_STATUS_OK;
+    }
+    free(filename);
+    zone_backup_mark(zone, 0);
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Export zone backup as text.
+ *
+ */
+ods_status
+zone_export2(zone_type* zone)
+{
+    /* not signed or recovered yet: the sign task is due right away */
+    return zone_backup_write(zone,
+        zone->backup_resign ? zone->backup_resign : time_now(),
+        ".backup2.text", ".backup2.text.tmp", 0);
+}
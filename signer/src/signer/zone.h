@@ -70,6 +70,8 @@ struct zone_struct {
     const char* policy_name; /* policy identifier */
     const char* signconf_filename; /* signconf filename */
     zone_zl_status zl_status; /* zonelist status */
+    uint32_t zl_hash; /* hash of the zonelist entry */
+    time_t zl_modified; /* zonelist file time when the entry was read */
     /* adapters */
     adapter_type* adinbound; /* inbound adapter */
     adapter_type* adoutbound; /* outbound adapter */
@@ -88,6 +90,15 @@ struct zone_struct {
     /* backing store for rrsigs (both domain as denial) */
     collection_class rrstore;
     int zoneconfigvalid; /* flag indicating whether the signconf has at least once been read */
+    /* backup state */
+    uint32_t backup_serial; /* outbound serial the backup files are at */
+    unsigned backup_keys; /* key list generation of the backup */
+    time_t backup_signconf; /* signconf modification time of the backup */
+    uint64_t backup_size; /* size of the backup */
+    uint64_t journal_size; /* size of the complete backup journal entries */
+    time_t backup_resign; /* next resign time as of the last backup */
+    int recovering; /* waiting to be recovered from backup, under zl_lock */
+    unsigned backup_valid : 1; /* backup files match the zone */
 };
 
 
@@ -131,13 +142,6 @@ ods_status zone_reschedule_task(zone_type* zone, schedule_type* taskq,
  */
 ods_status zone_publish_dnskeys(zone_type* zone, int skip_hsm_access);
 
-/**
- * Unlink DNSKEY RRs.
- * \param[in] zone zone
- *
- */
-void zone_rollback_dnskeys(zone_type* zone);
-
 /**
  * Publish the NSEC3 parameters as indicated by the signer configuration.
  * \param[in] zone zone
@@ -146,13 +150,6 @@ void zone_rollback_dnskeys(zone_type* zone);
  */
 ods_status zone_publish_nsec3param(zone_type* zone);
 
-/**
- * Unlink NSEC3PARAM RR.
- * \param[in] zone zone
- *
- */
-void zone_rollback_nsec3param(zone_type* zone);
-
 /**
  * Prepare keys for signing.
  * \param[in] zone zone
@@ -239,6 +236,17 @@ void zone_cleanup(zone_type* zone);
  */
 ods_status zone_backup2(zone_type* zone, time_t nextResign);
 
+/**
+ * Export zone backup in text format, to <zone>.backup2.text in the
+ * working directory.  It can be recovered from by renaming it to the
+ * regular backup file.  The caller holds the zone lock for the whole
+ * export, so the zone is not signed until it is written.
+ * \param[in] zone corresponding zone
+ * \return ods_status status
+ *
+ */
+ods_status zone_export2(zone_type* zone);
+
 /**
  * Recover zone from backup.
  * \param[in] zone corresponding zone
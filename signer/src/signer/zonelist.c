@@ -88,7 +88,7 @@ zonelist_create()
         return NULL;
     }
     zlist->last_modified = 0;
-    pthread_mutex_init(&zlist->zl_lock, NULL);
+    pthread_rwlock_init(&zlist->zl_lock, NULL);
     return zlist;
 }
 
@@ -98,19 +98,19 @@ zonelist_create()
  *
  */
 static ods_status
-zonelist_read(zonelist_type* zl, const char* zlfile)
+zonelist_read(zonelist_type* zl, const char* zlfile, const char* zonename)
 {
     const char* rngfile = ODS_SE_RNGDIR "/zonelist.rng";
     ods_status status = ODS_STATUS_OK;
     ods_log_assert(zlfile);
     ods_log_verbose("[%s] read file %s", zl_str, zlfile);
-    status = parse_file_check(zlfile, rngfile);
+    status = parse_zonelist_zones((struct zonelist_struct*) zl, zlfile,
+        rngfile, zonename);
     if (status != ODS_STATUS_OK) {
         ods_log_error("[%s] unable to read file: parse error in %s", zl_str,
             zlfile);
-        return status;
     }
-    return parse_zonelist_zones((struct zonelist_struct*) zl, zlfile);
+    return status;
 }
 
 
@@ -255,6 +255,33 @@ zone_not_present:
 }
 
 
+/**
+ * Merge a zone from a new zone list into the zone it replaces.  The
+ * zone is only marked as updated if its zonelist entry changed.
+ *
+ */
+static void
+zonelist_merge_zone(zonelist_type* zl1, zone_type* z1, zone_type* z2)
+{
+    zone_zl_status zl_status = z1->zl_status;
+    if (z1->zl_hash == z2->zl_hash) {
+        /* nothing changed, unless it was about to be removed */
+        if (zl_status == ZONE_ZL_REMOVED) {
+            z1->zl_status = ZONE_ZL_OK;
+        }
+        zone_cleanup(z2);
+        return;
+    }
+    zone_merge(z1, z2);
+    z1->zl_hash = z2->zl_hash;
+    zone_cleanup(z2);
+    /* a zone that is just added is configured from scratch anyway */
+    z1->zl_status = zl_status == ZONE_ZL_ADDED ? ZONE_ZL_ADDED :
+        ZONE_ZL_UPDATED;
+    zl1->just_updated++;
+}
+
+
 /**
  * Merge zone lists.
  *
@@ -311,15 +338,10 @@ zonelist_merge(zonelist_type* zl1, zonelist_type* zl2)
                 }
                 n2 = ldns_rbtree_next(n2);
             } else {
-                /* just update zone z1 */
+                /* update zone z1, if its entry changed */
                 n1 = ldns_rbtree_next(n1);
                 n2 = ldns_rbtree_next(n2);
-                zone_merge(z1, z2);
-                zone_cleanup(z2);
-                if (z1->zl_status == ZONE_ZL_UPDATED) {
-                    zl1->just_updated++;
-                }
-                z1->zl_status = ZONE_ZL_UPDATED;
+                zonelist_merge_zone(zl1, z1, z2);
             }
         }
     }
@@ -370,7 +392,7 @@ zonelist_update(zonelist_type* zl, const char* zlfile)
         return ODS_STATUS_ERR;
     }
     /* read zonelist */
-    status = zonelist_read(new_zlist, zlfile);
+    status = zonelist_read(new_zlist, zlfile, NULL);
     if (status == ODS_STATUS_OK) {
         zl->just_removed = 0;
         zl->just_added = 0;
@@ -381,15 +403,74 @@ zonelist_update(zonelist_type* zl, const char* zlfile)
         ods_log_debug("[%s] file %s is modified since %s", zl_str, zlfile,
             datestamp?datestamp:"Unknown");
         free((void*)datestamp);
+        /* the zones of the new list are merged or added by now */
+        zonelist_free(new_zlist);
     } else {
         ods_log_error("[%s] unable to update zonelist: read file %s failed "
             "(%s)", zl_str, zlfile, ods_status2str(status));
+        zonelist_cleanup(new_zlist);
     }
-    zonelist_free(new_zlist);
     return status;
 }
 
 
+/**
+ * Update a single zone from the zone list.
+ *
+ */
+ods_status
+zonelist_update_zone(zonelist_type* zl, const char* zlfile, const char* name)
+{
+    zonelist_type* new_zlist = NULL;
+    zone_type* z1 = NULL;
+    zone_type* z2 = NULL;
+    time_t st_mtime = 0;
+    ods_status status = ODS_STATUS_OK;
+
+    ods_log_debug("[%s] update zone %s from zone list", zl_str, name);
+    if (!zl|| !zl->zones || !zlfile || !name) {
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    /* before reading, a change made while reading is picked up next time */
+    st_mtime = ods_file_lastmodified(zlfile);
+    new_zlist = zonelist_create();
+    if (!new_zlist) {
+        ods_log_error("[%s] unable to update zone %s: zonelist_create() "
+            "failed", zl_str, name);
+        return ODS_STATUS_ERR;
+    }
+    status = zonelist_read(new_zlist, zlfile, name);
+    if (status != ODS_STATUS_OK) {
+        ods_log_error("[%s] unable to update zone %s: read file %s failed "
+            "(%s)", zl_str, name, zlfile, ods_status2str(status));
+        zonelist_cleanup(new_zlist);
+        return status;
+    }
+    zl->just_removed = 0;
+    zl->just_added = 0;
+    zl->just_updated = 0;
+    z1 = zonelist_lookup_zone_by_name(zl, name, LDNS_RR_CLASS_IN);
+    z2 = zonelist_lookup_zone_by_name(new_zlist, name, LDNS_RR_CLASS_IN);
+    if (z2) {
+        zonelist_del_zone(new_zlist, z2);
+    }
+    if (z1 && z2) {
+        zonelist_merge_zone(zl, z1, z2);
+        z1->zl_modified = st_mtime;
+    } else if (z2) {
+        z2->zl_modified = st_mtime;
+        (void) zonelist_add_zone(zl, z2);
+    } else if (z1 && z1->zl_status != ZONE_ZL_REMOVED) {
+        z1->zl_status = ZONE_ZL_REMOVED;
+        zl->just_removed++;
+    }
+    /* the list as a whole is not up to date: leave last_modified alone,
+     * the zone has its own */
+    zonelist_cleanup(new_zlist);
+    return ODS_STATUS_OK;
+}
+
+
 /**
  * Internal zone cleanup function.
  *
@@ -440,7 +521,7 @@ zonelist_cleanup(zonelist_type* zl)
         ldns_rbtree_free(zl->zones);
         zl->zones = NULL;
     }
-    pthread_mutex_destroy(&zl->zl_lock);
+    pthread_rwlock_destroy(&zl->zl_lock);
     free(zl);
 }
 
@@ -460,6 +541,6 @@ zonelist_free(zonelist_type* zl)
         ldns_rbtree_free(zl->zones);
         zl->zones = NULL;
     }
-    pthread_mutex_destroy(&zl->zl_lock);
+    pthread_rwlock_destroy(&zl->zl_lock);
     free(zl);
 }
@@ -47,7 +47,7 @@ struct zonelist_struct {
     int just_added;
     int just_updated;
     int just_removed;
-    pthread_mutex_t zl_lock;
+    pthread_rwlock_t zl_lock;
 };
 
 /**
@@ -106,6 +106,21 @@ void zonelist_del_zone(zonelist_type* zlist, zone_type* zone);
  */
 ods_status zonelist_update(zonelist_type* zl, const char* zlfile);
 
+/**
+ * Update a single zone from the zone list, leaving the other zones
+ * alone.  The zone is added, updated or marked as removed, depending
+ * on its entry in the zone list file.  The modification time of the
+ * file is recorded in the zone, so that the file is only read again for
+ * this zone once it changes.
+ * \param[in] zl zone list
+ * \param[in] zlfile zone list filename
+ * \param[in] name zone name
+ * \return ods_status status
+ *
+ */
+ods_status zonelist_update_zone(zonelist_type* zl, const char* zlfile,
+    const char* name);
+
 /**
  * Clean up zone list.
  * \param[in] zl zone list
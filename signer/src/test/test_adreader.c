@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+#include "CUnit/Basic.h"
+
+#include "adapter/adreader.h"
+#include "test_adreader.h"
+
+#include <ldns/ldns.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_ADREADER_MAXRR 16
+#define TEST_ADREADER_INCLUDE "test_adreader.inc"
+
+static FILE* fd = NULL;
+static adreader_type* reader = NULL;
+static ldns_rr* rrs[TEST_ADREADER_MAXRR];
+static size_t count = 0;
+
+/**
+ * Read all RRs of a zone file, up to the end, a marker or an error.
+ *
+ */
+static ldns_status
+test_adreader_read(const char* text, const char* origin, uint32_t ttl,
+    int flags)
+{
+    ldns_rdf* orig = NULL;
+    ldns_status status = LDNS_STATUS_OK;
+    ldns_rr* rr = NULL;
+
+    fd = tmpfile();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fd);
+    CU_ASSERT_FATAL(fputs(text, fd) >= 0);
+    rewind(fd);
+    if (origin) {
+        orig = ldns_dname_new_frm_str(origin);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(orig);
+    }
+    reader = adreader_create(fd, orig, ttl, flags);
+    ldns_rdf_deep_free(orig);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+    count = 0;
+    while ((rr = adreader_read_rr(reader, &status))) {
+        CU_ASSERT_FATAL(count < TEST_ADREADER_MAXRR);
+        rrs[count++] = rr;
+    }
+    return status;
+}
+
+/**
+ * Check RR against its presentation format.
+ *
+ */
+static void
+test_adreader_expect(size_t i, const char* str)
+{
+    ldns_rr* rr = NULL;
+    CU_ASSERT_FATAL(i < count);
+    CU_ASSERT_FATAL(ldns_rr_new_frm_str(&rr, str, 0, NULL, NULL) ==
+        LDNS_STATUS_OK);
+    CU_ASSERT(ldns_rr_compare(rrs[i], rr) == 0);
+    CU_ASSERT_EQUAL(ldns_rr_ttl(rrs[i]), ldns_rr_ttl(rr));
+    ldns_rr_free(rr);
+}
+
+static int
+test_adreader_init_suite(void)
+{
+    return 0;
+}
+
+static int
+test_adreader_clean_suite(void)
+{
+    (void) unlink(TEST_ADREADER_INCLUDE);
+    return 0;
+}
+
+/**
+ * Clean up after a test.
+ *
+ */
+static void
+test_adreader_done(void)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        ldns_rr_free(rrs[i]);
+    }
+    count = 0;
+    adreader_cleanup(reader);
+    reader = NULL;
+    fclose(fd);
+    fd = NULL;
+}
+
+static void
+test_adreader_omitted(void)
+{
+    CU_ASSERT(test_adreader_read(
+        "www 60 IN A 192.0.2.1\n"
+        "    IN AAAA 2001:db8::1\n"
+        "\tA 192.0.2.2\n"
+        "mail IN 120 MX 10 www\n"
+        "ftp CNAME www.example.net.\n",
+        "example.com.", 300, 0) == LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 5);
+    test_adreader_expect(0, "www.example.com. 60 IN A 192.0.2.1");
+    test_adreader_expect(1, "www.example.com. 300 IN AAAA 2001:db8::1");
+    test_adreader_expect(2, "www.example.com. 300 IN A 192.0.2.2");
+    test_adreader_expect(3, "mail.example.com. 120 IN MX 10 www.example.com.");
+    test_adreader_expect(4, "ftp.example.com. 300 IN CNAME www.example.net.");
+    test_adreader_done();
+}
+
+static void
+test_adreader_multiline(void)
+{
+    CU_ASSERT(test_adreader_read(
+        "@ IN SOA ns1 hostmaster (\n"
+        "        2016010101 ; serial\n"
+        "        3600       ; refresh\n"
+        "        (900)      ; retry\n"
+        "        1209600 300 )\n"
+        "www A 192.0.2.1\n",
+        "example.com.", 300, 0) == LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 2);
+    test_adreader_expect(0, "example.com. 300 IN SOA ns1.example.com. "
+        "hostmaster.example.com. 2016010101 3600 900 1209600 300");
+    test_adreader_expect(1, "www.example.com. 300 IN A 192.0.2.1");
+    CU_ASSERT_EQUAL(adreader_line(reader), 6);
+    test_adreader_done();
+
+    /* missing closing parenthesis */
+    CU_ASSERT(test_adreader_read(
+        "@ IN SOA ns1 hostmaster ( 1 3600 900 1209600 300\n",
+        "example.com.", 300, 0) != LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 0);
+    test_adreader_done();
+
+    /* closing parenthesis without an opening one */
+    CU_ASSERT(test_adreader_read("www A 192.0.2.1 )\n", "example.com.",
+        300, 0) != LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 0);
+    test_adreader_done();
+}
+
+static void
+test_adreader_quoted(void)
+{
+    CU_ASSERT(test_adreader_read(
+        "txt TXT \"a ; not a comment\" \"(b)\"\n"
+        "txt TXT \"two\n"
+        "lines\"\n"
+        "txt TXT \"say \\\"hi\\\"\"\n"
+        "www A 192.0.2.1\n",
+        "example.com.", 300, 0) == LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 4);
+    test_adreader_expect(0,
+        "txt.example.com. 300 IN TXT \"a ; not a comment\" \"(b)\"");
+    test_adreader_expect(1, "txt.example.com. 300 IN TXT \"two\\010lines\"");
+    test_adreader_expect(2, "txt.example.com. 300 IN TXT \"say \\\"hi\\\"\"");
+    test_adreader_expect(3, "www.example.com. 300 IN A 192.0.2.1");
+    test_adreader_done();
+
+    /* missing closing quote */
+    CU_ASSERT(test_adreader_read("txt TXT \"open\n", "example.com.", 300, 0)
+        != LDNS_STATUS_OK);
+    test_adreader_done();
+}
+
+static void
+test_adreader_escapes(void)
+{
+    CU_ASSERT(test_adreader_read(
+        "a\\.b A 192.0.2.1\n"
+        "c\\032d A 192.0.2.2\n"
+        "e\\(f\\) A 192.0.2.3\n",
+        "example.com.", 300, 0) == LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 3);
+    test_adreader_expect(0, "a\\.b.example.com. 300 IN A 192.0.2.1");
+    test_adreader_expect(1, "c\\032d.example.com. 300 IN A 192.0.2.2");
+    test_adreader_expect(2, "e\\(f\\).example.com. 300 IN A 192.0.2.3");
+    if (count == 3) {
+        /* the escaped dot is part of the label */
+        CU_ASSERT_EQUAL(ldns_dname_label_count(ldns_rr_owner(rrs[0])), 3);
+    }
+    test_adreader_done();
+}
+
+static void
+test_adreader_comments(void)
+{
+    CU_ASSERT(test_adreader_read(
+        "; comment line\n"
+        "\n"
+        "   ; indented comment\n"
+        "www A 192.0.2.1 ; trailing comment\n"
+        ";; not a marker without ADREADER_MARKERS\n"
+        "    A 192.0.2.2\n",
+        "example.com.", 300, 0) == LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 2);
+    test_adreader_expect(0, "www.example.com. 300 IN A 192.0.2.1");
+    test_adreader_expect(1, "www.example.com. 300 IN A 192.0.2.2");
+    test_adreader_done();
+}
+
+static void
+test_adreader_markers(void)
+{
+    CU_ASSERT(test_adreader_read(
+        "www A 192.0.2.1\n"
+        ";;ENDOFZONE  \n"
+        "www A 192.0.2.2\n",
+        "example.com.", 300, ADREADER_MARKERS) == LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(adreader_marker(reader));
+    CU_ASSERT_STRING_EQUAL(adreader_marker(reader), ";;ENDOFZONE");
+    test_adreader_done();
+}
+
+static void
+test_adreader_directives(void)
+{
+    CU_ASSERT(test_adreader_read(
+        "$TTL 600\n"
+        "www A 192.0.2.1\n"
+        "$ORIGIN sub.example.com.\n"
+        "www A 192.0.2.2\n"
+        "$TTL 1h\n"
+        "@ NS ns1.example.com.\n",
+        "example.com.", 300, 0) == LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 3);
+    test_adreader_expect(0, "www.example.com. 600 IN A 192.0.2.1");
+    test_adreader_expect(1, "www.sub.example.com. 600 IN A 192.0.2.2");
+    test_adreader_expect(2, "sub.example.com. 3600 IN NS ns1.example.com.");
+    test_adreader_done();
+
+    /* $ORIGIN without a name */
+    CU_ASSERT(test_adreader_read("$ORIGIN\n", "example.com.", 300, 0) !=
+        LDNS_STATUS_OK);
+    test_adreader_done();
+}
+
+static void
+test_adreader_include(void)
+{
+    FILE* inc = fopen(TEST_ADREADER_INCLUDE, "w");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(inc);
+    fputs("inc A 192.0.2.10\n"
+        "$ORIGIN other.example.com.\n"
+        "$TTL 60\n"
+        "inc A 192.0.2.11\n", inc);
+    fclose(inc);
+
+    /* $ORIGIN and $TTL carry into the included file, not back out */
+    CU_ASSERT(test_adreader_read(
+        "$TTL 600\n"
+        "$INCLUDE " TEST_ADREADER_INCLUDE "\n"
+        "www A 192.0.2.1\n"
+        "$INCLUDE " TEST_ADREADER_INCLUDE " sub.example.com.\n"
+        "    A 192.0.2.2\n",
+        "example.com.", 300, 0) == LDNS_STATUS_OK);
+    CU_ASSERT_EQUAL(count, 6);
+    test_adreader_expect(0, "inc.example.com. 600 IN A 192.0.2.10");
+    test_adreader_expect(1, "inc.other.example.com. 60 IN A 192.0.2.11");
+    test_adreader_expect(2, "www.example.com. 600 IN A 192.0.2.1");
+    test_adreader_expect(3, "inc.sub.example.com. 600 IN A 192.0.2.10");
+    test_adreader_expect(4, "inc.other.example.com. 60 IN A 192.0.2.11");
+    /* the previous owner name is restored too */
+    test_adreader_expect(5, "www.example.com. 600 IN A 192.0.2.2");
+    test_adreader_done();
+
+    /* include file that does not exist */
+    CU_ASSERT(test_adreader_read("$INCLUDE does-not-exist.zone\n",
+        "example.com.", 300, 0) != LDNS_STATUS_OK);
+    test_adreader_done();
+}
+
+static int
+test_adreader_add_tests(CU_pSuite pSuite)
+{
+    if (!CU_add_test(pSuite, "omitted owner, TTL and class",
+            test_adreader_omitted)
+        || !CU_add_test(pSuite, "parentheses and multi-line records",
+            test_adreader_multiline)
+        || !CU_add_test(pSuite, "quoted strings", test_adreader_quoted)
+        || !CU_add_test(pSuite, "escapes", test_adreader_escapes)
+        || !CU_add_test(pSuite, "comments", test_adreader_comments)
+        || !CU_add_test(pSuite, "markers", test_adreader_markers)
+        || !CU_add_test(pSuite, "$ORIGIN and $TTL", test_adreader_directives)
+        || !CU_add_test(pSuite, "$INCLUDE", test_adreader_include))
+    {
+        return CU_get_error();
+    }
+    return 0;
+}
+
+int
+test_adreader_add_suite(void)
+{
+    CU_pSuite pSuite = NULL;
+    pSuite = CU_add_suite("Test of zone file reader",
+        test_adreader_init_suite, test_adreader_clean_suite);
+    if (!pSuite) {
+        return CU_get_error();
+    }
+    return test_adreader_add_tests(pSuite);
+}
@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+#include "CUnit/Basic.h"
+
+#include "adapter/adapi.h"
+#include "signer/backup.h"
+#include "signer/namedb.h"
+#include "signer/zone.h"
+#include "test_backup.h"
+
+#include <ldns/ldns.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char* test_backup_rrs[] = {
+    "example.com. 3600 IN NS ns.example.com.",
+    "ns.example.com. 3600 IN A 192.0.2.53",
+    "www.example.com. 300 IN A 192.0.2.1",
+    "www.example.com. 300 IN A 192.0.2.2",
+    "www.example.com. 3600 IN TXT \"hello world\"",
+    NULL
+};
+
+/**
+ * Create RR from its presentation format.
+ *
+ */
+static ldns_rr*
+test_backup_rr(const char* str)
+{
+    ldns_rr* rr = NULL;
+    CU_ASSERT_FATAL(ldns_rr_new_frm_str(&rr, str, 0, NULL, NULL) ==
+        LDNS_STATUS_OK);
+    return rr;
+}
+
+/**
+ * Create SOA RR with serial.
+ *
+ */
+static ldns_rr*
+test_backup_soa(uint32_t serial)
+{
+    char str[128];
+    snprintf(str, sizeof(str), "example.com. 3600 IN SOA ns.example.com. "
+        "hostmaster.example.com. %u 3600 900 604800 300", (unsigned) serial);
+    return test_backup_rr(str);
+}
+
+/**
+ * Create an empty zone, NSEC signed.
+ *
+ */
+static zone_type*
+test_backup_zone(void)
+{
+    char name[] = "example.com";
+    zone_type* zone = zone_create(name, LDNS_RR_CLASS_IN);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(zone);
+    zone->signconf->nsec_type = LDNS_RR_TYPE_NSEC;
+    return zone;
+}
+
+/**
+ * Add the SOA with serial and a NULL terminated list of RRs to a zone,
+ * like recovery does.
+ *
+ */
+static void
+test_backup_fill(zone_type* zone, uint32_t serial, const char** rrs)
+{
+    ldns_rr* rr = test_backup_soa(serial);
+    CU_ASSERT_FATAL(adapi_add_rr(zone, rr, 1) == ODS_STATUS_OK);
+    while (rrs && *rrs) {
+        rr = test_backup_rr(*rrs++);
+        CU_ASSERT_FATAL(adapi_add_rr(zone, rr, 1) == ODS_STATUS_OK);
+    }
+    namedb_diff(zone->db, 0, 0);
+    zone->db->inbserial = serial;
+    zone->db->intserial = serial;
+    zone->db->outserial = serial;
+}
+
+/**
+ * Whether the zone has an RR, TTL included.
+ *
+ */
+static int
+test_backup_has(zone_type* zone, const char* str)
+{
+    ldns_rr* rr = test_backup_rr(str);
+    rrset_type* rrset = zone_lookup_rrset(zone, ldns_rr_owner(rr),
+        ldns_rr_get_type(rr));
+    rr_type* record = rrset ? rrset_lookup_rr(rrset, rr) : NULL;
+    int found = (record && record->exists &&
+        record->ttl == ldns_rr_ttl(rr));
+    ldns_rr_free(rr);
+    return found;
+}
+
+/**
+ * A copy of the NSEC RR of an owner name.
+ *
+ */
+static ldns_rr*
+test_backup_nsec(zone_type* zone, const char* owner)
+{
+    ldns_rdf* dname = ldns_dname_new_frm_str(owner);
+    denial_type* denial = NULL;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(dname);
+    denial = namedb_lookup_denial(zone->db, dname);
+    ldns_rdf_deep_free(dname);
+    if (!denial || !denial->rrset || denial->rrset->rr_count != 1) {
+        return NULL;
+    }
+    return rrset_rr2ldns(denial->rrset, &denial->rrset->rrs[0]);
+}
+
+/**
+ * Append a change to the backup journal as the signer does, the RRs
+ * removed and added are NULL terminated lists.
+ *
+ */
+static void
+test_backup_journal_write(FILE* fd, zone_type* zone, uint32_t from,
+    uint32_t to, const char** dels, const char** adds)
+{
+    part_type part;
+
+    part.min = ldns_rr_list_new();
+    part.plus = ldns_rr_list_new();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(part.min);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(part.plus);
+    part.soamin = test_backup_soa(from);
+    part.soaplus = test_backup_soa(to);
+    ldns_rr_list_push_rr(part.min, part.soamin);
+    ldns_rr_list_push_rr(part.plus, part.soaplus);
+    while (dels && *dels) {
+        ldns_rr_list_push_rr(part.min, test_backup_rr(*dels++));
+    }
+    while (adds && *adds) {
+        ldns_rr_list_push_rr(part.plus, test_backup_rr(*adds++));
+    }
+    zone->db->inbserial = to;
+    zone->db->intserial = to;
+    zone->db->outserial = to;
+    CU_ASSERT(backup_write_journal(fd, zone, &part) == ODS_STATUS_OK);
+    ldns_rr_list_deep_free(part.min);
+    ldns_rr_list_deep_free(part.plus);
+}
+
+/**
+ * Replay the backup journal on a zone recovered at serial.
+ *
+ */
+static zone_type*
+test_backup_replay(FILE* fd, uint32_t serial, ods_status* status,
+    uint64_t* size)
+{
+    zone_type* zone = test_backup_zone();
+    test_backup_fill(zone, serial, test_backup_rrs);
+    rewind(fd);
+    *size = 1;
+    *status = backup_read_journal(fd, zone, size);
+    return zone;
+}
+
+static int
+test_backup_init_suite(void)
+{
+    return 0;
+}
+
+static int
+test_backup_clean_suite(void)
+{
+    return 0;
+}
+
+static void
+test_backup_binary(void)
+{
+    zone_type* zone = test_backup_zone();
+    zone_type* recovered = test_backup_zone();
+    rrset_type* rrset = NULL;
+    rrsig_type* rrsig = NULL;
+    ldns_rr* rr = NULL;
+    ldns_rr* nsec = NULL;
+    ldns_rr* orig = NULL;
+    uint32_t added = 0;
+    FILE* fd = NULL;
+    size_t i;
+
+    test_backup_fill(zone, 10, test_backup_rrs);
+    namedb_nsecify(zone->db, &added);
+    CU_ASSERT_EQUAL(added, 3);
+    rr = test_backup_rr("www.example.com. 300 IN RRSIG A 8 3 300 "
+        "20261201000000 20261101000000 12345 example.com. dGVzdA==");
+    rrset = zone_lookup_rrset(zone, ldns_rr_owner(rr), LDNS_RR_TYPE_A);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rrset);
+    rrset_add_rrsig(rrset, ldns_rr_clone(rr), strdup("0123456789abcdef"),
+        257);
+
+    /* the binary part starts on the line after the text part */
+    fd = tmpfile();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fd);
+    CU_ASSERT(fputs("\n", fd) >= 0);
+    CU_ASSERT(namedb_backup_binary(fd, zone->db) == ODS_STATUS_OK);
+    CU_ASSERT(fflush(fd) == 0);
+    rewind(fd);
+    CU_ASSERT(backup_read_namedb_binary(fd, recovered) == ODS_STATUS_OK);
+
+    CU_ASSERT(test_backup_has(recovered, "example.com. 3600 IN SOA "
+        "ns.example.com. hostmaster.example.com. 10 3600 900 604800 300"));
+    for (i = 0; test_backup_rrs[i]; i++) {
+        CU_ASSERT(test_backup_has(recovered, test_backup_rrs[i]));
+    }
+    CU_ASSERT(!test_backup_has(recovered, "www.example.com. 3600 IN A "
+        "192.0.2.1"));
+    /* NSECs */
+    nsec = test_backup_nsec(recovered, "ns.example.com.");
+    CU_ASSERT_PTR_NOT_NULL(nsec);
+    ldns_rr_free(nsec);
+    nsec = test_backup_nsec(recovered, "www.example.com.");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(nsec);
+    orig = test_backup_nsec(zone, "www.example.com.");
+    CU_ASSERT(ldns_rr_compare(orig, nsec) == 0);
+    ldns_rr_free(orig);
+    ldns_rr_free(nsec);
+    /* RRSIGs, with the key they were made with */
+    rrset = zone_lookup_rrset(recovered, ldns_rr_owner(rr), LDNS_RR_TYPE_A);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rrset);
+    i = 0;
+    while ((rrsig = collection_iterator(rrset->rrsigs))) {
+        i++;
+        orig = rrset_rrsig2ldns(rrset, rrsig);
+        CU_ASSERT(ldns_rr_compare(orig, rr) == 0);
+        ldns_rr_free(orig);
+        CU_ASSERT_STRING_EQUAL(rrsig->key_locator, "0123456789abcdef");
+        CU_ASSERT_EQUAL(rrsig->key_flags, 257);
+        CU_ASSERT_EQUAL(rrsig->keytag, 12345);
+    }
+    CU_ASSERT_EQUAL(i, 1);
+    CU_ASSERT(!rrset->needs_signing);
+
+    fclose(fd);
+
+    /* a truncated binary part is refused */
+    zone_cleanup(recovered);
+    recovered = test_backup_zone();
+    fd = tmpfile();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fd);
+    CU_ASSERT(fputs("\n", fd) >= 0);
+    CU_ASSERT(namedb_backup_binary(fd, zone->db) == ODS_STATUS_OK);
+    CU_ASSERT(fflush(fd) == 0);
+    CU_ASSERT(ftruncate(fileno(fd), ftell(fd) - 1) == 0);
+    rewind(fd);
+    CU_ASSERT(backup_read_namedb_binary(fd, recovered) != ODS_STATUS_OK);
+    fclose(fd);
+    ldns_rr_free(rr);
+    zone_cleanup(recovered);
+    zone_cleanup(zone);
+}
+
+static void
+test_backup_journal(void)
+{
+    const char* dels11[] = { "www.example.com. 300 IN A 192.0.2.1", NULL };
+    const char* adds11[] = { "www.example.com. 300 IN A 192.0.2.3",
+        "mail.example.com. 3600 IN A 192.0.2.25", NULL };
+    const char* adds12[] = { "ftp.example.com. 3600 IN CNAME www.example.com.",
+        NULL };
+    zone_type* zone = test_backup_zone();
+    zone_type* recovered = NULL;
+    ods_status status;
+    uint8_t torn[16];
+    uint64_t size;
+    long end;
+    FILE* fd = NULL;
+
+    test_backup_fill(zone, 10, test_backup_rrs);
+    fd = tmpfile();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fd);
+    test_backup_journal_write(fd, zone, 10, 11, dels11, adds11);
+    test_backup_journal_write(fd, zone, 11, 12, NULL, adds12);
+    end = ftell(fd);
+    /* crash before the length of the next entry was written */
+    memset(torn, 0, sizeof(torn));
+    CU_ASSERT(fwrite(torn, 1, sizeof(torn), fd) == sizeof(torn));
+    CU_ASSERT(fflush(fd) == 0);
+
+    /* replayed on the backup it was written for */
+    recovered = test_backup_replay(fd, 10, &status, &size);
+    CU_ASSERT(status == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(size, (uint64_t) end);
+    CU_ASSERT_EQUAL(recovered->db->outserial, 12);
+    CU_ASSERT(test_backup_has(recovered, "example.com. 3600 IN SOA "
+        "ns.example.com. hostmaster.example.com. 12 3600 900 604800 300"));
+    CU_ASSERT(!test_backup_has(recovered, dels11[0]));
+    CU_ASSERT(test_backup_has(recovered, "www.example.com. 300 IN A "
+        "192.0.2.2"));
+    CU_ASSERT(test_backup_has(recovered, adds11[0]));
+    CU_ASSERT(test_backup_has(recovered, adds11[1]));
+    CU_ASSERT(test_backup_has(recovered, adds12[0]));
+    zone_cleanup(recovered);
+
+    /* left behind by a crash after a newer backup was written */
+    recovered = test_backup_replay(fd, 11, &status, &size);
+    CU_ASSERT(status == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(size, 0);
+    CU_ASSERT_EQUAL(recovered->db->outserial, 12);
+    CU_ASSERT(test_backup_has(recovered, adds12[0]));
+    zone_cleanup(recovered);
+    recovered = test_backup_replay(fd, 12, &status, &size);
+    CU_ASSERT(status == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(size, 0);
+    CU_ASSERT_EQUAL(recovered->db->outserial, 12);
+    CU_ASSERT(!test_backup_has(recovered, adds12[0]));
+    zone_cleanup(recovered);
+
+    /* a journal that does not follow the backup */
+    recovered = test_backup_replay(fd, 9, &status, &size);
+    CU_ASSERT(status != ODS_STATUS_OK);
+    zone_cleanup(recovered);
+    fclose(fd);
+    zone_cleanup(zone);
+}
+
+static int
+test_backup_add_tests(CU_pSuite pSuite)
+{
+    if (!CU_add_test(pSuite, "binary round-trip", test_backup_binary)
+        || !CU_add_test(pSuite, "journal replay", test_backup_journal))
+    {
+        return CU_get_error();
+    }
+    return 0;
+}
+
+int
+test_backup_add_suite(void)
+{
+    CU_pSuite pSuite = NULL;
+    pSuite = CU_add_suite("Test of zone backup",
+        test_backup_init_suite, test_backup_clean_suite);
+    if (!pSuite) {
+        return CU_get_error();
+    }
+    return test_backup_add_tests(pSuite);
+}
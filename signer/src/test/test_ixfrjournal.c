@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2016 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "config.h"
+#include "CUnit/Basic.h"
+
+#include "util.h"
+#include "signer/ixfrjournal.h"
+#include "test_ixfrjournal.h"
+
+#include <ldns/ldns.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_IXFRJOURNAL_FILE "test_ixfrjournal.journal"
+
+static ldns_rr_list* rrs = NULL;
+
+/**
+ * Create RR from its presentation format.
+ *
+ */
+static ldns_rr*
+test_ixfrjournal_rr(const char* str)
+{
+    ldns_rr* rr = NULL;
+    CU_ASSERT_FATAL(ldns_rr_new_frm_str(&rr, str, 0, NULL, NULL) ==
+        LDNS_STATUS_OK);
+    return rr;
+}
+
+/**
+ * Create SOA RR with serial.
+ *
+ */
+static ldns_rr*
+test_ixfrjournal_soa(uint32_t serial)
+{
+    char str[128];
+    snprintf(str, sizeof(str), "example.com. 3600 IN SOA ns.example.com. "
+        "hostmaster.example.com. %u 3600 900 604800 300", (unsigned) serial);
+    return test_ixfrjournal_rr(str);
+}
+
+/**
+ * Append a change to the journal, the RRs removed and added are NULL
+ * terminated lists.
+ *
+ */
+static ods_status
+test_ixfrjournal_append(uint32_t from, uint32_t to, const char** dels,
+    const char** adds)
+{
+    part_type part;
+    ods_status status;
+
+    part.min = ldns_rr_list_new();
+    part.plus = ldns_rr_list_new();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(part.min);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(part.plus);
+    part.soamin = test_ixfrjournal_soa(from);
+    part.soaplus = test_ixfrjournal_soa(to);
+    ldns_rr_list_push_rr(part.min, part.soamin);
+    ldns_rr_list_push_rr(part.plus, part.soaplus);
+    while (dels && *dels) {
+        ldns_rr_list_push_rr(part.min, test_ixfrjournal_rr(*dels++));
+    }
+    while (adds && *adds) {
+        ldns_rr_list_push_rr(part.plus, test_ixfrjournal_rr(*adds++));
+    }
+    status = ixfrjournal_append(TEST_IXFRJOURNAL_FILE, &part);
+    ldns_rr_list_deep_free(part.min);
+    ldns_rr_list_deep_free(part.plus);
+    return status;
+}
+
+/**
+ * Check RR of the IXFR answer against its presentation format.
+ *
+ */
+static void
+test_ixfrjournal_expect(size_t i, const char* str)
+{
+    ldns_rr* rr = NULL;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rrs);
+    CU_ASSERT_FATAL(i < ldns_rr_list_rr_count(rrs));
+    rr = test_ixfrjournal_rr(str);
+    CU_ASSERT(ldns_rr_compare(ldns_rr_list_rr(rrs, i), rr) == 0);
+    CU_ASSERT_EQUAL(ldns_rr_ttl(ldns_rr_list_rr(rrs, i)), ldns_rr_ttl(rr));
+    ldns_rr_free(rr);
+}
+
+/**
+ * Check SOA serial of the IXFR answer.
+ *
+ */
+static void
+test_ixfrjournal_expect_soa(size_t i, uint32_t serial)
+{
+    ldns_rr* rr = NULL;
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rrs);
+    CU_ASSERT_FATAL(i < ldns_rr_list_rr_count(rrs));
+    rr = ldns_rr_list_rr(rrs, i);
+    CU_ASSERT_FATAL(ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA);
+    CU_ASSERT_EQUAL(ldns_rdf2native_int32(ldns_rr_rdf(rr,
+        SE_SOA_RDATA_SERIAL)), serial);
+}
+
+/**
+ * Read the changes since serial.
+ *
+ */
+static ods_status
+test_ixfrjournal_read(uint32_t serial)
+{
+    ldns_rr_list_deep_free(rrs);
+    rrs = NULL;
+    return ixfrjournal_read(TEST_IXFRJOURNAL_FILE, serial, &rrs);
+}
+
+/**
+ * Append raw bytes to the journal.
+ *
+ */
+static void
+test_ixfrjournal_write(const uint8_t* data, size_t len)
+{
+    FILE* fd = fopen(TEST_IXFRJOURNAL_FILE, "ab");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(fd);
+    CU_ASSERT(fwrite(data, 1, len, fd) == len);
+    fclose(fd);
+}
+
+/**
+ * Size of the journal.
+ *
+ */
+static long
+test_ixfrjournal_size(void)
+{
+    struct stat st;
+    if (stat(TEST_IXFRJOURNAL_FILE, &st) != 0) {
+        return -1;
+    }
+    return (long) st.st_size;
+}
+
+static int
+test_ixfrjournal_init_suite(void)
+{
+    return 0;
+}
+
+static int
+test_ixfrjournal_clean_suite(void)
+{
+    (void) unlink(TEST_IXFRJOURNAL_FILE);
+    (void) unlink(TEST_IXFRJOURNAL_FILE ".tmp");
+    return 0;
+}
+
+/**
+ * Clean up after a test.
+ *
+ */
+static void
+test_ixfrjournal_done(void)
+{
+    ldns_rr_list_deep_free(rrs);
+    rrs = NULL;
+    ixfrjournal_set_depth(ODS_SE_IXFRHISTORY);
+    (void) unlink(TEST_IXFRJOURNAL_FILE);
+}
+
+static void
+test_ixfrjournal_appending(void)
+{
+    const char* dels[] = { "www.example.com. 3600 IN A 192.0.2.1", NULL };
+    const char* adds[] = { "www.example.com. 3600 IN A 192.0.2.2", NULL };
+    long size;
+
+    (void) unlink(TEST_IXFRJOURNAL_FILE);
+    CU_ASSERT(test_ixfrjournal_append(1, 2, dels, adds) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_size() > IXFRJOURNAL_MAGIC_LEN +
+        IXFRJOURNAL_HEADER_LEN);
+    CU_ASSERT(test_ixfrjournal_read(1) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(ldns_rr_list_rr_count(rrs), 6);
+    test_ixfrjournal_expect_soa(0, 2);
+    test_ixfrjournal_expect_soa(1, 1);
+    test_ixfrjournal_expect(2, "www.example.com. 3600 IN A 192.0.2.1");
+    test_ixfrjournal_expect_soa(3, 2);
+    test_ixfrjournal_expect(4, "www.example.com. 3600 IN A 192.0.2.2");
+    test_ixfrjournal_expect_soa(5, 2);
+
+    /* the same change again is not journaled twice */
+    size = test_ixfrjournal_size();
+    CU_ASSERT(test_ixfrjournal_append(1, 2, dels, adds) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(test_ixfrjournal_size(), size);
+
+    /* the next change goes behind it */
+    CU_ASSERT(test_ixfrjournal_append(2, 3, NULL, NULL) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_size() > size);
+    CU_ASSERT(test_ixfrjournal_read(2) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(ldns_rr_list_rr_count(rrs), 4);
+    test_ixfrjournal_expect_soa(0, 3);
+    test_ixfrjournal_expect_soa(1, 2);
+    test_ixfrjournal_expect_soa(2, 3);
+    test_ixfrjournal_expect_soa(3, 3);
+
+    /* a change that does not follow the history starts over */
+    CU_ASSERT(test_ixfrjournal_append(10, 11, NULL, NULL) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_read(2) == ODS_STATUS_REQAXFR);
+    CU_ASSERT(test_ixfrjournal_read(10) == ODS_STATUS_OK);
+    test_ixfrjournal_done();
+}
+
+static void
+test_ixfrjournal_torn(void)
+{
+    const char* adds[] = { "www.example.com. 3600 IN A 192.0.2.1", NULL };
+    uint8_t header[IXFRJOURNAL_HEADER_LEN + 10];
+    long size;
+
+    (void) unlink(TEST_IXFRJOURNAL_FILE);
+    CU_ASSERT(test_ixfrjournal_append(1, 2, NULL, adds) == ODS_STATUS_OK);
+    size = test_ixfrjournal_size();
+
+    /* crash before the length was written */
+    memset(header, 0xaa, sizeof(header));
+    ldns_write_uint32(header, 0);
+    ldns_write_uint32(header + 4, 2);
+    ldns_write_uint32(header + 8, 3);
+    test_ixfrjournal_write(header, sizeof(header));
+    CU_ASSERT(test_ixfrjournal_read(1) == ODS_STATUS_OK);
+    test_ixfrjournal_expect_soa(0, 2);
+    CU_ASSERT(test_ixfrjournal_read(2) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(ldns_rr_list_rr_count(rrs), 1);
+
+    /* the next append overwrites the torn entry */
+    CU_ASSERT(test_ixfrjournal_append(2, 3, NULL, NULL) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_read(1) == ODS_STATUS_OK);
+    test_ixfrjournal_expect_soa(0, 3);
+    test_ixfrjournal_expect(3, "www.example.com. 3600 IN A 192.0.2.1");
+    CU_ASSERT(test_ixfrjournal_size() > size);
+    size = test_ixfrjournal_size();
+
+    /* an entry that runs past the end of the file */
+    ldns_write_uint32(header, 100);
+    ldns_write_uint32(header + 4, 3);
+    ldns_write_uint32(header + 8, 4);
+    test_ixfrjournal_write(header, sizeof(header));
+    CU_ASSERT(test_ixfrjournal_read(3) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(ldns_rr_list_rr_count(rrs), 1);
+    CU_ASSERT(test_ixfrjournal_read(4) == ODS_STATUS_REQAXFR);
+    CU_ASSERT(test_ixfrjournal_append(3, 4, NULL, NULL) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_read(1) == ODS_STATUS_OK);
+    test_ixfrjournal_expect_soa(0, 4);
+    CU_ASSERT(test_ixfrjournal_size() > size);
+
+    /* a file that is not a journal */
+    (void) unlink(TEST_IXFRJOURNAL_FILE);
+    test_ixfrjournal_write((const uint8_t*) "garbage\n", 8);
+    CU_ASSERT(test_ixfrjournal_read(1) != ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_append(1, 2, NULL, adds) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_read(1) == ODS_STATUS_OK);
+    test_ixfrjournal_done();
+}
+
+static void
+test_ixfrjournal_condense(void)
+{
+    const char* dels2[] = { "old.example.com. 3600 IN A 192.0.2.9", NULL };
+    const char* adds2[] = { "www.example.com. 3600 IN A 192.0.2.1",
+        "mail.example.com. 3600 IN A 192.0.2.3", NULL };
+    const char* dels3[] = { "www.example.com. 3600 IN A 192.0.2.1", NULL };
+    const char* adds3[] = { "www.example.com. 3600 IN A 192.0.2.2",
+        "old.example.com. 3600 IN A 192.0.2.9", NULL };
+    const char* dels4[] = { "www.example.com. 3600 IN A 192.0.2.2", NULL };
+    const char* adds4[] = { "www.example.com. 300 IN A 192.0.2.2", NULL };
+
+    (void) unlink(TEST_IXFRJOURNAL_FILE);
+    CU_ASSERT(test_ixfrjournal_append(1, 2, dels2, adds2) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_append(2, 3, dels3, adds3) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_append(3, 4, dels4, adds4) == ODS_STATUS_OK);
+
+    /* added and removed again, removed and added again: gone */
+    CU_ASSERT(test_ixfrjournal_read(1) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(ldns_rr_list_rr_count(rrs), 6);
+    test_ixfrjournal_expect_soa(0, 4);
+    test_ixfrjournal_expect_soa(1, 1);
+    test_ixfrjournal_expect_soa(2, 4);
+    test_ixfrjournal_expect(3, "mail.example.com. 3600 IN A 192.0.2.3");
+    /* a TTL change is a change */
+    test_ixfrjournal_expect(4, "www.example.com. 300 IN A 192.0.2.2");
+    test_ixfrjournal_expect_soa(5, 4);
+
+    CU_ASSERT(test_ixfrjournal_read(3) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(ldns_rr_list_rr_count(rrs), 6);
+    test_ixfrjournal_expect_soa(1, 3);
+    test_ixfrjournal_expect(2, "www.example.com. 3600 IN A 192.0.2.2");
+    test_ixfrjournal_expect_soa(3, 4);
+    test_ixfrjournal_expect(4, "www.example.com. 300 IN A 192.0.2.2");
+    test_ixfrjournal_done();
+}
+
+static void
+test_ixfrjournal_serve(void)
+{
+    const char* adds[] = { "www.example.com. 3600 IN A 192.0.2.1", NULL };
+
+    /* no journal */
+    (void) unlink(TEST_IXFRJOURNAL_FILE);
+    CU_ASSERT(test_ixfrjournal_read(1) != ODS_STATUS_OK);
+    CU_ASSERT_PTR_NULL(rrs);
+
+    CU_ASSERT(test_ixfrjournal_append(1, 2, NULL, adds) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_append(2, 3, NULL, NULL) == ODS_STATUS_OK);
+    /* up to date: only the newest SOA */
+    CU_ASSERT(test_ixfrjournal_read(3) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(ldns_rr_list_rr_count(rrs), 1);
+    test_ixfrjournal_expect_soa(0, 3);
+    /* older or newer than the journal: AXFR */
+    CU_ASSERT(test_ixfrjournal_read(0) == ODS_STATUS_REQAXFR);
+    CU_ASSERT_PTR_NULL(rrs);
+    CU_ASSERT(test_ixfrjournal_read(4) == ODS_STATUS_REQAXFR);
+
+    /* the oldest changes are dropped when the journal is full */
+    ixfrjournal_set_depth(2);
+    CU_ASSERT(test_ixfrjournal_append(3, 4, NULL, NULL) == ODS_STATUS_OK);
+    CU_ASSERT(test_ixfrjournal_read(1) == ODS_STATUS_REQAXFR);
+    CU_ASSERT(test_ixfrjournal_read(2) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(ldns_rr_list_rr_count(rrs), 4);
+    test_ixfrjournal_expect_soa(0, 4);
+    test_ixfrjournal_expect_soa(1, 2);
+
+    /* no journal is kept at depth 0 */
+    ixfrjournal_set_depth(0);
+    CU_ASSERT(test_ixfrjournal_append(4, 5, NULL, NULL) == ODS_STATUS_OK);
+    CU_ASSERT_EQUAL(test_ixfrjournal_size(), -1);
+    test_ixfrjournal_done();
+}
+
+static int
+test_ixfrjournal_add_tests(CU_pSuite pSuite)
+{
+    if (!CU_add_test(pSuite, "append", test_ixfrjournal_appending)
+        || !CU_add_test(pSuite, "torn write recovery", test_ixfrjournal_torn)
+        || !CU_add_test(pSuite, "condensed changes",
+            test_ixfrjournal_condense)
+        || !CU_add_test(pSuite, "serve IXFR", test_ixfrjournal_serve))
+    {
+        return CU_get_error();
+    }
+    return 0;
+}
+
+int
+test_ixfrjournal_add_suite(void)
+{
+    CU_pSuite pSuite = NULL;
+    pSuite = CU_add_suite("Test of IXFR journal",
+        test_ixfrjournal_init_suite, test_ixfrjournal_clean_suite);
+    if (!pSuite) {
+        return CU_get_error();
+    }
+    return test_ixfrjournal_add_tests(pSuite);
+}
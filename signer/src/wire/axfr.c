@@ -34,16 +34,392 @@
 #include "adapter/adutil.h"
 #include "file.h"
 #include "util.h"
+#include "signer/ixfrjournal.h"
 #include "wire/axfr.h"
 #include "wire/buffer.h"
 #include "wire/edns.h"
 #include "wire/query.h"
 #include "wire/sock.h"
 
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #define AXFR_TSIG_SIGN_EVERY_NTH 96 /* tsig sign every N packets. */
+#define AXFR_WIRE_MESSAGE_LEN (AXFR_MAX_MESSAGE_LEN - AXFR_WIRE_RESERVE)
+#define AXFR_WIRE_BUCKETS 1024
+#define AXFR_WIRE_NAMES 4096
 
 const char* axfr_str = "axfr";
 
+/**
+ * Wire format AXFR snapshot writer.
+ *
+ */
+typedef struct axfr_wire_struct axfr_wire_type;
+struct axfr_wire_struct {
+    FILE* fd;
+    size_t base; /* message offset of the answer section */
+    size_t len;
+    size_t maxlen;
+    uint16_t ancount;
+    /* compression table: names written in the current message */
+    uint16_t buckets[AXFR_WIRE_BUCKETS];
+    uint16_t names[AXFR_WIRE_NAMES]; /* message offsets */
+    uint16_t chain[AXFR_WIRE_NAMES];
+    uint16_t hashes[AXFR_WIRE_NAMES];
+    size_t count;
+    uint8_t msg[AXFR_WIRE_MESSAGE_LEN];
+    unsigned full : 1;
+    unsigned error : 1;
+};
+
+
+/**
+ * Hash uncompressed domain name.
+ *
+ */
+static uint16_t
+axfr_wire_hash(const uint8_t* name, size_t len)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        h = (h ^ name[i]) * 16777619U;
+    }
+    return (uint16_t) (h % AXFR_WIRE_BUCKETS);
+}
+
+
+/**
+ * Compare uncompressed domain name with name in the message.
+ *
+ */
+static int
+axfr_wire_name_equal(axfr_wire_type* w, size_t offset, const uint8_t* name,
+    size_t len)
+{
+    size_t i = 0, pos;
+    uint8_t label;
+    while (offset >= w->base && offset - w->base < w->len) {
+        pos = offset - w->base;
+        label = w->msg[pos];
+        if ((label & 0xc0) == 0xc0) {
+            offset = ((size_t) (label & 0x3f) << 8) | w->msg[pos + 1];
+            continue;
+        }
+        if (i >= len || name[i] != label) {
+            return 0;
+        }
+        if (label == 0) {
+            return 1;
+        }
+        if (i + label >= len || pos + label >= w->len ||
+            memcmp(&w->msg[pos + 1], &name[i + 1], label) != 0) {
+            return 0;
+        }
+        i += label + 1;
+        offset += label + 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Write domain name to the message, compressed if allowed.
+ *
+ */
+static void
+axfr_wire_name(axfr_wire_type* w, ldns_rdf* dname, int compress)
+{
+    const uint8_t* name = ldns_rdf_data(dname);
+    size_t len = ldns_rdf_size(dname);
+    size_t i = 0, offset;
+    uint16_t h, n;
+    while (i < len && name[i] != 0) {
+        h = axfr_wire_hash(&name[i], len - i);
+        if (compress) {
+            for (n = w->buckets[h]; n; n = w->chain[n - 1]) {
+                if (w->hashes[n - 1] == h &&
+                    axfr_wire_name_equal(w, w->names[n - 1], &name[i],
+                        len - i)) {
+                    if (w->len + 2 > sizeof(w->msg)) {
+                        w->full = 1;
+                        return;
+                    }
+                    w->msg[w->len++] = 0xc0 | (w->names[n - 1] >> 8);
+                    w->msg[w->len++] = w->names[n - 1] & 0xff;
+                    return;
+                }
+            }
+        }
+        offset = w->base + w->len;
+        if (offset < MAX_COMPRESSION_OFFSET && w->count < AXFR_WIRE_NAMES) {
+            w->names[w->count] = (uint16_t) offset;
+            w->hashes[w->count] = h;
+            w->chain[w->count] = w->buckets[h];
+            w->buckets[h] = (uint16_t) ++w->count;
+        }
+        if (w->len + name[i] + 1 > sizeof(w->msg)) {
+            w->full = 1;
+            return;
+        }
+        memcpy(&w->msg[w->len], &name[i], name[i] + 1);
+        w->len += name[i] + 1;
+        i += name[i] + 1;
+    }
+    if (w->len + 1 > sizeof(w->msg)) {
+        w->full = 1;
+        return;
+    }
+    w->msg[w->len++] = 0;
+}
+
+
+/**
+ * Write message to the snapshot and start a new one.
+ *
+ */
+static void
+axfr_wire_flush(axfr_wire_type* w)
+{
+    uint8_t hdr[6];
+    if (!w->ancount) {
+        return;
+    }
+    ldns_write_uint16(hdr, (uint16_t) w->base);
+    ldns_write_uint16(hdr + 2, w->ancount);
+    ldns_write_uint16(hdr + 4, (uint16_t) w->len);
+    if (fwrite(hdr, 1, sizeof(hdr), w->fd) != sizeof(hdr) ||
+        fwrite(w->msg, 1, w->len, w->fd) != w->len) {
+        w->error = 1;
+    }
+    if (w->base + w->len > w->maxlen) {
+        w->maxlen = w->base + w->len;
+    }
+    w->base = BUFFER_PKT_HEADER_SIZE;
+    w->len = 0;
+    w->ancount = 0;
+    w->count = 0;
+    memset(w->buckets, 0, sizeof(w->buckets));
+}
+
+
+/**
+ * Add RR to the snapshot.
+ *
+ */
+static void
+axfr_wire_rr(axfr_wire_type* w, ldns_rr* rr)
+{
+    size_t mark_len, mark_count, rdlength_pos, i;
+    int compress = 0;
+    ldns_rdf* rdf = NULL;
+
+    if (w->error) {
+        return;
+    }
+    /* names in the RDATA of these types may be compressed (RFC 3597) */
+    switch (ldns_rr_get_type(rr)) {
+        case LDNS_RR_TYPE_NS:
+        case LDNS_RR_TYPE_MD:
+        case LDNS_RR_TYPE_MF:
+        case LDNS_RR_TYPE_CNAME:
+        case LDNS_RR_TYPE_SOA:
+        case LDNS_RR_TYPE_MB:
+        case LDNS_RR_TYPE_MG:
+        case LDNS_RR_TYPE_MR:
+        case LDNS_RR_TYPE_PTR:
+        case LDNS_RR_TYPE_MINFO:
+        case LDNS_RR_TYPE_MX:
+            compress = 1;
+            break;
+        default:
+            break;
+    }
+    while (1) {
+        mark_len = w->len;
+        mark_count = w->count;
+        w->full = 0;
+        axfr_wire_name(w, ldns_rr_owner(rr), 1);
+        if (!w->full && w->len + 10 <= sizeof(w->msg) &&
+            w->base + w->len + 10 <= AXFR_WIRE_MESSAGE_LEN) {
+            ldns_write_uint16(&w->msg[w->len], ldns_rr_get_type(rr));
+            ldns_write_uint16(&w->msg[w->len + 2], ldns_rr_get_class(rr));
+            ldns_write_uint32(&w->msg[w->len + 4], ldns_rr_ttl(rr));
+            rdlength_pos = w->len + 8;
+            w->len += 10;
+            for (i = 0; !w->full && i < ldns_rr_rd_count(rr); i++) {
+                rdf = ldns_rr_rdf(rr, i);
+                if (ldns_rdf_get_type(rdf) == LDNS_RDF_TYPE_DNAME) {
+                    axfr_wire_name(w, rdf, compress);
+                } else if (w->len + ldns_rdf_size(rdf) > sizeof(w->msg)) {
+                    w->full = 1;
+                } else {
+                    memcpy(&w->msg[w->len], ldns_rdf_data(rdf),
+                        ldns_rdf_size(rdf));
+                    w->len += ldns_rdf_size(rdf);
+                }
+            }
+            if (!w->full && w->base + w->len <= AXFR_WIRE_MESSAGE_LEN) {
+                ldns_write_uint16(&w->msg[rdlength_pos],
+                    (uint16_t) (w->len - rdlength_pos - 2));
+                w->ancount++;
+                return;
+            }
+        }
+        /* does not fit: forget the names, and continue in a new message */
+        while (w->count > mark_count) {
+            w->count--;
+            w->buckets[w->hashes[w->count]] = w->chain[w->count];
+        }
+        w->len = mark_len;
+        if (!w->ancount) {
+            log_rr(rr, "RR does not fit in axfr message", LOG_ERR);
+            w->error = 1;
+            return;
+        }
+        axfr_wire_flush(w);
+        if (w->error) {
+            return;
+        }
+    }
+}
+
+
+/**
+ * Add RRset to the snapshot.
+ *
+ */
+static void
+axfr_wire_rrset(axfr_wire_type* w, rrset_type* rrset, int skip_rrsigs)
+{
+    rrsig_type* rrsig = NULL;
+    ldns_rr* rr = NULL;
+    size_t i;
+    for (i = 0; i < rrset->rr_count; i++) {
+        if (rrset->rrs[i].exists) {
+            rr = rrset_rr2ldns(rrset, &rrset->rrs[i]);
+            axfr_wire_rr(w, rr);
+            ldns_rr_free(rr);
+            if (rrset->rrtype == LDNS_RR_TYPE_CNAME ||
+                rrset->rrtype == LDNS_RR_TYPE_DNAME) {
+                /* singleton types */
+                break;
+            }
+        }
+    }
+    if (!skip_rrsigs) {
+        while ((rrsig = collection_iterator(rrset->rrsigs))) {
+            rr = rrset_rrsig2ldns(rrset, rrsig);
+            axfr_wire_rr(w, rr);
+            ldns_rr_free(rr);
+        }
+    }
+}
+
+
+/**
+ * Add domain to the snapshot, in the order of the zone file.
+ *
+ */
+static void
+axfr_wire_domain(axfr_wire_type* w, domain_type* domain)
+{
+    rrset_type* rrset = NULL;
+    rrset_type* soa_rrset = NULL;
+    if (domain->rrsets) {
+        rrset = domain_lookup_rrset(domain, LDNS_RR_TYPE_CNAME);
+        if (rrset) {
+            axfr_wire_rrset(w, rrset, 0);
+        } else {
+            if (domain->is_apex) {
+                soa_rrset = domain_lookup_rrset(domain, LDNS_RR_TYPE_SOA);
+                if (soa_rrset) {
+                    axfr_wire_rrset(w, soa_rrset, 0);
+                }
+            }
+            for (rrset = domain->rrsets; rrset; rrset = rrset->next) {
+                if (rrset->rrtype != LDNS_RR_TYPE_SOA) {
+                    axfr_wire_rrset(w, rrset, 0);
+                }
+            }
+        }
+    }
+    if (domain->denial && ((denial_type*) domain->denial)->rrset) {
+        axfr_wire_rrset(w, ((denial_type*) domain->denial)->rrset, 0);
+    }
+}
+
+
+/**
+ * Write wire format AXFR snapshot.
+ *
+ */
+ods_status
+axfr_write_wire(FILE* fd, zone_type* zone)
+{
+    axfr_wire_type* w = NULL;
+    rrset_type* soa_rrset = NULL;
+    ldns_rr* soa = NULL;
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    uint8_t hdr[AXFR_WIRE_HEADER_LEN];
+    size_t i;
+    ods_status status = ODS_STATUS_OK;
+
+    ods_log_assert(fd);
+    ods_log_assert(zone);
+    ods_log_assert(zone->db);
+    soa_rrset = zone_lookup_rrset(zone, zone->apex, LDNS_RR_TYPE_SOA);
+    for (i = 0; soa_rrset && i < soa_rrset->rr_count; i++) {
+        if (soa_rrset->rrs[i].exists) {
+            soa = rrset_rr2ldns(soa_rrset, &soa_rrset->rrs[i]);
+            break;
+        }
+    }
+    if (!soa) {
+        ods_log_error("[%s] unable to write axfr snapshot zone %s: no soa",
+            axfr_str, zone->name);
+        return ODS_STATUS_ERR;
+    }
+    CHECKALLOC(w = (axfr_wire_type*) calloc(1, sizeof(axfr_wire_type)));
+    w->fd = fd;
+    w->base = BUFFER_PKT_HEADER_SIZE + ldns_rdf_size(zone->apex) +
+        2 * sizeof(uint16_t);
+    /* header, with the message length filled in at the end */
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, AXFR_WIRE_MAGIC, AXFR_WIRE_MAGIC_LEN);
+    ldns_write_uint32(hdr + 8, ldns_rdf2native_int32(
+        ldns_rr_rdf(soa, SE_SOA_RDATA_SERIAL)));
+    ldns_write_uint32(hdr + 12, ldns_rdf2native_int32(
+        ldns_rr_rdf(soa, SE_SOA_RDATA_EXPIRE)));
+    ldns_rr_free(soa);
+    if (fwrite(hdr, 1, sizeof(hdr), fd) != sizeof(hdr)) {
+        w->error = 1;
+    }
+    for (node = ldns_rbtree_first(zone->db->domains);
+         node && node != LDNS_RBTREE_NULL; node = ldns_rbtree_next(node)) {
+        if (node->data) {
+            axfr_wire_domain(w, (domain_type*) node->data);
+        }
+    }
+    /* closing SOA */
+    axfr_wire_rrset(w, soa_rrset, 1);
+    axfr_wire_flush(w);
+    ldns_write_uint16(hdr + 16, (uint16_t) w->maxlen);
+    if (!w->error && (fseek(fd, 16, SEEK_SET) != 0 ||
+        fwrite(hdr + 16, 1, 2, fd) != 2 || fflush(fd) != 0)) {
+        w->error = 1;
+    }
+    if (w->error) {
+        status = ODS_STATUS_FWRITE_ERR;
+    }
+    free(w);
+    return status;
+}
+
 
 /**
  * Handle SOA request.
@@ -144,6 +520,137 @@ soa_request(query_type* q, engine_type* engine)
 }
 
 
+/**
+ * Map the wire format AXFR snapshot, if it can be used for this transfer.
+ *
+ */
+static int
+axfr_wire_open(query_type* q)
+{
+    char* xfrfile = NULL;
+    struct stat st;
+    uint8_t* map = NULL;
+    size_t maplen = 0;
+    time_t expire = 0;
+    int fd = -1;
+
+    xfrfile = ods_build_path(q->zone->name, ".axfr.wire", 0, 1);
+    if (xfrfile) {
+        fd = open(xfrfile, O_RDONLY);
+    }
+    free((void*)xfrfile);
+    if (fd == -1) {
+        return 0;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size >= AXFR_WIRE_HEADER_LEN + 2) {
+        maplen = (size_t) st.st_size;
+        map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (!map || map == MAP_FAILED) {
+        return 0;
+    }
+    if (memcmp(map, AXFR_WIRE_MAGIC, AXFR_WIRE_MAGIC_LEN) != 0) {
+        ods_log_warning("[%s] bad axfr snapshot zone %s, using axfr file",
+            axfr_str, q->zone->name);
+        munmap(map, maplen);
+        return 0;
+    }
+    /* expired zones are refused by the text path */
+    if (q->zone->xfrd) {
+        expire = q->zone->xfrd->serial_xfr_acquired;
+        expire += ldns_read_uint32(map + 12);
+        if (expire < time_now()) {
+            munmap(map, maplen);
+            return 0;
+        }
+    }
+    /* the first message must follow the question */
+    if (ldns_read_uint16(map + AXFR_WIRE_HEADER_LEN) !=
+        buffer_position(q->buffer)) {
+        munmap(map, maplen);
+        return 0;
+    }
+    if (ldns_read_uint16(map + 16) + q->reserved_space > q->maxlen) {
+        ods_log_debug("[%s] axfr snapshot zone %s leaves no room for "
+            "tsig, using axfr file", axfr_str, q->zone->name);
+        munmap(map, maplen);
+        return 0;
+    }
+    (void) madvise(map, maplen, MADV_SEQUENTIAL);
+    q->axfr_map = map;
+    q->axfr_maplen = maplen;
+    q->axfr_mapoff = AXFR_WIRE_HEADER_LEN;
+    q->axfr_wire = 1;
+    return 1;
+}
+
+
+/**
+ * Add next message from the wire format AXFR snapshot. The answer
+ * section is not copied into the packet buffer, but written to the
+ * socket straight from the snapshot.
+ *
+ */
+static query_state
+axfr_wire_message(query_type* q)
+{
+    const uint8_t* hdr = NULL;
+    uint16_t ancount = 0, len = 0;
+
+    q->axfr_data = NULL;
+    q->axfr_data_len = 0;
+    if (q->axfr_maplen - q->axfr_mapoff < 6) {
+        ods_log_error("[%s] bad axfr snapshot zone %s, corrupted file",
+            axfr_str, q->zone->name);
+        goto axfr_wire_error;
+    }
+    hdr = q->axfr_map + q->axfr_mapoff;
+    ancount = ldns_read_uint16(hdr + 2);
+    len = ldns_read_uint16(hdr + 4);
+    if (ldns_read_uint16(hdr) != buffer_position(q->buffer) ||
+        q->axfr_maplen - q->axfr_mapoff - 6 < len) {
+        ods_log_error("[%s] bad axfr snapshot zone %s, corrupted file",
+            axfr_str, q->zone->name);
+        goto axfr_wire_error;
+    }
+    if (buffer_position(q->buffer) + len + q->reserved_space > q->maxlen) {
+        ods_log_error("[%s] axfr snapshot message does not fit zone %s",
+            axfr_str, q->zone->name);
+        goto axfr_wire_error;
+    }
+    q->axfr_data = hdr + 6;
+    q->axfr_data_len = len;
+    q->axfr_data_pos = buffer_position(q->buffer);
+    q->axfr_mapoff += 6 + len;
+    if (q->axfr_mapoff == q->axfr_maplen) {
+        /* the mapping is released with the query */
+        ods_log_debug("[%s] axfr zone %s is done", axfr_str, q->zone->name);
+        q->tsig_sign_it = 1; /* sign last packet */
+        q->axfr_is_done = 1;
+    }
+    buffer_pkt_set_aa(q->buffer);
+    buffer_pkt_set_ancount(q->buffer, ancount);
+    buffer_pkt_set_nscount(q->buffer, 0);
+    buffer_pkt_set_arcount(q->buffer, 0);
+    /* check if it needs TSIG signatures */
+    if (q->tsig_rr->status == TSIG_OK) {
+        if (q->tsig_rr->update_since_last_prepare >=
+            AXFR_TSIG_SIGN_EVERY_NTH) {
+            q->tsig_sign_it = 1;
+        }
+    }
+    return QUERY_AXFR;
+
+axfr_wire_error:
+    buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+    munmap(q->axfr_map, q->axfr_maplen);
+    q->axfr_map = NULL;
+    q->axfr_wire = 0;
+    return QUERY_PROCESSED;
+}
+
+
 /**
  * Do AXFR.
  *
@@ -168,6 +675,8 @@ axfr(query_type* q, engine_type* engine, int fallback)
     ods_log_assert(q->zone);
     ods_log_assert(q->zone->name);
     ods_log_assert(engine);
+    q->axfr_data = NULL;
+    q->axfr_data_len = 0;
     if (q->axfr_is_done) {
         ods_log_debug("[%s] zone transfer %s completed", axfr_str,
             q->zone->name);
@@ -187,7 +696,22 @@ axfr(query_type* q, engine_type* engine, int fallback)
         }
     }
     ods_log_assert(q->tsig_rr);
-    if (q->axfr_fd == NULL) {
+    if (q->axfr_wire) {
+        /* subsequent AXFR packets from the snapshot */
+        ods_log_debug("[%s] subsequent axfr packet zone %s", axfr_str,
+            q->zone->name);
+        q->edns_rr->status = EDNS_NOT_PRESENT;
+        buffer_set_limit(q->buffer, BUFFER_PKT_HEADER_SIZE);
+        buffer_pkt_set_qdcount(q->buffer, 0);
+        query_prepare(q);
+        return axfr_wire_message(q);
+    } else if (q->axfr_fd == NULL && q->tcp && axfr_wire_open(q)) {
+        /* start AXFR from the snapshot */
+        if (q->tsig_rr->status == TSIG_OK) {
+            q->tsig_sign_it = 1; /* sign first packet in stream */
+        }
+        return axfr_wire_message(q);
+    } else if (q->axfr_fd == NULL) {
         /* start AXFR */
         xfrfile = ods_build_path(q->zone->name, ".axfr", 0, 1);
         if (xfrfile) {
@@ -382,7 +906,7 @@ udp_overflow:
 
 
 /**
- * Do IXFR (equal to AXFR for now).
+ * Do IXFR, from the journal.
  *
  */
 query_state
@@ -390,19 +914,10 @@ ixfr(query_type* q, engine_type* engine)
 {
     char* xfrfile = NULL;
     ldns_rr* rr = NULL;
-    ldns_rdf* prev = NULL;
-    ldns_rdf* orig = NULL;
     uint16_t total_added = 0;
-    uint32_t ttl = 0;
     time_t expire = 0;
-    ldns_status status = LDNS_STATUS_OK;
-    char line[SE_ADFILE_MAXLINE];
-    unsigned l = 0;
-    long fpos = 0;
     size_t bufpos = 0;
-    uint32_t new_serial = 0;
-    unsigned del_mode = 0;
-    unsigned soa_found = 0;
+    ods_status status = ODS_STATUS_OK;
     ods_log_assert(engine);
     ods_log_assert(q);
     ods_log_assert(q->buffer);
@@ -422,56 +937,40 @@ ixfr(query_type* q, engine_type* engine)
         q->tsig_sign_it = 0;
     }
     ods_log_assert(q->tsig_rr);
-    if (q->axfr_fd == NULL) {
+    if (q->ixfr_rrs == NULL) {
         /* start IXFR */
-        xfrfile = ods_build_path(q->zone->name, ".ixfr", 0, 1);
-        if (xfrfile) {
-            q->axfr_fd = ods_fopen(xfrfile, NULL, "r");
+        xfrfile = ods_build_path(q->zone->name, ".ixfr.journal", 0, 1);
+        if (!xfrfile) {
+            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+            return QUERY_PROCESSED;
         }
-        if (!q->axfr_fd) {
-            ods_log_error("[%s] unable to open ixfr file %s for zone %s",
-                axfr_str, xfrfile, q->zone->name);
+        /* the journal is not appended to while it is condensed */
+        pthread_mutex_lock(&q->zone->xfr_lock);
+        status = ixfrjournal_read(xfrfile, q->serial, &q->ixfr_rrs);
+        pthread_mutex_unlock(&q->zone->xfr_lock);
+        free((void*)xfrfile);
+        if (status != ODS_STATUS_OK) {
+            if (status == ODS_STATUS_REQAXFR) {
+                ods_log_warning("[%s] zone %s journal not found for serial "
+                    "%u", axfr_str, q->zone->name, q->serial);
+            } else {
+                ods_log_error("[%s] unable to read ixfr journal for zone %s "
+                    "(%s)", axfr_str, q->zone->name,
+                    ods_status2str(status));
+            }
             ods_log_info("[%s] axfr fallback zone %s", axfr_str,
                 q->zone->name);
-            free((void*)xfrfile);
             buffer_set_position(q->buffer, q->startpos);
             return axfr(q, engine, 1);
         }
-        free((void*)xfrfile);
+        q->ixfr_pos = 0;
         if (q->tsig_rr->status == TSIG_OK) {
             q->tsig_sign_it = 1; /* sign first packet in stream */
         }
         /* compression? */
 
-        /* add SOA RR */
-        fpos = ftell(q->axfr_fd);
-        if (fpos < 0) {
-            ods_log_error("[%s] unable to read ixfr for zone %s: ftell() "
-                "failed (%s)", axfr_str, q->zone->name, strerror(errno));
-            ods_log_info("[%s] axfr fallback zone %s", axfr_str,
-                q->zone->name);
-            ods_fclose(q->axfr_fd);
-            q->axfr_fd = NULL;
-            buffer_set_position(q->buffer, q->startpos);
-            return axfr(q, engine, 1);
-        }
-        rr = addns_read_rr(q->axfr_fd, line, &orig, &prev, &ttl, &status,
-            &l);
-        if (!rr) {
-            /* no SOA no transfer */
-            ods_log_error("[%s] bad ixfr zone %s, corrupted file",
-                axfr_str, q->zone->name);
-            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
-            return QUERY_PROCESSED;
-        }
-        /* first RR must be SOA */
-        if (ldns_rr_get_type(rr) != LDNS_RR_TYPE_SOA) {
-            ods_log_error("[%s] bad ixfr zone %s, first rr is not soa",
-                axfr_str, q->zone->name);
-            ldns_rr_free(rr);
-            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
-            return QUERY_PROCESSED;
-        }
+        /* first RR is the newest SOA */
+        rr = ldns_rr_list_rr(q->ixfr_rrs, 0);
         /* zone not expired? */
         if (q->zone->xfrd) {
             expire = q->zone->xfrd->serial_xfr_acquired;
@@ -479,16 +978,12 @@ ixfr(query_type* q, engine_type* engine)
             if (expire < time_now()) {
                 ods_log_warning("[%s] zone %s expired, not transferring zone",
                     axfr_str, q->zone->name);
-                ldns_rr_free(rr);
                 buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
-                ods_fclose(q->axfr_fd);
-                q->axfr_fd = NULL;
+                ldns_rr_list_deep_free(q->ixfr_rrs);
+                q->ixfr_rrs = NULL;
                 return QUERY_PROCESSED;
             }
         }
-        /* newest serial */
-        new_serial = ldns_rdf2native_int32(
-            ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
         /* does it fit? */
         buffer_set_position(q->buffer, q->startpos);
         if (query_add_rr(q, rr)) {
@@ -496,20 +991,16 @@ ixfr(query_type* q, engine_type* engine)
                 q->zone->name);
             buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
             total_added++;
-            ldns_rr_free(rr);
-            rr = NULL;
+            q->ixfr_pos++;
             bufpos = buffer_position(q->buffer);
         } else {
             ods_log_error("[%s] soa does not fit in ixfr zone %s",
                 axfr_str, q->zone->name);
-            ldns_rr_free(rr);
-            rr = NULL;
+            ldns_rr_list_deep_free(q->ixfr_rrs);
+            q->ixfr_rrs = NULL;
             buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
             return QUERY_PROCESSED;
         }
-        if (util_serial_gt(q->serial, new_serial)) {
-            goto axfr_fallback;
-        }
     } else if (q->tcp) {
         /* subsequent IXFR packets */
         ods_log_debug("[%s] subsequent ixfr packet zone %s", axfr_str,
@@ -517,91 +1008,35 @@ ixfr(query_type* q, engine_type* engine)
         buffer_set_limit(q->buffer, BUFFER_PKT_HEADER_SIZE);
         buffer_pkt_set_qdcount(q->buffer, 0);
         query_prepare(q);
-        soa_found = 1;
     }
 
     /* add as many records as fit */
-    fpos = ftell(q->axfr_fd);
-    if (fpos < 0) {
-        ods_log_error("[%s] unable to read ixfr for zone %s: ftell() failed "
-            "(%s)", axfr_str, q->zone->name, strerror(errno));
-        ods_log_info("[%s] axfr fallback zone %s", axfr_str,
-            q->zone->name);
-        ods_fclose(q->axfr_fd);
-        q->axfr_fd = NULL;
-        buffer_set_position(q->buffer, q->startpos);
-        return axfr(q, engine, 1);
-    }
-    while ((rr = addns_read_rr(q->axfr_fd, line, &orig, &prev, &ttl,
-        &status, &l)) != NULL) {
-        ods_log_deeebug("[%s] read rr at line %d", axfr_str, l);
-        if (status != LDNS_STATUS_OK) {
-            ldns_rr_free(rr);
-            rr = NULL;
-            ods_log_error("[%s] error reading rr at line %i (%s): %s",
-                axfr_str, l, ldns_get_errorstr_by_id(status), line);
-            goto axfr_fallback;
-        }
-        if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
-            del_mode = !del_mode;
-        }
-        if (!soa_found) {
-            if (del_mode && ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA &&
-                q->serial == ldns_rdf2native_int32(
-                ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL))) {
-                soa_found = 1;
-            } else {
-                ods_log_deeebug("[%s] soa serial %u not found for rr at line %d",
-                    axfr_str, q->serial, l);
-                ldns_rr_free(rr);
-                rr = NULL;
-                continue;
-            }
-        }
-        /* does it fit? */
-        if (query_add_rr(q, rr)) {
-            ods_log_deeebug("[%s] add rr at line %d", axfr_str, l);
-            ldns_rr_free(rr);
-            rr = NULL;
-            fpos = ftell(q->axfr_fd);
-            if (fpos < 0) {
-                ods_log_error("[%s] unable to read ixfr for zone %s: ftell() "
-                    "failed (%s)", axfr_str, q->zone->name, strerror(errno));
-                ods_log_info("[%s] axfr fallback zone %s", axfr_str,
-                    q->zone->name);
-                ods_fclose(q->axfr_fd);
-                q->axfr_fd = NULL;
-                buffer_set_position(q->buffer, q->startpos);
-                return axfr(q, engine, 1);
-            }
-            buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
-            total_added++;
-        } else {
-            ods_log_deeebug("[%s] rr at line %d does not fit", axfr_str, l);
-            ldns_rr_free(rr);
-            rr = NULL;
-            if (fseek(q->axfr_fd, fpos, SEEK_SET) != 0) {
-                ods_log_error("[%s] unable to reset file position in ixfr "
-                    "file: fseek() failed (%s)", axfr_str, strerror(errno));
-                buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
-                return QUERY_PROCESSED;
-            } else if (q->tcp) {
+    while (q->ixfr_pos < ldns_rr_list_rr_count(q->ixfr_rrs)) {
+        rr = ldns_rr_list_rr(q->ixfr_rrs, q->ixfr_pos);
+        if (!query_add_rr(q, rr)) {
+            ods_log_deeebug("[%s] rr %u does not fit", axfr_str,
+                (unsigned) q->ixfr_pos);
+            if (!q->tcp) {
+                goto udp_overflow;
+            } else if (total_added) {
                 goto return_ixfr;
-            } else {
-                goto axfr_fallback;
             }
+            ods_log_error("[%s] rr %u does not fit in empty ixfr packet "
+                "zone %s", axfr_str, (unsigned) q->ixfr_pos, q->zone->name);
+            ldns_rr_list_deep_free(q->ixfr_rrs);
+            q->ixfr_rrs = NULL;
+            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+            return QUERY_PROCESSED;
         }
-    }
-    if (!soa_found) {
-        ods_log_warning("[%s] zone %s journal not found for serial %u",
-            axfr_str, q->zone->name, q->serial);
-        goto axfr_fallback;
+        buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
+        total_added++;
+        q->ixfr_pos++;
     }
     ods_log_debug("[%s] ixfr zone %s is done", axfr_str, q->zone->name);
     q->tsig_sign_it = 1; /* sign last packet */
     q->axfr_is_done = 1;
-    ods_fclose(q->axfr_fd);
-    q->axfr_fd = NULL;
+    ldns_rr_list_deep_free(q->ixfr_rrs);
+    q->ixfr_rrs = NULL;
 
 return_ixfr:
     ods_log_debug("[%s] return part ixfr zone %s", axfr_str, q->zone->name);
@@ -617,18 +1052,10 @@ return_ixfr:
     }
     return QUERY_IXFR;
 
-axfr_fallback:
-    if (q->tcp) {
-        ods_log_info("[%s] axfr fallback zone %s", axfr_str, q->zone->name);
-        if (q->axfr_fd) {
-            ods_fclose(q->axfr_fd);
-            q->axfr_fd = NULL;
-        }
-        buffer_set_position(q->buffer, q->startpos);
-        return axfr(q, engine, 1);
-    }
-    /* UDP Overflow */
+udp_overflow:
     ods_log_info("[%s] ixfr udp overflow zone %s", axfr_str, q->zone->name);
+    ldns_rr_list_deep_free(q->ixfr_rrs);
+    q->ixfr_rrs = NULL;
     buffer_set_position(q->buffer, bufpos);
     buffer_pkt_set_ancount(q->buffer, 1);
     buffer_pkt_set_nscount(q->buffer, 0);
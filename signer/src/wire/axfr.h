@@ -42,6 +42,31 @@
 #define MAX_COMPRESSION_OFFSET 16383 /* Compression pointers are 14 bit. */
 #define AXFR_MAX_MESSAGE_LEN MAX_COMPRESSION_OFFSET
 
+/**
+ * The wire format AXFR snapshot (<zone>.axfr.wire) holds the answer
+ * sections of the AXFR messages, with name compression applied.  The
+ * header is the magic, the SOA serial and expire (32 bits) and the length
+ * of the largest message (16 bits, followed by 16 unused bits).  Every
+ * message is the offset its answer section starts at, the number of RRs,
+ * the length of the answer section (all 16 bits) and the answer section.
+ * The first message follows the question section, the other messages
+ * follow the header.  Integers are in network byte order.
+ *
+ */
+#define AXFR_WIRE_MAGIC "ODSAXFR1"
+#define AXFR_WIRE_MAGIC_LEN 8
+#define AXFR_WIRE_HEADER_LEN 20
+#define AXFR_WIRE_RESERVE 1024 /* room for EDNS and TSIG */
+
+/**
+ * Write wire format AXFR snapshot.
+ * \param[in] fd file descriptor
+ * \param[in] zone zone
+ * \return ods_status status
+ *
+ */
+ods_status axfr_write_wire(FILE* fd, zone_type* zone);
+
 /**
  * Handle SOA request.
  * \param[in] q soa request
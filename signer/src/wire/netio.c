@@ -13,6 +13,12 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef USE_EPOLL
+#include <limits.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
 #include "log.h"
 #include "wire/netio.h"
 
@@ -30,67 +36,6 @@ int pselect(int n, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
 static const char* netio_str = "netio";
 
 
-/*
- * Create a new netio instance.
- * \return netio_type* netio instance
- *
- */
-netio_type*
-netio_create()
-{
-    netio_type* netio = NULL;
-    CHECKALLOC(netio = (netio_type*) malloc(sizeof(netio_type)));
-    netio->handlers = NULL;
-    netio->dispatch_next = NULL;
-    return netio;
-}
-
-/*
- * Add a new handler to netio.
- *
- */
-void
-netio_add_handler(netio_type* netio, netio_handler_type* handler)
-{
-    netio_handler_list_type* l = NULL;
-
-    ods_log_assert(netio);
-    ods_log_assert(handler);
-
-    CHECKALLOC(l = (netio_handler_list_type*) malloc(sizeof(netio_handler_list_type)));
-    l->next = netio->handlers;
-    l->handler = handler;
-    netio->handlers = l;
-    ods_log_debug("[%s] handler added", netio_str);
-}
-
-/*
- * Remove the handler from netio. Caller is responsible for freeing
- * handler afterwards.
- */
-void
-netio_remove_handler(netio_type* netio, netio_handler_type* handler)
-{
-    netio_handler_list_type** lptr;
-    if (!netio || !handler) {
-        return;
-    }
-    for (lptr = &netio->handlers; *lptr; lptr = &(*lptr)->next) {
-        if ((*lptr)->handler == handler) {
-            netio_handler_list_type* next = (*lptr)->next;
-            if ((*lptr) == netio->dispatch_next) {
-                netio->dispatch_next = next;
-            }
-            (*lptr)->handler = NULL;
-	    free(*lptr);
-            *lptr = next;
-            break;
-        }
-    }
-    ods_log_debug("[%s] handler removed", netio_str);
-}
-
-
 /*
  * Convert timeval to timespec.
  *
@@ -178,6 +123,670 @@ netio_current_time(netio_type* netio)
     return &netio->cached_current_time;
 }
 
+#ifdef USE_EPOLL
+
+/* Maximum number of events taken from the kernel per dispatch.  */
+#define NETIO_EPOLL_EVENTS 64
+/* Initial number of buckets in the handler hash.  */
+#define NETIO_HASH_SIZE 64
+
+
+/**
+ * Hash handler pointer.
+ *
+ */
+static size_t
+netio_hash(netio_type* netio, netio_handler_type* handler)
+{
+    size_t h = (size_t) handler;
+    h ^= h >> 4;
+    h ^= h >> 12;
+    return h & (netio->hash_size - 1);
+}
+
+
+/**
+ * Look up the registration of a handler.
+ *
+ */
+static netio_handler_list_type*
+netio_lookup(netio_type* netio, netio_handler_type* handler)
+{
+    netio_handler_list_type* l = NULL;
+    for (l = netio->hash[netio_hash(netio, handler)]; l; l = l->hash_next) {
+        if (l->handler == handler) {
+            return l;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Add registration to the handler hash, growing the hash if needed.
+ *
+ */
+static void
+netio_hash_insert(netio_type* netio, netio_handler_list_type* l)
+{
+    size_t h;
+    if (netio->hash_count >= netio->hash_size) {
+        netio_handler_list_type** old = netio->hash;
+        size_t old_size = netio->hash_size;
+        size_t i;
+        netio->hash_size *= 2;
+        CHECKALLOC(netio->hash = (netio_handler_list_type**) calloc(
+            netio->hash_size, sizeof(netio_handler_list_type*)));
+        for (i = 0; i < old_size; i++) {
+            while (old[i]) {
+                netio_handler_list_type* next = old[i]->hash_next;
+                h = netio_hash(netio, old[i]->handler);
+                old[i]->hash_next = netio->hash[h];
+                netio->hash[h] = old[i];
+                old[i] = next;
+            }
+        }
+        free(old);
+    }
+    h = netio_hash(netio, l->handler);
+    l->hash_next = netio->hash[h];
+    netio->hash[h] = l;
+    netio->hash_count++;
+}
+
+
+/**
+ * Remove registration from the handler hash.
+ *
+ */
+static void
+netio_hash_delete(netio_type* netio, netio_handler_list_type* l)
+{
+    netio_handler_list_type** lptr;
+    for (lptr = &netio->hash[netio_hash(netio, l->handler)]; *lptr;
+        lptr = &(*lptr)->hash_next) {
+        if (*lptr == l) {
+            *lptr = l->hash_next;
+            l->hash_next = NULL;
+            netio->hash_count--;
+            return;
+        }
+    }
+}
+
+
+/**
+ * Swap two positions in the timer heap.
+ *
+ */
+static void
+netio_heap_swap(netio_type* netio, size_t i, size_t j)
+{
+    netio_handler_list_type* l = netio->heap[i];
+    netio->heap[i] = netio->heap[j];
+    netio->heap[j] = l;
+    netio->heap[i]->heap_idx = i;
+    netio->heap[j]->heap_idx = j;
+}
+
+
+/**
+ * Restore the timer heap after the timeout at position i has changed.
+ *
+ */
+static void
+netio_heap_fix(netio_type* netio, size_t i)
+{
+    size_t child;
+    while (i > 1 && timespec_compare(&netio->heap[i]->timeout,
+        &netio->heap[i/2]->timeout) < 0) {
+        netio_heap_swap(netio, i, i/2);
+        i /= 2;
+    }
+    while ((child = 2*i) <= netio->heap_count) {
+        if (child < netio->heap_count &&
+            timespec_compare(&netio->heap[child+1]->timeout,
+            &netio->heap[child]->timeout) < 0) {
+            child++;
+        }
+        if (timespec_compare(&netio->heap[child]->timeout,
+            &netio->heap[i]->timeout) >= 0) {
+            break;
+        }
+        netio_heap_swap(netio, i, child);
+        i = child;
+    }
+}
+
+
+/**
+ * Remove registration from the timer heap.
+ *
+ */
+static void
+netio_heap_delete(netio_type* netio, netio_handler_list_type* l)
+{
+    size_t i = l->heap_idx;
+    if (!i) {
+        return;
+    }
+    l->heap_idx = 0;
+    if (i == netio->heap_count--) {
+        return;
+    }
+    netio->heap[i] = netio->heap[netio->heap_count + 1];
+    netio->heap[i]->heap_idx = i;
+    netio_heap_fix(netio, i);
+}
+
+
+/**
+ * Stop watching the file descriptor registered for the handler.
+ *
+ */
+static void
+netio_epoll_unwatch(netio_type* netio, netio_handler_list_type* l)
+{
+    if (l->fd < 0) {
+        return;
+    }
+    /* If the descriptor was closed and its number is now watched for
+     * another handler, the kernel already dropped our registration. */
+    if ((size_t) l->fd < netio->fds_size && netio->fds[l->fd] == l) {
+        (void) epoll_ctl(netio->epfd, EPOLL_CTL_DEL, l->fd, NULL);
+        netio->fds[l->fd] = NULL;
+    }
+    l->fd = -1;
+    l->events = 0;
+}
+
+
+/**
+ * Bring the epoll registration and the timer heap in line with the
+ * handler.
+ *
+ */
+static void
+netio_epoll_sync(netio_type* netio, netio_handler_list_type* l)
+{
+    netio_handler_type* handler = l->handler;
+    struct epoll_event ev;
+    unsigned events = 0;
+    int fd = handler->fd;
+
+    if (fd >= 0) {
+        if (handler->event_types & NETIO_EVENT_READ) {
+            events |= EPOLLIN;
+        }
+        if (handler->event_types & NETIO_EVENT_WRITE) {
+            events |= EPOLLOUT;
+        }
+        if (handler->event_types & NETIO_EVENT_EXCEPT) {
+            events |= EPOLLPRI;
+        }
+    }
+    if (l->fd >= 0 && (l->fd != fd || !events)) {
+        netio_epoll_unwatch(netio, l);
+    }
+    if (fd >= 0 && events) {
+        /* Always tell the kernel, the handler may have closed and
+         * reopened a descriptor with the same number. */
+        int op = l->fd == fd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.ptr = l;
+        if (epoll_ctl(netio->epfd, op, fd, &ev) == -1) {
+            op = errno == ENOENT ? EPOLL_CTL_ADD :
+                 errno == EEXIST ? EPOLL_CTL_MOD : -1;
+            if (op == -1 || epoll_ctl(netio->epfd, op, fd, &ev) == -1) {
+                ods_log_error("[%s] unable to watch fd %d: epoll_ctl() "
+                    "failed (%s)", netio_str, fd, strerror(errno));
+                l->fd = -1;
+                l->events = 0;
+                fd = -1;
+            }
+        }
+        if (fd >= 0) {
+            if ((size_t) fd >= netio->fds_size) {
+                size_t size = netio->fds_size ? netio->fds_size : 64;
+                while (size <= (size_t) fd) {
+                    size *= 2;
+                }
+                CHECKALLOC(netio->fds = (netio_handler_list_type**) realloc(
+                    netio->fds, size * sizeof(netio_handler_list_type*)));
+                memset(netio->fds + netio->fds_size, 0,
+                    (size - netio->fds_size) *
+                    sizeof(netio_handler_list_type*));
+                netio->fds_size = size;
+            }
+            if (netio->fds[fd] && netio->fds[fd] != l) {
+                /* stale owner, it closed the descriptor */
+                netio->fds[fd]->fd = -1;
+                netio->fds[fd]->events = 0;
+            }
+            netio->fds[fd] = l;
+            l->fd = fd;
+            l->events = events;
+        }
+    }
+    if (handler->timeout && (handler->event_types & NETIO_EVENT_TIMEOUT)) {
+        l->timeout.tv_sec = handler->timeout->tv_sec;
+        l->timeout.tv_nsec = handler->timeout->tv_nsec;
+        if (!l->heap_idx) {
+            if (netio->heap_count + 1 >= netio->heap_size) {
+                netio->heap_size = netio->heap_size ?
+                    netio->heap_size * 2 : 64;
+                CHECKALLOC(netio->heap = (netio_handler_list_type**)
+                    realloc(netio->heap, netio->heap_size *
+                    sizeof(netio_handler_list_type*)));
+            }
+            l->heap_idx = ++netio->heap_count;
+            netio->heap[l->heap_idx] = l;
+        }
+        netio_heap_fix(netio, l->heap_idx);
+    } else {
+        netio_heap_delete(netio, l);
+    }
+}
+
+
+/**
+ * Queue handler for synchronization at the next dispatch.
+ * Caller holds the netio lock.
+ *
+ */
+static void
+netio_mark_dirty(netio_type* netio, netio_handler_list_type* l)
+{
+    if (!l->is_dirty) {
+        l->is_dirty = 1;
+        l->dirty_next = netio->dirty;
+        netio->dirty = l;
+    }
+}
+
+
+/*
+ * Create a new netio instance.
+ * \return netio_type* netio instance
+ *
+ */
+netio_type*
+netio_create()
+{
+    netio_type* netio = NULL;
+    CHECKALLOC(netio = (netio_type*) malloc(sizeof(netio_type)));
+    netio->handlers = NULL;
+    netio->dispatch_next = NULL;
+    netio->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (netio->epfd == -1) {
+        ods_log_error("[%s] unable to create netio: epoll_create1() "
+            "failed (%s)", netio_str, strerror(errno));
+        free(netio);
+        return NULL;
+    }
+    netio->hash_size = NETIO_HASH_SIZE;
+    netio->hash_count = 0;
+    CHECKALLOC(netio->hash = (netio_handler_list_type**) calloc(
+        netio->hash_size, sizeof(netio_handler_list_type*)));
+    netio->heap = NULL;
+    netio->heap_size = 0;
+    netio->heap_count = 0;
+    netio->fds = NULL;
+    netio->fds_size = 0;
+    netio->dirty = NULL;
+    netio->removed = NULL;
+    pthread_mutex_init(&netio->netio_lock, NULL);
+    return netio;
+}
+
+/*
+ * Add a new handler to netio.
+ *
+ */
+void
+netio_add_handler(netio_type* netio, netio_handler_type* handler)
+{
+    netio_handler_list_type* l = NULL;
+
+    ods_log_assert(netio);
+    ods_log_assert(handler);
+
+    CHECKALLOC(l = (netio_handler_list_type*) calloc(1, sizeof(netio_handler_list_type)));
+    l->handler = handler;
+    l->fd = -1;
+    pthread_mutex_lock(&netio->netio_lock);
+    l->next = netio->handlers;
+    if (netio->handlers) {
+        netio->handlers->prev = l;
+    }
+    netio->handlers = l;
+    netio_hash_insert(netio, l);
+    netio_mark_dirty(netio, l);
+    pthread_mutex_unlock(&netio->netio_lock);
+    ods_log_debug("[%s] handler added", netio_str);
+}
+
+/*
+ * Remove the handler from netio. Caller is responsible for freeing
+ * handler afterwards.
+ */
+void
+netio_remove_handler(netio_type* netio, netio_handler_type* handler)
+{
+    netio_handler_list_type* l;
+    if (!netio || !handler) {
+        return;
+    }
+    pthread_mutex_lock(&netio->netio_lock);
+    l = netio_lookup(netio, handler);
+    if (l) {
+        netio_epoll_unwatch(netio, l);
+        netio_heap_delete(netio, l);
+        netio_hash_delete(netio, l);
+        if (l->prev) {
+            l->prev->next = l->next;
+        } else {
+            netio->handlers = l->next;
+        }
+        if (l->next) {
+            l->next->prev = l->prev;
+        }
+        /* Events for this handler may still be pending in the current
+         * dispatch, so keep the registration around until the next. */
+        l->handler = NULL;
+        l->next = netio->removed;
+        netio->removed = l;
+    }
+    pthread_mutex_unlock(&netio->netio_lock);
+    ods_log_debug("[%s] handler removed", netio_str);
+}
+
+/*
+ * Tell netio that the handler was changed.
+ *
+ */
+void
+netio_update_handler(netio_type* netio, netio_handler_type* handler)
+{
+    netio_handler_list_type* l;
+    if (!netio || !handler) {
+        return;
+    }
+    pthread_mutex_lock(&netio->netio_lock);
+    l = netio_lookup(netio, handler);
+    if (l) {
+        netio_mark_dirty(netio, l);
+    }
+    pthread_mutex_unlock(&netio->netio_lock);
+}
+
+
+/**
+ * Call the event handler and queue it for synchronization, as it is
+ * free to modify itself.
+ *
+ */
+static void
+netio_epoll_call(netio_type* netio, netio_handler_list_type* l,
+    netio_events_type event_types)
+{
+    netio_handler_type* handler = l->handler;
+    if (!handler) {
+        return;
+    }
+    handler->event_handler(netio, handler, event_types);
+    pthread_mutex_lock(&netio->netio_lock);
+    if (l->handler) {
+        netio_mark_dirty(netio, l);
+    }
+    pthread_mutex_unlock(&netio->netio_lock);
+}
+
+
+/*
+ * Check for events and dispatch them to the handlers.
+ *
+ */
+int
+netio_dispatch(netio_type* netio, const struct timespec* timeout,
+    const sigset_t* sigmask)
+{
+    struct epoll_event events[NETIO_EPOLL_EVENTS];
+    int have_timeout = 0;
+    struct timespec minimum_timeout;
+    netio_handler_list_type* timeout_handler = NULL;
+    netio_handler_list_type* l = NULL;
+    int ms = -1;
+    int rc = 0;
+    int i;
+    int result = 0;
+
+    if (!netio || !netio->handlers) {
+        return 0;
+    }
+    /* Clear the cached current time */
+    netio->have_current_time = 0;
+    /* Initialize the minimum timeout with the timeout parameter */
+    if (timeout) {
+        have_timeout = 1;
+        memcpy(&minimum_timeout, timeout, sizeof(struct timespec));
+    }
+    pthread_mutex_lock(&netio->netio_lock);
+    /* Synchronize the handlers that have changed */
+    while ((l = netio->dirty)) {
+        netio->dirty = l->dirty_next;
+        l->dirty_next = NULL;
+        l->is_dirty = 0;
+        if (l->handler) {
+            netio_epoll_sync(netio, l);
+        }
+    }
+    while ((l = netio->removed)) {
+        netio->removed = l->next;
+        free(l);
+    }
+    /* The earliest handler timeout is at the top of the heap */
+    if (netio->heap_count) {
+        struct timespec relative;
+        relative.tv_sec = netio->heap[1]->timeout.tv_sec;
+        relative.tv_nsec = netio->heap[1]->timeout.tv_nsec;
+        timespec_subtract(&relative, netio_current_time(netio));
+        if (!have_timeout ||
+            timespec_compare(&relative, &minimum_timeout) < 0) {
+            have_timeout = 1;
+            minimum_timeout.tv_sec = relative.tv_sec;
+            minimum_timeout.tv_nsec = relative.tv_nsec;
+            timeout_handler = netio->heap[1];
+        }
+    }
+    pthread_mutex_unlock(&netio->netio_lock);
+
+    if (have_timeout && minimum_timeout.tv_sec < 0) {
+        /*
+         * On negative timeout for a handler, immediately
+         * dispatch the timeout event without checking for other events.
+         */
+        ods_log_debug("[%s] dispatch timeout event without checking for "
+            "other events", netio_str);
+        if (timeout_handler) {
+            netio_epoll_call(netio, timeout_handler, NETIO_EVENT_TIMEOUT);
+        }
+        return result;
+    }
+    if (have_timeout) {
+        /* round up, so the timeout has passed when we wake up */
+        if (minimum_timeout.tv_sec >= INT_MAX / 1000 - 1) {
+            ms = INT_MAX;
+        } else {
+            ms = (int) minimum_timeout.tv_sec * 1000 +
+                (int) ((minimum_timeout.tv_nsec + 999999L) / 1000000L);
+        }
+    }
+    /* Check for events. */
+    rc = epoll_pwait(netio->epfd, events, NETIO_EPOLL_EVENTS, ms, sigmask);
+    if (rc == -1) {
+        if(errno == EINVAL || errno == EBADF || errno == EFAULT) {
+            ods_fatal_exit("[%s] fatal error epoll_pwait: %s", netio_str,
+                strerror(errno));
+        }
+        return -1;
+    }
+
+    /* Clear the cached current_time (epoll_pwait(2) may block for
+     * some time so the cached value is likely to be old).
+     */
+    netio->have_current_time = 0;
+    if (rc == 0) {
+        ods_log_debug("[%s] no events before the minimum timeout "
+            "expired", netio_str);
+        /*
+         * No events before the minimum timeout expired.
+         * Dispatch to handler if interested.
+         */
+        if (timeout_handler) {
+            netio_epoll_call(netio, timeout_handler, NETIO_EVENT_TIMEOUT);
+        }
+        return result;
+    }
+    /*
+     * Dispatch all the events to interested handlers.  Handlers that
+     * were removed by an earlier callback stay allocated until the
+     * next dispatch and have their handler cleared.
+     */
+    for (i = 0; i < rc; i++) {
+        netio_handler_type* handler = NULL;
+        netio_events_type event_types = NETIO_EVENT_NONE;
+        l = (netio_handler_list_type*) events[i].data.ptr;
+        handler = l->handler;
+        if (!handler || handler->fd < 0 || handler->fd != l->fd) {
+            /* removed, or moved on to another descriptor */
+            continue;
+        }
+        /* pselect(2) reports errors as readable and writable */
+        if (events[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP)) {
+            event_types |= NETIO_EVENT_READ;
+        }
+        if (events[i].events & (EPOLLOUT|EPOLLERR|EPOLLHUP)) {
+            event_types |= NETIO_EVENT_WRITE;
+        }
+        if (events[i].events & EPOLLPRI) {
+            event_types |= NETIO_EVENT_EXCEPT;
+        }
+        if (event_types & handler->event_types) {
+            netio_epoll_call(netio, l, event_types & handler->event_types);
+            ++result;
+        }
+    }
+    return result;
+}
+
+
+/**
+ * Clean up netio instance
+ *
+ */
+void
+netio_cleanup(netio_type* netio)
+{
+    netio_handler_list_type* handler;
+
+    ods_log_assert(netio);
+
+    while (netio->handlers) {
+        handler = netio->handlers->next;
+        /* handler and handler->user_data are managed by something else
+         * it seems */
+        free(netio->handlers);
+        netio->handlers = handler;
+    }
+    while (netio->removed) {
+        handler = netio->removed->next;
+        free(netio->removed);
+        netio->removed = handler;
+    }
+    close(netio->epfd);
+    free(netio->hash);
+    free(netio->heap);
+    free(netio->fds);
+    pthread_mutex_destroy(&netio->netio_lock);
+    free(netio);
+}
+
+#else /* !USE_EPOLL */
+
+/*
+ * Create a new netio instance.
+ * \return netio_type* netio instance
+ *
+ */
+netio_type*
+netio_create()
+{
+    netio_type* netio = NULL;
+    CHECKALLOC(netio = (netio_type*) malloc(sizeof(netio_type)));
+    netio->handlers = NULL;
+    netio->dispatch_next = NULL;
+    return netio;
+}
+
+/*
+ * Add a new handler to netio.
+ *
+ */
+void
+netio_add_handler(netio_type* netio, netio_handler_type* handler)
+{
+    netio_handler_list_type* l = NULL;
+
+    ods_log_assert(netio);
+    ods_log_assert(handler);
+
+    CHECKALLOC(l = (netio_handler_list_type*) malloc(sizeof(netio_handler_list_type)));
+    l->next = netio->handlers;
+    l->handler = handler;
+    netio->handlers = l;
+    ods_log_debug("[%s] handler added", netio_str);
+}
+
+/*
+ * Remove the handler from netio. Caller is responsible for freeing
+ * handler afterwards.
+ */
+void
+netio_remove_handler(netio_type* netio, netio_handler_type* handler)
+{
+    netio_handler_list_type** lptr;
+    if (!netio || !handler) {
+        return;
+    }
+    for (lptr = &netio->handlers; *lptr; lptr = &(*lptr)->next) {
+        if ((*lptr)->handler == handler) {
+            netio_handler_list_type* next = (*lptr)->next;
+            if ((*lptr) == netio->dispatch_next) {
+                netio->dispatch_next = next;
+            }
+            (*lptr)->handler = NULL;
+	    free(*lptr);
+            *lptr = next;
+            break;
+        }
+    }
+    ods_log_debug("[%s] handler removed", netio_str);
+}
+
+/*
+ * Tell netio that the handler was changed. Nothing to do, the
+ * handlers are scanned at every dispatch.
+ *
+ */
+void
+netio_update_handler(netio_type* netio, netio_handler_type* handler)
+{
+    (void) netio;
+    (void) handler;
+}
+
 
 /*
  * Check for events and dispatch them to the handlers.
@@ -349,3 +958,4 @@ netio_cleanup(netio_type* netio)
     free(netio);
 }
 
+#endif /* USE_EPOLL */
@@ -54,6 +54,10 @@
 #include "config.h"
 #include "status.h"
 
+#ifdef USE_EPOLL
+#include <pthread.h>
+#endif
+
 #ifndef PF_INET
 #define PF_INET AF_INET
 #endif
@@ -93,6 +97,21 @@ typedef void (*netio_event_handler_type)(netio_type *netio,
 struct netio_handler_list_struct {
     netio_handler_list_type* next;
     netio_handler_type* handler;
+#ifdef USE_EPOLL
+    netio_handler_list_type* prev;
+    /* next in the handler hash bucket */
+    netio_handler_list_type* hash_next;
+    /* next in the list of handlers to synchronize */
+    netio_handler_list_type* dirty_next;
+    /* file descriptor and events as registered with epoll(7) */
+    int fd;
+    unsigned events;
+    /* timeout as placed in the timer heap */
+    struct timespec timeout;
+    /* position in the timer heap, 0 if the handler has no timeout */
+    size_t heap_idx;
+    unsigned is_dirty : 1;
+#endif
 };
 
 /**
@@ -153,6 +172,27 @@ struct netio_struct {
      * To make sure that deletes respect the state of the iterator.
      */
     netio_handler_list_type* dispatch_next;
+#ifdef USE_EPOLL
+    /*
+     * The epoll(7) backend only looks at handlers that are new, that
+     * have been dispatched to, or that were passed to
+     * netio_update_handler(); their file descriptors are registered
+     * with the epoll instance and their timeouts are kept in a binary
+     * min-heap, so a dispatch does not scan the whole handler list.
+     */
+    int epfd;
+    netio_handler_list_type** hash;
+    size_t hash_size;
+    size_t hash_count;
+    netio_handler_list_type** heap; /* 1-based */
+    size_t heap_size;
+    size_t heap_count;
+    netio_handler_list_type** fds; /* owner of each registered fd */
+    size_t fds_size;
+    netio_handler_list_type* dirty;
+    netio_handler_list_type* removed; /* freed at the next dispatch */
+    pthread_mutex_t netio_lock;
+#endif
 };
 
 /*
@@ -179,6 +219,17 @@ void netio_add_handler(netio_type* netio, netio_handler_type* handler);
  */
 void netio_remove_handler(netio_type* netio, netio_handler_type* handler);
 
+/*
+ * Tell netio that the file descriptor, event types or timeout of the
+ * handler were changed outside of its own event handler. Changes made
+ * by a handler to itself during its callback are picked up
+ * automatically. May be called from other threads.
+ * \param[in] netio netio instance
+ * \param[in] handler handler
+ *
+ */
+void netio_update_handler(netio_type* netio, netio_handler_type* handler);
+
 /*
  * Retrieve the current time (using gettimeofday(2)).
  * \param[in] netio netio instance
@@ -192,7 +243,8 @@ const struct timespec* netio_current_time(netio_type* netio);
  * \param[in] netio netio instance
  * \param[in] timeout if specified, the maximum time to wait for an
  *                    event to arrive.
- * \param[in] sigmask is passed to the underlying pselect(2) call
+ * \param[in] sigmask is passed to the underlying pselect(2) or
+ *                    epoll_pwait(2) call
  * \return int the number of non-timeout events dispatched, 0 on timeout,
  *             and -1 on error (with errno set appropriately).
  *
@@ -89,6 +89,7 @@ notify_set_timer(notify_type* notify, time_t t)
     notify->handler.timeout = &notify->timeout;
     notify->timeout.tv_sec = t;
     notify->timeout.tv_nsec = 0;
+    netio_update_handler(notify->xfrhandler->netio, &notify->handler);
 }
 
 
@@ -182,6 +183,7 @@ notify_disable(notify_type* notify)
         close(notify->handler.fd);
         notify->handler.fd = -1;
     }
+    netio_update_handler(xfrhandler->netio, &notify->handler);
     if (xfrhandler->notify_udp_num == NOTIFY_MAX_UDP) {
         while (xfrhandler->notify_waiting_first) {
             notify_type* wn = xfrhandler->notify_waiting_first;
@@ -587,6 +589,7 @@ notify_enable(notify_type* notify, ldns_rr* soa)
     }
     xfrhandler->notify_waiting_last = notify;
     notify->handler.timeout = NULL;
+    netio_update_handler(xfrhandler->netio, &notify->handler);
     ods_log_debug("[%s] zone %s notify on waiting list", notify_str,
         zone->name);
 }
@@ -37,6 +37,8 @@
 #include "wire/axfr.h"
 #include "wire/query.h"
 
+#include <sys/mman.h>
+
 const char* query_str = "query";
 
 
@@ -52,6 +54,8 @@ query_create(void)
     q->buffer = NULL;
     q->tsig_rr = NULL;
     q->axfr_fd = NULL;
+    q->axfr_map = NULL;
+    q->ixfr_rrs = NULL;
     q->buffer = buffer_create(PACKET_BUFFER_SIZE);
     if (!q->buffer) {
         query_cleanup(q);
@@ -96,10 +100,25 @@ query_reset(query_type* q, size_t maxlen, int is_tcp)
     q->zone = NULL;
     /* domain, opcode, cname count, delegation, compression, temp */
     q->axfr_is_done = 0;
+    q->axfr_wire = 0;
     if (q->axfr_fd) {
         ods_fclose(q->axfr_fd);
         q->axfr_fd = NULL;
     }
+    if (q->axfr_map) {
+        munmap(q->axfr_map, q->axfr_maplen);
+        q->axfr_map = NULL;
+    }
+    q->axfr_maplen = 0;
+    q->axfr_mapoff = 0;
+    q->axfr_data = NULL;
+    q->axfr_data_len = 0;
+    q->axfr_data_pos = 0;
+    if (q->ixfr_rrs) {
+        ldns_rr_list_deep_free(q->ixfr_rrs);
+        q->ixfr_rrs = NULL;
+    }
+    q->ixfr_pos = 0;
     q->serial = 0;
     q->startpos = 0;
 }
@@ -505,6 +524,7 @@ static uint16_t
 response_encode_rrset(query_type* q, rrset_type* rrset, ldns_pkt_section section)
 {
     rrsig_type* rrsig;
+    ldns_rr* rr = NULL;
     uint16_t i = 0;
     uint16_t added = 0;
     ods_log_assert(q);
@@ -512,11 +532,15 @@ response_encode_rrset(query_type* q, rrset_type* rrset, ldns_pkt_section section
     ods_log_assert(section);
 
     for (i = 0; i < rrset->rr_count; i++) {
-        added += response_encode_rr(q, rrset->rrs[i].rr, section);
+        rr = rrset_rr2ldns(rrset, &rrset->rrs[i]);
+        added += response_encode_rr(q, rr, section);
+        ldns_rr_free(rr);
     }
     if (q->edns_rr && q->edns_rr->dnssec_ok) {
         while((rrsig = collection_iterator(rrset->rrsigs))) {
-            added += response_encode_rr(q, rrsig->rr, section);
+            rr = rrset_rrsig2ldns(rrset, rrsig);
+            added += response_encode_rr(q, rr, section);
+            ldns_rr_free(rr);
         }
     }
     /* truncation? */
@@ -869,7 +893,7 @@ query_process(query_type* q, engine_type* engine)
         ods_log_debug("[%s] no RRset in query section, ignoring", query_str);
         return QUERY_DISCARDED; /* no RRset in query */
     }
-    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    pthread_rwlock_rdlock(&engine->zonelist->zl_lock);
     /* we can just lookup the zone, because we will only handle SOA queries,
        zone transfers, updates and notifies */
     q->zone = zonelist_lookup_zone_by_dname(engine->zonelist, ldns_rr_owner(rr),
@@ -881,7 +905,7 @@ query_process(query_type* q, engine_type* engine)
             query_str, q->zone->name);
         q->zone = NULL;
     }
-    pthread_mutex_unlock(&engine->zonelist->zl_lock);
+    pthread_rwlock_unlock(&engine->zonelist->zl_lock);
     if (!q->zone) {
         ods_log_debug("[%s] zone not found", query_str);
         return query_servfail(q);
@@ -1012,8 +1036,10 @@ query_add_optional(query_type* q, engine_type* engine)
              if (q->tsig_prepare_it)
                  tsig_rr_prepare(q->tsig_rr);
              if (q->tsig_update_it)
-                 tsig_rr_update(q->tsig_rr, q->buffer,
-                     buffer_position(q->buffer));
+                 tsig_rr_update_data(q->tsig_rr, q->buffer,
+                     buffer_position(q->buffer), q->axfr_data,
+                     q->axfr_data_len, q->axfr_data_len ?
+                     q->axfr_data_pos : buffer_position(q->buffer));
              if (q->tsig_sign_it) {
                  tsig_rr_sign(q->tsig_rr);
                  tsig_rr_append(q->tsig_rr, q->buffer);
@@ -1096,6 +1122,14 @@ query_cleanup(query_type* q)
         ods_fclose(q->axfr_fd);
         q->axfr_fd = NULL;
     }
+    if (q->axfr_map) {
+        munmap(q->axfr_map, q->axfr_maplen);
+        q->axfr_map = NULL;
+    }
+    if (q->ixfr_rrs) {
+        ldns_rr_list_deep_free(q->ixfr_rrs);
+        q->ixfr_rrs = NULL;
+    }
     buffer_cleanup(q->buffer);
     tsig_rr_cleanup(q->tsig_rr);
     edns_rr_cleanup(q->edns_rr);
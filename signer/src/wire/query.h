@@ -79,10 +79,19 @@ struct query_struct {
 
     /* AXFR IXFR */
     FILE* axfr_fd;
+    uint8_t* axfr_map; /* wire format snapshot */
+    size_t axfr_maplen;
+    size_t axfr_mapoff;
+    const uint8_t* axfr_data; /* answer section sent from the snapshot */
+    size_t axfr_data_len;
+    size_t axfr_data_pos; /* where it goes in the packet */
+    ldns_rr_list* ixfr_rrs; /* condensed IXFR answer from the journal */
+    size_t ixfr_pos;
     uint32_t serial;
     size_t startpos;
     /* Bits */
     unsigned axfr_is_done : 1;
+    unsigned axfr_wire : 1; /* sending from the wire format snapshot */
     unsigned tsig_prepare_it : 1;
     unsigned tsig_update_it : 1;
     unsigned tsig_sign_it : 1;
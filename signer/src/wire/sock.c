@@ -41,6 +41,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <ldns/ldns.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #define SOCK_TCP_BACKLOG 5
@@ -125,6 +126,37 @@ sock_tcp_reuseaddr(sock_type* sock, const char* node, const char* port,
 }
 
 
+/**
+ * Set socket to share its port with the sockets of the other dns
+ * handler threads.
+ *
+ */
+static ods_status
+sock_reuseport(sock_type* sock, const char* node, const char* port,
+    const char* stype)
+{
+#ifdef SO_REUSEPORT
+    int on = 1;
+    ods_log_assert(sock);
+    ods_log_assert(port);
+    ods_log_assert(stype);
+    if (setsockopt(sock->s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        ods_log_error("[%s] unable to set %s socket '%s:%s' to "
+            "reuse-port: setsockopt() failed (%s)", sock_str, stype,
+            node?node:"localhost", port, strerror(errno));
+        return ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT;
+    }
+    return ODS_STATUS_OK;
+#else
+    (void) sock;
+    (void) node;
+    (void) port;
+    (void) stype;
+    return ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT;
+#endif /* SO_REUSEPORT */
+}
+
+
 /**
  * Listen on tcp socket.
  *
@@ -152,7 +184,7 @@ sock_tcp_listen(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 sock_server_udp(sock_type* sock, const char* node, const char* port,
-    unsigned* ip6_support)
+    unsigned* ip6_support, int reuseport)
 {
     int on = 0;
     ods_status status = ODS_STATUS_OK;
@@ -174,6 +206,12 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
         }
         return ODS_STATUS_SOCK_SOCKET_UDP;
     }
+    if (reuseport) {
+        status = sock_reuseport(sock, node, port, "udp");
+        if (status != ODS_STATUS_OK) {
+            return status;
+        }
+    }
     /* ipv4 */
     if (sock->addr->ai_family == AF_INET) {
         status = sock_fcntl_and_bind(sock, node, port, "udp", "ipv4");
@@ -196,7 +234,7 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 sock_server_tcp(sock_type* sock, const char* node, const char* port,
-    unsigned* ip6_support)
+    unsigned* ip6_support, int reuseport)
 {
     int on = 0;
     ods_status status = ODS_STATUS_OK;
@@ -218,6 +256,12 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
         }
         return ODS_STATUS_SOCK_SOCKET_TCP;
     }
+    if (reuseport) {
+        status = sock_reuseport(sock, node, port, "tcp");
+        if (status != ODS_STATUS_OK) {
+            return status;
+        }
+    }
     /* ipv4 */
     if (sock->addr->ai_family == AF_INET) {
         sock_tcp_reuseaddr(sock, node, port, on, "ipv4");
@@ -248,7 +292,7 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
-    const char* node, const char* port, unsigned* ip6_support)
+    const char* node, const char* port, unsigned* ip6_support, int reuseport)
 {
     ods_status status = ODS_STATUS_OK;
     int r = 0;
@@ -274,9 +318,9 @@ socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
     }
     /* socket */
     if (socktype == SOCK_DGRAM) {
-        status = sock_server_udp(sock, node, port, ip6_support);
+        status = sock_server_udp(sock, node, port, ip6_support, reuseport);
     } else if (socktype == SOCK_STREAM) {
-        status = sock_server_tcp(sock, node, port, ip6_support);
+        status = sock_server_tcp(sock, node, port, ip6_support, reuseport);
     }
     ods_log_debug("[%s] socket listening to %s:%s", sock_str,
         node?node:"localhost", port);
@@ -289,7 +333,7 @@ socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
  *
  */
 ods_status
-sock_listen(socklist_type* sockets, listener_type* listener)
+sock_listen(socklist_type* sockets, listener_type* listener, int reuseport)
 {
     ods_status status = ODS_STATUS_OK;
     struct addrinfo hints[MAX_INTERFACES];
@@ -326,7 +370,7 @@ sock_listen(socklist_type* sockets, listener_type* listener)
         }
         /* udp */
         status = socket_listen(&sockets->udp[i], hints[i], SOCK_DGRAM,
-            node, port, &ip6_support);
+            node, port, &ip6_support, reuseport);
         if (status != ODS_STATUS_OK) {
             if (!ip6_support) {
                 ods_log_warning("[%s] fallback to udp/ipv4, no udp/ipv6: "
@@ -338,7 +382,7 @@ sock_listen(socklist_type* sockets, listener_type* listener)
         }
         /* tcp */
         status = socket_listen(&sockets->tcp[i], hints[i], SOCK_STREAM,
-            node, port, &ip6_support);
+            node, port, &ip6_support, reuseport);
         if (status != ODS_STATUS_OK) {
             if (!ip6_support) {
                 ods_log_warning("[%s] fallback to udp/ipv4, no udp/ipv6: "
@@ -624,7 +668,8 @@ sock_handle_tcp_read(netio_type* netio, netio_handler_type* handler,
     query_add_optional(data->query, data->engine);
     /* switch to tcp write handler. */
     buffer_flip(data->query->buffer);
-    data->query->tcplen = buffer_remaining(data->query->buffer);
+    data->query->tcplen = buffer_remaining(data->query->buffer) +
+        data->query->axfr_data_len;
     ods_log_debug("[%s] TCP_READ: new tcplen %u", sock_str,
         data->query->tcplen);
     data->bytes_transmitted = 0;
@@ -636,6 +681,47 @@ sock_handle_tcp_read(netio_type* netio, netio_handler_type* handler,
 }
 
 
+/**
+ * Write tcp response, from where the previous write stopped. The message
+ * length, the packet buffer and the answer section that is sent from the
+ * AXFR snapshot go out in one system call, without copying.
+ *
+ */
+static ssize_t
+sock_tcp_write(int fd, query_type* q, size_t done)
+{
+    uint16_t n_tcplen = htons(q->tcplen);
+    struct iovec iov[4];
+    const uint8_t* part[4];
+    size_t len[4];
+    size_t at = buffer_limit(q->buffer);
+    int i, n = 0;
+
+    if (q->axfr_data_len) {
+        at = q->axfr_data_pos;
+    }
+    part[0] = (const uint8_t*) &n_tcplen;
+    len[0] = sizeof(n_tcplen);
+    part[1] = buffer_begin(q->buffer);
+    len[1] = at;
+    part[2] = q->axfr_data;
+    len[2] = q->axfr_data_len;
+    part[3] = buffer_at(q->buffer, at);
+    len[3] = buffer_limit(q->buffer) - at;
+    for (i = 0; i < 4; i++) {
+        if (done >= len[i]) {
+            done -= len[i];
+            continue;
+        }
+        iov[n].iov_base = (void*) (part[i] + done);
+        iov[n].iov_len = len[i] - done;
+        done = 0;
+        n++;
+    }
+    return writev(fd, iov, n);
+}
+
+
 /**
  * Handle outgoing tcp responses.
  *
@@ -654,48 +740,15 @@ sock_handle_tcp_write(netio_type* netio, netio_handler_type* handler,
     }
     ods_log_assert(event_types & NETIO_EVENT_WRITE);
 
-    if (data->bytes_transmitted < sizeof(q->tcplen)) {
-        uint16_t n_tcplen = htons(q->tcplen);
-        sent = write(handler->fd,
-            (const char*) &n_tcplen + data->bytes_transmitted,
-            sizeof(n_tcplen) - data->bytes_transmitted);
-        if (sent == -1) {
-             if (errno == EAGAIN || errno == EINTR) {
-                 /* write would block, wait until socket becomes writeable. */
-                 return;
-             } else {
-                 ods_log_error("[%s] unable to handle outgoing tcp response: "
-                     "write() failed (%s)", sock_str, strerror(errno));
-                 cleanup_tcp_handler(netio, handler);
-                 return;
-             }
-         } else if (sent == 0) {
-             cleanup_tcp_handler(netio, handler);
-             return;
-         }
-         data->bytes_transmitted += sent;
-         ods_log_debug("[%s] TCP_WRITE: bytes transmitted %lu (sent %ld)",
-                sock_str, (unsigned long)data->bytes_transmitted, (long)sent);
-         if (data->bytes_transmitted < sizeof(q->tcplen)) {
-             /* writing not complete, wait until socket becomes writable. */
-             ods_log_debug("[%s] TCP_WRITE: bytes transmitted %lu, while "
-                "sizeof tcplen %lu", sock_str, (unsigned long)data->bytes_transmitted,
-                (unsigned long)sizeof(q->tcplen));
-             return;
-         }
-         ods_log_assert(data->bytes_transmitted == sizeof(q->tcplen));
-    }
     ods_log_assert(data->bytes_transmitted < q->tcplen + sizeof(q->tcplen));
-
-    sent = write(handler->fd, buffer_current(q->buffer),
-        buffer_remaining(q->buffer));
+    sent = sock_tcp_write(handler->fd, q, data->bytes_transmitted);
     if (sent == -1) {
         if (errno == EAGAIN || errno == EINTR) {
             /* write would block, wait until socket becomes writeable. */
             return;
         } else {
             ods_log_error("[%s] unable to handle outgoing tcp response: "
-                 "write() failed (%s)", sock_str, strerror(errno));
+                 "writev() failed (%s)", sock_str, strerror(errno));
             cleanup_tcp_handler(netio, handler);
             return;
         }
@@ -703,8 +756,6 @@ sock_handle_tcp_write(netio_type* netio, netio_handler_type* handler,
         cleanup_tcp_handler(netio, handler);
         return;
     }
-
-    buffer_skip(q->buffer, sent);
     data->bytes_transmitted += sent;
     if (data->bytes_transmitted < q->tcplen + sizeof(q->tcplen)) {
         /* still more data to write when socket becomes writable. */
@@ -732,7 +783,7 @@ sock_handle_tcp_write(netio_type* netio, netio_handler_type* handler,
             /* edns, tsig */
             query_add_optional(q, data->engine);
             buffer_flip(q->buffer);
-            q->tcplen = buffer_remaining(q->buffer);
+            q->tcplen = buffer_remaining(q->buffer) + q->axfr_data_len;
             data->bytes_transmitted = 0;
             handler->timeout->tv_sec = XFRD_TCP_TIMEOUT;
             handler->timeout->tv_nsec = 0L;
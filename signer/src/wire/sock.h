@@ -96,10 +96,13 @@ struct tcp_data {
  * Create sockets and listen.
  * \param[out] sockets sockets
  * \param[in] listener interfaces
+ * \param[in] reuseport if true, allow other sockets to bind to the same
+ *            addresses (SO_REUSEPORT)
  * \return ods_status status
  *
  */
-ods_status sock_listen(socklist_type* sockets, listener_type* listener);
+ods_status sock_listen(socklist_type* sockets, listener_type* listener,
+    int reuseport);
 
 /**
  * Handle incoming udp queries.
@@ -32,7 +32,10 @@
 #include "config.h"
 #include "wire/tcpset.h"
 
+#include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 static const char* tcp_str = "tcp";
 
@@ -55,6 +58,14 @@ tcp_conn_create()
     tcp_conn->msglen = 0;
     tcp_conn->total_bytes = 0;
     tcp_conn->fd = -1;
+    tcp_conn->idx = -1;
+    tcp_conn->master = NULL;
+    tcp_conn->idle_next = NULL;
+    tcp_conn->handler.fd = -1;
+    tcp_conn->handler.user_data = (void*) tcp_conn;
+    tcp_conn->handler.timeout = &tcp_conn->timeout;
+    tcp_conn->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    tcp_conn->handler.event_handler = NULL;
     return tcp_conn;
 }
 
@@ -66,20 +77,207 @@ tcp_conn_create()
 tcp_set_type*
 tcp_set_create()
 {
-    size_t i = 0;
     tcp_set_type* tcp_set = NULL;
     CHECKALLOC(tcp_set = (tcp_set_type*) malloc(sizeof(tcp_set_type)));
     memset(tcp_set, 0, sizeof(tcp_set_type));
+    tcp_set->tcp_conn = NULL;
+    tcp_set->tcp_size = 0;
     tcp_set->tcp_count = 0;
-    for (i=0; i < TCPSET_MAX; i++) {
-        tcp_set->tcp_conn[i] = tcp_conn_create();
-    }
-    tcp_set->tcp_waiting_first = NULL;
-    tcp_set->tcp_waiting_last = NULL;
+    tcp_set->masters = NULL;
     return tcp_set;
 }
 
 
+/**
+ * Get the connections to a master, create them if needed.
+ *
+ */
+tcp_master_type*
+tcp_set_master(tcp_set_type* set, acl_type* acl)
+{
+    tcp_master_type* master = NULL;
+    unsigned int port = 0;
+    size_t addrlen = 0;
+    ods_log_assert(set);
+    ods_log_assert(acl);
+    port = acl->port ? acl->port : (unsigned) atoi(DNS_PORT_STRING);
+    addrlen = acl->family == AF_INET6 ? sizeof(struct in6_addr) :
+        sizeof(struct in_addr);
+    for (master = set->masters; master; master = master->next) {
+        if (master->family == acl->family && master->port == port &&
+            memcmp(&master->addr, &acl->addr, addrlen) == 0) {
+            return master;
+        }
+    }
+    CHECKALLOC(master = (tcp_master_type*) malloc(sizeof(tcp_master_type)));
+    memset(master, 0, sizeof(tcp_master_type));
+    master->set = set;
+    master->family = acl->family;
+    memcpy(&master->addr, &acl->addr, addrlen);
+    master->port = port;
+    master->tcp_count = 0;
+    master->idle_first = NULL;
+    master->tcp_waiting_first = NULL;
+    master->tcp_waiting_last = NULL;
+    master->next = set->masters;
+    set->masters = master;
+    return master;
+}
+
+
+/**
+ * Get a free slot for a new connection, grow the set if it is full.
+ *
+ */
+tcp_conn_type*
+tcp_set_slot(tcp_set_type* set)
+{
+    tcp_conn_type** conns = NULL;
+    size_t size = 0;
+    size_t i = 0;
+    ods_log_assert(set);
+    for (i=0; i < set->tcp_size; i++) {
+        if (!set->tcp_conn[i]->master && set->tcp_conn[i]->fd == -1) {
+            return set->tcp_conn[i];
+        }
+    }
+    size = set->tcp_size ? set->tcp_size * 2 : 8;
+    conns = (tcp_conn_type**) realloc(set->tcp_conn,
+        size * sizeof(tcp_conn_type*));
+    if (!conns) {
+        ods_log_error("[%s] unable to grow tcp set to %lu connections",
+            tcp_str, (unsigned long) size);
+        return NULL;
+    }
+    set->tcp_conn = conns;
+    for (i=set->tcp_size; i < size; i++) {
+        set->tcp_conn[i] = tcp_conn_create();
+        if (!set->tcp_conn[i]) {
+            break;
+        }
+        set->tcp_conn[i]->idx = (int) i;
+    }
+    if (i == set->tcp_size) {
+        return NULL;
+    }
+    ods_log_debug("[%s] grow tcp set from %lu to %lu connections", tcp_str,
+        (unsigned long) set->tcp_size, (unsigned long) i);
+    size = set->tcp_size;
+    set->tcp_size = i;
+    return set->tcp_conn[size];
+}
+
+
+/**
+ * Take an idle connection to a master.
+ *
+ */
+tcp_conn_type*
+tcp_master_pop_idle(tcp_master_type* master)
+{
+    tcp_conn_type* tcp = NULL;
+    ods_log_assert(master);
+    tcp = master->idle_first;
+    if (tcp) {
+        master->idle_first = tcp->idle_next;
+        tcp->idle_next = NULL;
+        tcp->is_idle = 0;
+    }
+    return tcp;
+}
+
+
+/**
+ * Remove a connection from the idle list of its master.
+ *
+ */
+void
+tcp_master_remove_idle(tcp_conn_type* tcp)
+{
+    tcp_conn_type** prev = NULL;
+    ods_log_assert(tcp);
+    ods_log_assert(tcp->master);
+    for (prev = &tcp->master->idle_first; *prev; prev = &(*prev)->idle_next) {
+        if (*prev == tcp) {
+            *prev = tcp->idle_next;
+            break;
+        }
+    }
+    tcp->idle_next = NULL;
+    tcp->is_idle = 0;
+}
+
+
+/**
+ * Add a zone transfer at the end of the waiting queue of a master.
+ *
+ */
+void
+tcp_master_push_waiting(tcp_master_type* master, xfrd_type* xfrd)
+{
+    ods_log_assert(master);
+    ods_log_assert(xfrd);
+    xfrd->tcp_waiting_next = NULL;
+    if (master->tcp_waiting_last) {
+        master->tcp_waiting_last->tcp_waiting_next = xfrd;
+    } else {
+        master->tcp_waiting_first = xfrd;
+    }
+    master->tcp_waiting_last = xfrd;
+}
+
+
+/**
+ * Take the first zone transfer from the waiting queue of a master.
+ *
+ */
+xfrd_type*
+tcp_master_pop_waiting(tcp_master_type* master)
+{
+    xfrd_type* xfrd = NULL;
+    ods_log_assert(master);
+    xfrd = master->tcp_waiting_first;
+    if (xfrd) {
+        master->tcp_waiting_first = xfrd->tcp_waiting_next;
+        if (!master->tcp_waiting_first) {
+            master->tcp_waiting_last = NULL;
+        }
+        xfrd->tcp_waiting_next = NULL;
+    }
+    return xfrd;
+}
+
+
+/**
+ * Remove a zone transfer from the waiting queue of its master.
+ *
+ */
+void
+tcp_master_remove_waiting(xfrd_type* xfrd)
+{
+    tcp_master_type* master = NULL;
+    xfrd_type** prev = NULL;
+    xfrd_type* last = NULL;
+    ods_log_assert(xfrd);
+    ods_log_assert(xfrd->tcp_waiting_master);
+    master = xfrd->tcp_waiting_master;
+    for (prev = &master->tcp_waiting_first; *prev;
+        prev = &(*prev)->tcp_waiting_next) {
+        if (*prev == xfrd) {
+            *prev = xfrd->tcp_waiting_next;
+            if (master->tcp_waiting_last == xfrd) {
+                master->tcp_waiting_last = last;
+            }
+            break;
+        }
+        last = *prev;
+    }
+    xfrd->tcp_waiting_next = NULL;
+    xfrd->tcp_waiting_master = NULL;
+    xfrd->tcp_waiting = 0;
+}
+
+
 /**
  * Make tcp connection ready for reading.
  * \param[in] tcp tcp connection
@@ -177,30 +375,23 @@ int
 tcp_conn_write(tcp_conn_type* tcp)
 {
     ssize_t sent = 0;
+    uint16_t sendlen = 0;
+    size_t headlen = 0;
+    struct iovec iov[2];
+    int n = 0;
     ods_log_assert(tcp);
     ods_log_assert(tcp->fd != -1);
+    /* length and message in one go */
     if (tcp->total_bytes < sizeof(tcp->msglen)) {
-        uint16_t sendlen = htons(tcp->msglen);
-        sent = write(tcp->fd, (const char*)&sendlen + tcp->total_bytes,
-            sizeof(tcp->msglen) - tcp->total_bytes);
-        if (sent == -1) {
-            if (errno == EAGAIN || errno == EINTR) {
-                /* write would block, try later */
-                return 0;
-            } else {
-                return -1;
-            }
-        }
-        tcp->total_bytes += sent;
-        if (tcp->total_bytes < sizeof(tcp->msglen)) {
-            /* incomplete write, resume later */
-            return 0;
-        }
-        ods_log_assert(tcp->total_bytes == sizeof(tcp->msglen));
+        sendlen = htons(tcp->msglen);
+        iov[n].iov_base = (char*) &sendlen + tcp->total_bytes;
+        iov[n].iov_len = sizeof(tcp->msglen) - tcp->total_bytes;
+        n++;
     }
-    ods_log_assert(tcp->total_bytes < tcp->msglen + sizeof(tcp->msglen));
-    sent = write(tcp->fd, buffer_current(tcp->packet),
-        buffer_remaining(tcp->packet));
+    iov[n].iov_base = buffer_current(tcp->packet);
+    iov[n].iov_len = buffer_remaining(tcp->packet);
+    n++;
+    sent = writev(tcp->fd, iov, n);
     if (sent == -1) {
         if (errno == EAGAIN || errno == EINTR) {
             /* write would block, try later */
@@ -209,6 +400,16 @@ tcp_conn_write(tcp_conn_type* tcp)
             return -1;
         }
     }
+    if (tcp->total_bytes < sizeof(tcp->msglen)) {
+        headlen = sizeof(tcp->msglen) - tcp->total_bytes;
+        if ((size_t) sent < headlen) {
+            /* incomplete write, resume later */
+            tcp->total_bytes += sent;
+            return 0;
+        }
+        tcp->total_bytes += headlen;
+        sent -= headlen;
+    }
     buffer_skip(tcp->packet, sent);
     tcp->total_bytes += sent;
     if (tcp->total_bytes < tcp->msglen + sizeof(tcp->msglen)) {
@@ -230,6 +431,9 @@ tcp_conn_cleanup(tcp_conn_type* conn)
     if (!conn) {
         return;
     }
+    if (conn->fd != -1) {
+        close(conn->fd);
+    }
     buffer_cleanup(conn->packet);
     free(conn);
 }
@@ -241,12 +445,19 @@ tcp_conn_cleanup(tcp_conn_type* conn)
 void
 tcp_set_cleanup(tcp_set_type* set)
 {
+    tcp_master_type* master = NULL;
     size_t i = 0;
     if (!set) {
         return;
     }
-    for (i=0; i < TCPSET_MAX; i++) {
+    for (i=0; i < set->tcp_size; i++) {
         tcp_conn_cleanup(set->tcp_conn[i]);
     }
+    free(set->tcp_conn);
+    while (set->masters) {
+        master = set->masters;
+        set->masters = master->next;
+        free(master);
+    }
     free(set);
 }
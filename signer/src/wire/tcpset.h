@@ -36,13 +36,18 @@
 #include <stdint.h>
 
 typedef struct tcp_conn_struct tcp_conn_type;
+typedef struct tcp_master_struct tcp_master_type;
 typedef struct tcp_set_struct tcp_set_type;
 
 #include "status.h"
+#include "wire/acl.h"
 #include "wire/buffer.h"
+#include "wire/netio.h"
 #include "wire/xfrd.h"
 
-#define TCPSET_MAX 50
+#define TCPSET_MAX 1024 /* open connections, all masters together */
+#define TCPSET_MAX_MASTER 32 /* open connections to a single master */
+#define TCPSET_IDLE_TIMEOUT 10 /* seconds an idle connection is kept open */
 
 /**
  * tcp connection.
@@ -56,8 +61,35 @@ struct tcp_conn_struct {
    uint16_t msglen;
    /* packet buffer of connection */
    buffer_type* packet;
+   /* position in the set */
+   int idx;
+   /* master the connection is open to, NULL if the slot is free */
+   tcp_master_type* master;
+   /* idle connections, kept open for the next transfer */
+   tcp_conn_type* idle_next;
+   netio_handler_type handler;
+   struct timespec timeout;
    /* state: reading or writing */
    unsigned is_reading : 1;
+   unsigned is_idle : 1;
+};
+
+/**
+ * Connections to a single master.
+ *
+ */
+struct tcp_master_struct {
+    tcp_master_type* next;
+    tcp_set_type* set;
+    int family;
+    union acl_addr_storage addr;
+    unsigned int port;
+    /* open connections, in use or idle */
+    size_t tcp_count;
+    tcp_conn_type* idle_first;
+    /* zone transfers waiting for a connection, first come first served */
+    xfrd_type* tcp_waiting_first;
+    xfrd_type* tcp_waiting_last;
 };
 
 /*
@@ -65,10 +97,16 @@ struct tcp_conn_struct {
  *
  */
 struct tcp_set_struct {
-    tcp_conn_type* tcp_conn[TCPSET_MAX];
-    xfrd_type* tcp_waiting_first;
-    xfrd_type* tcp_waiting_last;
+    tcp_conn_type** tcp_conn;
+    size_t tcp_size;
     size_t tcp_count;
+    tcp_master_type* masters;
+    /* statistics */
+    size_t tcp_opened;
+    size_t tcp_reused;
+    size_t wait_count;
+    time_t wait_total;
+    time_t wait_max;
 };
 
 /**
@@ -87,6 +125,61 @@ tcp_conn_type* tcp_conn_create(void);
  */
 tcp_set_type* tcp_set_create(void);
 
+/**
+ * Get the connections to a master, create them if needed.
+ * \param[in] set set of tcp connections
+ * \param[in] acl master
+ * \return tcp_master_type* connections to master
+ *
+ */
+tcp_master_type* tcp_set_master(tcp_set_type* set, acl_type* acl);
+
+/**
+ * Get a free slot for a new connection, grow the set if it is full.
+ * \param[in] set set of tcp connections
+ * \return tcp_conn_type* free connection, NULL on failure
+ *
+ */
+tcp_conn_type* tcp_set_slot(tcp_set_type* set);
+
+/**
+ * Take an idle connection to a master.
+ * \param[in] master connections to master
+ * \return tcp_conn_type* idle connection, NULL if there is none
+ *
+ */
+tcp_conn_type* tcp_master_pop_idle(tcp_master_type* master);
+
+/**
+ * Remove a connection from the idle list of its master.
+ * \param[in] tcp idle connection
+ *
+ */
+void tcp_master_remove_idle(tcp_conn_type* tcp);
+
+/**
+ * Add a zone transfer at the end of the waiting queue of a master.
+ * \param[in] master connections to master
+ * \param[in] xfrd zone transfer
+ *
+ */
+void tcp_master_push_waiting(tcp_master_type* master, xfrd_type* xfrd);
+
+/**
+ * Take the first zone transfer from the waiting queue of a master.
+ * \param[in] master connections to master
+ * \return xfrd_type* zone transfer, NULL if there is none
+ *
+ */
+xfrd_type* tcp_master_pop_waiting(tcp_master_type* master);
+
+/**
+ * Remove a zone transfer from the waiting queue of its master.
+ * \param[in] xfrd zone transfer waiting for a tcp connection
+ *
+ */
+void tcp_master_remove_waiting(xfrd_type* xfrd);
+
 /**
  * Make tcp connection ready for reading.
  * \param[in] tcp tcp connection
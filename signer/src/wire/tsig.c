@@ -557,6 +557,18 @@ tsig_rr_prepare(tsig_rr_type* trr)
  */
 void
 tsig_rr_update(tsig_rr_type* trr, buffer_type* buffer, size_t length)
+{
+    tsig_rr_update_data(trr, buffer, length, NULL, 0, length);
+}
+
+
+/**
+ * Update TSIG RR, for a packet with part of its data outside the buffer.
+ *
+ */
+void
+tsig_rr_update_data(tsig_rr_type* trr, buffer_type* buffer, size_t length,
+    const uint8_t* data, size_t datalen, size_t at)
 {
     uint16_t original_query_id = 0;
     ods_log_assert(trr);
@@ -564,12 +576,20 @@ tsig_rr_update(tsig_rr_type* trr, buffer_type* buffer, size_t length)
     ods_log_assert(trr->context);
     ods_log_assert(buffer);
     ods_log_assert(length <= buffer_limit(buffer));
+    ods_log_assert(at >= sizeof(original_query_id) && at <= length);
     original_query_id = htons(trr->original_query_id);
     trr->algo->hmac_update(trr->context, &original_query_id,
         sizeof(original_query_id));
     trr->algo->hmac_update(trr->context,
         buffer_at(buffer, sizeof(original_query_id)),
-        length - sizeof(original_query_id));
+        at - sizeof(original_query_id));
+    if (datalen) {
+        trr->algo->hmac_update(trr->context, data, datalen);
+    }
+    if (length > at) {
+        trr->algo->hmac_update(trr->context, buffer_at(buffer, at),
+            length - at);
+    }
     if (buffer_pkt_qr(buffer)) {
         ++trr->response_count;
     }
@@ -262,6 +262,19 @@ void tsig_rr_prepare(tsig_rr_type* trr);
  */
 void tsig_rr_update(tsig_rr_type* trr, buffer_type* buffer, size_t length);
 
+/**
+ * Update TSIG RR, for a packet with part of its data outside the buffer.
+ * \param[in] trr TSIG RR
+ * \param[in] buffer packet buffer
+ * \param[in] length number of octets of buffer to add to the TSIG hash
+ * \param[in] data packet data not in the buffer
+ * \param[in] datalen length of data
+ * \param[in] at position in the buffer where data goes
+ *
+ */
+void tsig_rr_update_data(tsig_rr_type* trr, buffer_type* buffer,
+    size_t length, const uint8_t* data, size_t datalen, size_t at);
+
 /**
  * Sign TSIG RR.
  * \param[in] trr TSIG RR
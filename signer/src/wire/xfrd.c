@@ -74,6 +74,8 @@ static void xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waitin
 static void xfrd_tcp_write(xfrd_type* xfrd, tcp_set_type* set);
 static void xfrd_tcp_xfr(xfrd_type* xfrd, tcp_set_type* set);
 static int xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set);
+static void xfrd_tcp_done(xfrd_type* xfrd, tcp_set_type* set);
+static void xfrd_tcp_wakeup(netio_type* netio, tcp_set_type* set);
 
 static void xfrd_udp_obtain(xfrd_type* xfrd);
 static void xfrd_udp_read(xfrd_type* xfrd);
@@ -349,6 +351,8 @@ xfrd_create(xfrhandler_type* xfrhandler, zone_type* zone)
     xfrd->udp_waiting_next = NULL;
     xfrd->tcp_waiting = 0;
     xfrd->tcp_waiting_next = NULL;
+    xfrd->tcp_waiting_master = NULL;
+    xfrd->tcp_waiting_since = 0;
     xfrd->tsig_rr = tsig_rr_create();
     if (!xfrd->tsig_rr) {
         xfrd_cleanup(xfrd, 0);
@@ -419,6 +423,7 @@ xfrd_set_timer(xfrd_type* xfrd, time_t t)
     xfrd->handler.timeout = &xfrd->timeout;
     xfrd->timeout.tv_sec = t;
     xfrd->timeout.tv_nsec = 0;
+    netio_update_handler(xfrd->xfrhandler->netio, &xfrd->handler);
 }
 
 
@@ -431,6 +436,9 @@ xfrd_unset_timer(xfrd_type* xfrd)
 {
     ods_log_assert(xfrd);
     xfrd->handler.timeout = NULL;
+    if (xfrd->xfrhandler) {
+        netio_update_handler(xfrd->xfrhandler->netio, &xfrd->handler);
+    }
 }
 
 
@@ -646,6 +654,24 @@ xfrd_tsig_process(xfrd_type* xfrd, buffer_type* buffer)
 }
 
 
+/**
+ * Write record to the zone transfer spool.
+ *
+ */
+static int
+xfrd_spool_record(FILE* fd, uint8_t type, const uint8_t* data, uint16_t len)
+{
+    uint8_t hdr[XFRD_SPOOL_RECORD_LEN];
+    hdr[0] = type;
+    hdr[1] = (uint8_t) (len >> 8);
+    hdr[2] = (uint8_t) (len & 0xff);
+    if (fwrite(hdr, 1, sizeof(hdr), fd) != sizeof(hdr)) {
+        return 0;
+    }
+    return (!len || fwrite(data, 1, len, fd) == len);
+}
+
+
 /**
  * Commit answer on disk.
  *
@@ -674,7 +700,7 @@ xfrd_commit_packet(xfrd_type* xfrd)
     fd = ods_fopen(xfrfile, NULL, "a");
     free((void*)xfrfile);
     if (fd) {
-        fprintf(fd, ";;ENDPACKET\n");
+        xfrd_spool_record(fd, XFRD_SPOOL_END, NULL, 0);
         ods_fclose(fd);
     } else {
         pthread_mutex_unlock(&xfrd->rw_lock);
@@ -729,21 +755,12 @@ xfrd_dump_packet(xfrd_type* xfrd, buffer_type* buffer)
     zone_type* zone = NULL;
     char* xfrfile = NULL;
     FILE* fd = NULL;
-    ldns_pkt* pkt = NULL;
-    ldns_status status = LDNS_STATUS_OK;
+    int ok = 0;
     ods_log_assert(buffer);
     ods_log_assert(xfrd);
     zone = (zone_type*) xfrd->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->name);
-    status = ldns_wire2pkt(&pkt, buffer_begin(buffer), buffer_limit(buffer));
-    if (status != LDNS_STATUS_OK) {
-        ods_log_crit("[%s] unable to dump packet zone %s: ldns_wire2pkt() "
-            "failed (%s)", xfrd_str, zone->name,
-            ldns_get_errorstr_by_id(status));
-        return;
-    }
-    ods_log_assert(pkt);
     xfrfile = ods_build_path(zone->name, ".xfrd", 0, 1);
     if (!xfrfile) {
         ods_log_crit("[%s] unable to dump packet zone %s: build path failed",
@@ -764,13 +781,21 @@ xfrd_dump_packet(xfrd_type* xfrd, buffer_type* buffer)
         return;
     }
     ods_log_assert(fd);
+    /* the message was parsed already, spool it as is */
+    ok = 1;
     if (xfrd->msg_seq_nr == 0) {
-        fprintf(fd, ";;BEGINPACKET\n");
+        ok = xfrd_spool_record(fd, XFRD_SPOOL_BEGIN, NULL, 0);
+    }
+    if (ok) {
+        ok = xfrd_spool_record(fd, XFRD_SPOOL_MSG, buffer_begin(buffer),
+            (uint16_t) buffer_limit(buffer));
+    }
+    if (!ok) {
+        ods_log_crit("[%s] unable to dump packet zone %s: fwrite() failed "
+            "(%s)", xfrd_str, zone->name, strerror(errno));
     }
-    ldns_rr_list_print(fd, ldns_pkt_answer(pkt));
     ods_fclose(fd);
     pthread_mutex_unlock(&xfrd->rw_lock);
-    ldns_pkt_free(pkt);
 }
 
 
@@ -1369,7 +1394,9 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
     interface_type interface = xfrd->xfrhandler->engine->dnshandler->interfaces->interfaces[0];
     if (!interface.address) {
         ods_log_error("[%s] unable to get the address of interface", xfrd_str);
-        return -1;
+        xfrd_set_timer_now(xfrd);
+        xfrd_tcp_release(xfrd, set, 0);
+        return 0;
     }
     if (acl_parse_family(interface.address) == AF_INET) {
         struct sockaddr_in addr;
@@ -1378,7 +1405,9 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
         addr.sin_port = 0;
         if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
             ods_log_error("[%s] unable to bind address %s: bind failed %s", xfrd_str, interface.address, strerror(errno));
-            return -1;
+            xfrd_set_timer_now(xfrd);
+            xfrd_tcp_release(xfrd, set, 0);
+            return 0;
         }
     }
     else {
@@ -1388,7 +1417,9 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
         addr6.sin6_port = 0;
         if (bind(fd, (struct sockaddr *) &addr6, sizeof(addr6)) != 0) {
             ods_log_error("[%s] unable to bind address %s: bind failed %s", xfrd_str, interface.address, strerror(errno));
-            return -1;
+            xfrd_set_timer_now(xfrd);
+            xfrd_tcp_release(xfrd, set, 0);
+            return 0;
         }
     }
 
@@ -1407,6 +1438,141 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
 }
 
 
+/**
+ * Close tcp connection and free its slot in the set.
+ *
+ */
+static void
+xfrd_tcp_close(netio_type* netio, tcp_conn_type* tcp)
+{
+    tcp_master_type* master = NULL;
+    ods_log_assert(tcp);
+    ods_log_assert(tcp->master);
+    master = tcp->master;
+    if (tcp->is_idle) {
+        tcp_master_remove_idle(tcp);
+        netio_remove_handler(netio, &tcp->handler);
+        tcp->handler.fd = -1;
+    }
+    if (tcp->fd != -1) {
+        close(tcp->fd);
+    }
+    tcp->fd = -1;
+    tcp->master = NULL;
+    master->tcp_count--;
+    master->set->tcp_count--;
+}
+
+
+/**
+ * Close an idle tcp connection, to make room for a connection to
+ * another master.
+ *
+ */
+static int
+xfrd_tcp_close_idle(netio_type* netio, tcp_set_type* set)
+{
+    tcp_master_type* master = NULL;
+    for (master = set->masters; master; master = master->next) {
+        if (master->idle_first) {
+            xfrd_tcp_close(netio, master->idle_first);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Handle events on an idle tcp connection. The master closed the
+ * connection or it was idle for too long: close it.
+ *
+ */
+static void
+xfrd_tcp_idle(netio_type* netio, netio_handler_type* handler,
+    netio_events_type event_types)
+{
+    tcp_conn_type* tcp = NULL;
+    tcp_set_type* set = NULL;
+    if (!handler) {
+        return;
+    }
+    tcp = (tcp_conn_type*) handler->user_data;
+    ods_log_assert(tcp);
+    ods_log_assert(tcp->master);
+    set = tcp->master->set;
+    ods_log_debug("[%s] close idle tcp connection: %s", xfrd_str,
+        (event_types & NETIO_EVENT_READ) ? "closed by master" : "timeout");
+    xfrd_tcp_close(netio, tcp);
+    xfrd_tcp_wakeup(netio, set);
+}
+
+
+/**
+ * Take zone transfer off the waiting queue and account the time it
+ * waited for a tcp connection.
+ *
+ */
+static void
+xfrd_tcp_unwait(xfrd_type* xfrd, tcp_set_type* set)
+{
+    zone_type* zone = NULL;
+    time_t waited = 0;
+    ods_log_assert(xfrd);
+    ods_log_assert(xfrd->tcp_waiting);
+    zone = (zone_type*) xfrd->zone;
+    waited = xfrd_time(xfrd) - xfrd->tcp_waiting_since;
+    if (waited < 0) {
+        waited = 0;
+    }
+    set->wait_count++;
+    set->wait_total += waited;
+    if (waited > set->wait_max) {
+        set->wait_max = waited;
+    }
+    xfrd->tcp_waiting = 0;
+    xfrd->tcp_waiting_master = NULL;
+    xfrd->tcp_waiting_since = 0;
+    ods_log_verbose("[%s] zone %s waited %lus for tcp connection to %s "
+        "(waits %lu, average %lus, max %lus)", xfrd_str, zone->name,
+        (unsigned long) waited, xfrd->master->address,
+        (unsigned long) set->wait_count,
+        (unsigned long) (set->wait_total / set->wait_count),
+        (unsigned long) set->wait_max);
+}
+
+
+/**
+ * Start xfr on an already open tcp connection.
+ *
+ */
+static void
+xfrd_tcp_reuse(xfrd_type* xfrd, tcp_set_type* set, tcp_conn_type* tcp)
+{
+    zone_type* zone = NULL;
+    ods_log_assert(xfrd);
+    ods_log_assert(tcp);
+    ods_log_assert(tcp->fd != -1);
+    zone = (zone_type*) xfrd->zone;
+    ods_log_debug("[%s] zone %s reuse tcp connection to %s (opened %lu, "
+        "reused %lu)", xfrd_str, zone->name, xfrd->master->address,
+        (unsigned long) set->tcp_opened, (unsigned long) set->tcp_reused);
+    xfrd->tcp_conn = tcp->idx;
+    xfrd->tcp_waiting = 0;
+    /* stop udp use (if any) */
+    if (xfrd->handler.fd != -1) {
+        xfrd_udp_release(xfrd);
+    }
+    tcp->is_reading = 0;
+    tcp->total_bytes = 0;
+    tcp->msglen = 0;
+    xfrd->handler.fd = tcp->fd;
+    xfrd->handler.event_types = NETIO_EVENT_WRITE|NETIO_EVENT_TIMEOUT;
+    xfrd_set_timer(xfrd, xfrd_time(xfrd) + XFRD_TCP_TIMEOUT);
+    xfrd_tcp_xfr(xfrd, set);
+}
+
+
 /**
  * Obtain tcp.
  *
@@ -1414,24 +1580,38 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
 static void
 xfrd_tcp_obtain(xfrd_type* xfrd, tcp_set_type* set)
 {
-    xfrhandler_type* xfrhandler;
-    int i = 0;
+    netio_type* netio = NULL;
+    tcp_master_type* master = NULL;
+    tcp_conn_type* tcp = NULL;
+    zone_type* zone = NULL;
 
     ods_log_assert(set);
     ods_log_assert(xfrd);
+    ods_log_assert(xfrd->master);
     ods_log_assert(xfrd->tcp_conn == -1);
     ods_log_assert(xfrd->tcp_waiting == 0);
-    if (set->tcp_count < TCPSET_MAX) {
-        ods_log_assert(!set->tcp_waiting_first);
-        set->tcp_count ++;
-        /* find a free tcp_buffer */
-        for (i=0; i < TCPSET_MAX; i++) {
-            if (set->tcp_conn[i]->fd == -1) {
-                xfrd->tcp_conn = i;
-                break;
-            }
-        }
-        ods_log_assert(xfrd->tcp_conn != -1);
+    zone = (zone_type*) xfrd->zone;
+    netio = xfrd->xfrhandler->netio;
+    master = tcp_set_master(set, xfrd->master);
+    /* an idle connection to this master saves a handshake */
+    tcp = tcp_master_pop_idle(master);
+    if (tcp) {
+        netio_remove_handler(netio, &tcp->handler);
+        tcp->handler.fd = -1;
+        set->tcp_reused++;
+        xfrd_tcp_reuse(xfrd, set, tcp);
+        return;
+    }
+    if (master->tcp_count < TCPSET_MAX_MASTER &&
+        (set->tcp_count < TCPSET_MAX || xfrd_tcp_close_idle(netio, set))) {
+        tcp = tcp_set_slot(set);
+    }
+    if (tcp) {
+        tcp->master = master;
+        master->tcp_count++;
+        set->tcp_count++;
+        set->tcp_opened++;
+        xfrd->tcp_conn = tcp->idx;
         xfrd->tcp_waiting = 0;
         /* stop udp use (if any) */
         if (xfrd->handler.fd != -1) {
@@ -1444,15 +1624,15 @@ xfrd_tcp_obtain(xfrd_type* xfrd, tcp_set_type* set)
         return;
     }
     /* wait, at end of line */
-    ods_log_verbose("[%s] max number of tcp connections (%d) reached",
-        xfrd_str, TCPSET_MAX);
+    ods_log_verbose("[%s] zone %s waits for tcp connection to %s: %lu of "
+        "max %d connections to master, %lu of max %d in total", xfrd_str,
+        zone->name, xfrd->master->address, (unsigned long) master->tcp_count,
+        TCPSET_MAX_MASTER, (unsigned long) set->tcp_count, TCPSET_MAX);
     xfrd->tcp_waiting = 1;
+    xfrd->tcp_waiting_master = master;
+    xfrd->tcp_waiting_since = xfrd_time(xfrd);
     xfrd_unset_timer(xfrd);
-
-    /* add it to the waiting queue */
-    xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
-    xfrd->tcp_waiting_next = xfrhandler->tcp_waiting_first;
-    xfrhandler->tcp_waiting_first = xfrd;
+    tcp_master_push_waiting(master, xfrd);
 }
 
 
@@ -1541,8 +1721,8 @@ xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set)
         case XFRD_PKT_XFR:
         case XFRD_PKT_NEWLEASE:
             ods_log_verbose("[%s] tcp read %s: release connection", xfrd_str,
-                XFRD_PKT_XFR?"xfr":"newlease");
-            xfrd_tcp_release(xfrd, set, 1);
+                ret==XFRD_PKT_XFR?"xfr":"newlease");
+            xfrd_tcp_done(xfrd, set);
             ods_log_assert(xfrd->round_num == -1);
             break;
         case XFRD_PKT_NOTIMPL:
@@ -1562,16 +1742,14 @@ xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set)
 
 
 /**
- * Release tcp connection from set for xfrd. If there are waiting TCP
- * connections open as many as free slots in set. This step is skipped
- * if open_waiting flag is unset.
+ * Detach tcp connection from xfrd.
+ *
  */
-static void
-xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting)
+static tcp_conn_type*
+xfrd_tcp_detach(xfrd_type* xfrd, tcp_set_type* set)
 {
-    xfrhandler_type* xfrhandler;
-    int conn = 0;
     zone_type* zone = NULL;
+    tcp_conn_type* tcp = NULL;
 
     ods_log_assert(set);
     ods_log_assert(xfrd);
@@ -1582,47 +1760,94 @@ xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting)
     zone = (zone_type*) xfrd->zone;
     ods_log_debug("[%s] zone %s release tcp connection to %s", xfrd_str,
         zone->name, xfrd->master->address);
-    conn = xfrd->tcp_conn;
+    tcp = set->tcp_conn[xfrd->tcp_conn];
     xfrd->tcp_conn = -1;
     xfrd->tcp_waiting = 0;
     xfrd->handler.fd = -1;
     xfrd->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    netio_update_handler(xfrd->xfrhandler->netio, &xfrd->handler);
+    return tcp;
+}
 
-    if (set->tcp_conn[conn]->fd != -1) {
-        close(set->tcp_conn[conn]->fd);
-    }
-    set->tcp_conn[conn]->fd = -1;
-    set->tcp_count --;
 
+/**
+ * Release tcp connection from set for xfrd. If there are waiting TCP
+ * connections open as many as free slots in set. This step is skipped
+ * if open_waiting flag is unset.
+ */
+static void
+xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting)
+{
+    netio_type* netio = xfrd->xfrhandler->netio;
+    xfrd_tcp_close(netio, xfrd_tcp_detach(xfrd, set));
     /* see if there are any connections waiting for a slot. Or return. */
     if (!open_waiting) return;
-    xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
-    while (xfrhandler->tcp_waiting_first && set->tcp_count < TCPSET_MAX) {
-        int i;
-        xfrd_type* waiting_xfrd = xfrhandler->tcp_waiting_first;
-        xfrhandler->tcp_waiting_first = waiting_xfrd->tcp_waiting_next;
-        waiting_xfrd->tcp_waiting_next = NULL;
-
-        /* find a free tcp_buffer */
-        for (i=0; i < TCPSET_MAX; i++) {
-            if (set->tcp_conn[i]->fd == -1) {
-                waiting_xfrd->tcp_conn = i;
-                set->tcp_count++;
-                break;
+    xfrd_tcp_wakeup(netio, set);
+}
+
+
+/**
+ * Done with the tcp connection after a completed transfer. Hand it
+ * over to the next zone waiting for this master, or keep it open for
+ * a while in case another transfer from this master comes along.
+ *
+ */
+static void
+xfrd_tcp_done(xfrd_type* xfrd, tcp_set_type* set)
+{
+    netio_type* netio = xfrd->xfrhandler->netio;
+    tcp_conn_type* tcp = xfrd_tcp_detach(xfrd, set);
+    tcp_master_type* master = tcp->master;
+    xfrd_type* waiting_xfrd = tcp_master_pop_waiting(master);
+
+    if (waiting_xfrd) {
+        xfrd_tcp_unwait(waiting_xfrd, set);
+        set->tcp_reused++;
+        xfrd_tcp_reuse(waiting_xfrd, set, tcp);
+        return;
+    }
+    tcp->is_idle = 1;
+    tcp->idle_next = master->idle_first;
+    master->idle_first = tcp;
+    tcp->handler.fd = tcp->fd;
+    tcp->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    tcp->handler.event_handler = xfrd_tcp_idle;
+    tcp->timeout.tv_sec = xfrd_time(xfrd) + TCPSET_IDLE_TIMEOUT;
+    tcp->timeout.tv_nsec = 0;
+    netio_add_handler(netio, &tcp->handler);
+    /* zones waiting for other masters may need the slot */
+    xfrd_tcp_wakeup(netio, set);
+}
+
+
+/**
+ * Open connections for the zones waiting for one, as far as the
+ * limits allow.
+ *
+ */
+static void
+xfrd_tcp_wakeup(netio_type* netio, tcp_set_type* set)
+{
+    tcp_master_type* master = NULL;
+    xfrd_type* waiting_xfrd = NULL;
+
+    for (master = set->masters; master; master = master->next) {
+        while (master->tcp_waiting_first &&
+            master->tcp_count < TCPSET_MAX_MASTER &&
+            (set->tcp_count < TCPSET_MAX ||
+             xfrd_tcp_close_idle(netio, set))) {
+            waiting_xfrd = tcp_master_pop_waiting(master);
+            xfrd_tcp_unwait(waiting_xfrd, set);
+            /* if xfrd_tcp_open() fails its slot in set->tcp_conn[]
+             * is released. Continue to next. We don't put it back in the
+             * waiting queue, it would keep the signer busy retrying,
+             * making things only worse. */
+            xfrd_tcp_obtain(waiting_xfrd, set);
+            if (waiting_xfrd->tcp_waiting) {
+                /* no room after all */
+                return;
             }
         }
-        waiting_xfrd->tcp_waiting = 0;
-        /* stop udp use (if any) */
-        if (waiting_xfrd->handler.fd != -1) {
-            xfrd_udp_release(waiting_xfrd);
-        }
-        /* if xfrd_tcp_open() fails its slot in set->tcp_conn[]
-         * is released. Continue to next. We don't put it back in the
-         * waiting queue, it would keep the signer busy retrying, making
-         * things only worse. */
-        if (xfrd_tcp_open(waiting_xfrd, set)) {
-            xfrd_tcp_xfr(waiting_xfrd, set);
-        }
     }
 }
 
@@ -1861,6 +2086,7 @@ xfrd_udp_release(xfrd_type* xfrd)
     xfrd->handler.fd = -1;
     xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
     ods_log_assert(xfrhandler);
+    netio_update_handler(xfrhandler->netio, &xfrd->handler);
     /* see if there are waiting zones */
     if (xfrhandler->udp_use_num == XFRD_MAX_UDP) {
         while (xfrhandler->udp_waiting_first) {
@@ -2181,6 +2407,10 @@ xfrd_cleanup(xfrd_type* xfrd, int backup)
     if (!xfrd) {
         return;
     }
+    /* do not leave it behind in the tcp waiting queue */
+    if (xfrd->tcp_waiting_master) {
+        tcp_master_remove_waiting(xfrd);
+    }
     /* backup */
     if (backup) {
         xfrd_backup(xfrd);
@@ -68,6 +68,19 @@ typedef struct xfrd_struct xfrd_type;
 #define XFRD_TCP_TIMEOUT 120 /* seconds, before a tcp request times out */
 #define XFRD_UDP_TIMEOUT 5 /* seconds, before a udp request times out */
 
+/**
+ * The zone transfers in <zone>.xfrd are spooled in wire format. Every
+ * record is a type (8 bits) and a length (16 bits, network byte order),
+ * followed by that many octets. A transfer is a BEGIN record, the
+ * received messages in MSG records and, once the transfer is complete,
+ * an END record.
+ *
+ */
+#define XFRD_SPOOL_BEGIN 0x01
+#define XFRD_SPOOL_MSG 0x02
+#define XFRD_SPOOL_END 0x03
+#define XFRD_SPOOL_RECORD_LEN 3
+
 /*
  * Zone transfer SOA information.
  */
@@ -134,6 +147,8 @@ struct xfrd_struct
     tsig_rr_type* tsig_rr;
 
     xfrd_type* tcp_waiting_next;
+    struct tcp_master_struct* tcp_waiting_master;
+    time_t tcp_waiting_since;
     xfrd_type* udp_waiting_next;
     unsigned tcp_waiting : 1;
     unsigned udp_waiting : 1;